@@ -0,0 +1,509 @@
+//
+//  audio.c
+//
+//  Pull-model audio engine. A render thread, at real-time priority if
+//  the system allows, fills a ring of a few periods ahead of the sink,
+//  and sleeps whenever the ring is full. The sink takes one period at
+//  a time at the device's pace: from a thread writing to a blocking
+//  device, from the device's own callback through aa_audio_pull(), or
+//  from a thread standing in for a device, which discards the audio or
+//  writes it to a file, so that timing can be measured without a sound
+//  card. Taking a period never waits: if none is ready the device gets
+//  silence and the underrun is counted.
+//
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "audio.h"
+
+typedef enum {
+	AA_AUDIO_SINK_DEVICE,       //!< A blocking sink function.
+	AA_AUDIO_SINK_NULL,         //!< Discards, at the device's pace.
+	AA_AUDIO_SINK_FILE,         //!< Writes to a file, paced or not.
+	AA_AUDIO_SINK_CALLBACK,     //!< The device calls aa_audio_pull().
+} aa_audio_sink_t;
+
+struct aa_audio_s {
+	/** Periods rendered so far. Written by the render thread only. */
+	unsigned	head;
+	char		head_pad[64 - sizeof(unsigned)];
+
+	/** Periods taken so far. Written by the sink only. */
+	unsigned	tail;
+	char		tail_pad[64 - sizeof(unsigned)];
+
+	int			period;
+	int			periods;
+	int			srate;
+	int64_t		periodNanos;
+
+	aa_audio_render_func_t render;
+	void *		context;
+
+	aa_audio_sink_t sinkType;
+	aa_audio_sink_func_t sink;
+	void *		sinkContext;
+	float *		sinkBuffer;
+
+	FILE *		file;
+	bool		paced;
+	uint64_t	frames;
+
+	/** Wakes the render thread when the sink takes a period. */
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+
+	pthread_t	renderThread;
+	pthread_t	sinkThread;
+	bool		rendering;
+	bool		sinking;
+	bool		stop;
+
+	/** Statistics of the sink side, written by the sink only. */
+	uint64_t	pulls;
+	uint64_t	underruns;
+	int			minReady;
+	int64_t		lastPull;
+	int64_t		jitterMax;
+	int64_t		jitterSum;
+
+	/** Statistics of the render side, written by its thread only. */
+	uint64_t	renders;
+	int64_t		renderMax;
+	int64_t		renderSum;
+	bool		realtime;
+
+	float		ring[];
+};
+
+static int64_t
+aa_audio_now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void
+aa_audio_sleep_until(int64_t deadline) {
+	int64_t remaining = deadline - aa_audio_now();
+	struct timespec wait;
+
+	if(remaining <= 0)
+		return;
+
+	wait.tv_sec = (time_t)(remaining / 1000000000);
+	wait.tv_nsec = (long)(remaining % 1000000000);
+	nanosleep(&wait, NULL);
+}
+
+static void
+aa_audio_put_le(
+	FILE *fp, uint32_t value, int bytes
+) {
+	for(int i = 0; i < bytes; i++)
+		fputc((value >> (8 * i)) & 0xFF, fp);
+}
+
+/** Writes a mono IEEE float WAV header for frames samples.
+ */
+static void
+aa_audio_write_wav_header(
+	FILE *fp, int srate, uint64_t frames
+) {
+	uint32_t data_size = (uint32_t)(frames * sizeof(float));
+
+	fwrite("RIFF", 1, 4, fp);
+	aa_audio_put_le(fp, 36 + data_size, 4);
+	fwrite("WAVEfmt ", 1, 8, fp);
+	aa_audio_put_le(fp, 16, 4);
+	aa_audio_put_le(fp, 3, 2);          // WAVE_FORMAT_IEEE_FLOAT
+	aa_audio_put_le(fp, 1, 2);
+	aa_audio_put_le(fp, srate, 4);
+	aa_audio_put_le(fp, srate * sizeof(float), 4);
+	aa_audio_put_le(fp, sizeof(float), 2);
+	aa_audio_put_le(fp, 32, 2);
+	fwrite("data", 1, 4, fp);
+	aa_audio_put_le(fp, data_size, 4);
+}
+
+/** Creates an engine that renders period samples at a time with
+    render, up to periods periods ahead of the sink.
+ */
+aa_audio_t
+aa_audio_create(
+	int period, int periods, int srate,
+	aa_audio_render_func_t render, void *context
+) {
+	aa_audio_t self = NULL;
+
+	if((period <= 0) || (periods < 1) || (periods > AA_AUDIO_MAX_PERIODS)
+	    || (srate <= 0) || !render)
+		goto bail;
+
+	self = calloc(sizeof(*self) + sizeof(float) * period * periods, 1);
+	if(!self)
+		goto bail;
+
+	self->sinkBuffer = calloc(sizeof(float), period);
+	if(!self->sinkBuffer) {
+		free(self);
+		self = NULL;
+		goto bail;
+	}
+
+	self->period = period;
+	self->periods = periods;
+	self->srate = srate;
+	self->periodNanos = (int64_t)period * 1000000000 / srate;
+	self->render = render;
+	self->context = context;
+	self->minReady = periods;
+
+	pthread_mutex_init(&self->lock, NULL);
+	pthread_cond_init(&self->wake, NULL);
+
+bail:
+	return self;
+}
+
+/** Stops self if it is playing, and frees it.
+ */
+void
+aa_audio_release(aa_audio_t self) {
+	if(!self)
+		return;
+
+	aa_audio_stop(self);
+	pthread_mutex_destroy(&self->lock);
+	pthread_cond_destroy(&self->wake);
+	free(self->sinkBuffer);
+	free(self);
+}
+
+/** Asks for real-time scheduling of the calling thread. Most systems
+    only grant it to privileged processes; without it the thread runs
+    at normal priority.
+ */
+static bool
+aa_audio_set_realtime(void) {
+	struct sched_param param = {
+		.sched_priority = (sched_get_priority_min(SCHED_FIFO)
+		    + sched_get_priority_max(SCHED_FIFO)) / 2,
+	};
+
+	return !pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+}
+
+static void*
+aa_audio_render_main(void *context) {
+	aa_audio_t self = context;
+
+	__atomic_store_n(&self->realtime, aa_audio_set_realtime(),
+		__ATOMIC_RELAXED);
+
+	pthread_mutex_lock(&self->lock);
+
+	while(!__atomic_load_n(&self->stop, __ATOMIC_RELAXED)) {
+		unsigned head = self->head;
+		unsigned tail = __atomic_load_n(&self->tail, __ATOMIC_ACQUIRE);
+		int64_t start, elapsed;
+
+		if((int)(head - tail) >= self->periods) {
+			struct timespec until;
+
+			// The sink signals when it can, but may not get the
+			// lock, so never sleep much past a period.
+			clock_gettime(CLOCK_REALTIME, &until);
+			until.tv_nsec += (long)self->periodNanos;
+			until.tv_sec += until.tv_nsec / 1000000000L;
+			until.tv_nsec %= 1000000000L;
+			pthread_cond_timedwait(&self->wake, &self->lock, &until);
+			continue;
+		}
+
+		pthread_mutex_unlock(&self->lock);
+
+		start = aa_audio_now();
+		(*self->render)(self->context,
+			self->ring + (head % self->periods) * self->period,
+			self->period);
+		elapsed = aa_audio_now() - start;
+
+		__atomic_store_n(&self->head, head + 1, __ATOMIC_RELEASE);
+
+		__atomic_store_n(&self->renders, self->renders + 1,
+			__ATOMIC_RELAXED);
+		__atomic_store_n(&self->renderSum, self->renderSum + elapsed,
+			__ATOMIC_RELAXED);
+		if(elapsed > self->renderMax)
+			__atomic_store_n(&self->renderMax, elapsed, __ATOMIC_RELAXED);
+
+		pthread_mutex_lock(&self->lock);
+	}
+
+	pthread_mutex_unlock(&self->lock);
+
+	return NULL;
+}
+
+/** Takes the next period into output, on the device's thread. Never
+    blocks: if no period is ready, output gets silence and an underrun
+    is counted. Returns nonzero on an underrun.
+ */
+int
+aa_audio_pull(
+	aa_audio_t self, float *output
+) {
+	unsigned tail = self->tail;
+	unsigned head = __atomic_load_n(&self->head, __ATOMIC_ACQUIRE);
+	int ready = (int)(head - tail);
+	int64_t now = aa_audio_now();
+
+	if(ready) {
+		memcpy(output, self->ring + (tail % self->periods) * self->period,
+			sizeof(float) * self->period);
+		__atomic_store_n(&self->tail, tail + 1, __ATOMIC_RELEASE);
+	} else {
+		memset(output, 0, sizeof(float) * self->period);
+		__atomic_store_n(&self->underruns, self->underruns + 1,
+			__ATOMIC_RELAXED);
+	}
+
+	// A render thread holding the lock is awake already.
+	if(!pthread_mutex_trylock(&self->lock)) {
+		pthread_cond_signal(&self->wake);
+		pthread_mutex_unlock(&self->lock);
+	}
+
+	if(self->pulls) {
+		int64_t jitter = now - self->lastPull - self->periodNanos;
+
+		jitter = jitter < 0 ? -jitter : jitter;
+		__atomic_store_n(&self->jitterSum, self->jitterSum + jitter,
+			__ATOMIC_RELAXED);
+		if(jitter > self->jitterMax)
+			__atomic_store_n(&self->jitterMax, jitter, __ATOMIC_RELAXED);
+	}
+	if(ready < self->minReady)
+		__atomic_store_n(&self->minReady, ready, __ATOMIC_RELAXED);
+	self->lastPull = now;
+	__atomic_store_n(&self->pulls, self->pulls + 1, __ATOMIC_RELAXED);
+
+	return !ready;
+}
+
+static void*
+aa_audio_sink_main(void *context) {
+	aa_audio_t self = context;
+	bool paced = self->sinkType == AA_AUDIO_SINK_NULL
+	    || ((self->sinkType == AA_AUDIO_SINK_FILE) && self->paced);
+	int64_t next;
+
+	// Start with the ring full, as a device would after prerolling.
+	while(!__atomic_load_n(&self->stop, __ATOMIC_RELAXED)
+	    && ((int)(__atomic_load_n(&self->head, __ATOMIC_ACQUIRE)
+	        - self->tail) < self->periods))
+		aa_audio_sleep_until(aa_audio_now() + self->periodNanos / 4);
+
+	next = aa_audio_now();
+
+	while(!__atomic_load_n(&self->stop, __ATOMIC_RELAXED)) {
+		if(paced) {
+			next += self->periodNanos;
+			aa_audio_sleep_until(next);
+		} else if(self->sinkType == AA_AUDIO_SINK_FILE) {
+			// Unpaced, the file takes periods as soon as they are
+			// ready instead of as a device would.
+			if(__atomic_load_n(&self->head, __ATOMIC_ACQUIRE)
+			    == self->tail) {
+				sched_yield();
+				continue;
+			}
+		}
+
+		aa_audio_pull(self, self->sinkBuffer);
+
+		if(self->sinkType == AA_AUDIO_SINK_FILE) {
+			for(int i = 0; i < self->period; i++) {
+				uint32_t bits;
+
+				memcpy(&bits, &self->sinkBuffer[i], sizeof(bits));
+				aa_audio_put_le(self->file, bits, 4);
+			}
+			self->frames += self->period;
+		} else if((self->sinkType == AA_AUDIO_SINK_DEVICE)
+		    && (*self->sink)(self->sinkContext, self->sinkBuffer,
+		        self->period)) {
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/** Starts the render thread, and the sink thread unless the device
+    pulls periods itself.
+ */
+static int
+aa_audio_launch(
+	aa_audio_t self, aa_audio_sink_t sinkType
+) {
+	if(self->rendering)
+		return -1;
+
+	self->sinkType = sinkType;
+	self->stop = false;
+
+	if(pthread_create(&self->renderThread, NULL, &aa_audio_render_main,
+		    self))
+		return -1;
+	self->rendering = true;
+
+	if(sinkType == AA_AUDIO_SINK_CALLBACK)
+		return 0;
+
+	if(pthread_create(&self->sinkThread, NULL, &aa_audio_sink_main, self)) {
+		aa_audio_stop(self);
+		return -1;
+	}
+	self->sinking = true;
+
+	return 0;
+}
+
+/** Starts playing into sink, which blocks until a device has taken
+    each period and so sets the pace. Returns nonzero if self is
+    playing already or the threads could not be started.
+ */
+int
+aa_audio_start(
+	aa_audio_t self, aa_audio_sink_func_t sink, void *context
+) {
+	if(!sink)
+		return -1;
+
+	self->sink = sink;
+	self->sinkContext = context;
+
+	return aa_audio_launch(self, AA_AUDIO_SINK_DEVICE);
+}
+
+/** Starts playing into nothing, at the pace of a device, to measure
+    timing without one.
+ */
+int
+aa_audio_start_null(aa_audio_t self) {
+	return aa_audio_launch(self, AA_AUDIO_SINK_NULL);
+}
+
+/** Starts playing into a float WAV file at path, at the pace of a
+    device if paced, or as fast as periods are rendered otherwise.
+ */
+int
+aa_audio_start_file(
+	aa_audio_t self, const char *path, bool paced
+) {
+	if(self->rendering)
+		return -1;
+
+	self->file = fopen(path, "wb");
+	if(!self->file) {
+		perror(path);
+		return -1;
+	}
+
+	self->paced = paced;
+	self->frames = 0;
+	aa_audio_write_wav_header(self->file, self->srate, 0);
+
+	if(aa_audio_launch(self, AA_AUDIO_SINK_FILE)) {
+		fclose(self->file);
+		self->file = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+/** Starts the render thread only, for a device that calls
+    aa_audio_pull() from its own callback.
+ */
+int
+aa_audio_start_callback(aa_audio_t self) {
+	return aa_audio_launch(self, AA_AUDIO_SINK_CALLBACK);
+}
+
+/** Stops playing, once the periods being rendered and played are
+    done. A file sink is finished off and closed.
+ */
+void
+aa_audio_stop(aa_audio_t self) {
+	if(!self->rendering)
+		return;
+
+	__atomic_store_n(&self->stop, true, __ATOMIC_RELAXED);
+
+	pthread_mutex_lock(&self->lock);
+	pthread_cond_signal(&self->wake);
+	pthread_mutex_unlock(&self->lock);
+
+	if(self->sinking)
+		pthread_join(self->sinkThread, NULL);
+	pthread_join(self->renderThread, NULL);
+	self->rendering = self->sinking = false;
+
+	if(self->file) {
+		fseek(self->file, 0, SEEK_SET);
+		aa_audio_write_wav_header(self->file, self->srate, self->frames);
+		fclose(self->file);
+		self->file = NULL;
+	}
+}
+
+int
+aa_audio_get_period(aa_audio_t self) {
+	return self->period;
+}
+
+/** The delay, in samples, from a period being rendered to it reaching
+    the sink with the ring full, not counting the device's own.
+ */
+int
+aa_audio_get_latency(aa_audio_t self) {
+	return self->period * self->periods;
+}
+
+/** Reads the engine statistics. Safe from any thread.
+ */
+void
+aa_audio_get_stats(
+	aa_audio_t self, struct aa_audio_stats_s *stats
+) {
+	uint64_t pulls = __atomic_load_n(&self->pulls, __ATOMIC_RELAXED);
+	uint64_t renders = __atomic_load_n(&self->renders, __ATOMIC_RELAXED);
+
+	memset(stats, 0, sizeof(*stats));
+
+	stats->periods = pulls;
+	stats->underruns = __atomic_load_n(&self->underruns, __ATOMIC_RELAXED);
+	stats->min_ready = __atomic_load_n(&self->minReady, __ATOMIC_RELAXED);
+	stats->jitter_max = __atomic_load_n(&self->jitterMax, __ATOMIC_RELAXED)
+	    * 1e-9;
+	if(pulls > 1)
+		stats->jitter_mean = __atomic_load_n(&self->jitterSum,
+			__ATOMIC_RELAXED) * 1e-9 / (pulls - 1);
+	stats->render_max = __atomic_load_n(&self->renderMax, __ATOMIC_RELAXED)
+	    * 1e-9;
+	if(renders)
+		stats->render_mean = __atomic_load_n(&self->renderSum,
+			__ATOMIC_RELAXED) * 1e-9 / renders;
+	stats->realtime = __atomic_load_n(&self->realtime, __ATOMIC_RELAXED);
+}
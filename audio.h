@@ -0,0 +1,78 @@
+//
+//  audio.h
+//
+
+#ifndef __AA_AUDIO_H__
+#define __AA_AUDIO_H__ 1
+
+#if !defined(__BEGIN_DECLS) || !defined(__END_DECLS)
+#if defined(__cplusplus)
+#define __BEGIN_DECLS   extern "C" {
+#define __END_DECLS \
+	}
+#else
+#define __BEGIN_DECLS
+#define __END_DECLS
+#endif
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+__BEGIN_DECLS
+
+/** Periods rendered ahead of the sink when none is given: triple
+    buffering. */
+#define AA_AUDIO_DEFAULT_PERIODS    (3)
+
+/** Most periods the output ring holds. */
+#define AA_AUDIO_MAX_PERIODS        (16)
+
+/** Renders one period of nsamples samples into output, on the render
+    thread. */
+typedef void (*aa_audio_render_func_t)(
+	void *context, float *output, int nsamples);
+
+/** Plays one period, blocking until the device has taken it, on the
+    sink thread. Returns nonzero to stop playing. */
+typedef int (*aa_audio_sink_func_t)(
+	void *context, const float *input, int nsamples);
+
+struct aa_audio_stats_s {
+	uint64_t	periods;        //!< Periods taken by the sink.
+	uint64_t	underruns;      //!< Of those, played as silence.
+	int			min_ready;      //!< Fewest periods queued when one was taken.
+	double		jitter_max;     //!< Largest deviation of the time between
+	double		jitter_mean;    //!< two periods from nominal, in seconds.
+	double		render_max;     //!< Time the render function took for a
+	double		render_mean;    //!< period, in seconds.
+	bool		realtime;       //!< The render thread has real-time priority.
+};
+
+struct aa_audio_s;
+typedef struct aa_audio_s *aa_audio_t;
+
+aa_audio_t aa_audio_create(
+	int period, int periods, int srate,
+	aa_audio_render_func_t render, void *context);
+void aa_audio_release(aa_audio_t self);
+
+int aa_audio_start(
+	aa_audio_t self, aa_audio_sink_func_t sink, void *context);
+int aa_audio_start_null(aa_audio_t self);
+int aa_audio_start_file(
+	aa_audio_t self, const char *path, bool paced);
+int aa_audio_start_callback(aa_audio_t self);
+void aa_audio_stop(aa_audio_t self);
+
+int aa_audio_pull(
+	aa_audio_t self, float *output);
+
+int aa_audio_get_period(aa_audio_t self);
+int aa_audio_get_latency(aa_audio_t self);
+void aa_audio_get_stats(
+	aa_audio_t self, struct aa_audio_stats_s *stats);
+
+__END_DECLS
+#endif                          // #ifndef __AA_AUDIO_H__
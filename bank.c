@@ -0,0 +1,245 @@
+//
+//  bank.c
+//
+//  Process-wide model bank. Each model file is loaded once per sample
+//  rate; every bell made from it shares its mode parameters and filter
+//  coefficients and owns only its filter state, until a tweak gives it
+//  a private copy.
+//
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bank.h"
+#include "bell_private.h"
+
+#define AA_BANK_INITIAL_BUCKETS     (64)
+
+struct aa_bank_entry_s {
+	struct aa_bank_entry_s *next;
+
+	/** Holds one reference; instances hold the others. */
+	aa_bell_t	model;
+
+	int			srate;
+	uint32_t	hash;
+	char		path[];
+};
+
+static struct {
+	pthread_mutex_t lock;
+
+	struct aa_bank_entry_s **buckets;
+	int			bucket_count;
+	int			model_count;
+
+	uint64_t	hits;
+	uint64_t	misses;
+} gBank = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static uint32_t
+aa_bank_hash(
+	const char *path, int srate
+) {
+	uint32_t hash = 2166136261u;    // FNV-1a
+
+	while(*path) {
+		hash ^= (uint8_t)*path++;
+		hash *= 16777619u;
+	}
+	for(int i = 0; i < 4; i++) {
+		hash ^= (uint8_t)(srate >> (8 * i));
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/** Doubles the bucket array. Lookups keep working if this fails.
+ */
+static void
+aa_bank_grow(void) {
+	int count = gBank.bucket_count ? gBank.bucket_count * 2
+	    : AA_BANK_INITIAL_BUCKETS;
+	struct aa_bank_entry_s **buckets = calloc(sizeof(*buckets), count);
+
+	if(!buckets)
+		return;
+
+	for(int b = 0; b < gBank.bucket_count; b++) {
+		struct aa_bank_entry_s *entry = gBank.buckets[b];
+
+		while(entry) {
+			struct aa_bank_entry_s *next = entry->next;
+			int index = entry->hash & (count - 1);
+
+			entry->next = buckets[index];
+			buckets[index] = entry;
+			entry = next;
+		}
+	}
+
+	free(gBank.buckets);
+	gBank.buckets = buckets;
+	gBank.bucket_count = count;
+}
+
+/** Returns the bank entry for path at srate, loading the model if it is
+    not in the bank yet. Must be called with the bank locked; other
+    loads wait while a file is read.
+ */
+static struct aa_bank_entry_s *
+aa_bank_lookup(
+	const char *path, int srate
+) {
+	struct aa_bank_entry_s *entry = NULL;
+	uint32_t hash = aa_bank_hash(path, srate);
+	size_t len = strlen(path);
+
+	if(gBank.bucket_count) {
+		entry = gBank.buckets[hash & (gBank.bucket_count - 1)];
+		while(entry && ((entry->hash != hash) || (entry->srate != srate)
+		        || strcmp(entry->path, path)))
+			entry = entry->next;
+	}
+
+	if(entry) {
+		gBank.hits++;
+		goto bail;
+	}
+
+	gBank.misses++;
+
+	if(gBank.model_count >= gBank.bucket_count)
+		aa_bank_grow();
+
+	if(!gBank.bucket_count)
+		goto bail;
+
+	entry = calloc(sizeof(*entry) + len + 1, 1);
+
+	if(!entry)
+		goto bail;
+
+	// The model itself never renders, so it gets the smallest buffer.
+	entry->model = aa_bell_create_from_file(path, 1, srate);
+
+	if(!entry->model) {
+		free(entry);
+		entry = NULL;
+		goto bail;
+	}
+
+	entry->srate = srate;
+	entry->hash = hash;
+	memcpy(entry->path, path, len + 1);
+
+	entry->next = gBank.buckets[hash & (gBank.bucket_count - 1)];
+	gBank.buckets[hash & (gBank.bucket_count - 1)] = entry;
+	gBank.model_count++;
+
+bail:
+	return entry;
+}
+
+/** Makes a bell from the model at path, sharing the bank's copy of its
+    mode data. The first call for a path and sample rate loads the file;
+    later ones only allocate filter state. Release the bell as usual.
+ */
+aa_bell_t
+aa_bank_create_bell(
+	const char *path, int bufferSize, int srate
+) {
+	aa_bell_t ret = NULL;
+	struct aa_bank_entry_s *entry;
+
+	if(!srate)
+		srate = (int)AA_BELL_DEFAULT_SRATE;
+
+	pthread_mutex_lock(&gBank.lock);
+
+	entry = aa_bank_lookup(path, srate);
+
+	if(entry)
+		ret = aa_bell_create_shared_sized(entry->model, bufferSize);
+
+	pthread_mutex_unlock(&gBank.lock);
+
+	return ret;
+}
+
+/** Drops every model that no bell is sharing any more.
+ */
+void
+aa_bank_purge(void) {
+	pthread_mutex_lock(&gBank.lock);
+
+	for(int b = 0; b < gBank.bucket_count; b++) {
+		struct aa_bank_entry_s **link = &gBank.buckets[b];
+
+		while(*link) {
+			struct aa_bank_entry_s *entry = *link;
+
+			if(__atomic_load_n(&entry->model->refCount, __ATOMIC_ACQUIRE)
+			    == 1) {
+				*link = entry->next;
+				aa_bell_release(entry->model);
+				free(entry);
+				gBank.model_count--;
+			} else {
+				link = &entry->next;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&gBank.lock);
+}
+
+/** Bytes of mode data a bell shares with its model.
+ */
+static size_t
+aa_bank_model_bytes(aa_bell_t model) {
+	size_t modes = sizeof(float) * AA_BELL_PADDED_MODE_COUNT(model->nf);
+	size_t ret = 0;
+
+	ret += 6 * modes;   // f, d, R2, twoRCosTheta, c_i, ampR
+	ret += sizeof(float) * model->nf * model->np;
+	if(model->pointAmpR)
+		ret += modes * model->np;
+	if(model->blockP)
+		ret += 2 * sizeof(float) * AA_BELL_BLOCK_LEN * model->nf;
+
+	return ret;
+}
+
+void
+aa_bank_get_stats(struct aa_bank_stats_s *stats) {
+	memset(stats, 0, sizeof(*stats));
+
+	pthread_mutex_lock(&gBank.lock);
+
+	stats->hits = gBank.hits;
+	stats->misses = gBank.misses;
+	stats->model_count = gBank.model_count;
+
+	for(int b = 0; b < gBank.bucket_count; b++) {
+		for(struct aa_bank_entry_s *entry = gBank.buckets[b]; entry;
+		    entry = entry->next) {
+			size_t bytes = aa_bank_model_bytes(entry->model);
+			int instances = __atomic_load_n(&entry->model->refCount,
+				__ATOMIC_RELAXED) - 1;
+
+			stats->instance_count += instances;
+			stats->bytes_held += bytes;
+			if(instances > 1)
+				stats->bytes_shared += bytes * (instances - 1);
+		}
+	}
+
+	pthread_mutex_unlock(&gBank.lock);
+}
@@ -0,0 +1,54 @@
+//
+//  bank.h
+//
+
+#ifndef __AA_BANK_H__
+#define __AA_BANK_H__ 1
+
+#if !defined(__BEGIN_DECLS) || !defined(__END_DECLS)
+#if defined(__cplusplus)
+#define __BEGIN_DECLS   extern "C" {
+#define __END_DECLS \
+	}
+#else
+#define __BEGIN_DECLS
+#define __END_DECLS
+#endif
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bell.h"
+
+__BEGIN_DECLS
+
+struct aa_bank_stats_s {
+	/** Loads served from the bank. */
+	uint64_t	hits;
+
+	/** Loads that had to read a model file. */
+	uint64_t	misses;
+
+	/** Models held by the bank. */
+	int			model_count;
+
+	/** Bells currently sharing a banked model. Bells that have been
+	    tweaked own their data and are not counted. */
+	int			instance_count;
+
+	/** Mode data held by the bank, in bytes. */
+	size_t		bytes_held;
+
+	/** Mode data that sharing instances would otherwise each hold,
+	    in bytes. */
+	size_t		bytes_shared;
+};
+
+aa_bell_t aa_bank_create_bell(
+	const char *path, int bufferSize, int srate);
+void aa_bank_purge(void);
+void aa_bank_get_stats(struct aa_bank_stats_s *stats);
+
+__END_DECLS
+#endif                          // #ifndef __AA_BANK_H__
@@ -1,62 +1,11 @@
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
-#include "bell.h"
-
-struct aa_bell_s {
-	int		bufferSize;
-
-	/** Mode frequencies in Hertz. */
-	float * f;
-
-	/**  Angular decay rates in Hertz. */
-	float * d;
-
-	/** Gains. a[p][k] is gain at point p for mode k. */
-	float * a;
-
-	/** Number of modes available. */
-	int		nf;
-
-	/** Number of modes used. */
-	int		nfUsed;
-
-	/** Number of points. */
-	int		np;
-
-	/** Multiplies all frequencies. */
-	float	fscale;
-
-	/** Multiplies all dampings. */
-	float	dscale;
-
-	/** Multiplies all gains. */
-	float	ascale;
-
-
-	float * cosForce;
-
-
-	/** Sampling rate in Hertz. */
-	float	srate;
-
-	/** State of filters. */
-	float * yt_1, *yt_2;
-
-	/** The transfer function of a reson filter is H(z) = 1/(1-twoRCosTheta/z + R2/z*z). */
-	float * R2;
-
-	/** The transfer function of a reson filter is H(z) = 1/(1-twoRCosTheta/z + R2/z*z). */
-	float * twoRCosTheta;
-
-	/** Cached values. */
-	float * c_i;
-
-	/** Reson filter gain vector. */
-	float * ampR;
-};
+#include "bell_private.h"
 
 void
 aa_bell_dump(
@@ -101,141 +50,630 @@ aa_bell_dump(
 	fprintf(outfile, "-------\n");
 }
 
+/** Allocates a zeroed per-mode array, padded and aligned for the
+    SIMD kernels.
+ */
+float*
+aa_bell_alloc_modes(int nf) {
+	void *ret = NULL;
+	size_t size = sizeof(float) * AA_BELL_PADDED_MODE_COUNT(nf);
+
+	if(posix_memalign(&ret, sizeof(float) * AA_BELL_MODE_PAD, size))
+		return NULL;
+
+	memset(ret, 0, size);
+
+	return (float*)ret;
+}
+
+/** Sets up the scalar fields of a zeroed bell. Arrays are left NULL
+    so that a loader can point them into a mapped model file before
+    calling aa_bell_alloc_arrays().
+ */
+void
+aa_bell_init(
+	aa_bell_t self, int nf, int np, int bufferSize, int srate
+) {
+	self->fscale = self->dscale = self->ascale = 1.0f;
+	self->nfUsed = self->nf = nf;
+	self->np = np;
+	if(srate)
+		self->srate = srate;
+	else
+		self->srate = AA_BELL_DEFAULT_SRATE;
+	self->bufferSize = bufferSize;
+	self->kernel = aa_bell_kernel_resolve(AA_BELL_KERNEL_AUTO);
+	self->coeff = AA_BELL_COEFF_EXACT;
+	self->excite = AA_BELL_EXCITE_RAISED_COSINE;
+	self->channels = 1;
+	self->refCount = 1;
+}
+
+/** Allocates every array of self that is still NULL. Returns nonzero
+    if an allocation failed; the bell must then be released.
+ */
+int
+aa_bell_alloc_arrays(aa_bell_t self) {
+	int nf = self->nf;
+
+	if(!self->f)
+		self->f = (float*)malloc(sizeof(float) * nf);
+	if(!self->d)
+		self->d = (float*)calloc(sizeof(float), nf);
+	if(!self->a)
+		self->a = (float*)calloc(sizeof(float), nf * self->np);
+	if(!self->cosForce)
+		self->cosForce = (float*)calloc(sizeof(float), self->bufferSize);
+	if(!self->R2)
+		self->R2 = aa_bell_alloc_modes(nf);
+	if(!self->twoRCosTheta)
+		self->twoRCosTheta = aa_bell_alloc_modes(nf);
+	if(!self->yt_1)
+		self->yt_1 = aa_bell_alloc_modes(nf);
+	if(!self->yt_2)
+		self->yt_2 = aa_bell_alloc_modes(nf);
+	if(!self->c_i)
+		self->c_i = aa_bell_alloc_modes(nf);
+	if(!self->ampR)
+		self->ampR = aa_bell_alloc_modes(nf);
+	if((self->np > 1) && !self->pointAmpR)
+		self->pointAmpR = aa_bell_alloc_modes(
+			AA_BELL_PADDED_MODE_COUNT(nf) * self->np);
+	if((self->np > 1) && !self->pointForce)
+		self->pointForce = (float*)calloc(sizeof(float),
+			self->bufferSize * self->np);
+	if((self->np > 1) && !self->pointForced)
+		self->pointForced = (int*)calloc(sizeof(int), self->np);
+
+	if(!self->f || !self->d || !self->a || !self->cosForce || !self->R2
+	    || !self->twoRCosTheta || !self->yt_1 || !self->yt_2 || !self->c_i
+	    || !self->ampR || ((self->np > 1) && (!self->pointAmpR
+	        || !self->pointForce || !self->pointForced)))
+		return -1;
+
+	return 0;
+}
+
+/** Creates a bell in memory, which must be aligned to
+    AA_BELL_ARENA_ALIGN bytes and hold aa_bell_get_arena_size() bytes,
+    with all its arrays in order of use. The memory stays the caller's:
+    releasing the bell frees only what was allocated for it later, and
+    the memory can then be reused. Returns NULL if memory is too small
+    or misaligned.
+ */
+aa_bell_t
+aa_bell_create_at(
+	void *memory, size_t size, int nf, int np, int bufferSize, int srate
+) {
+	aa_bell_t ret = NULL;
+	size_t need = aa_bell_get_arena_size(nf, np, bufferSize);
+
+	if(!memory || ((uintptr_t)memory & (AA_BELL_ARENA_ALIGN - 1))
+	    || (size < need))
+		goto bail;
+
+	ret = memory;
+	memset(ret, 0, need);
+
+	aa_bell_init(ret, nf, np, bufferSize, srate);
+	ret->placed = true;
+	aa_bell_arena_place(ret, false);
+
+bail:
+	return ret;
+}
+
 aa_bell_t
 aa_bell_create(
 	int nf, int np, int bufferSize, int srate
 ) {
+	size_t size = aa_bell_get_arena_size(nf, np, bufferSize);
+	void *block = NULL;
 	aa_bell_t ret = NULL;
 
-	ret = calloc(sizeof(*ret), 1);
-
-	if(!ret)
+	if(posix_memalign(&block, AA_BELL_ARENA_ALIGN, size))
 		goto bail;
 
+	ret = aa_bell_create_at(block, size, nf, np, bufferSize, srate);
 
-	ret->fscale = ret->dscale = ret->ascale = 1.0f;
-	ret->nfUsed = ret->nf = nf;
-	ret->np = np;
-	if(srate)
-		ret->srate = srate;
+	if(ret)
+		ret->placed = false;
 	else
-		ret->srate = AA_BELL_DEFAULT_SRATE;
-	ret->bufferSize = bufferSize;
+		free(block);
 
-	ret->f = (float*)malloc(sizeof(float) * nf);
+bail:
+	return ret;
+}
 
-	if(!ret->f) {
-		aa_bell_release(ret);
-		ret = NULL;
+/** Creates a bell that renders the modes of model with its own filter
+    state and force buffer of bufferSize samples. Mode parameters and
+    coefficients are shared, so tweaks made to the model are heard by
+    every shared bell, while the first tweak made to a shared bell gives
+    it a private copy. The model is retained until the shared bell is
+    released; its kernel should be selected first.
+ */
+aa_bell_t
+aa_bell_create_shared_sized(
+	aa_bell_t model, int bufferSize
+) {
+	size_t size = aa_bell_get_shared_arena_size(model, bufferSize);
+	void *block = NULL;
+	aa_bell_t ret = NULL;
+
+	if(posix_memalign(&block, AA_BELL_ARENA_ALIGN, size))
 		goto bail;
-	}
 
-	ret->d = (float*)calloc(sizeof(float), nf);
+	ret = aa_bell_create_shared_at(block, size, model, bufferSize);
 
-	if(!ret->d) {
-		aa_bell_release(ret);
-		ret = NULL;
+	if(ret)
+		ret->placed = false;
+	else
+		free(block);
+
+bail:
+	return ret;
+}
+
+/** Creates a shared bell of model in memory, as aa_bell_create_at()
+    does, with its force and filter state; memory must hold
+    aa_bell_get_shared_arena_size() bytes.
+ */
+aa_bell_t
+aa_bell_create_shared_at(
+	void *memory, size_t size, aa_bell_t model, int bufferSize
+) {
+	aa_bell_t ret = NULL;
+
+	// Share with the bell that owns the data, so that a shared bell
+	// unsharing never pulls data from under another.
+	if(model->model)
+		model = model->model;
+
+	if(!memory || ((uintptr_t)memory & (AA_BELL_ARENA_ALIGN - 1))
+	    || (size < aa_bell_get_shared_arena_size(model, bufferSize)))
 		goto bail;
+
+	ret = memory;
+
+	memcpy(ret, model, offsetof(struct aa_bell_s, refCount));
+	ret->model = aa_bell_retain(model);
+	ret->refCount = 1;
+	ret->bufferSize = bufferSize;
+	ret->map = NULL;
+	ret->mapSize = 0;
+	ret->placed = true;
+	ret->pool = NULL;
+	ret->params = NULL;
+	ret->rampR2 = ret->rampTwoRCosTheta = ret->rampAmpR = NULL;
+	ret->rampNext = ret->rampBlock = false;
+	ret->ownGains = false;
+	ret->ownAmpR = NULL;
+	ret->ownWideAmpR = NULL;
+	ret->pointForce = NULL;
+	ret->pointForced = NULL;
+	ret->pointForcedCount = 0;
+	ret->time = 0;
+	ret->strikeCount = 0;
+	ret->live = ret->render = NULL;
+	ret->liveCount = ret->renderCount = 0;
+	ret->drop = NULL;
+	ret->power = NULL;
+	ret->pack = NULL;
+	ret->packed = ret->wakeNext = false;
+	ret->cullThreshold = 0.0f;
+	ret->budgeted = ret->forced = false;
+	ret->forceBegin = ret->forceEnd = 0;
+	ret->budget = NULL;
+	ret->dropDecay = NULL;
+	ret->wideYt_1 = ret->wideYt_2 = NULL;
+	ret->spectral = NULL;
+	ret->channels = 1;
+	ret->channelGain = NULL;
+	ret->channelStride = 0;
+	ret->channelStale = false;
+	ret->channelSerial = 0;
+
+	aa_bell_arena_place(ret, true);
+	memset(ret->cosForce, 0,
+		ret->arenaSize - ((char*)ret->cosForce - (char*)ret));
+
+	if(ret->precision != AA_BELL_PRECISION_FLOAT) {
+		ret->wideYt_1 = aa_bell_precision_alloc_modes(ret->precision,
+			ret->nf);
+		ret->wideYt_2 = aa_bell_precision_alloc_modes(ret->precision,
+			ret->nf);
+		if(ret->np > 1)
+			ret->ownWideAmpR = aa_bell_precision_alloc_modes(
+				ret->precision, ret->nf);
 	}
 
-	ret->a = (float*)calloc(sizeof(float), nf * np);
+	// Frames of its own now rather than on the audio thread; without
+	// them, or at a block size they do not fit, it renders in time.
+	if(ret->synthesis == AA_BELL_SYNTHESIS_SPECTRAL) {
+		ret->synthesis = AA_BELL_SYNTHESIS_TIME;
+		aa_bell_set_synthesis(ret, AA_BELL_SYNTHESIS_SPECTRAL);
+	}
 
-	if(!ret->a) {
+	if(((ret->precision != AA_BELL_PRECISION_FLOAT)
+	        && (!ret->wideYt_1 || !ret->wideYt_2
+	        || ((ret->np > 1) && !ret->ownWideAmpR)))
+	    || ((model->cullThreshold > 0.0f)
+	        && aa_bell_set_cull_threshold(ret, model->cullThreshold))) {
 		aa_bell_release(ret);
 		ret = NULL;
 		goto bail;
 	}
 
-	ret->cosForce = (float*)calloc(sizeof(float), bufferSize);
+bail:
+	return ret;
+}
 
-	ret->R2 = (float*)calloc(sizeof(float), nf);
-	ret->twoRCosTheta = (float*)calloc(sizeof(float), nf);
-	ret->yt_1 = (float*)calloc(sizeof(float), nf);
-	ret->yt_2 = (float*)calloc(sizeof(float), nf);
-	ret->c_i = (float*)calloc(sizeof(float), nf);
-	ret->ampR = (float*)calloc(sizeof(float), nf);
+aa_bell_t
+aa_bell_create_shared(aa_bell_t model) {
+	return aa_bell_create_shared_sized(model, model->bufferSize);
+}
 
+/** Copies nf floats into a new per-mode array.
+ */
+static float*
+aa_bell_copy_modes(
+	const float *src, size_t count
+) {
+	float *ret = aa_bell_alloc_modes((int)count);
+
+	if(ret)
+		memcpy(ret, src, sizeof(float) * count);
 
-bail:
 	return ret;
 }
 
-void
-aa_bell_release(aa_bell_t self) {
-	free(self->f);
-	free(self->d);
-	free(self->a);
-	free(self->R2);
-	free(self->twoRCosTheta);
-	free(self->yt_1);
-	free(self->yt_2);
-	free(self->c_i);
-	free(self->ampR);
-	free(self->cosForce);
-	free(self);
+/** Gives a shared bell its own copy of the model's mode data before it
+    is modified, and lets go of the model. Returns nonzero if out of
+    memory, in which case the bell stays shared and the tweak must be
+    dropped.
+ */
+int
+aa_bell_unshare(aa_bell_t self) {
+	aa_bell_t model = self->model;
+	struct aa_bell_s copy;
+	size_t nf = self->nf;
+	size_t rows = AA_BELL_PADDED_MODE_COUNT(self->nf) * self->np;
+
+	if(!model)
+		return 0;
+
+	memset(&copy, 0, sizeof(copy));
+	copy.f = aa_bell_copy_modes(model->f, nf);
+	copy.d = aa_bell_copy_modes(model->d, nf);
+	copy.a = aa_bell_copy_modes(model->a, nf * self->np);
+	copy.R2 = aa_bell_copy_modes(model->R2, nf);
+	copy.twoRCosTheta = aa_bell_copy_modes(model->twoRCosTheta, nf);
+	copy.c_i = aa_bell_copy_modes(model->c_i, nf);
+	copy.ampR = self->ownGains ? self->ampR
+	    : aa_bell_copy_modes(model->ampR, nf);
+	copy.wideR2 = aa_bell_precision_copy_modes(self->precision,
+		model->wideR2, nf);
+	copy.wideTwoRCosTheta = aa_bell_precision_copy_modes(self->precision,
+		model->wideTwoRCosTheta, nf);
+	copy.wideAmpR = self->ownGains ? self->wideAmpR
+	    : aa_bell_precision_copy_modes(self->precision, model->wideAmpR, nf);
+	if(model->pointAmpR)
+		copy.pointAmpR = aa_bell_copy_modes(model->pointAmpR, rows);
+	copy.widePointAmpR = aa_bell_precision_copy_modes(self->precision,
+		model->widePointAmpR, (int)rows);
+	if(self->blockP) {
+		copy.blockP = aa_bell_copy_modes(model->blockP,
+			nf * AA_BELL_BLOCK_LEN);
+		copy.blockQ = aa_bell_copy_modes(model->blockQ,
+			nf * AA_BELL_BLOCK_LEN);
+	}
+	if(model->rampR2) {
+		copy.rampR2 = aa_bell_copy_modes(model->rampR2, nf);
+		copy.rampTwoRCosTheta = aa_bell_copy_modes(model->rampTwoRCosTheta,
+			nf);
+		copy.rampAmpR = aa_bell_copy_modes(model->rampAmpR, nf);
+	}
+
+	if(!copy.f || !copy.d || !copy.a || !copy.R2 || !copy.twoRCosTheta
+	    || !copy.c_i || !copy.ampR
+	    || (self->blockP && (!copy.blockP || !copy.blockQ))
+	    || (model->wideR2 && (!copy.wideR2 || !copy.wideTwoRCosTheta
+	        || !copy.wideAmpR))
+	    || (model->pointAmpR && !copy.pointAmpR)
+	    || (model->widePointAmpR && !copy.widePointAmpR)
+	    || (model->rampR2 && (!copy.rampR2 || !copy.rampTwoRCosTheta
+	        || !copy.rampAmpR))) {
+		free(copy.f);
+		free(copy.d);
+		free(copy.a);
+		free(copy.R2);
+		free(copy.twoRCosTheta);
+		free(copy.c_i);
+		if(!self->ownGains) {
+			free(copy.ampR);
+			free(copy.wideAmpR);
+		}
+		free(copy.pointAmpR);
+		free(copy.widePointAmpR);
+		free(copy.wideR2);
+		free(copy.wideTwoRCosTheta);
+		free(copy.blockP);
+		free(copy.blockQ);
+		free(copy.rampR2);
+		free(copy.rampTwoRCosTheta);
+		free(copy.rampAmpR);
+		return -1;
+	}
+
+	self->f = copy.f;
+	self->d = copy.d;
+	self->a = copy.a;
+	self->R2 = copy.R2;
+	self->twoRCosTheta = copy.twoRCosTheta;
+	self->c_i = copy.c_i;
+	self->ampR = copy.ampR;
+	self->wideR2 = copy.wideR2;
+	self->wideTwoRCosTheta = copy.wideTwoRCosTheta;
+	self->wideAmpR = copy.wideAmpR;
+	self->pointAmpR = copy.pointAmpR;
+	self->widePointAmpR = copy.widePointAmpR;
+	self->blockP = copy.blockP;
+	self->blockQ = copy.blockQ;
+	self->rampR2 = copy.rampR2;
+	self->rampTwoRCosTheta = copy.rampTwoRCosTheta;
+	self->rampAmpR = copy.rampAmpR;
+	self->rampBegin = model->rampBegin;
+	self->rampEnd = model->rampEnd;
+	self->rampNext = model->rampNext;
+	self->rampBlock = model->rampBlock;
+	if(self->ownGains && self->rampAmpR)
+		memcpy(self->rampAmpR, self->ampR, sizeof(float) * nf);
+	// Gains of its own are now simply its gains.
+	if(!self->ownGains)
+		free(self->ownWideAmpR);
+	self->ownAmpR = NULL;
+	self->ownWideAmpR = NULL;
+	self->ownGains = false;
+	self->model = NULL;
+
+	aa_bell_release(model);
+
+	return 0;
 }
 
 aa_bell_t
-aa_bell_create_from_file(
-	const char *path, int bufferSize, int srate
+aa_bell_retain(aa_bell_t self) {
+	__atomic_add_fetch(&self->refCount, 1, __ATOMIC_RELAXED);
+	return self;
+}
+
+/** Frees an array of self unless it lives in its mapped model file or
+    in the block self was created in.
+ */
+static void
+aa_bell_free_array(
+	aa_bell_t self, void *array
 ) {
-	aa_bell_t ret = NULL;
-	float dval;
-	int ival;
-	int nfUsed, nf, np;
-	char s[256];
-	FILE* fp;
+	uintptr_t p = (uintptr_t)array;
+	uintptr_t map = (uintptr_t)self->map;
+	uintptr_t arena = (uintptr_t)self;
 
-	fp = fopen(path, "r");
+	if(self->map && (p >= map) && (p < map + self->mapSize))
+		return;
+	if((p >= arena) && (p < arena + self->arenaSize))
+		return;
 
-	if(!fp)
-		goto bail;
+	free(array);
+}
 
-	fscanf(fp, "%s\n", s);
-	// s is now: "nactive_freq:"
-	fscanf(fp, "%d\n", &nfUsed);
-	//printf(":%s:\n",s);
-	fscanf(fp, "%s\n", s);      // n_freq:
-	fscanf(fp, "%d\n", &nf);
-	fscanf(fp, "%s\n", s);      // n_points:
-	fscanf(fp, "%d\n", &np);
+/** Frees the block of self, or hands it back to its pool; a block the
+    caller placed self in stays the caller's.
+ */
+static void
+aa_bell_free_block(aa_bell_t self) {
+	if(self->pool)
+		aa_bell_pool_put(self->pool, self);
+	else if(!self->placed)
+		free(self);
+}
 
-	ret = aa_bell_create(nf, np, bufferSize, srate);
+/** Drops a reference to self, freeing it with the last one.
+ */
+void
+aa_bell_release(aa_bell_t self) {
+	if(__atomic_sub_fetch(&self->refCount, 1, __ATOMIC_ACQ_REL))
+		return;
+
+	aa_bell_release_params(self);
+	if(self->budget)
+		aa_bell_budget_release(self->budget);
+	aa_bell_release_cull(self);
+	aa_bell_release_spectral(self);
+
+	if(self->model) {
+		aa_bell_t model = self->model;
+
+		aa_bell_free_array(self, self->yt_1);
+		aa_bell_free_array(self, self->yt_2);
+		aa_bell_free_array(self, self->cosForce);
+		aa_bell_free_array(self, self->pointForce);
+		aa_bell_free_array(self, self->pointForced);
+		free(self->wideYt_1);
+		free(self->wideYt_2);
+		free(self->ownWideAmpR);
+		free(self->channelGain);
+		aa_bell_free_block(self);
+		aa_bell_release(model);
+		return;
+	}
 
-	if(!ret)
-		goto bail;
+	aa_bell_free_array(self, self->f);
+	aa_bell_free_array(self, self->d);
+	aa_bell_free_array(self, self->a);
+	aa_bell_free_array(self, self->R2);
+	aa_bell_free_array(self, self->twoRCosTheta);
+	aa_bell_free_array(self, self->yt_1);
+	aa_bell_free_array(self, self->yt_2);
+	aa_bell_free_array(self, self->c_i);
+	aa_bell_free_array(self, self->ampR);
+	aa_bell_free_array(self, self->pointAmpR);
+	aa_bell_free_array(self, self->cosForce);
+	aa_bell_free_array(self, self->pointForce);
+	aa_bell_free_array(self, self->pointForced);
+	free(self->blockP);
+	free(self->blockQ);
+	free(self->rampR2);
+	free(self->rampTwoRCosTheta);
+	free(self->rampAmpR);
+	free(self->wideR2);
+	free(self->wideTwoRCosTheta);
+	free(self->wideAmpR);
+	free(self->widePointAmpR);
+	free(self->wideYt_1);
+	free(self->wideYt_2);
+	free(self->channelGain);
+	if(self->map)
+		munmap(self->map, self->mapSize);
+	aa_bell_free_block(self);
+}
+
+/** Makes the coefficients the last block ended with the start of the
+    next ramp.
+ */
+static void
+aa_bell_ramp_commit(aa_bell_t self) {
+	int begin = self->rampBegin;
+	size_t size = sizeof(float) * (self->rampEnd - begin);
+
+	if(self->rampEnd > begin) {
+		memcpy(self->rampR2 + begin, self->R2 + begin, size);
+		memcpy(self->rampTwoRCosTheta + begin, self->twoRCosTheta + begin,
+			size);
+		memcpy(self->rampAmpR + begin, self->ampR + begin, size);
+	}
+	self->rampBegin = self->nf;
+	self->rampEnd = 0;
+	self->rampBlock = false;
+}
 
-	fscanf(fp, "%s\n", s);      // f_scale:
-	fscanf(fp, "%f\n", &ret->fscale);
-	fscanf(fp, "%s\n", s);      // d_scale:
-	fscanf(fp, "%f\n", &ret->dscale);
-	fscanf(fp, "%s\n", s);      // a_scale:
-	fscanf(fp, "%f\n", &ret->ascale);
+/** Called before the coefficients of mode i change, so that the next
+    block ramps it from what the last one ended with.
+ */
+static void
+aa_bell_ramp_prepare(
+	aa_bell_t self, int i
+) {
+	if(!self->rampR2)
+		return;
+
+	if(self->rampBlock)
+		aa_bell_ramp_commit(self);
+	if(i < self->rampBegin)
+		self->rampBegin = i;
+	if(i >= self->rampEnd)
+		self->rampEnd = i + 1;
+	self->rampNext = true;
+}
 
-	fscanf(fp, "%s\n", s);      // frequencies:
-	for(int i = 0; i < nf; i++) {
-		fscanf(fp, "%f\n", &ret->f[i]);
+/** Gets self ready for the block about to be rendered: recomputes
+    its own gains if its model's changed, and decides whether the block
+    ramps. Called by aa_bell_apply_params() at the start of each block.
+ */
+void
+aa_bell_start_block(aa_bell_t self) {
+	if(self->ownGains && (self->gainSerial != self->model->gainSerial)) {
+		self->gainSerial = self->model->gainSerial;
+		aa_bell_compute_gains(self, 0, self->nf);
 	}
-	fscanf(fp, "%s\n", s);      // dampings:
-	for(int i = 0; i < nf; i++) {
-		fscanf(fp, "%f\n", &ret->d[i]);
+
+	if(self->rampR2) {
+		if(self->rampBlock)
+			aa_bell_ramp_commit(self);
+		self->rampBlock = self->rampNext;
+		self->rampNext = false;
 	}
-	fscanf(fp, "%s\n", s);      // amplitudes[point][freq]:
-	for(int p = 0; p < np; p++) {
-		for(int i = 0; i < nf; i++) {
-			fscanf(fp, "%f\n", &ret->a[p * nf + i]);
-		}
+
+	if(self->budget)
+		aa_bell_budget_select(self->budget, &self, 1);
+
+	aa_bell_channels_update(self);
+	aa_bell_cull_pack(self);
+}
+
+/** Runs the selected kernel over modes [begin, end) for the block
+    about to be rendered, or its ramping variant right after
+    coefficients changed on a smoothed bell. Shared bells follow their
+    model. If store is set, output is written rather than added to, so
+    it need not be cleared first.
+ */
+double
+aa_bell_run_kernel(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store
+) {
+	aa_bell_t owner = self->model ? self->model : self;
+
+	if(self->precision != AA_BELL_PRECISION_FLOAT)
+		return aa_bell_precision_run(self, output, begin, end, store);
+
+	if(self->packed)
+		return aa_bell_cull_run(self, output, begin, end, store);
+
+	if(owner->rampBlock)
+		return aa_bell_kernel_get_ramp_func(self->kernel)(
+			self, output, begin, end, store);
+
+	return aa_bell_kernel_get_func(self->kernel)(self, output, begin, end,
+		store);
+}
+
+/** Turns coefficient smoothing on or off. While it is on, changes to
+    frequencies, dampings and gains are not heard as a step: the block
+    after the change ramps every coefficient linearly from its old to
+    its new value. Shared bells follow their model's setting. Returns
+    nonzero if it could not be changed.
+ */
+int
+aa_bell_set_smoothing(
+	aa_bell_t self, bool enable
+) {
+	if(self->model)
+		return -1;
+
+	if(!enable) {
+		free(self->rampR2);
+		free(self->rampTwoRCosTheta);
+		free(self->rampAmpR);
+		self->rampR2 = self->rampTwoRCosTheta = self->rampAmpR = NULL;
+		self->rampNext = self->rampBlock = false;
+		return 0;
 	}
 
-	aa_bell_compute_filter(ret);
+	if(self->rampR2)
+		return 0;
 
-bail:
-	if(fp)
-		fclose(fp);
+	self->rampNext = self->rampBlock = false;
+	self->rampR2 = aa_bell_alloc_modes(self->nf);
+	self->rampTwoRCosTheta = aa_bell_alloc_modes(self->nf);
+	self->rampAmpR = aa_bell_alloc_modes(self->nf);
 
-	return ret;
+	if(!self->rampR2 || !self->rampTwoRCosTheta || !self->rampAmpR) {
+		aa_bell_set_smoothing(self, false);
+		return -1;
+	}
+
+	self->rampBegin = 0;
+	self->rampEnd = self->nf;
+	aa_bell_ramp_commit(self);
+
+	return 0;
 }
 
+bool
+aa_bell_get_smoothing(aa_bell_t self) {
+	aa_bell_t owner = self->model ? self->model : self;
+
+	return owner->rampR2 != NULL;
+}
 
 /** Compute gains of contact
  */
@@ -243,7 +681,153 @@ void
 aa_bell_compute_location(
 	aa_bell_t self, int i
 ) {
-	self->ampR[i] = self->ascale * self->c_i[i] * self->a[i];
+	if(aa_bell_unshare(self))
+		return;
+
+	aa_bell_ramp_prepare(self, i);
+	aa_bell_compute_gains(self, i, i + 1);
+	aa_bell_compute_point_gains(self, i, i + 1);
+	self->gainSerial++;
+}
+
+/** Notes that force was written into samples [begin, end) of the block
+    about to be rendered, so that only those need clearing after it.
+ */
+static void
+aa_bell_mark_force(
+	aa_bell_t self, int begin, int end
+) {
+	if(!self->forced) {
+		self->forceBegin = begin;
+		self->forceEnd = end;
+		self->forced = true;
+		return;
+	}
+
+	if(begin < self->forceBegin)
+		self->forceBegin = begin;
+	if(end > self->forceEnd)
+		self->forceEnd = end;
+}
+
+/** Clears the force written into the block just rendered.
+ */
+static void
+aa_bell_clear_block_force(aa_bell_t self) {
+	size_t size = sizeof(float) * (self->forceEnd - self->forceBegin);
+
+	if(self->forced) {
+		memset((void*)(self->cosForce + self->forceBegin), 0, size);
+		for(int j = 0; j < self->pointForcedCount; j++)
+			memset((void*)(self->pointForce + self->forceBegin
+				+ self->pointForced[j] * self->bufferSize), 0, size);
+	}
+	self->pointForcedCount = 0;
+	self->forced = false;
+}
+
+/** The point self's gains are for: its own once it has gains of its
+    own, its model's otherwise.
+ */
+static float
+aa_bell_gains_point(aa_bell_t self) {
+	return self->model && !self->ownGains ? self->model->point
+	    : self->point;
+}
+
+/** Returns row p of pointForce, listing it among the rows holding force
+    for the block about to be rendered.
+ */
+static float*
+aa_bell_point_row(
+	aa_bell_t self, int p
+) {
+	int j = 0;
+
+	while((j < self->pointForcedCount) && (self->pointForced[j] != p))
+		j++;
+	if(j == self->pointForcedCount)
+		self->pointForced[self->pointForcedCount++] = p;
+
+	return self->pointForce + p * self->bufferSize;
+}
+
+/** Moves the force written into samples [forceBegin, forceEnd) of
+    cosForce, which self's gains at point act on, to the rows of the
+    measured points around point, before self is moved away from it.
+ */
+static void
+aa_bell_point_keep(
+	aa_bell_t self, float point
+) {
+	int p = (int)point;
+	float t = point - p;
+	float *row = aa_bell_point_row(self, p);
+	float *next = t > 0.0f ? aa_bell_point_row(self, p + 1) : NULL;
+
+	for(int k = self->forceBegin; k < self->forceEnd; k++) {
+		row[k] += (1.0f - t) * self->cosForce[k];
+		if(next)
+			next[k] += t * self->cosForce[k];
+	}
+
+	memset((void*)(self->cosForce + self->forceBegin), 0,
+		sizeof(float) * (self->forceEnd - self->forceBegin));
+}
+
+/** Moves the strike position. Whole numbers are the measured points of
+    the model; a fraction in between mixes the gains of the two points
+    around it. The new gains apply to energy added from now on, so
+    modes already ringing are not disturbed. Returns nonzero if point is
+    out of range.
+
+    A shared bell that is moved takes the gains of its own it was made
+    with and keeps following its model's coefficients. Force still to
+    come from strikes at the old point keeps the old point's gains: it
+    goes to the rows of pointForce, which the kernels drive with the
+    gains of each measured point. Moving costs a pass over the modes and
+    never allocates.
+ */
+int
+aa_bell_set_strike_point(
+	aa_bell_t self, float point
+) {
+	float from = aa_bell_gains_point(self);
+
+	if(!(point >= 0.0f) || (point > self->np - 1))
+		return -1;
+
+	// A bell of one point has one set of gains.
+	if(self->np < 2)
+		return 0;
+
+	if((point != from) && self->forced)
+		aa_bell_point_keep(self, from);
+
+	if(self->model && !self->ownGains) {
+		self->ampR = self->ownAmpR;
+		self->wideAmpR = self->ownWideAmpR;
+		self->ownGains = true;
+	}
+
+	self->point = point;
+	aa_bell_compute_gains(self, 0, self->nf);
+
+	if(self->model) {
+		self->gainSerial = self->model->gainSerial;
+	} else {
+		// Gains act on new energy only, so they need no ramp.
+		if(self->rampAmpR)
+			memcpy(self->rampAmpR, self->ampR, sizeof(float) * self->nf);
+		self->gainSerial++;
+	}
+
+	return 0;
+}
+
+float
+aa_bell_get_strike_point(aa_bell_t self) {
+	return aa_bell_gains_point(self);
 }
 
 /** Set state to non-vibrating.
@@ -272,15 +856,37 @@ void
 aa_bell_compute_reson_coeff(
 	aa_bell_t self, int i
 ) {
-	float tmp_r = (float)(exp(-self->dscale * self->d[i] / self->srate));
+	if(aa_bell_unshare(self))
+		return;
+
+	aa_bell_ramp_prepare(self, i);
+	aa_bell_compute_reson_coeff_at(self, i, self->srate,
+		&self->R2[i], &self->twoRCosTheta[i], &self->c_i[i]);
+
+	if(self->blockP)
+		aa_bell_kernel_block_coeff(self, i);
+	if(self->wideR2)
+		aa_bell_precision_coeffs(self, i, i + 1);
+}
+
+/** Computes the reson coefficients of mode i for an arbitrary sampling
+    rate, without touching the bell. Model files use this to store
+    coefficients for rates other than the bell's own.
+ */
+void
+aa_bell_compute_reson_coeff_at(
+	aa_bell_t self, int i, float srate,
+	float *R2, float *twoRCosTheta, float *c_i
+) {
+	float tmp_r = (float)(exp(-self->dscale * self->d[i] / srate));
 
-	self->R2[i] = tmp_r * tmp_r;
-	self->twoRCosTheta[i] =
+	*R2 = tmp_r * tmp_r;
+	*twoRCosTheta =
 	    (float)(2. *
-	    cos(2. * M_PI * self->fscale * self->f[i] / self->srate) * tmp_r);
-	self->c_i[i] =
+	    cos(2. * M_PI * self->fscale * self->f[i] / srate) * tmp_r);
+	*c_i =
 	    (float)(sin(2. * M_PI * self->fscale * self->f[i] /
-			self->srate) * tmp_r);
+			srate) * tmp_r);
 }
 
 /** Compute the filter coefficients used for real-time rendering
@@ -288,10 +894,94 @@ aa_bell_compute_reson_coeff(
  */
 void
 aa_bell_compute_filter(aa_bell_t self) {
-	for(int i = 0; i < self->nf; i++) {
-		aa_bell_compute_reson_coeff(self, i);
-		aa_bell_compute_location(self, i);
-	}
+	aa_bell_compute_filter_range(self, 0, self->nf);
+}
+
+/** Recomputes the filter coefficients and gains of modes [begin, end)
+    in one batch, with the accuracy set by aa_bell_set_coeff_accuracy().
+ */
+void
+aa_bell_compute_filter_range(
+	aa_bell_t self, int begin, int end
+) {
+	if(begin < 0)
+		begin = 0;
+	if(end > self->nf)
+		end = self->nf;
+	if((begin >= end) || aa_bell_unshare(self))
+		return;
+
+	aa_bell_ramp_prepare(self, begin);
+	aa_bell_ramp_prepare(self, end - 1);
+	aa_bell_compute_coeffs(self, begin, end, true);
+	if(self->wideR2)
+		aa_bell_precision_coeffs(self, begin, end);
+	aa_bell_compute_gains(self, begin, end);
+	aa_bell_compute_point_gains(self, begin, end);
+	self->gainSerial++;
+
+	if(self->blockP)
+		for(int i = begin; i < end; i++)
+			aa_bell_kernel_block_coeff(self, i);
+}
+
+/** Sets the factors applied to every frequency, damping and gain, and
+    recomputes only what they change: a new gain factor costs a multiply
+    per mode, a new frequency factor a sine and cosine, and only a new
+    damping factor the full computation.
+ */
+void
+aa_bell_set_scales(
+	aa_bell_t self, float fscale, float dscale, float ascale
+) {
+	bool angle = fscale != self->fscale;
+	bool decay = dscale != self->dscale;
+
+	if(!angle && !decay && (ascale == self->ascale))
+		return;
+	if(aa_bell_unshare(self))
+		return;
+
+	self->fscale = fscale;
+	self->dscale = dscale;
+	self->ascale = ascale;
+
+	if(!self->nf)
+		return;
+
+	aa_bell_ramp_prepare(self, 0);
+	aa_bell_ramp_prepare(self, self->nf - 1);
+
+	if(angle || decay)
+		aa_bell_compute_coeffs(self, 0, self->nf, decay);
+	if((angle || decay) && self->wideR2)
+		aa_bell_precision_coeffs(self, 0, self->nf);
+	aa_bell_compute_gains(self, 0, self->nf);
+	aa_bell_compute_point_gains(self, 0, self->nf);
+	self->gainSerial++;
+
+	if((angle || decay) && self->blockP)
+		for(int i = 0; i < self->nf; i++)
+			aa_bell_kernel_block_coeff(self, i);
+}
+
+/** Selects how accurately coefficients are computed in bulk. Single
+    mode updates always use AA_BELL_COEFF_EXACT. Returns the accuracy in
+    use.
+ */
+aa_bell_coeff_t
+aa_bell_set_coeff_accuracy(
+	aa_bell_t self, aa_bell_coeff_t coeff
+) {
+	if((coeff >= AA_BELL_COEFF_EXACT) && (coeff <= AA_BELL_COEFF_TABLE))
+		self->coeff = coeff;
+
+	return self->coeff;
+}
+
+aa_bell_coeff_t
+aa_bell_get_coeff_accuracy(aa_bell_t self) {
+	return self->coeff;
 }
 
 double
@@ -300,65 +990,244 @@ aa_bell_compute_sound_buffer(
 	float *		output
 ) {
 	double total = 0.0;
-	int numResonators = self->nfUsed;
 	int nsamples = self->bufferSize;
 
-	memset((void*)output, 0, sizeof(float) * nsamples);
+	total = aa_bell_render_sound_buffer(self, output, true);
+
+	aa_bell_clamp_buffer(output, nsamples);
+
+	return total;
+}
+
+/** Adds one buffer of this bell into output, without clearing or
+    clamping it, so several bells can be mixed into one bus.
+ */
+double
+aa_bell_mix_sound_buffer(
+	aa_bell_t	self,
+	float *		output
+) {
+	return aa_bell_render_sound_buffer(self, output, false);
+}
+
+/** Renders one buffer of this bell into output, storing it there
+    if store is set and adding it otherwise. Storing spares the caller
+    clearing output, and the kernels a pass over it.
+ */
+double
+aa_bell_render_sound_buffer(
+	aa_bell_t self, float *restrict output, bool store
+) {
+	double total = 0.0;
+	int numResonators;
 
-	for(int i = 0; i < numResonators; i++) {
-		float tmp_twoRCosTheta = self->twoRCosTheta[i];
-		float tmp_R2 = self->R2[i];
-		float tmp_a = self->ampR[i];
-		float tmp_yt_1 = self->yt_1[i];
-		float tmp_yt_2 = self->yt_2[i];
+	aa_bell_apply_params(self);
+	numResonators = self->nfUsed;
 
-		for(int k = 0; k < nsamples; k++) {
-			float ynew = tmp_twoRCosTheta * tmp_yt_1 - tmp_R2 * tmp_yt_2
-			    + tmp_a * self->cosForce[k];
-			tmp_yt_2 = tmp_yt_1;
-			tmp_yt_1 = ynew;
-			output[k] += ynew;
+	if(self->spectral)
+		total = aa_bell_spectral_run(self, output, numResonators, store);
+	else
+		total = aa_bell_run_kernel(self, output, 0, numResonators, store);
 
+	aa_bell_end_block(self);
 
-			if(i == 0)          // only total f0
-				total += fabs(ynew);
-		}
-		self->yt_1[i] = tmp_yt_1;
-		self->yt_2[i] = tmp_yt_2;
-	}
+	return total;
+}
 
-	memset((void*)self->cosForce, 0, sizeof(float) * self->bufferSize);
+typedef float aa_bell_clamp_vec __attribute__((vector_size(16)));
+typedef int32_t aa_bell_clamp_ivec __attribute__((vector_size(16)));
 
-	for(int i = 0; i < self->bufferSize; i++) {
-//		output[i] /= numResonators;
-		// printf("%f\n",buffer[i]);
-		// XXX Realy should saturate...
-		if(output[i] > 1.0)
-			output[i] = 1.0;
-		if(output[i] < -1.0)
-			output[i] = -1.0;
+/** Clips output to +-1, four samples at a time and without branches.
+    Buses that should saturate or limit instead run an aa_output_t over
+    their sum.
+ */
+void
+aa_bell_clamp_buffer(
+	float *output, int nsamples
+) {
+	aa_bell_clamp_vec one = { 1.0f, 1.0f, 1.0f, 1.0f };
+	int i = 0;
+
+	for(; i + 4 <= nsamples; i += 4) {
+		aa_bell_clamp_vec x;
+		aa_bell_clamp_ivec m;
+
+		memcpy(&x, output + i, sizeof(x));
+		m = x < one;
+		x = (aa_bell_clamp_vec)(((aa_bell_clamp_ivec)x & m)
+		    | ((aa_bell_clamp_ivec)one & ~m));
+		m = x > -one;
+		x = (aa_bell_clamp_vec)(((aa_bell_clamp_ivec)x & m)
+		    | ((aa_bell_clamp_ivec)-one & ~m));
+		memcpy(output + i, &x, sizeof(x));
 	}
 
-	return total;
+	for(; i < nsamples; i++) {
+		if(output[i] > 1.0f)
+			output[i] = 1.0f;
+		if(output[i] < -1.0f)
+			output[i] = -1.0f;
+	}
 }
 
 void
 aa_bell_add_energy(
 	aa_bell_t self, float energy, float dur
 ) {
-	int nsamples = (int)(self->srate * dur);
+	aa_bell_add_energy_at(self, energy, dur, 0);
+}
 
-	if(nsamples > self->bufferSize)
-		nsamples = self->bufferSize;
-	if(nsamples <= 1) {
-		self->cosForce[0] = energy;
+/** Adds the part of strike that falls in the block about to be rendered
+    into cosForce, or, if it is at another point than self's, into the
+    rows of the measured points around its point, weighted as its gains
+    mix theirs. Returns true if nothing of it is left for later blocks.
+ */
+static bool
+aa_bell_write_strike(
+	aa_bell_t self, const struct aa_bell_strike_s *strike
+) {
+	int64_t from = strike->start - self->time;
+	int64_t to = from + strike->length;
+	int begin = from > 0 ? (int)(from < self->bufferSize ? from
+	    : self->bufferSize) : 0;
+	int end = to < self->bufferSize ? (int)(to > 0 ? to : 0)
+	    : self->bufferSize;
+
+	if(begin >= end)
+		return to <= self->bufferSize;
+
+	if(strike->point == aa_bell_gains_point(self)) {
+		aa_bell_excite_write(strike, self->cosForce, from, begin, end);
 	} else {
-		for(int i = 0; i < nsamples; i++) {
-			self->cosForce[i] +=
-			    (float)(energy *
-			        (1. - cos(2 * M_PI * (i + 1) / (1 + nsamples))));
+		struct aa_bell_strike_s part = *strike;
+		int p = (int)strike->point;
+		float t = strike->point - p;
+
+		part.energy = (1.0f - t) * strike->energy;
+		aa_bell_excite_write(&part, aa_bell_point_row(self, p), from,
+			begin, end);
+		if(t > 0.0f) {
+			part.energy = t * strike->energy;
+			aa_bell_excite_write(&part, aa_bell_point_row(self, p + 1),
+				from, begin, end);
 		}
 	}
+
+	aa_bell_cull_wake(self);
+	aa_bell_mark_force(self, begin, end);
+
+	return to <= self->bufferSize;
+}
+
+/** Strikes self offset samples into the block about to be rendered, or
+    into a later block if offset is past its end. A force longer than
+    what is left of the block continues into the following ones, and
+    overlapping strikes add up. Returns nonzero if AA_BELL_MAX_STRIKES
+    strikes are already waiting, in which case the strike is dropped.
+ */
+int
+aa_bell_add_energy_at(
+	aa_bell_t self, float energy, float dur, int offset
+) {
+	struct aa_bell_strike_s strike = {
+		.start = self->time + (offset > 0 ? offset : 0),
+		.length = (int)(self->srate * dur),
+		.energy = energy,
+		.point = aa_bell_gains_point(self),
+		.shape = self->excite,
+	};
+
+	if(strike.length < 1)
+		strike.length = 1;
+
+	if(strike.shape == AA_BELL_EXCITE_NOISE) {
+		strike.phase = self->noisePhase;
+		self->noisePhase += (uint32_t)strike.length;
+	}
+
+	if(strike.start + strike.length > self->time + self->bufferSize) {
+		if(self->strikeCount == AA_BELL_MAX_STRIKES)
+			return -1;
+		self->strikes[self->strikeCount++] = strike;
+	}
+
+	aa_bell_write_strike(self, &strike);
+
+	return 0;
+}
+
+/** Adds gain times the bufferSize samples of force to the force of the
+    block about to be rendered, on top of whatever strikes have put
+    there, as a continuous excitation such as audio input would.
+ */
+void
+aa_bell_add_force(
+	aa_bell_t self, const float *force, float gain
+) {
+	float *restrict cosForce = self->cosForce;
+
+	for(int k = 0; k < self->bufferSize; k++)
+		cosForce[k] += gain * force[k];
+
+	aa_bell_cull_wake(self);
+	aa_bell_mark_force(self, 0, self->bufferSize);
+}
+
+/** Sets the force envelope of strikes added from now on. Returns the
+    envelope in effect, which is unchanged if excite is not one.
+ */
+aa_bell_excite_t
+aa_bell_set_excitation(
+	aa_bell_t self, aa_bell_excite_t excite
+) {
+	if((excite >= AA_BELL_EXCITE_RAISED_COSINE)
+	    && (excite <= AA_BELL_EXCITE_NOISE))
+		self->excite = excite;
+
+	return self->excite;
+}
+
+aa_bell_excite_t
+aa_bell_get_excitation(aa_bell_t self) {
+	return self->excite;
+}
+
+/** Moves on to the next block once the current one has been rendered:
+    clears cosForce and writes the force strikes have left for the next
+    block into it. Called by aa_bell_mix_sound_buffer(); anything
+    rendering a bell's modes some other way must call it after each
+    block.
+ */
+void
+aa_bell_end_block(aa_bell_t self) {
+	int kept = 0;
+
+	aa_bell_cull_update(self);
+
+	aa_bell_clear_block_force(self);
+	self->time += self->bufferSize;
+
+	for(int i = 0; i < self->strikeCount; i++) {
+		if(!aa_bell_write_strike(self, &self->strikes[i]))
+			self->strikes[kept++] = self->strikes[i];
+	}
+	self->strikeCount = kept;
+}
+
+/** Drops every strike, including the force already in cosForce.
+ */
+void
+aa_bell_clear_force(aa_bell_t self) {
+	aa_bell_clear_block_force(self);
+	self->strikeCount = 0;
+}
+
+/** Whether strikes will still add force after the block about to be
+    rendered.
+ */
+bool
+aa_bell_has_pending_force(aa_bell_t self) {
+	return self->strikeCount > 0;
 }
 
 
@@ -366,21 +1235,22 @@ void
 aa_bell_set_mode_freq(
 	aa_bell_t self, int res_index, float val
 ) {
-	if(res_index < self->nf)
+	if((res_index >= 0) && (res_index < self->nf) && !aa_bell_unshare(self))
 		self->f[res_index] = val;
 }
 
 void aa_bell_set_angular_decay(
 	aa_bell_t self, int res_index, float val
 ) {
-	if(res_index < self->nf)
+	if((res_index >= 0) && (res_index < self->nf) && !aa_bell_unshare(self))
 		self->d[res_index] = val;
 }
 
 void aa_bell_set_gain(
 	aa_bell_t self, int point, int mode, float val
 ) {
-	if((mode < self->nf) && (point < self->np))
+	if((point >= 0) && (mode >= 0) && (mode < self->nf)
+	    && (point < self->np) && !aa_bell_unshare(self))
 		self->a[mode + point * self->nf] = val;
 }
 
@@ -392,6 +1262,10 @@ int aa_bell_get_point_count(aa_bell_t self) {
 	return self->np;
 }
 
+int aa_bell_get_buffer_size(aa_bell_t self) {
+	return self->bufferSize;
+}
+
 int aa_bell_get_used_mode_count(aa_bell_t self) {
 	return self->nfUsed;
 }
@@ -402,6 +1276,51 @@ void aa_bell_set_used_mode_count(
 	self->nfUsed = nfUsed;
 }
 
+/** Returns the force of the block about to be rendered, for callers
+    that drive the bell themselves. Culled modes are woken, since the
+    force may be anything.
+ */
 float* aa_bell_get_cos_force_ptr(aa_bell_t self) {
+	aa_bell_cull_wake(self);
+	aa_bell_mark_force(self, 0, self->bufferSize);
 	return self->cosForce;
 }
+
+/** Selects the rendering kernel. Kernels wider than the CPU supports
+    are narrowed; returns the kernel actually in use.
+ */
+aa_bell_kernel_t aa_bell_set_kernel(
+	aa_bell_t self, aa_bell_kernel_t kernel
+) {
+	kernel = aa_bell_kernel_resolve(kernel);
+
+	// A shared bell cannot add tables to its model's data.
+	if((kernel == AA_BELL_KERNEL_BLOCK) && !self->blockP
+	    && aa_bell_unshare(self))
+		kernel = aa_bell_kernel_resolve(AA_BELL_KERNEL_AUTO);
+
+	if((kernel == AA_BELL_KERNEL_BLOCK) && !self->blockP) {
+		size_t size = AA_BELL_BLOCK_LEN * self->nf;
+		void *p = NULL, *q = NULL;
+
+		if(posix_memalign(&p, sizeof(float) * AA_BELL_MODE_PAD,
+			sizeof(float) * size)
+		    || posix_memalign(&q, sizeof(float) * AA_BELL_MODE_PAD,
+			sizeof(float) * size)) {
+			free(p);
+			kernel = aa_bell_kernel_resolve(AA_BELL_KERNEL_AUTO);
+		} else {
+			self->blockP = (float*)p;
+			self->blockQ = (float*)q;
+			for(int i = 0; i < self->nf; i++)
+				aa_bell_kernel_block_coeff(self, i);
+		}
+	}
+
+	self->kernel = kernel;
+	return self->kernel;
+}
+
+aa_bell_kernel_t aa_bell_get_kernel(aa_bell_t self) {
+	return self->kernel;
+}
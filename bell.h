@@ -16,6 +16,7 @@
 #endif
 #endif
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -23,16 +24,204 @@ __BEGIN_DECLS
 
 #define AA_BELL_DEFAULT_SRATE       (44100.0f)
 
+/** Strikes a bell holds whose force runs past the block about to be
+    rendered, or starts after it. */
+#define AA_BELL_MAX_STRIKES         (16)
+
+/** Output channels a bell renders in one pass at most. */
+#define AA_BELL_MAX_CHANNELS        (16)
+
 struct aa_bell_s;
 typedef struct aa_bell_s *aa_bell_t;
 
+/** A limit on the modes rendered per block across a set of bells. */
+struct aa_bell_budget_s;
+typedef struct aa_bell_budget_s *aa_bell_budget_t;
+
+/** Memory for a bell and its arrays, given to aa_bell_create_at() or
+    aa_bell_create_shared_at(), must be aligned to this many bytes. */
+#define AA_BELL_ARENA_ALIGN         (64)
+
+/** Blocks for shared bells of one model, handed out and taken back
+    without allocating. */
+struct aa_bell_pool_s;
+typedef struct aa_bell_pool_s *aa_bell_pool_t;
+
+/** Impulse responses of a model that is no longer changed, cached per
+    strike point and contact duration, from which strikes are mixed
+    instead of rendered. */
+struct aa_bell_frozen_s;
+typedef struct aa_bell_frozen_s *aa_bell_frozen_t;
+
+/** Longest response a frozen model caches, in seconds; modes ringing
+    for longer are cut off there. */
+#define AA_BELL_FROZEN_MAX_SECONDS  (30.0)
+
+/** Rendering kernels, in order of increasing width. */
+typedef enum {
+	AA_BELL_KERNEL_AUTO = 0,    //!< Widest kernel this CPU supports.
+	AA_BELL_KERNEL_SCALAR,      //!< One serial loop per mode.
+	AA_BELL_KERNEL_SIMD4,       //!< 4 modes per vector (SSE/NEON).
+	AA_BELL_KERNEL_SIMD8,       //!< 8 modes per vector (AVX2).
+	AA_BELL_KERNEL_SIMD16,      //!< 16 modes per vector (AVX-512).
+	AA_BELL_KERNEL_BLOCK,       //!< Time-parallel state-space blocks,
+	                            //!< for offline renders of long buffers.
+} aa_bell_kernel_t;
+
+/** Accuracy of filter coefficients computed in bulk, by
+    aa_bell_compute_filter(), aa_bell_compute_filter_range() and
+    aa_bell_set_scales(). */
+typedef enum {
+	AA_BELL_COEFF_EXACT = 0,    //!< Double precision libm, one mode at a time.
+	AA_BELL_COEFF_POLY,         //!< Single precision polynomials, a few ulp.
+	AA_BELL_COEFF_TABLE,        //!< Sine and exponential tables with
+	                            //!< a first order correction.
+} aa_bell_coeff_t;
+
+/** Sample type of the reson state and coefficients. */
+typedef enum {
+	AA_BELL_PRECISION_FLOAT = 0,    //!< Single precision, every feature.
+	AA_BELL_PRECISION_DOUBLE,       //!< Double precision, for long renders
+	                                //!< of lightly damped or high-Q modes.
+	AA_BELL_PRECISION_Q31,          //!< 32-bit fixed point, for targets
+	                                //!< without fast floating point.
+	                                //!< One mode at a time, with 64-bit
+	                                //!< products: where floats are fast
+	                                //!< it renders 8-20x slower than
+	                                //!< AA_BELL_PRECISION_FLOAT.
+} aa_bell_precision_t;
+
+/** How blocks are synthesized. Spectral synthesis renders the blocks
+    in which no force is applied from windowed frames of twice the
+    block, built a few bins around each mode and brought back by an
+    inverse FFT, at a cost per mode independent of the block size; the
+    blocks with force, and the one after them, are rendered in time as
+    usual. Each sample is then within 3e-4 (-70 dB) of the time domain
+    render of the sum over the modes of their amplitude when the frame
+    before was started, and usually much closer, as damping only helps.
+    Rendered throughout, the two drift apart by the rounding of the
+    float kernels, and stay within 3e-4 of the largest such sum so far.
+    Which blocks render in time depends on the block size, so spectral
+    synthesis alone gives up identical output across block sizes. */
+typedef enum {
+	AA_BELL_SYNTHESIS_AUTO = 0,     //!< Time, until a crossover holds
+	                                //!< for struck bells too.
+	AA_BELL_SYNTHESIS_TIME,         //!< Reson kernels for every block.
+	AA_BELL_SYNTHESIS_SPECTRAL,     //!< Frames where no force is applied.
+} aa_bell_synthesis_t;
+
+/** Force envelopes of a strike. */
+typedef enum {
+	AA_BELL_EXCITE_RAISED_COSINE = 0,   //!< 1 - cos, a smooth contact.
+	AA_BELL_EXCITE_HALF_SINE,           //!< A sine arch, a harder onset.
+	AA_BELL_EXCITE_NOISE,               //!< Raised cosine times noise,
+	                                    //!< for scraping and rolling.
+} aa_bell_excite_t;
+
+/** Arrangement of multichannel output buffers. */
+typedef enum {
+	AA_BELL_LAYOUT_PLANAR = 0,      //!< One block per channel in turn.
+	AA_BELL_LAYOUT_INTERLEAVED,     //!< One frame of every channel per
+	                                //!< sample.
+} aa_bell_layout_t;
+
+/** Mode parameters that can be changed through the parameter queue. */
+typedef enum {
+	AA_BELL_PARAM_FREQ,         //!< As aa_bell_set_mode_freq().
+	AA_BELL_PARAM_DECAY,        //!< As aa_bell_set_angular_decay().
+	AA_BELL_PARAM_GAIN,         //!< As aa_bell_set_gain().
+} aa_bell_param_t;
+
+struct aa_bell_param_stats_s {
+	/** Messages applied at the start of the last block. */
+	int			depth;
+
+	/** Most messages applied at the start of any block. */
+	int			max_depth;
+
+	/** Modes recomputed in the last block. The other depth - modes
+	    messages were coalesced. */
+	int			modes;
+
+	/** Size of the queue. */
+	int			capacity;
+
+	/** Messages applied in total. */
+	uint64_t	applied;
+
+	/** Messages dropped because the queue was full, in total and
+	    since the block before the last one. */
+	uint64_t	overflow;
+	uint64_t	block_overflow;
+};
+
+struct aa_bell_frozen_stats_s {
+	/** Responses cached, and the memory they hold, in bytes. */
+	int			responses;
+	size_t		bytes;
+
+	/** Longest response, in samples. */
+	int			longest;
+
+	/** Largest bound on what was cut off the end of a response,
+	    relative to its peak: within the noise floor, unless a response
+	    ran for AA_BELL_FROZEN_MAX_SECONDS. */
+	float		tail;
+
+	/** Strikes that found their response prepared, and strikes
+	    dropped because it was not. */
+	uint64_t	hits;
+	uint64_t	misses;
+
+	/** Strikes playing, and those heard in the last block. Each strike
+	    heard costs a multiply-add per sample, where rendering it would
+	    cost a reson update for each of the model's modes used. */
+	int			playing;
+	int			heard;
+	int			modes;
+};
+
 aa_bell_t aa_bell_create(
 	int mode_count, int point_count, int bufferSize, int srate);
 
 aa_bell_t aa_bell_create_from_file(
 	const char *path, int bufferSize, int srate);
+aa_bell_t aa_bell_create_shared(aa_bell_t model);
+aa_bell_t aa_bell_retain(aa_bell_t self);
 void aa_bell_release(aa_bell_t x);
 
+size_t aa_bell_get_arena_size(
+	int mode_count, int point_count, int bufferSize);
+aa_bell_t aa_bell_create_at(
+	void *memory, size_t size,
+	int mode_count, int point_count, int bufferSize, int srate);
+size_t aa_bell_get_shared_arena_size(
+	aa_bell_t model, int bufferSize);
+aa_bell_t aa_bell_create_shared_at(
+	void *memory, size_t size, aa_bell_t model, int bufferSize);
+
+aa_bell_pool_t aa_bell_pool_create(
+	aa_bell_t model, int bell_count, int bufferSize);
+void aa_bell_pool_release(aa_bell_pool_t self);
+aa_bell_t aa_bell_pool_acquire(aa_bell_pool_t self);
+int aa_bell_pool_get_available(aa_bell_pool_t self);
+
+aa_bell_frozen_t aa_bell_frozen_create(
+	aa_bell_t model, int strike_count, float noise_floor);
+void aa_bell_frozen_release(aa_bell_frozen_t self);
+void aa_bell_frozen_purge(aa_bell_frozen_t self);
+int aa_bell_frozen_prepare(
+	aa_bell_frozen_t self, float point, float dur);
+int aa_bell_frozen_strike(
+	aa_bell_frozen_t self, float energy, float dur, float point, int offset);
+void aa_bell_frozen_clear_history(aa_bell_frozen_t self);
+int aa_bell_frozen_mix_sound_buffer(
+	aa_bell_frozen_t self, float *output);
+int aa_bell_frozen_compute_sound_buffer(
+	aa_bell_frozen_t self, float *output);
+void aa_bell_frozen_get_stats(
+	aa_bell_frozen_t self, struct aa_bell_frozen_stats_s *stats);
+
 void aa_bell_set_mode_freq(
 	aa_bell_t self, int res_index, float val);
 void aa_bell_set_angular_decay(
@@ -41,10 +230,40 @@ void aa_bell_set_gain(
 	aa_bell_t self, int point, int mode, float val);
 int aa_bell_get_mode_count(aa_bell_t self);
 int aa_bell_get_point_count(aa_bell_t self);
+int aa_bell_set_strike_point(
+	aa_bell_t self, float point);
+float aa_bell_get_strike_point(aa_bell_t self);
+int aa_bell_get_buffer_size(aa_bell_t self);
 int aa_bell_get_used_mode_count(aa_bell_t self);
 void aa_bell_set_used_mode_count(
 	aa_bell_t self, int nfUsed);
 float* aa_bell_get_cos_force_ptr(aa_bell_t self);
+aa_bell_kernel_t aa_bell_set_kernel(
+	aa_bell_t self, aa_bell_kernel_t kernel);
+aa_bell_kernel_t aa_bell_get_kernel(aa_bell_t self);
+aa_bell_coeff_t aa_bell_set_coeff_accuracy(
+	aa_bell_t self, aa_bell_coeff_t coeff);
+aa_bell_coeff_t aa_bell_get_coeff_accuracy(aa_bell_t self);
+aa_bell_precision_t aa_bell_set_precision(
+	aa_bell_t self, aa_bell_precision_t precision);
+aa_bell_precision_t aa_bell_get_precision(aa_bell_t self);
+aa_bell_synthesis_t aa_bell_set_synthesis(
+	aa_bell_t self, aa_bell_synthesis_t synthesis);
+aa_bell_synthesis_t aa_bell_get_synthesis(aa_bell_t self);
+void aa_bell_set_scales(
+	aa_bell_t self, float fscale, float dscale, float ascale);
+int aa_bell_set_smoothing(
+	aa_bell_t self, bool enable);
+bool aa_bell_get_smoothing(aa_bell_t self);
+int aa_bell_set_cull_threshold(
+	aa_bell_t self, float threshold);
+float aa_bell_get_cull_threshold(aa_bell_t self);
+int aa_bell_get_live_mode_count(aa_bell_t self);
+bool aa_bell_is_quiet(aa_bell_t self);
+int aa_bell_set_mode_budget(
+	aa_bell_t self, int modes);
+int aa_bell_get_mode_budget(aa_bell_t self);
+int aa_bell_get_dropped_mode_count(aa_bell_t self);
 
 void aa_bell_compute_location(
 	aa_bell_t self, int i);
@@ -55,16 +274,70 @@ void aa_bell_compute_reson_coeff(
 	aa_bell_t self, int i);
 void aa_bell_add_energy(
 	aa_bell_t self, float energy, float dur);
+int aa_bell_add_energy_at(
+	aa_bell_t self, float energy, float dur, int offset);
+void aa_bell_add_force(
+	aa_bell_t self, const float *force, float gain);
+void aa_bell_clear_force(aa_bell_t self);
+aa_bell_excite_t aa_bell_set_excitation(
+	aa_bell_t self, aa_bell_excite_t excite);
+aa_bell_excite_t aa_bell_get_excitation(aa_bell_t self);
+void aa_bell_prepare_excitation(
+	aa_bell_t self, float dur);
+bool aa_bell_has_pending_force(aa_bell_t self);
 
 void aa_bell_compute_filter(aa_bell_t self);
+void aa_bell_compute_filter_range(
+	aa_bell_t self, int begin, int end);
+
+int aa_bell_create_param_queue(
+	aa_bell_t self, int capacity);
+int aa_bell_post_param(
+	aa_bell_t self, aa_bell_param_t param, int point, int mode, float value);
+int aa_bell_apply_params(aa_bell_t self);
+void aa_bell_get_param_stats(
+	aa_bell_t self, struct aa_bell_param_stats_s *stats);
 
 double aa_bell_compute_sound_buffer(
 	aa_bell_t self, float *output);
+double aa_bell_mix_sound_buffer(
+	aa_bell_t self, float *output);
+int aa_bell_set_channel_count(
+	aa_bell_t self, int channels);
+int aa_bell_get_channel_count(aa_bell_t self);
+int aa_bell_set_channel_pan(
+	aa_bell_t self, int channel, float gain);
+int aa_bell_set_channel_point(
+	aa_bell_t self, int channel, float point);
+double aa_bell_compute_channels(
+	aa_bell_t self, float *output, aa_bell_layout_t layout);
+double aa_bell_mix_channels(
+	aa_bell_t self, float *output, aa_bell_layout_t layout);
+void aa_bell_clamp_buffer(
+	float *output, int nsamples);
 
 void aa_bell_clear_history(aa_bell_t self);
 
+aa_bell_budget_t aa_bell_budget_create(
+	aa_bell_t model, int bell_count, int modes);
+void aa_bell_budget_release(aa_bell_budget_t self);
+int aa_bell_budget_attach(
+	aa_bell_budget_t self, aa_bell_t bell);
+void aa_bell_budget_detach(
+	aa_bell_budget_t self, aa_bell_t bell);
+void aa_bell_budget_set_modes(
+	aa_bell_budget_t self, int modes);
+int aa_bell_budget_get_modes(aa_bell_budget_t self);
+int aa_bell_budget_get_dropped_count(aa_bell_budget_t self);
+int aa_bell_budget_select(
+	aa_bell_budget_t self, aa_bell_t *bells, int count);
+
 void aa_bell_dump(
 	aa_bell_t self, FILE* outfile);
+int aa_bell_write_text(
+	aa_bell_t self, FILE *outfile);
+int aa_bell_write_binary(
+	aa_bell_t self, FILE *outfile, const int *srates, int srate_count);
 
 __END_DECLS
 #endif                          // #ifndef __AA_BELL_H__
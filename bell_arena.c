@@ -0,0 +1,286 @@
+//
+//  bell_arena.c
+//
+//  Bells created in one block. A bell and all the arrays it is created
+//  with share a single cache-line-aligned block, laid out in the order
+//  rendering touches them, so that creating and releasing a bell is one
+//  allocation, or none when the caller provides the memory, and a
+//  voice's hot data sits on neighbouring lines instead of wherever the
+//  heap had room. Pools keep blocks for the shared bells of one model,
+//  for workloads that start and stop a bell per impact.
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bell_private.h"
+
+#define AA_ARENA_ROUND(bytes) \
+	(((bytes) + AA_BELL_ARENA_ALIGN - 1) & ~(size_t)(AA_BELL_ARENA_ALIGN - 1))
+
+/** Byte offsets of a bell's arrays from the start of its block. The
+    force and filter state come first, as every block writes them, then
+    the coefficients the kernels read with them, then what is only read
+    when coefficients or gains are recomputed. A shared bell's block
+    holds only its force and filter state, and the gains it takes once
+    moved. The force and gains of each point are only there for models
+    of several points.
+ */
+struct aa_arena_layout_s {
+	size_t	cosForce;
+	size_t	yt_1, yt_2;
+	size_t	pointForce, pointForced;
+	size_t	twoRCosTheta, R2, ampR, pointAmpR;
+	size_t	c_i, f, d, a;
+	size_t	ownAmpR;
+	size_t	size;
+};
+
+static size_t
+aa_arena_take(
+	size_t *offset, size_t bytes
+) {
+	size_t ret = *offset;
+
+	*offset += AA_ARENA_ROUND(bytes);
+
+	return ret;
+}
+
+static void
+aa_arena_layout(
+	struct aa_arena_layout_s *layout, int nf, int np, int bufferSize,
+	bool shared
+) {
+	size_t modes = sizeof(float) * AA_BELL_PADDED_MODE_COUNT(nf);
+	size_t offset = AA_ARENA_ROUND(sizeof(struct aa_bell_s));
+
+	memset(layout, 0, sizeof(*layout));
+
+	layout->cosForce = aa_arena_take(&offset, sizeof(float) * bufferSize);
+	layout->yt_1 = aa_arena_take(&offset, modes);
+	layout->yt_2 = aa_arena_take(&offset, modes);
+
+	if(np > 1) {
+		layout->pointForce = aa_arena_take(&offset,
+			sizeof(float) * bufferSize * np);
+		layout->pointForced = aa_arena_take(&offset, sizeof(int) * np);
+	}
+
+	if(!shared) {
+		layout->twoRCosTheta = aa_arena_take(&offset, modes);
+		layout->R2 = aa_arena_take(&offset, modes);
+		layout->ampR = aa_arena_take(&offset, modes);
+		if(np > 1)
+			layout->pointAmpR = aa_arena_take(&offset, modes * np);
+		layout->c_i = aa_arena_take(&offset, modes);
+		layout->f = aa_arena_take(&offset, sizeof(float) * nf);
+		layout->d = aa_arena_take(&offset, sizeof(float) * nf);
+		layout->a = aa_arena_take(&offset, sizeof(float) * nf * np);
+	} else if(np > 1) {
+		layout->ownAmpR = aa_arena_take(&offset, modes);
+	}
+
+	layout->size = offset;
+}
+
+/** Bytes aa_bell_create_at() needs for a bell of nf modes and np
+    points rendering bufferSize samples at a time.
+ */
+size_t
+aa_bell_get_arena_size(
+	int nf, int np, int bufferSize
+) {
+	struct aa_arena_layout_s layout;
+
+	aa_arena_layout(&layout, nf, np, bufferSize, false);
+
+	return layout.size;
+}
+
+/** Bytes aa_bell_create_shared_at() needs for a shared bell of model
+    rendering bufferSize samples at a time.
+ */
+size_t
+aa_bell_get_shared_arena_size(
+	aa_bell_t model, int bufferSize
+) {
+	struct aa_arena_layout_s layout;
+
+	aa_arena_layout(&layout, model->nf, model->np, bufferSize, true);
+
+	return layout.size;
+}
+
+/** Points the arrays of self, a zeroed bell at the start of a block
+    large enough for them, into the block. A shared bell only gets its
+    force and filter state, and gains of its own if it has several
+    points.
+ */
+void
+aa_bell_arena_place(
+	aa_bell_t self, bool shared
+) {
+	struct aa_arena_layout_s layout;
+	char *block = (char*)self;
+
+	aa_arena_layout(&layout, self->nf, self->np, self->bufferSize, shared);
+
+	self->cosForce = (float*)(block + layout.cosForce);
+	self->yt_1 = (float*)(block + layout.yt_1);
+	self->yt_2 = (float*)(block + layout.yt_2);
+
+	if(self->np > 1) {
+		self->pointForce = (float*)(block + layout.pointForce);
+		self->pointForced = (int*)(block + layout.pointForced);
+	}
+
+	if(!shared) {
+		self->twoRCosTheta = (float*)(block + layout.twoRCosTheta);
+		self->R2 = (float*)(block + layout.R2);
+		self->ampR = (float*)(block + layout.ampR);
+		self->c_i = (float*)(block + layout.c_i);
+		self->f = (float*)(block + layout.f);
+		self->d = (float*)(block + layout.d);
+		self->a = (float*)(block + layout.a);
+		if(self->np > 1)
+			self->pointAmpR = (float*)(block + layout.pointAmpR);
+	} else if(self->np > 1) {
+		self->ownAmpR = (float*)(block + layout.ownAmpR);
+	}
+
+	self->arenaSize = layout.size;
+}
+
+struct aa_bell_pool_s {
+	aa_bell_t	model;
+	int			bufferSize;
+	size_t		slotSize;
+	int			count;
+
+	/** Blocks not in use, as a stack. */
+	void **		free;
+	int			freeCount;
+
+	/** The pool has been released, and goes with its last bell. */
+	bool		released;
+
+	char *		slots;
+};
+
+static void
+aa_bell_pool_free(aa_bell_pool_t self) {
+	aa_bell_release(self->model);
+	free(self->slots);
+	free(self->free);
+	free(self);
+}
+
+/** Creates a pool of bell_count blocks for shared bells of model
+    rendering bufferSize samples at a time. The blocks are allocated
+    and touched here, so that acquiring a bell later neither allocates
+    nor faults pages in, except for what the model's culling or
+    precision keeps per bell, which is allocated as for
+    aa_bell_create_shared(). A pool and its bells are for one thread.
+ */
+aa_bell_pool_t
+aa_bell_pool_create(
+	aa_bell_t model, int count, int bufferSize
+) {
+	aa_bell_pool_t ret = NULL;
+	void *slots = NULL;
+
+	if(count <= 0)
+		goto bail;
+
+	if(model->model)
+		model = model->model;
+
+	ret = calloc(sizeof(*ret), 1);
+
+	if(!ret)
+		goto bail;
+
+	ret->bufferSize = bufferSize;
+	ret->count = count;
+	ret->slotSize = aa_bell_get_shared_arena_size(model, bufferSize);
+	ret->free = calloc(sizeof(void*), count);
+
+	if(!ret->free || posix_memalign(&slots, AA_BELL_ARENA_ALIGN,
+		    ret->slotSize * count)) {
+		free(ret->free);
+		free(ret);
+		ret = NULL;
+		goto bail;
+	}
+
+	ret->slots = slots;
+	memset(ret->slots, 0, ret->slotSize * count);
+
+	// Hand out the lowest blocks first.
+	for(int i = 0; i < count; i++)
+		ret->free[i] = ret->slots + (count - 1 - i) * ret->slotSize;
+	ret->freeCount = count;
+
+	ret->model = aa_bell_retain(model);
+
+bail:
+	return ret;
+}
+
+/** Releases self. Bells still out keep it alive until they are
+    released.
+ */
+void
+aa_bell_pool_release(aa_bell_pool_t self) {
+	self->released = true;
+
+	if(self->freeCount == self->count)
+		aa_bell_pool_free(self);
+}
+
+/** Creates a shared bell of the pool's model in a free block, or
+    returns NULL if there is none. Releasing the bell hands its block
+    back.
+ */
+aa_bell_t
+aa_bell_pool_acquire(aa_bell_pool_t self) {
+	aa_bell_t ret;
+	void *slot;
+
+	if(!self->freeCount)
+		return NULL;
+
+	slot = self->free[--self->freeCount];
+	ret = aa_bell_create_shared_at(slot, self->slotSize, self->model,
+		self->bufferSize);
+
+	if(!ret) {
+		self->freeCount++;
+		return NULL;
+	}
+
+	ret->pool = self;
+
+	return ret;
+}
+
+/** Takes back the block of bell, once released.
+ */
+void
+aa_bell_pool_put(
+	aa_bell_pool_t self, aa_bell_t bell
+) {
+	self->free[self->freeCount++] = bell;
+
+	if(self->released && (self->freeCount == self->count))
+		aa_bell_pool_free(self);
+}
+
+int
+aa_bell_pool_get_available(aa_bell_pool_t self) {
+	return self->freeCount;
+}
@@ -0,0 +1,594 @@
+//
+//  bell_budget.c
+//
+//  Mode budgets. Under a budget, only the modes that would be heard
+//  most among a set of bells are rendered each block, up to a fixed
+//  number; the rest are dropped for the block and decay unheard, so an
+//  overloaded engine loses its quietest detail instead of whole
+//  buffers. Modes are ranked by the power culling already reads off
+//  their state, weighted by a loudness curve and lowered where louder
+//  modes nearby mask them. The kernels render a bell's modes a vector
+//  at a time, so each bell keeps whole vectors of them, or none.
+//
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bell_private.h"
+
+#ifndef M_PI
+#define M_PI                    3.14159265358979323846
+#endif
+
+/** Critical bands, one Bark wide, that masking works within. */
+#define AA_BUDGET_BANDS         (25)
+
+/** A mode below this fraction of the power of the loudest mode in its
+    critical band, or of the same mode of a louder bell, is masked and
+    ranks lower by as much again: about -15 dB. */
+#define AA_BUDGET_MASKING       (0.03f)
+
+/** Masking reaches into the neighbouring bands this much weaker. */
+#define AA_BUDGET_SPREAD        (0.1f)
+
+/** Modes rendered in the last block rank this much higher, so that
+    modes near the cut do not come and go every block. */
+#define AA_BUDGET_HOLD          (2.0f)
+
+/** Modes the pack kernels of few modes advance at once. A bell costs
+    as much for one mode as for this many, so the modes kept of each
+    bell are rounded to a multiple of it. */
+#define AA_BUDGET_VECTOR        (4)
+
+/** Blocks a ranking is kept for, as long as the modes it kept still
+    fit as well as they did. Modes decay by little over a few blocks, so
+    ranking them again every block mostly finds the same cut. */
+#define AA_BUDGET_RANK_BLOCKS   (8)
+
+struct aa_bell_budget_s {
+	/** Modes rendered per block, across all bells ranked. */
+	int		modes;
+
+	/** Modes dropped from the last block. */
+	int		dropped;
+
+	/** Blocks since the last ranking, and how far the modes it kept
+	    went over the budget, since each bell keeps whole vectors. */
+	int		age;
+	int		over;
+
+	/** Scores of every candidate mode, and a copy to select from. */
+	int		capacity;
+	float *	scores;
+	float *	order;
+
+	/** Per mode of owner: the coefficients the entry was made for, its
+	    A-weighting as a power ratio, its critical band, its decay over
+	    a block, and its power in the loudest bell ranked. */
+	aa_bell_t owner;
+	int		nf;
+	float *	key;
+	float *	keyR2;
+	float *	weight;
+	uint8_t * band;
+	float *	decay;
+	float *	loudest;
+};
+
+/** A-weighting of f Hz as a power ratio, 1 at 1 kHz.
+ */
+static float
+aa_budget_a_weight(double f) {
+	double f2 = f * f;
+	double ra = 12194.0 * 12194.0 * f2 * f2
+	    / ((f2 + 20.6 * 20.6) * (f2 + 12194.0 * 12194.0)
+	       * sqrt((f2 + 107.7 * 107.7) * (f2 + 737.9 * 737.9)));
+
+	return (float)(ra * ra * 1.5848932);    // +2 dB
+}
+
+/** Critical band of f Hz, after Zwicker and Terhardt.
+ */
+static int
+aa_budget_band(double f) {
+	double z = 13.0 * atan(0.00076 * f) + 3.5 * atan(f * f / (7500.0 * 7500.0));
+
+	return z < AA_BUDGET_BANDS - 1 ? (int)z : AA_BUDGET_BANDS - 1;
+}
+
+/** Brings the tables up to date with owner's coefficients. Entries are
+    only recomputed for modes whose frequency moved.
+ */
+static void
+aa_budget_update_tables(
+	aa_bell_budget_t self, aa_bell_t owner
+) {
+	if(owner != self->owner) {
+		self->owner = owner;
+		for(int i = 0; i < self->nf; i++)
+			self->key[i] = NAN;
+	}
+
+	for(int i = 0; i < self->nf; i++) {
+		double r, f;
+
+		if((owner->twoRCosTheta[i] == self->key[i])
+		    && (owner->R2[i] == self->keyR2[i]))
+			continue;
+
+		self->key[i] = owner->twoRCosTheta[i];
+		self->keyR2[i] = owner->R2[i];
+		self->decay[i] = powf(owner->R2[i], 0.5f * owner->bufferSize);
+		r = sqrt(owner->R2[i]);
+		f = r > 0.0 ? acos(fmax(-1.0, fmin(1.0,
+		    owner->twoRCosTheta[i] / (2.0 * r)))) * owner->srate / (2. * M_PI)
+		    : 0.0;
+		self->weight[i] = aa_budget_a_weight(f);
+		self->band[i] = (uint8_t)aa_budget_band(f);
+	}
+}
+
+/** Swaps a and b.
+ */
+static void
+aa_budget_swap(float *a, float *b) {
+	float t = *a;
+
+	*a = *b;
+	*b = t;
+}
+
+/** Returns the k-th largest of the count values, 1 <= k <= count,
+    reordering them.
+ */
+static float
+aa_budget_select_kth(
+	float *values, int count, int k
+) {
+	int lo = 0, hi = count - 1;
+
+	k--;
+	while(lo < hi) {
+		float pivot = values[(lo + hi) / 2];
+		int i = lo, j = hi;
+
+		while(i <= j) {
+			while(values[i] > pivot)
+				i++;
+			while(values[j] < pivot)
+				j--;
+			if(i <= j)
+				aa_budget_swap(&values[i++], &values[j--]);
+		}
+
+		if(k <= j)
+			hi = j;
+		else if(k >= i)
+			lo = i;
+		else
+			break;
+	}
+
+	return values[k];
+}
+
+/** Rounds the kept modes of bell, whose count scores from first on are
+    those of its live modes below nfUsed, to the nearest multiple of
+    AA_BUDGET_VECTOR: keeps its best dropped modes, or drops its worst
+    kept ones. Returns the number of modes now kept.
+ */
+static int
+aa_budget_round(
+	aa_bell_budget_t self, aa_bell_t bell, int first, int count, int kept
+) {
+	const float *scores = self->scores + first;
+	int extra = kept % AA_BUDGET_VECTOR;
+	bool keep = 2 * extra >= AA_BUDGET_VECTOR;
+
+	if(keep)
+		extra = AA_BUDGET_VECTOR - extra;
+	if(keep && (kept + extra > count))
+		extra = count - kept;
+
+	for(int n = 0; n < extra; n++) {
+		int best = -1;
+
+		// Live modes below nfUsed come first, in candidate order.
+		for(int j = 0; j < count; j++) {
+			int i = bell->live[j];
+
+			if((bell->drop[i] == keep) && ((best < 0) || (keep
+			        ? scores[j] > scores[best] : scores[j] < scores[best])))
+				best = j;
+		}
+
+		bell->drop[bell->live[best]] = !keep;
+		kept += keep ? 1 : -1;
+	}
+
+	return kept;
+}
+
+/** Whether self may drop modes of bell in the coming block. Bells that
+    are struck in it render every live mode, so that no force is lost,
+    and bells that do not render from a pack cannot leave modes out.
+ */
+static bool
+aa_budget_is_ranked(
+	aa_bell_budget_t self, aa_bell_t bell
+) {
+	return bell->budgeted && bell->pack && !bell->forced
+	    && (bell->kernel != AA_BELL_KERNEL_BLOCK)
+	    && (bell->precision == AA_BELL_PRECISION_FLOAT)
+	    && (bell->nf == self->nf);
+}
+
+/** Creates a budget rendering at most modes modes per block across up
+    to bell_count bells made from model, or sharing it. 0 renders every
+    mode.
+ */
+aa_bell_budget_t
+aa_bell_budget_create(
+	aa_bell_t model, int bell_count, int modes
+) {
+	aa_bell_budget_t ret = NULL;
+	int nf = model->nf;
+
+	if((modes < 0) || (bell_count < 1))
+		goto bail;
+
+	ret = calloc(sizeof(*ret), 1);
+
+	if(!ret)
+		goto bail;
+
+	ret->modes = modes;
+	ret->nf = nf;
+	ret->age = AA_BUDGET_RANK_BLOCKS;
+	ret->capacity = nf * bell_count;
+	ret->scores = calloc(sizeof(float), ret->capacity);
+	ret->order = calloc(sizeof(float), ret->capacity);
+	ret->key = calloc(sizeof(float), nf);
+	ret->keyR2 = calloc(sizeof(float), nf);
+	ret->decay = calloc(sizeof(float), nf);
+	ret->weight = calloc(sizeof(float), nf);
+	ret->band = calloc(sizeof(uint8_t), nf);
+	ret->loudest = calloc(sizeof(float), nf);
+
+	if(!ret->scores || !ret->order || !ret->key || !ret->keyR2
+	    || !ret->decay || !ret->weight || !ret->band || !ret->loudest) {
+		aa_bell_budget_release(ret);
+		ret = NULL;
+	}
+
+bail:
+	return ret;
+}
+
+void
+aa_bell_budget_release(aa_bell_budget_t self) {
+	free(self->scores);
+	free(self->order);
+	free(self->key);
+	free(self->keyR2);
+	free(self->decay);
+	free(self->weight);
+	free(self->band);
+	free(self->loudest);
+	free(self);
+}
+
+/** Lets self drop modes of bell, which needs a live mode list. Call
+    before bell is ranked, outside the audio thread since this may
+    allocate. Returns nonzero if that failed.
+ */
+int
+aa_bell_budget_attach(
+	aa_bell_budget_t self, aa_bell_t bell
+) {
+	(void)self;
+
+	if(aa_bell_enable_pack(bell))
+		return -1;
+
+	bell->budgeted = true;
+
+	return 0;
+}
+
+/** Renders every live mode of bell again, as before it was attached.
+ */
+void
+aa_bell_budget_detach(
+	aa_bell_budget_t self, aa_bell_t bell
+) {
+	(void)self;
+
+	bell->budgeted = false;
+	bell->dropDecay = NULL;
+	if(bell->cullThreshold == 0.0f)
+		aa_bell_release_cull(bell);
+	else
+		aa_bell_cull_wake(bell);
+}
+
+void
+aa_bell_budget_set_modes(
+	aa_bell_budget_t self, int modes
+) {
+	self->modes = modes > 0 ? modes : 0;
+	self->age = AA_BUDGET_RANK_BLOCKS;
+}
+
+int
+aa_bell_budget_get_modes(aa_bell_budget_t self) {
+	return self->modes;
+}
+
+int
+aa_bell_budget_get_dropped_count(aa_bell_budget_t self) {
+	return self->dropped;
+}
+
+/** Chooses which modes of the count bells the coming block renders, the
+    same block for all of them, and marks the rest dropped. Call after
+    the bells' parameters have been applied and before they are
+    rendered, with no more bells than self was created for. Bells struck
+    in the block, or not attached, render every live mode and come off
+    the budget first. What each other bell keeps is rounded to whole
+    vectors, so the budget holds to within half a vector per bell. When
+    every live mode fits, nothing is scored, and a ranking is kept for
+    up to AA_BUDGET_RANK_BLOCKS blocks while the modes it kept, less
+    those culled since, go no further over the budget than they did.
+    Returns the number of modes dropped.
+ */
+int
+aa_bell_budget_select(
+	aa_bell_budget_t self, aa_bell_t *bells, int count
+) {
+	aa_bell_t owner = NULL;
+	int left = self->modes, candidates = 0, above = 0, dropped = 0;
+	int live = 0, held = 0, total = 0;
+	float cut = 0.0f;
+
+	for(int b = 0; b < count; b++) {
+		aa_bell_t bell = bells[b];
+
+		if(aa_budget_is_ranked(self, bell) && self->modes) {
+			if(!owner)
+				owner = bell->model ? bell->model : bell;
+			continue;
+		}
+
+		left -= aa_bell_get_live_mode_count(bell);
+		if(bell->pack) {
+			for(int j = 0; j < bell->liveCount; j++)
+				bell->drop[bell->live[j]] = false;
+		}
+	}
+
+	if(!owner)
+		goto fits;
+
+	if(left < 0)
+		left = 0;
+
+	// Nothing to drop: leave the scoring for blocks that need it.
+	for(int b = 0; b < count; b++) {
+		if(aa_budget_is_ranked(self, bells[b]))
+			live += aa_bell_get_live_mode_count(bells[b]);
+	}
+	if(live <= left) {
+		for(int b = 0; self->dropped && (b < count); b++) {
+			aa_bell_t bell = bells[b];
+
+			for(int j = 0; bell->pack && (j < bell->liveCount); j++)
+				bell->drop[bell->live[j]] = false;
+		}
+		self->age = AA_BUDGET_RANK_BLOCKS;
+		goto fits;
+	}
+
+	// Keep the last ranking while it still holds.
+	for(int b = 0; b < count; b++) {
+		aa_bell_t bell = bells[b];
+
+		if(!aa_budget_is_ranked(self, bell))
+			continue;
+
+		for(int j = 0; j < bell->liveCount; j++) {
+			int i = bell->live[j];
+
+			if(i >= bell->nfUsed)
+				break;
+			if(bell->drop[i])
+				dropped++;
+			else
+				held++;
+		}
+	}
+	if((self->age < AA_BUDGET_RANK_BLOCKS) && (held - left <= self->over)) {
+		self->age++;
+		self->dropped = dropped;
+		return dropped;
+	}
+	dropped = 0;
+
+	aa_budget_update_tables(self, owner);
+	memset(self->loudest, 0, sizeof(float) * self->nf);
+
+	// The same mode of several bells sharing owner masks itself.
+	for(int b = 0; b < count; b++) {
+		aa_bell_t bell = bells[b];
+
+		if(!aa_budget_is_ranked(self, bell)
+		    || ((bell->model ? bell->model : bell) != owner))
+			continue;
+
+		for(int j = 0; j < bell->liveCount; j++) {
+			int i = bell->live[j];
+
+			if(bell->power[i] > self->loudest[i])
+				self->loudest[i] = bell->power[i];
+		}
+	}
+
+	for(int b = 0; b < count; b++) {
+		aa_bell_t bell = bells[b];
+		bool tables = (bell->model ? bell->model : bell) == owner;
+		float bandMax[AA_BUDGET_BANDS] = { 0.0f };
+
+		if(!aa_budget_is_ranked(self, bell))
+			continue;
+
+		bell->dropDecay = tables && (bell->bufferSize == owner->bufferSize)
+		    ? self->decay : NULL;
+
+		for(int j = 0; tables && j < bell->liveCount; j++) {
+			int i = bell->live[j];
+			float s = bell->power[i] * self->weight[i];
+
+			if(s > bandMax[self->band[i]])
+				bandMax[self->band[i]] = s;
+		}
+
+		for(int j = 0; j < bell->liveCount; j++) {
+			int i = bell->live[j];
+			float s = bell->power[i];
+
+			if(i >= bell->nfUsed)
+				break;
+
+			if(tables) {
+				int z = self->band[i];
+				float masker = bandMax[z];
+
+				if(z > 0 && AA_BUDGET_SPREAD * bandMax[z - 1] > masker)
+					masker = AA_BUDGET_SPREAD * bandMax[z - 1];
+				if(z < AA_BUDGET_BANDS - 1
+				    && AA_BUDGET_SPREAD * bandMax[z + 1] > masker)
+					masker = AA_BUDGET_SPREAD * bandMax[z + 1];
+
+				s *= self->weight[i];
+				if((s < AA_BUDGET_MASKING * masker)
+				    || (bell->power[i] < AA_BUDGET_MASKING * self->loudest[i]))
+					s *= AA_BUDGET_MASKING;
+			}
+			if(!bell->drop[i])
+				s *= AA_BUDGET_HOLD;
+
+			self->scores[candidates++] = s;
+		}
+	}
+
+	if(candidates > left) {
+		if(left > 0) {
+			memcpy(self->order, self->scores, sizeof(float) * candidates);
+			cut = aa_budget_select_kth(self->order, candidates, left);
+			for(int c = 0; c < candidates; c++)
+				above += self->scores[c] > cut;
+		} else {
+			cut = INFINITY;
+		}
+	}
+
+	// Keep the candidates above the cut, then ties in bell order, and
+	// round what is kept of each bell to whole vectors.
+	candidates = 0;
+	for(int b = 0; b < count; b++) {
+		aa_bell_t bell = bells[b];
+		int first = candidates, kept = 0;
+
+		if(!aa_budget_is_ranked(self, bell))
+			continue;
+
+		for(int j = 0; j < bell->liveCount; j++) {
+			int i = bell->live[j];
+			float s;
+
+			if(i >= bell->nfUsed) {
+				bell->drop[i] = false;
+				continue;
+			}
+
+			s = self->scores[candidates++];
+			if((s > cut) || ((s == cut) && (above < left))) {
+				above += s == cut;
+				bell->drop[i] = false;
+				kept++;
+			} else {
+				bell->drop[i] = true;
+			}
+		}
+
+		kept = aa_budget_round(self, bell, first, candidates - first, kept);
+		dropped += candidates - first - kept;
+		total += kept;
+	}
+
+	self->dropped = dropped;
+	self->age = 1;
+	self->over = total > left ? total - left : 0;
+
+	return dropped;
+
+fits:
+	self->dropped = 0;
+	return 0;
+}
+
+/** Renders at most modes of self's modes per block, ranked by how much
+    they would be heard; 0 renders every mode. Dropped modes keep
+    decaying and return once they rank high enough again. Shared bells
+    made from self do not inherit the budget. Returns nonzero if it
+    could not be changed.
+ */
+int
+aa_bell_set_mode_budget(
+	aa_bell_t self, int modes
+) {
+	if(modes < 0)
+		return -1;
+
+	if(!modes) {
+		if(self->budget) {
+			aa_bell_budget_detach(self->budget, self);
+			aa_bell_budget_release(self->budget);
+			self->budget = NULL;
+		}
+		return 0;
+	}
+
+	if(!self->budget) {
+		self->budget = aa_bell_budget_create(self, 1, modes);
+
+		if(!self->budget)
+			return -1;
+
+		if(aa_bell_budget_attach(self->budget, self)) {
+			aa_bell_budget_release(self->budget);
+			self->budget = NULL;
+			return -1;
+		}
+	}
+
+	aa_bell_budget_set_modes(self->budget, modes);
+
+	return 0;
+}
+
+int
+aa_bell_get_mode_budget(aa_bell_t self) {
+	return self->budget ? aa_bell_budget_get_modes(self->budget) : 0;
+}
+
+/** Number of live modes the budget left out of the last block.
+ */
+int
+aa_bell_get_dropped_mode_count(aa_bell_t self) {
+	return self->budget ? aa_bell_budget_get_dropped_count(self->budget) : 0;
+}
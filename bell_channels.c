@@ -0,0 +1,256 @@
+//
+//  bell_channels.c
+//
+//  Multichannel output. Every channel hears each mode through a gain
+//  of its own: the gain of the mode at the point the channel picks up
+//  at, as a contact microphone there would, times a pan gain. The modes
+//  are advanced once per sample whatever the number of channels, and
+//  each new output is scattered to all of them, so a channel costs a
+//  multiply-add per mode and sample rather than a bell of its own.
+//
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bell_private.h"
+
+/** Allocates zeroed channel gain rows for nf modes into *gain, freeing
+    the old ones, and returns the row stride, or -1 if out of memory.
+ */
+static int
+aa_channels_alloc_rows(
+	float **gain, int channels, int nf
+) {
+	int stride = AA_BELL_PADDED_MODE_COUNT(nf);
+	size_t size = sizeof(float) * stride * channels;
+	void *rows;
+
+	if(posix_memalign(&rows, sizeof(float) * AA_BELL_MODE_PAD, size))
+		return -1;
+
+	memset(rows, 0, size);
+	free(*gain);
+	*gain = rows;
+
+	return stride;
+}
+
+/** Gives the pack of self rows for the gains of the modes it packs.
+    Returns nonzero if out of memory.
+ */
+int
+aa_bell_channels_alloc_pack(aa_bell_t self) {
+	aa_bell_t pack = self->pack;
+	int stride;
+
+	if(!pack || !self->channelGain)
+		return 0;
+
+	stride = aa_channels_alloc_rows(&pack->channelGain, self->channels,
+		self->nf);
+	if(stride < 0)
+		return -1;
+
+	pack->channels = self->channels;
+	pack->channelStride = stride;
+
+	return 0;
+}
+
+/** Sets the number of output channels self renders with
+    aa_bell_compute_channels(), from 1 to AA_BELL_MAX_CHANNELS. New
+    channels hear every mode at unit gain, as the mono output does,
+    until given a pan or a pickup point. Channels are private to each
+    bell, so voices sharing a model pan independently. Bells at other
+    than float precision render mono only. Returns nonzero if the count
+    is out of range or out of memory.
+ */
+int
+aa_bell_set_channel_count(
+	aa_bell_t self, int channels
+) {
+	int old = self->channelGain ? self->channels : 0;
+	int stride;
+
+	if((channels < 1) || (channels > AA_BELL_MAX_CHANNELS)
+	    || (self->precision != AA_BELL_PRECISION_FLOAT))
+		return -1;
+	if(channels == old)
+		return 0;
+
+	stride = aa_channels_alloc_rows(&self->channelGain, channels, self->nf);
+	if(stride < 0)
+		return -1;
+
+	for(int c = old; c < channels; c++) {
+		self->channelPan[c] = 1.0f;
+		self->channelPoint[c] = -1.0f;
+	}
+	self->channels = channels;
+	self->channelStride = stride;
+	self->channelStale = true;
+
+	if(aa_bell_channels_alloc_pack(self)) {
+		free(self->channelGain);
+		self->channelGain = NULL;
+		self->channels = 1;
+		return -1;
+	}
+
+	aa_bell_channels_update(self);
+
+	return 0;
+}
+
+int
+aa_bell_get_channel_count(aa_bell_t self) {
+	return self->channels;
+}
+
+/** Sets the gain channel applies to everything it hears. Returns
+    nonzero if there is no such channel.
+ */
+int
+aa_bell_set_channel_pan(
+	aa_bell_t self, int channel, float gain
+) {
+	if(!self->channelGain || (channel < 0) || (channel >= self->channels))
+		return -1;
+
+	self->channelPan[channel] = gain;
+	self->channelStale = true;
+
+	return 0;
+}
+
+/** Lets channel pick up the bell at point, whole numbers being the
+    measured points of the model as for aa_bell_set_strike_point(), or
+    hear every mode at unit gain if point is negative. Pickup gains are
+    the model's gains at the point over its largest gain at any point,
+    so that the loudest pickup hears its loudest mode at unit gain.
+    Returns nonzero if there is no such channel or point.
+ */
+int
+aa_bell_set_channel_point(
+	aa_bell_t self, int channel, float point
+) {
+	if(!self->channelGain || (channel < 0) || (channel >= self->channels)
+	    || (point > self->np - 1) || isnan(point))
+		return -1;
+
+	self->channelPoint[channel] = point < 0.0f ? -1.0f : point;
+	self->channelStale = true;
+
+	return 0;
+}
+
+/** Recomputes the channel gain rows of self if a pan or pickup point
+    changed, or the gains of its owner did. Called at the start of each
+    block, before the modes are packed.
+ */
+void
+aa_bell_channels_update(aa_bell_t self) {
+	aa_bell_t owner = self->model ? self->model : self;
+	int nf = self->nf;
+	float peak = 0.0f;
+
+	if(!self->channelGain || (!self->channelStale
+	        && (self->channelSerial == owner->gainSerial)))
+		return;
+
+	for(int i = 0; i < owner->np * nf; i++)
+		if(fabsf(owner->a[i]) > peak)
+			peak = fabsf(owner->a[i]);
+	peak = peak > 0.0f ? 1.0f / peak : 1.0f;
+
+	for(int c = 0; c < self->channels; c++) {
+		float *row = self->channelGain + c * self->channelStride;
+		float pan = self->channelPan[c];
+		float point = self->channelPoint[c];
+		int p = (int)point;
+		float t = point - p;
+		const float *a0 = owner->a + p * nf;
+		const float *a1 = t > 0.0f ? a0 + nf : a0;
+
+		if(point < 0.0f) {
+			for(int i = 0; i < nf; i++)
+				row[i] = pan;
+			continue;
+		}
+
+		for(int i = 0; i < nf; i++)
+			row[i] = pan * peak * (a0[i] + (a1[i] - a0[i]) * t);
+	}
+
+	self->channelSerial = owner->gainSerial;
+	self->channelStale = false;
+}
+
+/** Runs the channel kernel of self over modes [begin, end), as
+    aa_bell_run_kernel() does the mono one.
+ */
+static double
+aa_channels_run(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store,
+	bool interleaved
+) {
+	if(self->packed)
+		return aa_bell_cull_run_channels(self, output, begin, end, store,
+			interleaved);
+
+	return aa_bell_kernel_get_channels_func(self->kernel)(self, output,
+		begin, end, store, interleaved);
+}
+
+/** Renders one buffer of self into the channels of output, storing if
+    store is set and adding otherwise. Bells without channels set up
+    render mono.
+ */
+static double
+aa_channels_render(
+	aa_bell_t self, float *restrict output, aa_bell_layout_t layout,
+	bool store
+) {
+	double total;
+
+	if(!self->channelGain)
+		return aa_bell_render_sound_buffer(self, output, store);
+
+	aa_bell_apply_params(self);
+	total = aa_channels_run(self, output, 0, self->nfUsed, store,
+		layout == AA_BELL_LAYOUT_INTERLEAVED);
+	aa_bell_end_block(self);
+
+	return total;
+}
+
+/** Renders one buffer of self into output, bufferSize samples for each
+    of its channels laid out as layout says, and clamps them to +-1.
+    Returns the sum of |y| of mode 0, as aa_bell_compute_sound_buffer()
+    does.
+ */
+double
+aa_bell_compute_channels(
+	aa_bell_t self, float *output, aa_bell_layout_t layout
+) {
+	double total = aa_channels_render(self, output, layout, true);
+
+	aa_bell_clamp_buffer(output, self->bufferSize * self->channels);
+
+	return total;
+}
+
+/** Adds one buffer of self into the channels of output, without
+    clearing or clamping them, so that several bells can be mixed into
+    one multichannel bus.
+ */
+double
+aa_bell_mix_channels(
+	aa_bell_t self, float *output, aa_bell_layout_t layout
+) {
+	return aa_channels_render(self, output, layout, false);
+}
@@ -0,0 +1,312 @@
+//
+//  bell_coeff.c
+//
+//  Filter coefficients of many modes at once. Retuning a whole model,
+//  for instance sweeping its pitch, recomputes a decay, a cosine and a
+//  sine per mode; the approximate tiers here do that four modes at a
+//  time in single precision instead of calling libm in double.
+//
+
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bell_private.h"
+
+#ifndef M_PI
+#define M_PI                    3.14159265358979323846
+#endif
+
+#define AA_COEFF_LANES          (4)
+
+/** Entries per turn of the sine table. */
+#define AA_COEFF_TABLE_SIZE     (1024)
+
+/** Entries per octave of the exponential table. */
+#define AA_COEFF_EXP_TABLE_SIZE (64)
+
+typedef float aa_coeff_vec
+    __attribute__((vector_size(AA_COEFF_LANES * sizeof(float))));
+typedef int32_t aa_coeff_ivec
+    __attribute__((vector_size(AA_COEFF_LANES * sizeof(int32_t))));
+
+static struct {
+	pthread_once_t once;
+	float	sin[AA_COEFF_TABLE_SIZE];
+	float	cos[AA_COEFF_TABLE_SIZE];
+	float	exp2[AA_COEFF_EXP_TABLE_SIZE];
+} gCoeffTables = {
+	.once = PTHREAD_ONCE_INIT,
+};
+
+static void
+aa_coeff_init_tables(void) {
+	for(int j = 0; j < AA_COEFF_TABLE_SIZE; j++) {
+		gCoeffTables.sin[j] = (float)sin(2. * M_PI * j / AA_COEFF_TABLE_SIZE);
+		gCoeffTables.cos[j] = (float)cos(2. * M_PI * j / AA_COEFF_TABLE_SIZE);
+	}
+	for(int j = 0; j < AA_COEFF_EXP_TABLE_SIZE; j++)
+		gCoeffTables.exp2[j] = (float)exp2(-(double)j / AA_COEFF_EXP_TABLE_SIZE);
+}
+
+static inline aa_coeff_vec
+aa_coeff_select(
+	aa_coeff_ivec mask, aa_coeff_vec a, aa_coeff_vec b
+) {
+	return (aa_coeff_vec)((mask & (aa_coeff_ivec)a)
+	    | (~mask & (aa_coeff_ivec)b));
+}
+
+/** Rounds to the nearest integer, for |x| < 2^22.
+ */
+static inline aa_coeff_vec
+aa_coeff_round(aa_coeff_vec x) {
+	const aa_coeff_vec magic = (aa_coeff_vec) { 0 } + 12582912.0f;
+
+	return (x + magic) - magic;
+}
+
+/** 2^n for integral n in [-126, 127].
+ */
+static inline aa_coeff_vec
+aa_coeff_pow2(aa_coeff_ivec n) {
+	return (aa_coeff_vec)((n + 127) << 23);
+}
+
+/** e^-x by range reduction to |r| <= ln(2)/2 and a degree 7 Taylor
+    polynomial, accurate to a few ulp.
+ */
+static inline aa_coeff_vec
+aa_coeff_exp_neg_poly(aa_coeff_vec x) {
+	aa_coeff_vec y = -x, n, r, p;
+
+	y = aa_coeff_select(y < -87.0f, (aa_coeff_vec) { 0 } - 87.0f, y);
+	y = aa_coeff_select(y > 88.0f, (aa_coeff_vec) { 0 } + 88.0f, y);
+
+	n = aa_coeff_round(y * 1.44269504f);
+	r = y - n * 0.693145751953125f - n * 1.428606765330187e-06f;
+
+	p = 1.0f / 5040.0f + r * (1.0f / 40320.0f);
+	p = 1.0f / 720.0f + r * p;
+	p = 1.0f / 120.0f + r * p;
+	p = 1.0f / 24.0f + r * p;
+	p = 1.0f / 6.0f + r * p;
+	p = 0.5f + r * p;
+	p = 1.0f + r * p;
+	p = 1.0f + r * p;
+
+	return p * aa_coeff_pow2(__builtin_convertvector(n, aa_coeff_ivec));
+}
+
+/** sin and cos by reduction to [-pi/4, pi/4] and Taylor polynomials
+    of degree 9 and 8.
+ */
+static inline void
+aa_coeff_sincos_poly(
+	aa_coeff_vec theta, aa_coeff_vec *s, aa_coeff_vec *c
+) {
+	aa_coeff_vec n = aa_coeff_round(theta * 0.636619772f);
+	aa_coeff_vec x = theta - n * 1.5707963705062866f
+	    - n * -4.371139000186243e-08f;
+	aa_coeff_vec x2 = x * x;
+	aa_coeff_vec sp, cp;
+	aa_coeff_ivec q = __builtin_convertvector(n, aa_coeff_ivec);
+	aa_coeff_ivec swap = (q & 1) != 0;
+
+	sp = -1.0f / 5040.0f + x2 * (1.0f / 362880.0f);
+	sp = 1.0f / 120.0f + x2 * sp;
+	sp = -1.0f / 6.0f + x2 * sp;
+	sp = x + x * x2 * sp;
+
+	cp = 1.0f / 24.0f + x2 * (-1.0f / 720.0f + x2 * (1.0f / 40320.0f));
+	cp = -0.5f + x2 * cp;
+	cp = 1.0f + x2 * cp;
+
+	// Quadrant q: sin is sp, cp, -sp, -cp and cos is cp, -sp, -cp, sp.
+	*s = (aa_coeff_vec)((aa_coeff_ivec)aa_coeff_select(swap, cp, sp)
+	    ^ ((q & 2) << 30));
+	*c = (aa_coeff_vec)((aa_coeff_ivec)aa_coeff_select(swap, sp, cp)
+	    ^ (((q + 1) & 2) << 30));
+}
+
+/** e^-x as 2^k times an octave table entry times a short polynomial
+    for the remaining 1/128 octave.
+ */
+static inline aa_coeff_vec
+aa_coeff_exp_neg_table(aa_coeff_vec x) {
+	aa_coeff_vec y = x * (1.44269504f * AA_COEFF_EXP_TABLE_SIZE), k, r, t;
+	aa_coeff_ivec ik;
+
+	y = aa_coeff_select(y < -127.0f * AA_COEFF_EXP_TABLE_SIZE,
+		(aa_coeff_vec) { 0 } - 127.0f * AA_COEFF_EXP_TABLE_SIZE, y);
+	y = aa_coeff_select(y > 125.0f * AA_COEFF_EXP_TABLE_SIZE,
+		(aa_coeff_vec) { 0 } + 125.0f * AA_COEFF_EXP_TABLE_SIZE, y);
+
+	k = aa_coeff_round(y);
+	ik = __builtin_convertvector(k, aa_coeff_ivec);
+	r = (y - k) * (0.693147181f / AA_COEFF_EXP_TABLE_SIZE);
+
+	for(int l = 0; l < AA_COEFF_LANES; l++)
+		t[l] = gCoeffTables.exp2[ik[l] & (AA_COEFF_EXP_TABLE_SIZE - 1)];
+
+	return t * (1.0f - r * (1.0f - r * (0.5f - r * (1.0f / 6.0f))))
+	    * aa_coeff_pow2(-(ik >> 6));
+}
+
+/** sin and cos from the nearest table entry a and the remainder b by
+    the angle-addition formulas, with sin b = b and cos b = 1 - b^2/2.
+ */
+static inline void
+aa_coeff_sincos_table(
+	aa_coeff_vec theta, aa_coeff_vec *s, aa_coeff_vec *c
+) {
+	aa_coeff_vec n = aa_coeff_round(theta
+	    * (float)(AA_COEFF_TABLE_SIZE / (2. * M_PI)));
+	aa_coeff_vec b = theta
+	    - n * (float)(2. * M_PI / AA_COEFF_TABLE_SIZE)
+	    - n * (float)(2. * M_PI / AA_COEFF_TABLE_SIZE
+	        - (float)(2. * M_PI / AA_COEFF_TABLE_SIZE));
+	aa_coeff_vec cb = 1.0f - 0.5f * b * b;
+	aa_coeff_ivec j = __builtin_convertvector(n, aa_coeff_ivec);
+	aa_coeff_vec sa, ca;
+
+	for(int l = 0; l < AA_COEFF_LANES; l++) {
+		sa[l] = gCoeffTables.sin[j[l] & (AA_COEFF_TABLE_SIZE - 1)];
+		ca[l] = gCoeffTables.cos[j[l] & (AA_COEFF_TABLE_SIZE - 1)];
+	}
+
+	*s = sa * cb + ca * b;
+	*c = ca * cb - sa * b;
+}
+
+/** Computes R2, twoRCosTheta and c_i of modes [begin, end) at the
+    bell's sample rate and scales, with the bell's accuracy. If decay is
+    false the dampings are taken to be unchanged and R is recovered from
+    R2 rather than recomputed. The caller unshares the bell, then
+    recomputes the gains and keeps any derived tables up to date.
+ */
+void
+aa_bell_compute_coeffs(
+	aa_bell_t self, int begin, int end, bool decay
+) {
+	float w = (float)(2. * M_PI / self->srate) * self->fscale;
+	float k = self->dscale / self->srate;
+
+	if(self->coeff == AA_BELL_COEFF_EXACT) {
+		for(int i = begin; i < end; i++) {
+			if(decay) {
+				aa_bell_compute_reson_coeff_at(self, i, self->srate,
+					&self->R2[i], &self->twoRCosTheta[i], &self->c_i[i]);
+			} else {
+				double r = sqrt(self->R2[i]);
+				double theta = 2. * M_PI * self->fscale * self->f[i]
+				    / self->srate;
+
+				self->twoRCosTheta[i] = (float)(2. * cos(theta) * r);
+				self->c_i[i] = (float)(sin(theta) * r);
+			}
+		}
+		return;
+	}
+
+	if(self->coeff == AA_BELL_COEFF_TABLE)
+		pthread_once(&gCoeffTables.once, &aa_coeff_init_tables);
+
+	for(int i = begin; i < end; i += AA_COEFF_LANES) {
+		int n = end - i < AA_COEFF_LANES ? end - i : AA_COEFF_LANES;
+		aa_coeff_vec f = { 0 }, d = { 0 }, r = { 0 };
+		aa_coeff_vec s, c;
+
+		if(n == AA_COEFF_LANES) {
+			memcpy(&f, self->f + i, sizeof(f));
+			if(decay)
+				memcpy(&d, self->d + i, sizeof(d));
+		} else {
+			memcpy(&f, self->f + i, n * sizeof(float));
+			if(decay)
+				memcpy(&d, self->d + i, n * sizeof(float));
+		}
+		if(!decay)
+			for(int l = 0; l < n; l++)
+				r[l] = sqrtf(self->R2[i + l]);
+
+		if(self->coeff == AA_BELL_COEFF_TABLE) {
+			aa_coeff_sincos_table(f * w, &s, &c);
+			if(decay)
+				r = aa_coeff_exp_neg_table(d * k);
+		} else {
+			aa_coeff_sincos_poly(f * w, &s, &c);
+			if(decay)
+				r = aa_coeff_exp_neg_poly(d * k);
+		}
+
+		s *= r;
+		c *= 2.0f * r;
+		r *= r;
+
+		if(decay)
+			memcpy(self->R2 + i, &r, n * sizeof(float));
+		memcpy(self->twoRCosTheta + i, &c, n * sizeof(float));
+		memcpy(self->c_i + i, &s, n * sizeof(float));
+	}
+}
+
+/** Computes ampR of modes [begin, end) from the coefficients and gains
+    of the bell that owns them, at self's strike point.
+ */
+void
+aa_bell_compute_gains(
+	aa_bell_t self, int begin, int end
+) {
+	aa_bell_t owner = self->model ? self->model : self;
+	int p = (int)self->point;
+	float t = self->point - p;
+	const float *a0 = owner->a + p * owner->nf;
+	const float *a1 = t > 0.0f ? a0 + owner->nf : a0;
+	const float *c_i = owner->c_i;
+	float ascale = owner->ascale;
+
+	for(int i = begin; i < end; i += AA_COEFF_LANES) {
+		int n = end - i < AA_COEFF_LANES ? end - i : AA_COEFF_LANES;
+		aa_coeff_vec g0 = { 0 }, g1 = { 0 }, c = { 0 };
+
+		memcpy(&g0, a0 + i, n * sizeof(float));
+		memcpy(&g1, a1 + i, n * sizeof(float));
+		memcpy(&c, c_i + i, n * sizeof(float));
+
+		c = ascale * c * (g0 + (g1 - g0) * t);
+
+		memcpy(self->ampR + i, &c, n * sizeof(float));
+	}
+
+	if(self->wideAmpR)
+		aa_bell_precision_gains(self, begin, end);
+}
+
+/** Computes the gains of modes [begin, end) at every measured point of
+    self, which owns its coefficients, into pointAmpR, for force at
+    other points than its own. Shared bells use their model's.
+ */
+void
+aa_bell_compute_point_gains(
+	aa_bell_t self, int begin, int end
+) {
+	int stride = AA_BELL_PADDED_MODE_COUNT(self->nf);
+
+	if(!self->pointAmpR)
+		return;
+
+	for(int p = 0; p < self->np; p++) {
+		const float *a = self->a + p * self->nf;
+		float *g = self->pointAmpR + p * stride;
+
+		for(int i = begin; i < end; i++)
+			g[i] = self->ascale * self->c_i[i] * a[i];
+	}
+
+	if(self->widePointAmpR)
+		aa_bell_precision_point_gains(self, begin, end);
+}
@@ -0,0 +1,419 @@
+//
+//  bell_cull.c
+//
+//  Adaptive mode culling. After each block, modes whose ringing has
+//  fallen below a threshold are silenced and left out of rendering
+//  until the next strike. The modes still ringing are usually scattered
+//  over the model, so rather than calling the kernels on short runs,
+//  every block packs them into a bell of their own and renders that at
+//  full vector width.
+//
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bell_private.h"
+
+#ifndef M_PI
+#define M_PI                    3.14159265358979323846
+#endif
+
+/** Number of the count modes listed, in increasing order, below mode i.
+ */
+static int
+aa_cull_lower_bound(
+	const int *modes, int count, int i
+) {
+	int lo = 0, hi = count;
+
+	while(lo < hi) {
+		int mid = (lo + hi) / 2;
+
+		if(modes[mid] < i)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/** Few modes render faster on narrow vectors, where the sum across
+    lanes each sample costs less than the modes themselves.
+ */
+static aa_bell_kernel_t
+aa_cull_pack_kernel(
+	aa_bell_kernel_t kernel, int count
+) {
+	if((kernel == AA_BELL_KERNEL_SIMD16) && (count < 96))
+		kernel = AA_BELL_KERNEL_SIMD8;
+	if((kernel == AA_BELL_KERNEL_SIMD8) && (count < 48))
+		kernel = AA_BELL_KERNEL_SIMD4;
+
+	return kernel;
+}
+
+static aa_bell_t
+aa_cull_create_pack(aa_bell_t self) {
+	aa_bell_t ret = calloc(sizeof(*ret), 1);
+	int nf = self->nf;
+
+	if(!ret)
+		goto bail;
+
+	aa_bell_init(ret, nf, 0, self->bufferSize, (int)self->srate);
+
+	ret->R2 = aa_bell_alloc_modes(nf);
+	ret->twoRCosTheta = aa_bell_alloc_modes(nf);
+	ret->ampR = aa_bell_alloc_modes(nf);
+	ret->yt_1 = aa_bell_alloc_modes(nf);
+	ret->yt_2 = aa_bell_alloc_modes(nf);
+	ret->rampR2 = aa_bell_alloc_modes(nf);
+	ret->rampTwoRCosTheta = aa_bell_alloc_modes(nf);
+	ret->rampAmpR = aa_bell_alloc_modes(nf);
+
+	if(!ret->R2 || !ret->twoRCosTheta || !ret->ampR || !ret->yt_1
+	    || !ret->yt_2 || !ret->rampR2 || !ret->rampTwoRCosTheta
+	    || !ret->rampAmpR) {
+		aa_bell_release(ret);
+		ret = NULL;
+	}
+
+bail:
+	return ret;
+}
+
+/** Silences modes of self once their amplitude falls below threshold,
+    in output units, until the next strike; 0 renders every mode.
+    Culling is per bell and shared bells made from self afterwards
+    start with the same threshold. Returns nonzero if it could not be
+    changed.
+ */
+int
+aa_bell_set_cull_threshold(
+	aa_bell_t self, float threshold
+) {
+	if(!(threshold >= 0.0f))
+		return -1;
+
+	if((threshold == 0.0f) && !self->budgeted) {
+		aa_bell_release_cull(self);
+		self->cullThreshold = 0.0f;
+		return 0;
+	}
+
+	if(aa_bell_enable_pack(self))
+		return -1;
+
+	self->cullThreshold = threshold;
+
+	return 0;
+}
+
+/** Gives self a live mode list and a pack, so that modes can be left
+    out of rendering by culling or by a mode budget. Returns nonzero if
+    that failed.
+ */
+int
+aa_bell_enable_pack(aa_bell_t self) {
+	if(self->pack)
+		return 0;
+
+	self->live = calloc(sizeof(int), self->nf);
+	self->render = calloc(sizeof(int), self->nf);
+	self->drop = calloc(sizeof(bool), self->nf);
+	self->power = calloc(sizeof(float), self->nf);
+	self->pack = aa_cull_create_pack(self);
+
+	if(!self->live || !self->render || !self->drop || !self->power
+	    || !self->pack || aa_bell_channels_alloc_pack(self)) {
+		aa_bell_release_cull(self);
+		return -1;
+	}
+
+	aa_bell_cull_wake(self);
+
+	return 0;
+}
+
+float
+aa_bell_get_cull_threshold(aa_bell_t self) {
+	return self->cullThreshold;
+}
+
+/** Number of modes rendered in the next block.
+ */
+int
+aa_bell_get_live_mode_count(aa_bell_t self) {
+	int count = self->pack ? self->liveCount : self->nf;
+
+	return count < self->nfUsed ? count : self->nfUsed;
+}
+
+/** Whether every mode has been culled and no strike is still to come,
+    so that rendering self adds nothing. Always false without culling.
+ */
+bool
+aa_bell_is_quiet(aa_bell_t self) {
+	return self->pack && !self->liveCount && !self->strikeCount;
+}
+
+void
+aa_bell_release_cull(aa_bell_t self) {
+	if(self->pack) {
+		self->pack->cosForce = NULL;
+		aa_bell_release(self->pack);
+	}
+	free(self->live);
+	free(self->render);
+	free(self->drop);
+	free(self->power);
+	self->pack = NULL;
+	self->live = NULL;
+	self->render = NULL;
+	self->drop = NULL;
+	self->power = NULL;
+	self->liveCount = self->renderCount = 0;
+	self->packed = false;
+	self->wakeNext = false;
+}
+
+/** Brings every mode back to life, for force about to be rendered.
+    Modes rendered from a pack wait for the end of the block.
+ */
+void
+aa_bell_cull_wake(aa_bell_t self) {
+	if(!self->pack)
+		return;
+
+	if(self->packed) {
+		self->wakeNext = true;
+		return;
+	}
+
+	for(int i = 0; i < self->nf; i++) {
+		self->live[i] = i;
+		self->drop[i] = false;
+	}
+	self->liveCount = self->nf;
+}
+
+/** Packs the live modes the budget has not dropped for the block
+    about to be rendered, unless that is every mode. Called at the
+    start of each block.
+ */
+void
+aa_bell_cull_pack(aa_bell_t self) {
+	aa_bell_t owner = self->model ? self->model : self;
+	aa_bell_t pack = self->pack;
+	int count = 0, padded;
+
+	if(!pack || (self->kernel == AA_BELL_KERNEL_BLOCK)
+	    || (self->precision != AA_BELL_PRECISION_FLOAT))
+		return;
+
+	for(int j = 0; j < self->liveCount; j++) {
+		int i = self->live[j];
+
+		if(!self->drop[i])
+			self->render[count++] = i;
+	}
+	self->renderCount = count;
+
+	if(count == self->nf)
+		return;
+
+	padded = AA_BELL_PADDED_MODE_COUNT(count);
+
+	for(int j = 0; j < count; j++) {
+		int i = self->render[j];
+
+		pack->R2[j] = self->R2[i];
+		pack->twoRCosTheta[j] = self->twoRCosTheta[i];
+		pack->ampR[j] = self->ampR[i];
+		pack->yt_1[j] = self->yt_1[i];
+		pack->yt_2[j] = self->yt_2[i];
+	}
+	for(int j = count; j < padded; j++)
+		pack->R2[j] = pack->twoRCosTheta[j] = pack->ampR[j]
+		    = pack->yt_1[j] = pack->yt_2[j] = 0.0f;
+
+	for(int c = 0; self->channelGain && (c < self->channels); c++) {
+		const float *from = self->channelGain + c * self->channelStride;
+		float *to = pack->channelGain + c * pack->channelStride;
+
+		for(int j = 0; j < count; j++)
+			to[j] = from[self->render[j]];
+		for(int j = count; j < padded; j++)
+			to[j] = 0.0f;
+	}
+
+	pack->rampBlock = owner->rampBlock;
+	if(owner->rampBlock) {
+		const float *fromAmpR = self->ownGains ? self->ampR
+		    : owner->rampAmpR;
+
+		// Modes outside the ramp span start where they end, so packing
+		// all of them lets the kernels round the span as they like.
+		for(int j = 0; j < count; j++) {
+			int i = self->render[j];
+
+			pack->rampR2[j] = owner->rampR2[i];
+			pack->rampTwoRCosTheta[j] = owner->rampTwoRCosTheta[i];
+			pack->rampAmpR[j] = fromAmpR[i];
+		}
+		for(int j = count; j < padded; j++)
+			pack->rampR2[j] = pack->rampTwoRCosTheta[j]
+			    = pack->rampAmpR[j] = 0.0f;
+
+		pack->rampBegin = aa_cull_lower_bound(self->render, count,
+			owner->rampBegin);
+		pack->rampEnd = aa_cull_lower_bound(self->render, count,
+			owner->rampEnd);
+	}
+
+	pack->nf = count;
+	pack->kernel = aa_cull_pack_kernel(self->kernel, count);
+	pack->cosForce = self->cosForce;
+	self->packed = true;
+}
+
+/** The total of a packed render of [begin, end) for its caller: that
+    of mode 0 if it was packed, or an estimate if the budget dropped it.
+ */
+static double
+aa_cull_total(
+	aa_bell_t self, int begin, int lo, int hi, double total
+) {
+	if((begin == 0) && self->drop[0])
+		return self->bufferSize * 2. / M_PI * sqrt(self->power[0]);
+
+	return (lo < hi) && (lo == 0) && (self->render[0] == 0) ? total : 0.0;
+}
+
+/** Renders the packed modes among [begin, end), into output as a
+    kernel would. Returns the kernel's total, which is of mode 0 only if
+    mode 0 is packed. If the budget dropped mode 0, the total is
+    estimated from its amplitude, as the mean |y| of a sinusoid, so that
+    callers judging silence by it are not misled.
+ */
+double
+aa_bell_cull_run(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store
+) {
+	aa_bell_t pack = self->pack;
+	int lo = aa_cull_lower_bound(self->render, self->renderCount, begin);
+	int hi = aa_cull_lower_bound(self->render, self->renderCount, end);
+	double total;
+
+	if(lo >= hi) {
+		total = 0.0;
+		if(store)
+			memset(output, 0, sizeof(float) * self->bufferSize);
+	} else if(pack->rampBlock) {
+		total = aa_bell_kernel_get_ramp_func(pack->kernel)(
+			pack, output, lo, hi, store);
+	} else {
+		total = aa_bell_kernel_get_func(pack->kernel)(pack, output, lo, hi,
+			store);
+	}
+
+	return aa_cull_total(self, begin, lo, hi, total);
+}
+
+/** Renders the packed modes among [begin, end) into the channels of
+    output, as aa_bell_cull_run() does into one.
+ */
+double
+aa_bell_cull_run_channels(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store,
+	bool interleaved
+) {
+	aa_bell_t pack = self->pack;
+	int lo = aa_cull_lower_bound(self->render, self->renderCount, begin);
+	int hi = aa_cull_lower_bound(self->render, self->renderCount, end);
+	double total;
+
+	if(lo >= hi) {
+		total = 0.0;
+		if(store)
+			memset(output, 0,
+				sizeof(float) * self->bufferSize * self->channels);
+	} else {
+		total = aa_bell_kernel_get_channels_func(pack->kernel)(pack, output,
+			lo, hi, store, interleaved);
+	}
+
+	return aa_cull_total(self, begin, lo, hi, total);
+}
+
+/** Unpacks the state of the block just rendered and culls the modes
+    that have gone quiet, zeroing their state so that a strike starts
+    them from rest. Called at the end of each block, before the next
+    block's force is written.
+
+    Undriven, a reson keeps Q = y1^2 - twoRCosTheta y1 y2 + R2 y2^2
+    decaying by exactly R2 per sample, and Q R2 / c_i^2 is its squared
+    amplitude, so one look at the state is enough. The squared
+    amplitudes are kept in power for the mode budget.
+
+    Modes the budget dropped were not rendered, so they are decayed by
+    the block's R^n in one step instead. Their phase goes astray, which
+    cannot be heard since they come back with a jump anyway.
+ */
+void
+aa_bell_cull_update(aa_bell_t self) {
+	aa_bell_t pack = self->pack;
+	float limit = self->cullThreshold * self->cullThreshold;
+	int kept = 0;
+
+	if(!pack)
+		return;
+
+	if(self->packed) {
+		for(int j = 0; j < self->renderCount; j++) {
+			int i = self->render[j];
+
+			self->yt_1[i] = pack->yt_1[j];
+			self->yt_2[i] = pack->yt_2[j];
+		}
+		self->packed = false;
+	}
+
+	for(int j = 0; j < self->liveCount; j++) {
+		int i = self->live[j];
+		float y1, y2, q;
+
+		if(self->drop[i]) {
+			float decay = self->dropDecay ? self->dropDecay[i]
+			    : powf(self->R2[i], 0.5f * self->bufferSize);
+
+			self->yt_1[i] *= decay;
+			self->yt_2[i] *= decay;
+		}
+
+		y1 = self->yt_1[i];
+		y2 = self->yt_2[i];
+		q = y1 * y1 - self->twoRCosTheta[i] * y1 * y2
+		    + self->R2[i] * y2 * y2;
+		self->power[i] = q * self->R2[i] / (self->c_i[i] * self->c_i[i]);
+
+		if(q * self->R2[i] > limit * self->c_i[i] * self->c_i[i]) {
+			self->live[kept++] = i;
+		} else {
+			self->drop[i] = false;
+			self->yt_1[i] = 0.0f;
+			self->yt_2[i] = 0.0f;
+		}
+	}
+	self->liveCount = kept;
+
+	if(self->wakeNext) {
+		self->wakeNext = false;
+		aa_bell_cull_wake(self);
+	}
+}
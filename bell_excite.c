@@ -0,0 +1,251 @@
+//
+//  bell_excite.c
+//
+//  Force envelopes of strikes. Each envelope is computed once per shape
+//  and length in samples and kept for the life of the process, so a
+//  strike only scales and adds a table instead of calling cos() per
+//  sample. The cache is lock-free, since strikes come from the audio
+//  thread.
+//
+
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bell_private.h"
+
+#ifndef M_PI
+#define M_PI                    3.14159265358979323846
+#endif
+
+/** Envelopes the cache holds; must be a power of two. */
+#define AA_EXCITE_CACHE_SLOTS   (1024)
+
+/** Slots looked at before a lookup gives up. */
+#define AA_EXCITE_CACHE_PROBES  (16)
+
+/** Longest envelope cached, in samples. Longer ones are computed per
+    sample as they are written. */
+#define AA_EXCITE_MAX_CACHED    (32768)
+
+/** Samples of noise; must be a power of two. */
+#define AA_EXCITE_NOISE_SIZE    (8192)
+
+#define AA_EXCITE_LANES         (4)
+
+typedef float aa_excite_vec
+    __attribute__((vector_size(AA_EXCITE_LANES * sizeof(float))));
+
+struct aa_excite_entry_s {
+	uint32_t key;
+	float	env[];
+};
+
+static struct aa_excite_entry_s *gExciteCache[AA_EXCITE_CACHE_SLOTS];
+
+static struct {
+	pthread_once_t once;
+	float	samples[AA_EXCITE_NOISE_SIZE];
+} gExciteNoise = {
+	.once = PTHREAD_ONCE_INIT,
+};
+
+/** Uniform noise of unit RMS, the same in every run.
+ */
+static void
+aa_excite_init_noise(void) {
+	uint32_t state = 22222u;
+
+	for(int j = 0; j < AA_EXCITE_NOISE_SIZE; j++) {
+		state = state * 1664525u + 1013904223u;     // LCG
+		gExciteNoise.samples[j] = (float)(sqrt(3.)
+		    * ((double)(state >> 8) / (1 << 23) - 1.));
+	}
+}
+
+/** The noise shape is the raised cosine envelope times noise, so the
+    two share envelopes.
+ */
+static aa_bell_excite_t
+aa_excite_envelope_shape(aa_bell_excite_t shape) {
+	return shape == AA_BELL_EXCITE_HALF_SINE ? AA_BELL_EXCITE_HALF_SINE
+	       : AA_BELL_EXCITE_RAISED_COSINE;
+}
+
+/** Envelope of shape at sample j of length. Every shape sums to about
+    length, so a strike transfers the same energy whatever its shape.
+ */
+static float
+aa_excite_envelope(
+	aa_bell_excite_t shape, int length, int64_t j
+) {
+	if(length <= 1)
+		return 1.0f;
+
+	if(shape == AA_BELL_EXCITE_HALF_SINE)
+		return (float)(M_PI / 2. * sin(M_PI * (j + 1) / (1 + length)));
+
+	return (float)(1. - cos(2. * M_PI * (j + 1) / (1 + length)));
+}
+
+/** Adds energy * env[k], times noise[k] unless noise is NULL, to
+    output[k] for k in [0, n).
+ */
+static void
+aa_excite_add(
+	float *output, const float *env, const float *noise, float energy, int n
+) {
+	int k = 0;
+
+	for(; k + AA_EXCITE_LANES <= n; k += AA_EXCITE_LANES) {
+		aa_excite_vec o, e;
+
+		memcpy(&o, output + k, sizeof(o));
+		memcpy(&e, env + k, sizeof(e));
+		e *= energy;
+		if(noise) {
+			aa_excite_vec x;
+
+			memcpy(&x, noise + k, sizeof(x));
+			e *= x;
+		}
+		o += e;
+		memcpy(output + k, &o, sizeof(o));
+	}
+
+	for(; k < n; k++)
+		output[k] += noise ? energy * env[k] * noise[k] : energy * env[k];
+}
+
+/** Returns the cached envelope of shape and length, computing it on
+    the first call. Returns NULL if it is too long to cache, the cache
+    is full around its slot or memory ran out; the caller then computes
+    it per sample with aa_excite_envelope().
+ */
+static const float *
+aa_excite_lookup(
+	aa_bell_excite_t shape, int length
+) {
+	struct aa_excite_entry_s *entry = NULL;
+	uint32_t key = ((uint32_t)length << 2) | (uint32_t)shape;
+	uint32_t hash = key * 2654435761u;
+	const float *ret = NULL;
+
+	if(length > AA_EXCITE_MAX_CACHED)
+		return NULL;
+
+	for(int p = 0; p < AA_EXCITE_CACHE_PROBES; p++) {
+		struct aa_excite_entry_s **slot =
+		    &gExciteCache[(hash + p) & (AA_EXCITE_CACHE_SLOTS - 1)];
+		struct aa_excite_entry_s *found =
+		    __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+
+		if(!found) {
+			if(!entry) {
+				entry = malloc(sizeof(*entry) + sizeof(float) * length);
+				if(!entry)
+					goto bail;
+				entry->key = key;
+				for(int j = 0; j < length; j++)
+					entry->env[j] = aa_excite_envelope(shape, length, j);
+			}
+			if(__atomic_compare_exchange_n(slot, &found, entry, false,
+			        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+				ret = entry->env;
+				entry = NULL;
+				goto bail;
+			}
+			// Another thread filled the slot first; found is its entry.
+		}
+
+		if(found->key == key) {
+			ret = found->env;
+			goto bail;
+		}
+	}
+
+bail:
+	free(entry);
+	return ret;
+}
+
+/** Computes the force envelope of a strike of dur seconds with self's
+    excitation ahead of time, so that the first such strike does not
+    allocate on the audio thread.
+ */
+void
+aa_bell_prepare_excitation(
+	aa_bell_t self, float dur
+) {
+	aa_bell_excite_t shape = self->excite;
+	int length = (int)(self->srate * dur);
+
+	if(shape == AA_BELL_EXCITE_NOISE)
+		pthread_once(&gExciteNoise.once, &aa_excite_init_noise);
+	if(length > 1)
+		aa_excite_lookup(aa_excite_envelope_shape(shape), length);
+}
+
+/** Adds samples [begin, end) of strike's force, which starts at sample
+    from of output, to output.
+ */
+void
+aa_bell_excite_write(
+	const struct aa_bell_strike_s *strike, float *output,
+	int64_t from, int begin, int end
+) {
+	aa_bell_excite_t shape = aa_excite_envelope_shape(strike->shape);
+	const float *env = NULL;
+	const float *noise = NULL;
+	float energy = strike->energy;
+
+	if(strike->length <= 1) {
+		for(int k = begin; k < end; k++)
+			output[k] += energy;
+		return;
+	}
+
+	if(strike->shape == AA_BELL_EXCITE_NOISE) {
+		pthread_once(&gExciteNoise.once, &aa_excite_init_noise);
+		noise = gExciteNoise.samples;
+	}
+
+	env = aa_excite_lookup(shape, strike->length);
+
+	if(!env) {
+		for(int k = begin; k < end; k++) {
+			float force = energy
+			    * aa_excite_envelope(shape, strike->length, k - from);
+
+			if(noise)
+				force *= noise[(strike->phase + k - from)
+				    & (AA_EXCITE_NOISE_SIZE - 1)];
+			output[k] += force;
+		}
+		return;
+	}
+
+	env += begin - from;
+	output += begin;
+
+	if(!noise) {
+		aa_excite_add(output, env, NULL, energy, end - begin);
+		return;
+	}
+
+	// Add the noise in runs that do not wrap around its end.
+	for(int k = 0; k < end - begin;) {
+		int j = (int)((strike->phase + begin - from + k)
+		    & (AA_EXCITE_NOISE_SIZE - 1));
+		int n = AA_EXCITE_NOISE_SIZE - j;
+
+		if(n > end - begin - k)
+			n = end - begin - k;
+		aa_excite_add(output + k, env + k, noise + j, energy, n);
+		k += n;
+	}
+}
@@ -0,0 +1,540 @@
+//
+//  bell_file.c
+//
+//  Model files. Two formats are understood:
+//
+//  * Text (.sy): labelled sections of whitespace separated numbers, as
+//    written by the analysis tools. Labels are skipped, not checked.
+//
+//  * Binary (.syb): a 64-byte little-endian header followed by 64-byte
+//    aligned float sections, so a model can be mapped and rendered
+//    without parsing or copying:
+//
+//        header          struct aa_bell_file_header_s
+//        srates          coeff_count uint32 sample rates, padded
+//        f, d            nf floats each, padded
+//        a               nf * np floats, padded
+//        coefficients    for each sample rate: R2, twoRCosTheta, c_i,
+//                        nf floats each, padded
+//
+//    Every section is padded with zeros to AA_BELL_MODE_PAD floats, so
+//    the mode arrays can be used by the SIMD kernels in place. Loading
+//    checks the padding, and that every float is finite.
+//
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bell_private.h"
+
+#define AA_BELL_FILE_VERSION        (1)
+
+/** Limits that keep section sizes well inside 64 bits. Anything larger
+    is taken to be a corrupt file. */
+#define AA_BELL_FILE_MAX_MODES      (1 << 24)
+#define AA_BELL_FILE_MAX_POINTS     (1 << 12)
+#define AA_BELL_FILE_MAX_COEFFS     (64)
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define AA_BELL_FILE_NATIVE         0
+#else
+#define AA_BELL_FILE_NATIVE         1
+#endif
+
+/** Like PNG's, the magic catches files mangled by newline or
+    end-of-file translation. */
+static const uint8_t aa_bell_file_magic[8] = {
+	0x89, 'B', 'E', 'L', '\r', '\n', 0x1A, '\n'
+};
+
+struct aa_bell_file_header_s {
+	uint8_t		magic[8];
+	uint32_t	version;
+
+	/** Offset of the sample rate table. */
+	uint32_t	header_size;
+
+	uint32_t	nf;
+	uint32_t	nf_used;
+	uint32_t	np;
+
+	/** Number of sample rates with precomputed coefficients. */
+	uint32_t	coeff_count;
+
+	float		fscale;
+	float		dscale;
+	float		ascale;
+
+	/** Must be zero. */
+	uint32_t	reserved[3];
+
+	/** Size of the whole file, to catch truncation. */
+	uint64_t	file_size;
+};
+
+/** Size in bytes of a section of count floats, padded. */
+static uint64_t
+aa_bell_file_section_size(uint64_t count) {
+	return sizeof(float) * ((count + AA_BELL_MODE_PAD - 1)
+	       & ~(uint64_t)(AA_BELL_MODE_PAD - 1));
+}
+
+static uint64_t
+aa_bell_file_size(
+	uint32_t nf, uint32_t np, uint32_t coeff_count
+) {
+	return sizeof(struct aa_bell_file_header_s)
+	       + aa_bell_file_section_size(coeff_count)
+	       + 2 * aa_bell_file_section_size(nf)
+	       + aa_bell_file_section_size((uint64_t)nf * np)
+	       + 3 * (uint64_t)coeff_count * aa_bell_file_section_size(nf);
+}
+
+static bool
+aa_bell_file_check_counts(
+	int nf, int nf_used, int np
+) {
+	return (nf > 0) && (nf <= AA_BELL_FILE_MAX_MODES)
+	       && (nf_used >= 0) && (nf_used <= nf)
+	       && (np > 0) && (np <= AA_BELL_FILE_MAX_POINTS);
+}
+
+/* ------------------------------------------------------------------ */
+// Text models
+
+/** Skips a section label such as "frequencies:". Labels are not
+    checked, since older models abbreviate them ("fs:" for "f_scale:").
+    Returns nonzero at the end of the file.
+ */
+static int
+aa_bell_text_skip_label(FILE *fp) {
+	char s[256];
+
+	return fscanf(fp, "%255s", s) != 1;
+}
+
+static int
+aa_bell_text_read_int(
+	FILE *fp, int *value
+) {
+	return fscanf(fp, "%d", value) != 1;
+}
+
+static int
+aa_bell_text_read_float(
+	FILE *fp, float *value
+) {
+	return fscanf(fp, "%f", value) != 1;
+}
+
+static aa_bell_t
+aa_bell_create_from_text(
+	FILE *fp, const char *path, int bufferSize, int srate
+) {
+	aa_bell_t ret = NULL;
+	int nfUsed, nf, np;
+
+	if(aa_bell_text_skip_label(fp)          // nactive_freq:
+	    || aa_bell_text_read_int(fp, &nfUsed)
+	    || aa_bell_text_skip_label(fp)      // n_freq:
+	    || aa_bell_text_read_int(fp, &nf)
+	    || aa_bell_text_skip_label(fp)      // n_points:
+	    || aa_bell_text_read_int(fp, &np)
+	    || !aa_bell_file_check_counts(nf, nfUsed, np))
+		goto corrupt;
+
+	ret = aa_bell_create(nf, np, bufferSize, srate);
+
+	if(!ret)
+		goto bail;
+
+	if(aa_bell_text_skip_label(fp)          // f_scale:
+	    || aa_bell_text_read_float(fp, &ret->fscale)
+	    || aa_bell_text_skip_label(fp)      // d_scale:
+	    || aa_bell_text_read_float(fp, &ret->dscale)
+	    || aa_bell_text_skip_label(fp)      // a_scale:
+	    || aa_bell_text_read_float(fp, &ret->ascale))
+		goto corrupt;
+
+	if(aa_bell_text_skip_label(fp))         // frequencies:
+		goto corrupt;
+	for(int i = 0; i < nf; i++) {
+		if(aa_bell_text_read_float(fp, &ret->f[i]))
+			goto corrupt;
+	}
+	if(aa_bell_text_skip_label(fp))         // dampings:
+		goto corrupt;
+	for(int i = 0; i < nf; i++) {
+		if(aa_bell_text_read_float(fp, &ret->d[i]))
+			goto corrupt;
+	}
+	if(aa_bell_text_skip_label(fp))         // amplitudes[point][freq]:
+		goto corrupt;
+	for(int p = 0; p < np; p++) {
+		for(int i = 0; i < nf; i++) {
+			if(aa_bell_text_read_float(fp, &ret->a[p * nf + i]))
+				goto corrupt;
+		}
+	}
+
+	aa_bell_compute_filter(ret);
+	ret->nfUsed = nfUsed;
+
+	goto bail;
+
+corrupt:
+	fprintf(stderr, "%s: truncated or malformed model\n", path);
+	if(ret) {
+		aa_bell_release(ret);
+		ret = NULL;
+	}
+
+bail:
+	return ret;
+}
+
+/** Writes a model in the text format. Returns nonzero on error.
+ */
+int
+aa_bell_write_text(
+	aa_bell_t self, FILE *outfile
+) {
+	fprintf(outfile, "nactive_freq:\n%d\n", self->nfUsed);
+	fprintf(outfile, "n_freq:\n%d\n", self->nf);
+	fprintf(outfile, "n_points:\n%d\n", self->np);
+	fprintf(outfile, "frequency_scale:\n%.9g\n", self->fscale);
+	fprintf(outfile, "damping_scale:\n%.9g\n", self->dscale);
+	fprintf(outfile, "amplitude_scale:\n%.9g\n", self->ascale);
+	fprintf(outfile, "frequencies:\n");
+	for(int i = 0; i < self->nf; i++)
+		fprintf(outfile, "%.9g\n", self->f[i]);
+	fprintf(outfile, "dampings:\n");
+	for(int i = 0; i < self->nf; i++)
+		fprintf(outfile, "%.9g\n", self->d[i]);
+	fprintf(outfile, "amplitudes[point][freq]:\n");
+	for(int i = 0; i < self->nf * self->np; i++)
+		fprintf(outfile, "%.9g\n", self->a[i]);
+	fprintf(outfile, "END\n");
+
+	return ferror(outfile) ? -1 : 0;
+}
+
+/* ------------------------------------------------------------------ */
+// Binary models
+
+static bool
+aa_bell_file_check_header(
+	const struct aa_bell_file_header_s *header, uint64_t size
+) {
+	if(memcmp(header->magic, aa_bell_file_magic, sizeof(header->magic))
+	    || (header->version != AA_BELL_FILE_VERSION)
+	    || (header->header_size != sizeof(*header))
+	    || header->reserved[0] || header->reserved[1] || header->reserved[2])
+		return false;
+
+	if((header->nf > AA_BELL_FILE_MAX_MODES)
+	    || (header->np > AA_BELL_FILE_MAX_POINTS)
+	    || (header->coeff_count > AA_BELL_FILE_MAX_COEFFS)
+	    || !aa_bell_file_check_counts((int)header->nf, (int)header->nf_used,
+		    (int)header->np))
+		return false;
+
+	if(!isfinite(header->fscale) || !isfinite(header->dscale)
+	    || !isfinite(header->ascale))
+		return false;
+
+	return (header->file_size == size)
+	       && (aa_bell_file_size(header->nf, header->np,
+		           header->coeff_count) == size);
+}
+
+/** Checks a section of count floats: the floats must be finite and the
+    padding after them zero, as the SIMD kernels read it.
+ */
+static bool
+aa_bell_file_check_section(
+	const float *section, uint64_t count
+) {
+	uint64_t padded = aa_bell_file_section_size(count) / sizeof(float);
+
+	for(uint64_t i = 0; i < count; i++) {
+		if(!isfinite(section[i]))
+			return false;
+	}
+	for(uint64_t i = count; i < padded; i++) {
+		if(section[i] != 0.0f)
+			return false;
+	}
+
+	return true;
+}
+
+/** Checks the float sections of a mapped binary model, which follow
+    its sample rate table.
+ */
+static bool
+aa_bell_file_check_sections(
+	const struct aa_bell_file_header_s *header, const char *section
+) {
+	uint64_t nf = header->nf;
+	uint64_t count = nf * header->np;
+
+	if(!aa_bell_file_check_section((const float*)section, nf))
+		return false;
+	section += aa_bell_file_section_size(nf);
+	if(!aa_bell_file_check_section((const float*)section, nf))
+		return false;
+	section += aa_bell_file_section_size(nf);
+	if(!aa_bell_file_check_section((const float*)section, count))
+		return false;
+	section += aa_bell_file_section_size(count);
+
+	for(uint64_t c = 0; c < 3 * (uint64_t)header->coeff_count; c++) {
+		if(!aa_bell_file_check_section((const float*)section, nf))
+			return false;
+		section += aa_bell_file_section_size(nf);
+	}
+
+	return true;
+}
+
+/** Maps a binary model. Mode parameters, and the coefficients for srate
+    if the file has them, are used in place; only the filter state and
+    gains are allocated.
+ */
+static aa_bell_t
+aa_bell_create_from_binary(
+	FILE *fp, const char *path, int bufferSize, int srate
+) {
+	aa_bell_t ret = NULL;
+	void *map = MAP_FAILED;
+	const struct aa_bell_file_header_s *header;
+	const uint32_t *srates;
+	char *section;
+	struct stat st;
+	uint64_t size;
+	int nf, np;
+	bool precomputed = false;
+
+	if(!AA_BELL_FILE_NATIVE) {
+		fprintf(stderr, "%s: binary models need a little-endian host\n",
+			path);
+		goto bail;
+	}
+
+	if(fstat(fileno(fp), &st)) {
+		perror(path);
+		goto bail;
+	}
+
+	size = (uint64_t)st.st_size;
+
+	if(size < sizeof(*header))
+		goto corrupt;
+
+	map = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+		fileno(fp), 0);
+
+	if(map == MAP_FAILED) {
+		perror(path);
+		goto bail;
+	}
+
+	header = (const struct aa_bell_file_header_s*)map;
+
+	if(!aa_bell_file_check_header(header, size)
+	    || !aa_bell_file_check_sections(header, (const char*)map
+	        + header->header_size
+	        + aa_bell_file_section_size(header->coeff_count)))
+		goto corrupt;
+
+	nf = (int)header->nf;
+	np = (int)header->np;
+
+	ret = calloc(sizeof(*ret), 1);
+
+	if(!ret)
+		goto bail;
+
+	aa_bell_init(ret, nf, np, bufferSize, srate);
+	ret->fscale = header->fscale;
+	ret->dscale = header->dscale;
+	ret->ascale = header->ascale;
+
+	ret->map = map;
+	ret->mapSize = (size_t)size;
+	map = MAP_FAILED;
+
+	section = (char*)ret->map + header->header_size;
+	srates = (const uint32_t*)section;
+	section += aa_bell_file_section_size(header->coeff_count);
+
+	ret->f = (float*)section;
+	section += aa_bell_file_section_size(nf);
+	ret->d = (float*)section;
+	section += aa_bell_file_section_size(nf);
+	ret->a = (float*)section;
+	section += aa_bell_file_section_size((uint64_t)nf * np);
+
+	for(uint32_t c = 0; c < header->coeff_count; c++) {
+		if((float)srates[c] == ret->srate) {
+			ret->R2 = (float*)section;
+			ret->twoRCosTheta =
+			    (float*)(section + aa_bell_file_section_size(nf));
+			ret->c_i = (float*)(section + 2 * aa_bell_file_section_size(nf));
+			precomputed = true;
+			break;
+		}
+		section += 3 * aa_bell_file_section_size(nf);
+	}
+
+	if(aa_bell_alloc_arrays(ret)) {
+		aa_bell_release(ret);
+		ret = NULL;
+		goto bail;
+	}
+
+	if(precomputed) {
+		for(int i = 0; i < nf; i++)
+			aa_bell_compute_location(ret, i);
+	} else {
+		aa_bell_compute_filter(ret);
+	}
+	ret->nfUsed = (int)header->nf_used;
+
+	goto bail;
+
+corrupt:
+	fprintf(stderr, "%s: corrupt or unsupported binary model\n", path);
+
+bail:
+	if(map != MAP_FAILED)
+		munmap(map, (size_t)size);
+	return ret;
+}
+
+/** Writes count floats followed by zeros up to the padded section size.
+ */
+static void
+aa_bell_file_write_section(
+	FILE *outfile, const void *data, uint64_t count
+) {
+	static const float zeros[AA_BELL_MODE_PAD];
+	uint64_t padded = aa_bell_file_section_size(count) / sizeof(float);
+
+	fwrite(data, sizeof(float), (size_t)count, outfile);
+	fwrite(zeros, sizeof(float), (size_t)(padded - count), outfile);
+}
+
+/** Writes a model in the binary format, with precomputed coefficients
+    for each of the srate_count sample rates in srates. Returns nonzero
+    on error.
+ */
+int
+aa_bell_write_binary(
+	aa_bell_t self, FILE *outfile, const int *srates, int srate_count
+) {
+	int ret = -1;
+	struct aa_bell_file_header_s header;
+	uint32_t *table = NULL;
+	float *R2 = NULL, *twoRCosTheta = NULL, *c_i = NULL;
+	int nf = self->nf;
+
+	if(!AA_BELL_FILE_NATIVE || (srate_count < 0)
+	    || (srate_count > AA_BELL_FILE_MAX_COEFFS))
+		goto bail;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, aa_bell_file_magic, sizeof(header.magic));
+	header.version = AA_BELL_FILE_VERSION;
+	header.header_size = sizeof(header);
+	header.nf = nf;
+	header.nf_used = self->nfUsed;
+	header.np = self->np;
+	header.coeff_count = srate_count;
+	header.fscale = self->fscale;
+	header.dscale = self->dscale;
+	header.ascale = self->ascale;
+	header.file_size = aa_bell_file_size(nf, self->np, srate_count);
+
+	table = calloc(sizeof(uint32_t), srate_count + 1);
+	R2 = calloc(sizeof(float), nf);
+	twoRCosTheta = calloc(sizeof(float), nf);
+	c_i = calloc(sizeof(float), nf);
+
+	if(!table || !R2 || !twoRCosTheta || !c_i)
+		goto bail;
+
+	for(int c = 0; c < srate_count; c++) {
+		if(srates[c] <= 0)
+			goto bail;
+		table[c] = srates[c];
+	}
+
+	fwrite(&header, sizeof(header), 1, outfile);
+	aa_bell_file_write_section(outfile, table, srate_count);
+	aa_bell_file_write_section(outfile, self->f, nf);
+	aa_bell_file_write_section(outfile, self->d, nf);
+	aa_bell_file_write_section(outfile, self->a, (uint64_t)nf * self->np);
+
+	for(int c = 0; c < srate_count; c++) {
+		for(int i = 0; i < nf; i++) {
+			aa_bell_compute_reson_coeff_at(self, i, srates[c],
+				&R2[i], &twoRCosTheta[i], &c_i[i]);
+		}
+		aa_bell_file_write_section(outfile, R2, nf);
+		aa_bell_file_write_section(outfile, twoRCosTheta, nf);
+		aa_bell_file_write_section(outfile, c_i, nf);
+	}
+
+	if(!ferror(outfile))
+		ret = 0;
+
+bail:
+	free(table);
+	free(R2);
+	free(twoRCosTheta);
+	free(c_i);
+	return ret;
+}
+
+/* ------------------------------------------------------------------ */
+
+/** Loads a model in either format, telling them apart by the binary
+    magic.
+ */
+aa_bell_t
+aa_bell_create_from_file(
+	const char *path, int bufferSize, int srate
+) {
+	aa_bell_t ret = NULL;
+	uint8_t magic[sizeof(aa_bell_file_magic)];
+	FILE* fp;
+
+	fp = fopen(path, "rb");
+
+	if(!fp)
+		goto bail;
+
+	if((fread(magic, 1, sizeof(magic), fp) == sizeof(magic))
+	    && !memcmp(magic, aa_bell_file_magic, sizeof(magic))) {
+		ret = aa_bell_create_from_binary(fp, path, bufferSize, srate);
+	} else {
+		rewind(fp);
+		ret = aa_bell_create_from_text(fp, path, bufferSize, srate);
+	}
+
+bail:
+	if(fp)
+		fclose(fp);
+
+	return ret;
+}
@@ -0,0 +1,472 @@
+//
+//  bell_frozen.c
+//
+//  Strikes played from cached impulse responses. A model that is no
+//  longer changed answers every strike at one point with one contact
+//  duration by a scaled and shifted copy of the same response, so the
+//  response is rendered once, up to where what is left of it falls
+//  below a noise floor, and each strike mixes it in at a multiply-add
+//  per sample, however many modes the model has. Responses are only
+//  rendered by aa_bell_frozen_prepare(), never by a strike.
+//
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bell_private.h"
+
+#define AA_FROZEN_LANES         (4)
+
+typedef float aa_frozen_vec
+    __attribute__((vector_size(AA_FROZEN_LANES * sizeof(float))));
+
+/** Response of the model at point to a strike of unit energy whose
+    force lasts length samples, cut off after size samples. */
+struct aa_frozen_response_s {
+	float	point;
+	int		length;
+	int		size;
+
+	/** Largest |y| of the response, and a bound on what was cut off
+	    its end relative to it. */
+	float	peak;
+	float	tail;
+
+	float	samples[];
+};
+
+/** A strike mixing in response. Position is the sample of the response
+    heard at the start of the next block, negative if the strike starts
+    later. */
+struct aa_frozen_strike_s {
+	const struct aa_frozen_response_s *response;
+	int64_t	position;
+	float	energy;
+};
+
+struct aa_bell_frozen_s {
+	/** Shared bell of the model that renders the responses. */
+	aa_bell_t	bell;
+
+	int			bufferSize;
+
+	/** Responses end where the bound on what is left of them falls to
+	    this fraction of their peak. */
+	float		noiseFloor;
+
+	struct aa_frozen_response_s **responses;
+	int			responseCount;
+	int			responseCapacity;
+
+	struct aa_frozen_strike_s *strikes;
+	int			strikeCount;
+	int			strikeCapacity;
+
+	/** Strikes mixed into the last block. */
+	int			heard;
+
+	/** Strikes that found their response, and those dropped for want
+	    of one. */
+	uint64_t	hits;
+	uint64_t	misses;
+};
+
+/** Creates a cache of the responses of model, and room for strike_count
+    strikes playing them at once. Responses end where the modes still
+    ringing add up to less than noise_floor times their peak, which
+    bounds the error of a strike against rendering it with the model to
+    that. The model must not change while it is frozen, and must not
+    use noise excitation, whose force differs from strike to strike.
+    Responses are rendered in time with model's excitation, at the
+    precision of its modes, by aa_bell_frozen_prepare() for each point
+    and duration to be struck. A cache and its strikes are for one
+    thread.
+ */
+aa_bell_frozen_t
+aa_bell_frozen_create(
+	aa_bell_t model, int strike_count, float noise_floor
+) {
+	aa_bell_frozen_t ret = NULL;
+
+	if((strike_count <= 0) || !(noise_floor > 0.0f)
+	    || !(noise_floor < 1.0f))
+		goto bail;
+
+	ret = calloc(sizeof(*ret), 1);
+
+	if(!ret)
+		goto bail;
+
+	ret->noiseFloor = noise_floor;
+	ret->strikeCapacity = strike_count;
+	ret->strikes = calloc(sizeof(*ret->strikes), strike_count);
+	ret->bell = aa_bell_create_shared(model);
+
+	if(!ret->strikes || !ret->bell
+	    || (aa_bell_set_excitation(ret->bell, aa_bell_get_excitation(model))
+	        == AA_BELL_EXCITE_NOISE)
+	    || (aa_bell_set_synthesis(ret->bell, AA_BELL_SYNTHESIS_TIME)
+	        != AA_BELL_SYNTHESIS_TIME)) {
+		aa_bell_frozen_release(ret);
+		ret = NULL;
+		goto bail;
+	}
+
+	ret->bufferSize = aa_bell_get_buffer_size(ret->bell);
+
+bail:
+	return ret;
+}
+
+void
+aa_bell_frozen_release(aa_bell_frozen_t self) {
+	aa_bell_frozen_purge(self);
+
+	if(self->bell)
+		aa_bell_release(self->bell);
+	free(self->responses);
+	free(self->strikes);
+	free(self);
+}
+
+/** Stops every strike and drops every response, so that the model can
+    be changed and frozen again.
+ */
+void
+aa_bell_frozen_purge(aa_bell_frozen_t self) {
+	for(int i = 0; i < self->responseCount; i++)
+		free(self->responses[i]);
+	self->responseCount = 0;
+	self->strikeCount = 0;
+}
+
+/** Bound on the output of bell from its state on without force: the sum
+    over its modes of the amplitude culling reads off their state.
+ */
+static double
+aa_frozen_amplitude(aa_bell_t bell) {
+	double total = 0.0;
+
+	for(int i = 0; i < bell->nfUsed; i++) {
+		double y1 = bell->yt_1[i];
+		double y2 = bell->yt_2[i];
+		double q = y1 * y1 - bell->twoRCosTheta[i] * y1 * y2
+		    + bell->R2[i] * y2 * y2;
+
+		if(bell->c_i[i] != 0.0f)
+			total += sqrt(fmax(q * bell->R2[i], 0.0)) / fabs(bell->c_i[i]);
+		else
+			total += fabs(y1) + fabs(y2);
+	}
+
+	return total;
+}
+
+/** Makes room for size samples in *response, which holds *capacity.
+    Returns nonzero if out of memory, leaving *response as it was.
+ */
+static int
+aa_frozen_reserve(
+	struct aa_frozen_response_s **response, int *capacity, int size
+) {
+	struct aa_frozen_response_s *grown;
+
+	if(size <= *capacity)
+		return 0;
+
+	if(size < 2 * *capacity)
+		size = 2 * *capacity;
+
+	grown = realloc(*response, sizeof(**response) + sizeof(float) * size);
+
+	if(!grown)
+		return -1;
+
+	*response = grown;
+	*capacity = size;
+
+	return 0;
+}
+
+/** Renders the response at point to a strike of unit energy lasting
+    dur seconds, length samples, a block at a time until the force is
+    spent and the modes still ringing are below the floor, or for
+    AA_BELL_FROZEN_MAX_SECONDS. Samples at the end below the floor are
+    left out too. The response is rendered in place, and trimmed to its
+    size once done. Returns NULL if out of memory.
+ */
+static struct aa_frozen_response_s *
+aa_frozen_render(
+	aa_bell_frozen_t self, float point, float dur, int length
+) {
+	aa_bell_t bell = self->bell;
+	struct aa_frozen_response_s *ret = NULL, *trimmed;
+	int limit = (int)(AA_BELL_FROZEN_MAX_SECONDS * bell->srate);
+	double peak = 0.0, left = 0.0, cut;
+	int size = 0, capacity = 0;
+
+	aa_bell_clear_history(bell);
+	aa_bell_clear_force(bell);
+
+	if((point != aa_bell_get_strike_point(bell))
+	    && aa_bell_set_strike_point(bell, point))
+		goto fail;
+
+	aa_bell_add_energy(bell, 1.0f, dur);
+
+	for(;;) {
+		if(aa_frozen_reserve(&ret, &capacity, size + self->bufferSize))
+			goto fail;
+
+		aa_bell_render_sound_buffer(bell, ret->samples + size, true);
+		for(int k = size; k < size + self->bufferSize; k++)
+			peak = fmax(peak, fabs(ret->samples[k]));
+		size += self->bufferSize;
+
+		left = aa_frozen_amplitude(bell);
+
+		if(size >= limit)
+			break;
+		if(!bell->forced && !aa_bell_has_pending_force(bell)
+		    && (left <= self->noiseFloor * peak))
+			break;
+	}
+
+	cut = self->noiseFloor * peak;
+	while((size > 0) && (fabs(ret->samples[size - 1]) <= cut)) {
+		left = fmax(left, fabs(ret->samples[size - 1]));
+		size--;
+	}
+
+	trimmed = realloc(ret, sizeof(*ret) + sizeof(float) * size);
+	if(trimmed)
+		ret = trimmed;
+
+	ret->point = point;
+	ret->length = length;
+	ret->size = size;
+	ret->peak = (float)peak;
+	ret->tail = peak > 0.0 ? (float)(left / peak) : 0.0f;
+
+	return ret;
+
+fail:
+	free(ret);
+	return NULL;
+}
+
+/** Strikes of the same length in samples, as aa_bell_add_energy_at()
+    counts them, have the same force.
+ */
+static int
+aa_frozen_length(
+	aa_bell_frozen_t self, float dur
+) {
+	int length = (int)(self->bell->srate * dur);
+
+	return length < 1 ? 1 : length;
+}
+
+/** Returns the cached response at point to a strike length samples
+    long, or NULL if it has not been prepared.
+ */
+static const struct aa_frozen_response_s *
+aa_frozen_find(
+	aa_bell_frozen_t self, float point, int length
+) {
+	for(int i = 0; i < self->responseCount; i++) {
+		const struct aa_frozen_response_s *response = self->responses[i];
+
+		if((response->point == point) && (response->length == length))
+			return response;
+	}
+
+	return NULL;
+}
+
+/** Renders the response to a strike at point lasting dur seconds, unless
+    it is cached already. Every point and duration a strike will use
+    must be prepared first, away from the audio thread: rendering a
+    response takes as long as the model takes to ring out. Returns
+    nonzero if point is out of range or out of memory.
+ */
+int
+aa_bell_frozen_prepare(
+	aa_bell_frozen_t self, float point, float dur
+) {
+	int length = aa_frozen_length(self, dur);
+	struct aa_frozen_response_s *response;
+
+	if(!(point >= 0.0f)
+	    || (point > aa_bell_get_point_count(self->bell) - 1))
+		return -1;
+
+	if(aa_frozen_find(self, point, length))
+		return 0;
+
+	if(self->responseCount == self->responseCapacity) {
+		int capacity = self->responseCapacity ? 2 * self->responseCapacity
+		    : 16;
+		struct aa_frozen_response_s **responses = realloc(self->responses,
+			sizeof(*responses) * capacity);
+
+		if(!responses)
+			return -1;
+
+		self->responses = responses;
+		self->responseCapacity = capacity;
+	}
+
+	response = aa_frozen_render(self, point, dur, length);
+
+	if(!response)
+		return -1;
+
+	self->responses[self->responseCount++] = response;
+
+	return 0;
+}
+
+/** Strikes the frozen model at point offset samples into the next
+    buffer, as aa_bell_set_strike_point() and aa_bell_add_energy_at()
+    would. Never renders: returns nonzero, and counts a miss, if the
+    response has not been prepared with aa_bell_frozen_prepare(), and
+    returns nonzero if strike_count strikes are already playing. Either
+    way the strike is dropped.
+ */
+int
+aa_bell_frozen_strike(
+	aa_bell_frozen_t self, float energy, float dur, float point, int offset
+) {
+	const struct aa_frozen_response_s *response;
+
+	if(self->strikeCount == self->strikeCapacity)
+		return -1;
+
+	response = aa_frozen_find(self, point, aa_frozen_length(self, dur));
+
+	if(!response) {
+		self->misses++;
+		return -1;
+	}
+	self->hits++;
+
+	self->strikes[self->strikeCount++] = (struct aa_frozen_strike_s){
+		.response = response,
+		.position = -(int64_t)(offset > 0 ? offset : 0),
+		.energy = energy,
+	};
+
+	return 0;
+}
+
+/** Stops every strike.
+ */
+void
+aa_bell_frozen_clear_history(aa_bell_frozen_t self) {
+	self->strikeCount = 0;
+}
+
+/** Adds energy * samples[k] to output[k] for k in [0, n).
+ */
+static void
+aa_frozen_add(
+	float *output, const float *samples, float energy, int n
+) {
+	int k = 0;
+
+	for(; k + AA_FROZEN_LANES <= n; k += AA_FROZEN_LANES) {
+		aa_frozen_vec o, x;
+
+		memcpy(&o, output + k, sizeof(o));
+		memcpy(&x, samples + k, sizeof(x));
+		o += x * energy;
+		memcpy(output + k, &o, sizeof(o));
+	}
+
+	for(; k < n; k++)
+		output[k] += energy * samples[k];
+}
+
+/** Adds one buffer of every strike playing into output, without
+    clearing or clamping it. Returns the number of strikes heard in it.
+ */
+int
+aa_bell_frozen_mix_sound_buffer(
+	aa_bell_frozen_t self, float *output
+) {
+	int bufferSize = self->bufferSize;
+	int kept = 0;
+
+	self->heard = 0;
+
+	for(int i = 0; i < self->strikeCount; i++) {
+		struct aa_frozen_strike_s strike = self->strikes[i];
+		int64_t position = strike.position;
+		int64_t size = strike.response->size;
+		int begin = position < 0 ? (int)(-position < bufferSize ? -position
+		    : bufferSize) : 0;
+		int end = size - position < bufferSize ? (int)(size - position)
+		    : bufferSize;
+
+		if(begin < end) {
+			aa_frozen_add(output + begin,
+				strike.response->samples + position + begin, strike.energy,
+				end - begin);
+			self->heard++;
+		}
+
+		strike.position += bufferSize;
+		if(strike.position < size)
+			self->strikes[kept++] = strike;
+	}
+	self->strikeCount = kept;
+
+	return self->heard;
+}
+
+/** Renders one buffer of every strike playing into output, clamped as
+    aa_bell_compute_sound_buffer() does. Returns the number of strikes
+    heard in it.
+ */
+int
+aa_bell_frozen_compute_sound_buffer(
+	aa_bell_frozen_t self, float *output
+) {
+	int ret;
+
+	memset(output, 0, sizeof(float) * self->bufferSize);
+	ret = aa_bell_frozen_mix_sound_buffer(self, output);
+	aa_bell_clamp_buffer(output, self->bufferSize);
+
+	return ret;
+}
+
+void
+aa_bell_frozen_get_stats(
+	aa_bell_frozen_t self, struct aa_bell_frozen_stats_s *stats
+) {
+	memset(stats, 0, sizeof(*stats));
+
+	stats->responses = self->responseCount;
+
+	for(int i = 0; i < self->responseCount; i++) {
+		const struct aa_frozen_response_s *response = self->responses[i];
+
+		stats->bytes += sizeof(*response) + sizeof(float) * response->size;
+		if(response->size > stats->longest)
+			stats->longest = response->size;
+		if(response->tail > stats->tail)
+			stats->tail = response->tail;
+	}
+
+	stats->hits = self->hits;
+	stats->misses = self->misses;
+	stats->playing = self->strikeCount;
+	stats->heard = self->heard;
+	stats->modes = aa_bell_get_used_mode_count(self->bell);
+}
@@ -0,0 +1,681 @@
+//
+//  bell_kernel.c
+//
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bell_private.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define AA_KERNEL_X86 1
+#endif
+
+/** Input to mode i at sample k from the force self holds at other
+    points than its own, for the kernels advancing one mode at a time.
+ */
+static inline float
+aa_bell_point_input(
+	aa_bell_t self, int i, int k
+) {
+	int stride = AA_BELL_PADDED_MODE_COUNT(self->nf);
+	float u = 0.0f;
+
+	for(int j = 0; j < self->pointForcedCount; j++) {
+		int p = self->pointForced[j];
+
+		u += self->pointAmpR[p * stride + i]
+		    * self->pointForce[p * self->bufferSize + k];
+	}
+
+	return u;
+}
+
+/** Reference kernel: one serial loop over the buffer per mode.
+ */
+double
+aa_bell_kernel_scalar(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store
+) {
+	double total = 0.0;
+	int nsamples = self->bufferSize;
+	const float *restrict cosForce = self->cosForce;
+	bool points = self->pointForcedCount > 0;
+
+	if(store && (begin >= end))
+		memset(output, 0, sizeof(float) * nsamples);
+
+	for(int i = begin; i < end; i++) {
+		bool first = store && (i == begin);
+		float tmp_twoRCosTheta = self->twoRCosTheta[i];
+		float tmp_R2 = self->R2[i];
+		float tmp_a = self->ampR[i];
+		float tmp_yt_1 = self->yt_1[i];
+		float tmp_yt_2 = self->yt_2[i];
+
+		for(int k = 0; k < nsamples; k++) {
+			float ynew = tmp_twoRCosTheta * tmp_yt_1 - tmp_R2 * tmp_yt_2
+			    + tmp_a * cosForce[k];
+			if(points)
+				ynew += aa_bell_point_input(self, i, k);
+			tmp_yt_2 = tmp_yt_1;
+			tmp_yt_1 = ynew;
+			if(first)
+				output[k] = ynew;
+			else
+				output[k] += ynew;
+
+			if(i == 0)          // only total f0
+				total += fabs(ynew);
+		}
+		self->yt_1[i] = tmp_yt_1;
+		self->yt_2[i] = tmp_yt_2;
+	}
+
+	return total;
+}
+
+/** Reference kernel for blocks that ramp: the coefficients of each
+    mode move linearly from the ones the last block ended with to the
+    current ones, arriving at the last sample. A line between two
+    stable resons stays inside the (convex) stability triangle of
+    (twoRCosTheta, R2), so every intermediate filter is stable too.
+ */
+double
+aa_bell_kernel_scalar_ramp(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store
+) {
+	double total = 0.0;
+	int nsamples = self->bufferSize;
+	aa_bell_t owner = self->model ? self->model : self;
+	const float *fromAmpR = self->ownGains ? self->ampR : owner->rampAmpR;
+	const float *restrict cosForce = self->cosForce;
+	bool points = self->pointForcedCount > 0;
+	float step = 1.0f / nsamples;
+
+	if(store && (begin >= end))
+		memset(output, 0, sizeof(float) * nsamples);
+
+	for(int i = begin; i < end; i++) {
+		bool first = store && (i == begin);
+		float c0 = owner->rampTwoRCosTheta[i];
+		float r0 = owner->rampR2[i];
+		float a0 = fromAmpR[i];
+		float dc = self->twoRCosTheta[i] - c0;
+		float dr = self->R2[i] - r0;
+		float da = self->ampR[i] - a0;
+		float tmp_yt_1 = self->yt_1[i];
+		float tmp_yt_2 = self->yt_2[i];
+
+		for(int k = 0; k < nsamples; k++) {
+			float t = (k + 1) * step;
+			float ynew = (c0 + dc * t) * tmp_yt_1 - (r0 + dr * t) * tmp_yt_2
+			    + (a0 + da * t) * cosForce[k];
+			if(points)
+				ynew += aa_bell_point_input(self, i, k);
+			tmp_yt_2 = tmp_yt_1;
+			tmp_yt_1 = ynew;
+			if(first)
+				output[k] = ynew;
+			else
+				output[k] += ynew;
+
+			if(i == 0)          // only total f0
+				total += fabs(ynew);
+		}
+		self->yt_1[i] = tmp_yt_1;
+		self->yt_2[i] = tmp_yt_2;
+	}
+
+	return total;
+}
+
+#define AA_KERNEL_NAME      aa_bell_kernel_simd4
+#define AA_KERNEL_LANES     4
+#define AA_KERNEL_VEC       aa_v4sf
+#define AA_KERNEL_ATTR
+#include "bell_kernel_lanes.h"
+
+#define AA_KERNEL_NAME      aa_bell_kernel_simd8
+#define AA_KERNEL_LANES     8
+#define AA_KERNEL_VEC       aa_v8sf
+#if AA_KERNEL_X86
+#define AA_KERNEL_ATTR      __attribute__((target("avx2")))
+#else
+#define AA_KERNEL_ATTR
+#endif
+#include "bell_kernel_lanes.h"
+
+#define AA_KERNEL_NAME      aa_bell_kernel_simd16
+#define AA_KERNEL_LANES     16
+#define AA_KERNEL_VEC       aa_v16sf
+#if AA_KERNEL_X86
+#define AA_KERNEL_ATTR      __attribute__((target("avx512f")))
+#else
+#define AA_KERNEL_ATTR
+#endif
+#include "bell_kernel_lanes.h"
+
+#define AA_KERNEL_NAME      aa_bell_kernel_simd4_ramp
+#define AA_KERNEL_LANES     4
+#define AA_KERNEL_VEC       aa_v4sf
+#define AA_KERNEL_ATTR
+#define AA_KERNEL_RAMP      1
+#include "bell_kernel_lanes.h"
+
+#define AA_KERNEL_NAME      aa_bell_kernel_simd8_ramp
+#define AA_KERNEL_LANES     8
+#define AA_KERNEL_VEC       aa_v8sf
+#if AA_KERNEL_X86
+#define AA_KERNEL_ATTR      __attribute__((target("avx2")))
+#else
+#define AA_KERNEL_ATTR
+#endif
+#define AA_KERNEL_RAMP      1
+#include "bell_kernel_lanes.h"
+
+#define AA_KERNEL_NAME      aa_bell_kernel_simd16_ramp
+#define AA_KERNEL_LANES     16
+#define AA_KERNEL_VEC       aa_v16sf
+#if AA_KERNEL_X86
+#define AA_KERNEL_ATTR      __attribute__((target("avx512f")))
+#else
+#define AA_KERNEL_ATTR
+#endif
+#define AA_KERNEL_RAMP      1
+#include "bell_kernel_lanes.h"
+
+/** Reference channel kernel: one serial loop over the buffer per mode,
+    scattering each output to every channel. Modes ramp when the
+    owner's block does, from where they ended the last block.
+ */
+double
+aa_bell_kernel_scalar_channels(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store,
+	bool interleaved
+) {
+	double total = 0.0;
+	int nsamples = self->bufferSize;
+	int channels = self->channels;
+	int chStep = interleaved ? 1 : nsamples;
+	int kStep = interleaved ? channels : 1;
+	aa_bell_t owner = self->model ? self->model : self;
+	bool ramp = owner->rampBlock;
+	const float *fromAmpR = self->ownGains ? self->ampR : owner->rampAmpR;
+	const float *restrict cosForce = self->cosForce;
+	bool points = self->pointForcedCount > 0;
+	float step = 1.0f / nsamples;
+
+	if(store && (begin >= end))
+		memset(output, 0, sizeof(float) * nsamples * channels);
+
+	for(int i = begin; i < end; i++) {
+		bool first = store && (i == begin);
+		float c1 = self->twoRCosTheta[i];
+		float r1 = self->R2[i];
+		float a1 = self->ampR[i];
+		float c0 = ramp ? owner->rampTwoRCosTheta[i] : c1;
+		float r0 = ramp ? owner->rampR2[i] : r1;
+		float a0 = ramp ? fromAmpR[i] : a1;
+		float tmp_yt_1 = self->yt_1[i];
+		float tmp_yt_2 = self->yt_2[i];
+		float g[AA_BELL_MAX_CHANNELS];
+
+		for(int c = 0; c < channels; c++)
+			g[c] = self->channelGain[c * self->channelStride + i];
+
+		for(int k = 0; k < nsamples; k++) {
+			float t = (k + 1) * step;
+			float ynew = (c0 + (c1 - c0) * t) * tmp_yt_1
+			    - (r0 + (r1 - r0) * t) * tmp_yt_2
+			    + (a0 + (a1 - a0) * t) * cosForce[k];
+			float *out = output + k * kStep;
+
+			if(points)
+				ynew += aa_bell_point_input(self, i, k);
+			tmp_yt_2 = tmp_yt_1;
+			tmp_yt_1 = ynew;
+			for(int c = 0; c < channels; c++) {
+				if(first)
+					out[c * chStep] = g[c] * ynew;
+				else
+					out[c * chStep] += g[c] * ynew;
+			}
+
+			if(i == 0)          // only total f0
+				total += fabs(ynew);
+		}
+		self->yt_1[i] = tmp_yt_1;
+		self->yt_2[i] = tmp_yt_2;
+	}
+
+	return total;
+}
+
+#define AA_KERNEL_NAME      aa_bell_kernel_simd4_channels
+#define AA_KERNEL_LANES     4
+#define AA_KERNEL_VEC       aa_v4sf
+#define AA_KERNEL_ATTR
+#include "bell_kernel_channels.h"
+
+#define AA_KERNEL_NAME      aa_bell_kernel_simd8_channels
+#define AA_KERNEL_LANES     8
+#define AA_KERNEL_VEC       aa_v8sf
+#if AA_KERNEL_X86
+#define AA_KERNEL_ATTR      __attribute__((target("avx2")))
+#else
+#define AA_KERNEL_ATTR
+#endif
+#include "bell_kernel_channels.h"
+
+#define AA_KERNEL_NAME      aa_bell_kernel_simd16_channels
+#define AA_KERNEL_LANES     16
+#define AA_KERNEL_VEC       aa_v16sf
+#if AA_KERNEL_X86
+#define AA_KERNEL_ATTR      __attribute__((target("avx512f")))
+#else
+#define AA_KERNEL_ATTR
+#endif
+#include "bell_kernel_channels.h"
+
+#define AA_TYPED_NAME       aa_bell_kernel_scalar_double
+#define AA_TYPED_SAMPLE     double
+#define AA_TYPED_SUM        double
+#define AA_TYPED_INPUT(x)   ((double)(x))
+#define AA_TYPED_STEP(c, r, a, y1, y2, x) \
+	((c) * (y1) - (r) * (y2) + (a) * (x))
+#define AA_TYPED_INJECT(y, a, x) \
+	((y) + (a) * (x))
+#define AA_TYPED_OUTPUT(y)  ((float)(y))
+#include "bell_kernel_typed.h"
+
+#define AA_KERNEL_NAME      aa_bell_kernel_simd4_double
+#define AA_KERNEL_LANES     2
+#define AA_KERNEL_VEC       aa_v2df
+#define AA_KERNEL_ATTR
+#define AA_KERNEL_SAMPLE    double
+#include "bell_kernel_lanes.h"
+
+#define AA_KERNEL_NAME      aa_bell_kernel_simd8_double
+#define AA_KERNEL_LANES     4
+#define AA_KERNEL_VEC       aa_v4df
+#if AA_KERNEL_X86
+#define AA_KERNEL_ATTR      __attribute__((target("avx2")))
+#else
+#define AA_KERNEL_ATTR
+#endif
+#define AA_KERNEL_SAMPLE    double
+#include "bell_kernel_lanes.h"
+
+#define AA_KERNEL_NAME      aa_bell_kernel_simd16_double
+#define AA_KERNEL_LANES     8
+#define AA_KERNEL_VEC       aa_v8df
+#if AA_KERNEL_X86
+#define AA_KERNEL_ATTR      __attribute__((target("avx512f")))
+#else
+#define AA_KERNEL_ATTR
+#endif
+#define AA_KERNEL_SAMPLE    double
+#include "bell_kernel_lanes.h"
+
+/** Force sample x in fixed point, saturated.
+ */
+static inline int32_t
+aa_q31_input(float x) {
+	float q = x * (float)(1 << AA_BELL_Q31_STATE_BITS);
+
+	if(q >= 2147483647.0f)
+		return INT32_MAX;
+	if(q <= -2147483647.0f)
+		return -INT32_MAX;
+
+	return (int32_t)lrintf(q);
+}
+
+/** One fixed point reson step: the feedback and the input are each
+    rounded back to the state's fraction bits from 64-bit products, and
+    the sum is saturated.
+ */
+static inline int32_t
+aa_q31_step(
+	int32_t c, int32_t r, int32_t a, int32_t y1, int32_t y2, int32_t x
+) {
+	int64_t feedback = (int64_t)c * y1 - (int64_t)r * y2;
+	int64_t input = (int64_t)a * x;
+	int64_t y = ((feedback + ((int64_t)1 << (AA_BELL_Q31_COEFF_BITS - 1)))
+	    >> AA_BELL_Q31_COEFF_BITS)
+	    + ((input + ((int64_t)1 << (AA_BELL_Q31_STATE_BITS - 1)))
+	    >> AA_BELL_Q31_STATE_BITS);
+
+	return y > INT32_MAX ? INT32_MAX : y < -INT32_MAX ? -INT32_MAX
+	    : (int32_t)y;
+}
+
+/** y with the input a * x added, rounded as aa_q31_step() rounds it,
+    and saturated.
+ */
+static inline int32_t
+aa_q31_inject(
+	int32_t y, int32_t a, int32_t x
+) {
+	int64_t input = (int64_t)a * x;
+	int64_t v = (int64_t)y
+	    + ((input + ((int64_t)1 << (AA_BELL_Q31_STATE_BITS - 1)))
+	    >> AA_BELL_Q31_STATE_BITS);
+
+	return v > INT32_MAX ? INT32_MAX : v < -INT32_MAX ? -INT32_MAX
+	    : (int32_t)v;
+}
+
+#define AA_TYPED_NAME       aa_bell_kernel_scalar_q31
+#define AA_TYPED_SAMPLE     int32_t
+#define AA_TYPED_SUM        int64_t
+#define AA_TYPED_INPUT(x)   aa_q31_input(x)
+#define AA_TYPED_STEP(c, r, a, y1, y2, x) \
+	aa_q31_step((c), (r), (a), (y1), (y2), (x))
+#define AA_TYPED_INJECT(y, a, x) \
+	aa_q31_inject((y), (a), (x))
+#define AA_TYPED_OUTPUT(y) \
+	((float)(y) * (1.0f / (1 << AA_BELL_Q31_STATE_BITS)))
+#include "bell_kernel_typed.h"
+
+/** Modes without a complex pole pair have no coupled form; the block
+    kernel hands them to the scalar kernel.
+ */
+static inline bool
+aa_bell_block_is_real_pole(
+	aa_bell_t self, int i
+) {
+	double c = self->twoRCosTheta[i];
+	double r2 = self->R2[i];
+
+	return (r2 <= 0.0) || (c * c >= 4.0 * r2);
+}
+
+/** Pole radius and angle of mode i, from the same float coefficients
+    the recurrence uses. Returns false for real poles.
+ */
+static bool
+aa_bell_block_pole(
+	aa_bell_t self, int i, double *r, double *cos_theta, double *sin_theta
+) {
+	if(aa_bell_block_is_real_pole(self, i))
+		return false;
+
+	*r = sqrt((double)self->R2[i]);
+	*cos_theta = self->twoRCosTheta[i] / (2.0 * *r);
+	*sin_theta = sqrt(1.0 - *cos_theta * *cos_theta);
+
+	return true;
+}
+
+/** Fills in the block tables of mode i from its reson coefficients.
+ */
+void
+aa_bell_kernel_block_coeff(
+	aa_bell_t self, int i
+) {
+	float *p = self->blockP + i * AA_BELL_BLOCK_LEN;
+	float *q = self->blockQ + i * AA_BELL_BLOCK_LEN;
+	double r = 0.0, cos_theta = 1.0, sin_theta = 0.0;
+	double theta;
+
+	aa_bell_block_pole(self, i, &r, &cos_theta, &sin_theta);
+	theta = atan2(sin_theta, cos_theta);
+
+	for(int j = 0; j < AA_BELL_BLOCK_LEN; j++) {
+		double rj = pow(r, j + 1);
+
+		p[j] = (float)(rj * cos((j + 1) * theta));
+		q[j] = (float)(-rj * sin((j + 1) * theta));
+	}
+}
+
+/** Time-parallel kernel. Each reson is rotated into its coupled form,
+    where the state (u, v) at the end of the previous sample advances by
+    a scaled rotation. The next AA_BELL_BLOCK_LEN outputs are then
+    y[j] = blockP[j] * u + blockQ[j] * v, computed for all j at once.
+    Force samples enter as impulses (ampR * cosForce, -ampR * cosForce *
+    cot(theta)), with the force at other points added, that are rotated
+    the same way, and only in blocks where the force is nonzero.
+
+    Unlike the (yt_1, yt_2) transition matrix, which is nearly singular
+    for low, lightly damped modes, a rotation is well conditioned, so
+    rounding in the tables does not shift the pole. The state is
+    converted to and from (yt_1, yt_2) once per call.
+ */
+double
+aa_bell_kernel_block(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store
+) {
+	double total = 0.0;
+	int nsamples = self->bufferSize;
+	bool points = self->pointForcedCount > 0;
+	union {
+		aa_v8sf v[AA_BELL_BLOCK_LEN / 8];
+		float	f[AA_BELL_BLOCK_LEN];
+	} y, acc;
+
+	for(int i = begin; i < end; i++) {
+		double r, cos_theta, sin_theta;
+
+		if(aa_bell_block_pole(self, i, &r, &cos_theta, &sin_theta)) {
+			self->yt_2[i] = (float)((r * self->yt_2[i]
+				- cos_theta * self->yt_1[i]) / sin_theta);
+		} else {
+			total += aa_bell_kernel_scalar(self, output, i, i + 1, store);
+			store = false;
+		}
+	}
+
+	for(int k0 = 0; k0 < nsamples; k0 += AA_BELL_BLOCK_LEN) {
+		const float *x = self->cosForce + k0;
+		int len = nsamples - k0;
+		bool forced = false;
+
+		if(len > AA_BELL_BLOCK_LEN)
+			len = AA_BELL_BLOCK_LEN;
+
+		for(int j = 0; j < len; j++)
+			forced |= (x[j] != 0.0f);
+		for(int r = 0; r < self->pointForcedCount; r++) {
+			const float *xp = self->pointForce + k0
+			    + self->pointForced[r] * nsamples;
+
+			for(int j = 0; j < len; j++)
+				forced |= (xp[j] != 0.0f);
+		}
+
+		memset(&acc, 0, sizeof(acc));
+
+		for(int i = begin; i < end; i++) {
+			const float *p = self->blockP + i * AA_BELL_BLOCK_LEN;
+			const float *q = self->blockQ + i * AA_BELL_BLOCK_LEN;
+			float u = self->yt_1[i];
+			float v = self->yt_2[i];
+			float pl = p[len - 1], ql = q[len - 1];
+			float unew, vnew;
+
+			if(aa_bell_block_is_real_pole(self, i))
+				continue;
+
+			for(int w = 0; w < AA_BELL_BLOCK_LEN / 8; w++)
+				y.v[w] = ((const aa_v8sf*)p)[w] * u
+				    + ((const aa_v8sf*)q)[w] * v;
+
+			vnew = pl * v - ql * u;
+
+			if(forced) {
+				double r, cos_theta, sin_theta;
+				float cot_theta;
+
+				aa_bell_block_pole(self, i, &r, &cos_theta, &sin_theta);
+				cot_theta = (float)(cos_theta / sin_theta);
+
+				for(int m = 0; m < len; m++) {
+					float du = self->ampR[i] * x[m];
+					float dv;
+					int steps = len - 1 - m;
+
+					if(points)
+						du += aa_bell_point_input(self, i, k0 + m);
+					dv = -du * cot_theta;
+					if(du == 0.0f)
+						continue;
+
+					y.f[m] += du;
+					for(int j = m + 1; j < len; j++)
+						y.f[j] += p[j - m - 1] * du + q[j - m - 1] * dv;
+
+					if(steps)
+						vnew += p[steps - 1] * dv - q[steps - 1] * du;
+					else
+						vnew += dv;
+				}
+			}
+
+			unew = y.f[len - 1];
+			self->yt_1[i] = unew;
+			self->yt_2[i] = vnew;
+
+			if(i == 0) {        // only total f0
+				for(int j = 0; j < len; j++)
+					total += fabs(y.f[j]);
+			}
+
+			for(int w = 0; w < AA_BELL_BLOCK_LEN / 8; w++)
+				acc.v[w] += y.v[w];
+		}
+
+		if(store) {
+			for(int j = 0; j < len; j++)
+				output[k0 + j] = acc.f[j];
+		} else {
+			for(int j = 0; j < len; j++)
+				output[k0 + j] += acc.f[j];
+		}
+	}
+
+	for(int i = begin; i < end; i++) {
+		double r, cos_theta, sin_theta;
+
+		if(aa_bell_block_pole(self, i, &r, &cos_theta, &sin_theta)) {
+			self->yt_2[i] = (float)((cos_theta * self->yt_1[i]
+				+ sin_theta * self->yt_2[i]) / r);
+		}
+	}
+
+	return total;
+}
+
+/** Returns the kernel that will actually be used when asking for
+    the given one: AUTO becomes the widest kernel the CPU supports,
+    and kernels wider than that are narrowed.
+ */
+aa_bell_kernel_t
+aa_bell_kernel_resolve(aa_bell_kernel_t kernel) {
+	aa_bell_kernel_t best = AA_BELL_KERNEL_SIMD4;
+
+	if(kernel == AA_BELL_KERNEL_BLOCK)
+		return kernel;
+
+#if AA_KERNEL_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx512f"))
+		best = AA_BELL_KERNEL_SIMD16;
+	else if(__builtin_cpu_supports("avx2"))
+		best = AA_BELL_KERNEL_SIMD8;
+#endif
+
+	if((kernel == AA_BELL_KERNEL_AUTO) || (kernel > best))
+		kernel = best;
+
+	return kernel;
+}
+
+aa_bell_kernel_func_t
+aa_bell_kernel_get_func(aa_bell_kernel_t kernel) {
+	switch(kernel) {
+	case AA_BELL_KERNEL_SIMD4:
+		return &aa_bell_kernel_simd4;
+	case AA_BELL_KERNEL_SIMD8:
+		return &aa_bell_kernel_simd8;
+	case AA_BELL_KERNEL_SIMD16:
+		return &aa_bell_kernel_simd16;
+	case AA_BELL_KERNEL_BLOCK:
+		return &aa_bell_kernel_block;
+	default:
+		return &aa_bell_kernel_scalar;
+	}
+}
+
+/** Returns the kernel for the wide arrays of a bell at precision. The
+    double kernels use vectors of the given kernel's width in bytes,
+    and the block kernel, which has no double form, the widest there
+    are. Fixed point renders with its scalar kernel only.
+ */
+aa_bell_kernel_func_t
+aa_bell_kernel_get_wide_func(
+	aa_bell_precision_t precision, aa_bell_kernel_t kernel
+) {
+	if(precision == AA_BELL_PRECISION_Q31)
+		return &aa_bell_kernel_scalar_q31;
+
+	if(kernel == AA_BELL_KERNEL_BLOCK)
+		kernel = aa_bell_kernel_resolve(AA_BELL_KERNEL_AUTO);
+
+	switch(kernel) {
+	case AA_BELL_KERNEL_SIMD4:
+		return &aa_bell_kernel_simd4_double;
+	case AA_BELL_KERNEL_SIMD8:
+		return &aa_bell_kernel_simd8_double;
+	case AA_BELL_KERNEL_SIMD16:
+		return &aa_bell_kernel_simd16_double;
+	default:
+		return &aa_bell_kernel_scalar_double;
+	}
+}
+
+/** Returns the kernel for blocks that ramp. The block kernel's tables
+    hold only the target coefficients, so it ramps with the widest SIMD
+    kernel instead.
+ */
+aa_bell_kernel_func_t
+aa_bell_kernel_get_ramp_func(aa_bell_kernel_t kernel) {
+	if(kernel == AA_BELL_KERNEL_BLOCK)
+		kernel = aa_bell_kernel_resolve(AA_BELL_KERNEL_AUTO);
+
+	switch(kernel) {
+	case AA_BELL_KERNEL_SIMD4:
+		return &aa_bell_kernel_simd4_ramp;
+	case AA_BELL_KERNEL_SIMD8:
+		return &aa_bell_kernel_simd8_ramp;
+	case AA_BELL_KERNEL_SIMD16:
+		return &aa_bell_kernel_simd16_ramp;
+	default:
+		return &aa_bell_kernel_scalar_ramp;
+	}
+}
+
+/** Returns the channel kernel of the given width. The block kernel
+    has no channel form; its bells use the widest SIMD kernel.
+ */
+aa_bell_channels_func_t
+aa_bell_kernel_get_channels_func(aa_bell_kernel_t kernel) {
+	if(kernel == AA_BELL_KERNEL_BLOCK)
+		kernel = aa_bell_kernel_resolve(AA_BELL_KERNEL_AUTO);
+
+	switch(kernel) {
+	case AA_BELL_KERNEL_SIMD4:
+		return &aa_bell_kernel_simd4_channels;
+	case AA_BELL_KERNEL_SIMD8:
+		return &aa_bell_kernel_simd8_channels;
+	case AA_BELL_KERNEL_SIMD16:
+		return &aa_bell_kernel_simd16_channels;
+	default:
+		return &aa_bell_kernel_scalar_channels;
+	}
+}
@@ -0,0 +1,269 @@
+//
+//  bell_kernel_channels.h
+//
+//  Mode-parallel multichannel reson kernel body. This file is included
+//  once per lane width by bell_kernel.c, after bell_kernel_lanes.h has
+//  declared the vector type, with AA_KERNEL_NAME, AA_KERNEL_LANES,
+//  AA_KERNEL_VEC and AA_KERNEL_ATTR defined as for that header.
+//
+
+/** Advances AA_KERNEL_LANES modes per vector operation, as the mono
+    kernels do. One or two channels accumulate the new outputs as they
+    come; more go through a buffer holding the tile's new outputs, with
+    which each channel then takes the dot product of its gains, eight
+    or four channels at a time so that they share its loads and keep
+    their accumulators in registers. The modes are advanced once
+    whatever the channel count, which only adds a multiply-add per mode
+    and channel. Tiles are AA_BELL_KERNEL_TILE modes as for the mono
+    kernels; shrinking them to keep the gain rows in L1 costs more in
+    per-sample reductions than it saves. Force at other points is added
+    as the mono kernels add it.
+ */
+AA_KERNEL_ATTR double
+AA_KERNEL_NAME(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store,
+	bool interleaved
+) {
+	double total = 0.0;
+	int nsamples = self->bufferSize;
+	int channels = self->channels;
+	int stride = self->channelStride;
+	int chStep = interleaved ? 1 : nsamples;
+	int kStep = interleaved ? channels : 1;
+	int vbegin = (begin + AA_KERNEL_LANES - 1) & ~(AA_KERNEL_LANES - 1);
+	int vend, rampBegin = 0, rampEnd = 0;
+	aa_bell_t owner = self->model ? self->model : self;
+	const float *restrict cosForce = self->cosForce;
+	const float *restrict pointForce = self->pointForce;
+	const int *restrict pointForced = self->pointForced;
+	const float *restrict pointAmpR = self->pointAmpR;
+	int pointCount = self->pointForcedCount;
+	int pointStride = AA_BELL_PADDED_MODE_COUNT(self->nf);
+	const float *restrict gain = self->channelGain;
+	int pair = channels > 1 ? 1 : 0;
+	const float *restrict R2 = self->R2;
+	const float *restrict twoRCosTheta = self->twoRCosTheta;
+	const float *restrict ampR = self->ampR;
+	const float *restrict fromR2 = owner->rampR2;
+	const float *restrict fromTwoRCosTheta = owner->rampTwoRCosTheta;
+	const float *restrict fromAmpR = self->ownGains ? ampR
+	    : owner->rampAmpR;
+	float *restrict yt_1 = self->yt_1;
+	float *restrict yt_2 = self->yt_2;
+	float step = 1.0f / nsamples;
+
+	if(end == self->nf)
+		vend = AA_BELL_PADDED_MODE_COUNT(end);
+	else
+		vend = end & ~(AA_KERNEL_LANES - 1);
+
+	if(vbegin >= end)
+		return aa_bell_kernel_scalar_channels(self, output, begin, end,
+			store, interleaved);
+	if(vend < vbegin)
+		vend = vbegin;
+
+	if(owner->rampBlock) {
+		rampBegin = owner->rampBegin & ~(AA_KERNEL_LANES - 1);
+		rampEnd = (owner->rampEnd + AA_KERNEL_LANES - 1)
+		    & ~(AA_KERNEL_LANES - 1);
+	}
+
+// Channel c's gains for the modes at i.
+#define AA_CHANNELS_GAIN(c, i) \
+	(*(const AA_KERNEL_VEC*)(gain + (c) * stride + (i)))
+
+// Keeps ynew of the modes at i for the dot products.
+#define AA_CHANNELS_BUFFER(i, ynew) \
+	y[((i) - from) / AA_KERNEL_LANES] = (ynew);
+
+// Adds u to the kept outputs of the modes at i.
+#define AA_CHANNELS_BUFFER_ADD(i, u) \
+	y[((i) - from) / AA_KERNEL_LANES] += (u);
+
+// Adds ynew of the modes at i to a pair of channels directly.
+#define AA_CHANNELS_PAIR(i, ynew) \
+	p0 += AA_CHANNELS_GAIN(0, i) * (ynew); \
+	p1 += AA_CHANNELS_GAIN(pair, i) * (ynew);
+
+// Advances the modes in [from, to) one sample with fixed coefficients.
+#define AA_CHANNELS_MODES(from, to, keep) \
+	for(int i = (from); i < (to); i += AA_KERNEL_LANES) { \
+		AA_KERNEL_VEC tmp_yt_1 = *(AA_KERNEL_VEC*)(yt_1 + i); \
+		AA_KERNEL_VEC tmp_yt_2 = *(AA_KERNEL_VEC*)(yt_2 + i); \
+		AA_KERNEL_VEC ynew = \
+		    *(const AA_KERNEL_VEC*)(twoRCosTheta + i) * tmp_yt_1 \
+		    - *(const AA_KERNEL_VEC*)(R2 + i) * tmp_yt_2 \
+		    + *(const AA_KERNEL_VEC*)(ampR + i) * x; \
+		*(AA_KERNEL_VEC*)(yt_2 + i) = tmp_yt_1; \
+		*(AA_KERNEL_VEC*)(yt_1 + i) = ynew; \
+		keep(i, ynew) \
+	}
+
+// Advances the modes of the tile one sample, ramping those in [rb, re).
+#define AA_CHANNELS_SAMPLE(keep) \
+	AA_CHANNELS_MODES(from, rb, keep); \
+	for(int i = rb; i < re; i += AA_KERNEL_LANES) { \
+		AA_KERNEL_VEC tmp_yt_1 = *(AA_KERNEL_VEC*)(yt_1 + i); \
+		AA_KERNEL_VEC tmp_yt_2 = *(AA_KERNEL_VEC*)(yt_2 + i); \
+		AA_KERNEL_VEC c0 = *(const AA_KERNEL_VEC*)(fromTwoRCosTheta + i); \
+		AA_KERNEL_VEC r0 = *(const AA_KERNEL_VEC*)(fromR2 + i); \
+		AA_KERNEL_VEC a0 = *(const AA_KERNEL_VEC*)(fromAmpR + i); \
+		AA_KERNEL_VEC ynew = \
+		    (c0 + (*(const AA_KERNEL_VEC*)(twoRCosTheta + i) - c0) * t) \
+		    * tmp_yt_1 \
+		    - (r0 + (*(const AA_KERNEL_VEC*)(R2 + i) - r0) * t) \
+		    * tmp_yt_2 \
+		    + (a0 + (*(const AA_KERNEL_VEC*)(ampR + i) - a0) * t) * x; \
+		*(AA_KERNEL_VEC*)(yt_2 + i) = tmp_yt_1; \
+		*(AA_KERNEL_VEC*)(yt_1 + i) = ynew; \
+		keep(i, ynew) \
+	} \
+	AA_CHANNELS_MODES(re, to, keep);
+
+// Adds the force at other points of this sample to the new outputs of
+// the modes of the tile, keeping what it adds.
+#define AA_CHANNELS_POINTS(keep) \
+	for(int j = 0; j < pointCount; j++) { \
+		int p = pointForced[j]; \
+		float xp = pointForce[p * nsamples + k]; \
+		const float *g = pointAmpR + p * pointStride; \
+		AA_KERNEL_VEC v = (AA_KERNEL_VEC) { 0 } + xp; \
+		if(xp == 0.0f) \
+			continue; \
+		for(int i = from; i < to; i += AA_KERNEL_LANES) { \
+			AA_KERNEL_VEC u = *(const AA_KERNEL_VEC*)(g + i) * v; \
+			*(AA_KERNEL_VEC*)(yt_1 + i) += u; \
+			keep(i, u) \
+		} \
+	}
+
+	for(int from = vbegin; from < vend; from += AA_BELL_KERNEL_TILE) {
+		int to = vend - from < AA_BELL_KERNEL_TILE ? vend
+		    : from + AA_BELL_KERNEL_TILE;
+		bool first = store && (from == vbegin);
+		int rb = rampBegin < from ? from : rampBegin > to ? to : rampBegin;
+		int re = rampEnd < rb ? rb : rampEnd > to ? to : rampEnd;
+
+		for(int k = 0; k < nsamples; k++) {
+			AA_KERNEL_VEC x = (AA_KERNEL_VEC) { 0 } + cosForce[k];
+			AA_KERNEL_VEC t = (AA_KERNEL_VEC) { 0 } + (k + 1) * step;
+			AA_KERNEL_VEC y[AA_BELL_KERNEL_TILE / AA_KERNEL_LANES];
+			float sum[AA_BELL_MAX_CHANNELS];
+			int c = 0;
+
+			// One or two channels add up as the modes advance, as the
+			// mono kernels do, rather than going through the buffer.
+			if(channels <= 2) {
+				AA_KERNEL_VEC p0 = { 0 }, p1 = { 0 };
+
+				AA_CHANNELS_SAMPLE(AA_CHANNELS_PAIR)
+				AA_CHANNELS_POINTS(AA_CHANNELS_PAIR)
+				sum[0] = sum[1] = 0.0f;
+				for(int l = 0; l < AA_KERNEL_LANES; l++) {
+					sum[0] += p0[l];
+					sum[1] += p1[l];
+				}
+				c = channels;
+			} else {
+				AA_CHANNELS_SAMPLE(AA_CHANNELS_BUFFER)
+				AA_CHANNELS_POINTS(AA_CHANNELS_BUFFER_ADD)
+			}
+
+			for(; c + 8 <= channels; c += 8) {
+				AA_KERNEL_VEC a0 = { 0 }, a1 = { 0 }, a2 = { 0 }, a3 = { 0 };
+				AA_KERNEL_VEC a4 = { 0 }, a5 = { 0 }, a6 = { 0 }, a7 = { 0 };
+
+				for(int i = from, j = 0; i < to; i += AA_KERNEL_LANES, j++) {
+					AA_KERNEL_VEC v = y[j];
+
+					a0 += AA_CHANNELS_GAIN(c, i) * v;
+					a1 += AA_CHANNELS_GAIN(c + 1, i) * v;
+					a2 += AA_CHANNELS_GAIN(c + 2, i) * v;
+					a3 += AA_CHANNELS_GAIN(c + 3, i) * v;
+					a4 += AA_CHANNELS_GAIN(c + 4, i) * v;
+					a5 += AA_CHANNELS_GAIN(c + 5, i) * v;
+					a6 += AA_CHANNELS_GAIN(c + 6, i) * v;
+					a7 += AA_CHANNELS_GAIN(c + 7, i) * v;
+				}
+				for(int l = 0; l < 8; l++)
+					sum[c + l] = 0.0f;
+				for(int l = 0; l < AA_KERNEL_LANES; l++) {
+					sum[c] += a0[l];
+					sum[c + 1] += a1[l];
+					sum[c + 2] += a2[l];
+					sum[c + 3] += a3[l];
+					sum[c + 4] += a4[l];
+					sum[c + 5] += a5[l];
+					sum[c + 6] += a6[l];
+					sum[c + 7] += a7[l];
+				}
+			}
+			for(; c + 4 <= channels; c += 4) {
+				AA_KERNEL_VEC a0 = { 0 }, a1 = { 0 }, a2 = { 0 }, a3 = { 0 };
+
+				for(int i = from, j = 0; i < to; i += AA_KERNEL_LANES, j++) {
+					AA_KERNEL_VEC v = y[j];
+
+					a0 += AA_CHANNELS_GAIN(c, i) * v;
+					a1 += AA_CHANNELS_GAIN(c + 1, i) * v;
+					a2 += AA_CHANNELS_GAIN(c + 2, i) * v;
+					a3 += AA_CHANNELS_GAIN(c + 3, i) * v;
+				}
+				sum[c] = sum[c + 1] = sum[c + 2] = sum[c + 3] = 0.0f;
+				for(int l = 0; l < AA_KERNEL_LANES; l++) {
+					sum[c] += a0[l];
+					sum[c + 1] += a1[l];
+					sum[c + 2] += a2[l];
+					sum[c + 3] += a3[l];
+				}
+			}
+			for(; c < channels; c++) {
+				AA_KERNEL_VEC a0 = { 0 };
+
+				for(int i = from, j = 0; i < to; i += AA_KERNEL_LANES, j++)
+					a0 += AA_CHANNELS_GAIN(c, i) * y[j];
+				sum[c] = 0.0f;
+				for(int l = 0; l < AA_KERNEL_LANES; l++)
+					sum[c] += a0[l];
+			}
+
+			for(c = 0; c < channels; c++) {
+				float *out = output + c * chStep + k * kStep;
+
+				if(first)
+					*out = sum[c];
+				else
+					*out += sum[c];
+			}
+
+			if(from == 0)       // only total f0
+				total += fabs(yt_1[0]);
+		}
+	}
+
+	store = store && (vbegin == vend);
+
+	if(begin < vbegin) {
+		total += aa_bell_kernel_scalar_channels(self, output, begin, vbegin,
+			store, interleaved);
+		store = false;
+	}
+	if(vend < end)
+		total += aa_bell_kernel_scalar_channels(self, output, vend, end,
+			store, interleaved);
+
+	return total;
+}
+
+#undef AA_KERNEL_NAME
+#undef AA_KERNEL_LANES
+#undef AA_KERNEL_VEC
+#undef AA_KERNEL_ATTR
+#undef AA_CHANNELS_GAIN
+#undef AA_CHANNELS_BUFFER
+#undef AA_CHANNELS_BUFFER_ADD
+#undef AA_CHANNELS_POINTS
+#undef AA_CHANNELS_PAIR
+#undef AA_CHANNELS_MODES
+#undef AA_CHANNELS_SAMPLE
@@ -0,0 +1,207 @@
+//
+//  bell_kernel_lanes.h
+//
+//  Mode-parallel reson kernel body. This file is included once per
+//  lane width by bell_kernel.c, which defines AA_KERNEL_NAME,
+//  AA_KERNEL_LANES, AA_KERNEL_VEC and AA_KERNEL_ATTR beforehand, and
+//  once more per width with AA_KERNEL_RAMP defined to 1 for the
+//  variant that ramps coefficients across the block. With
+//  AA_KERNEL_SAMPLE defined to double, it renders the wide arrays of a
+//  double precision bell instead; those never ramp.
+//
+
+#ifndef AA_KERNEL_RAMP
+#define AA_KERNEL_RAMP      0
+#endif
+
+#ifndef AA_KERNEL_SAMPLE
+#define AA_KERNEL_SAMPLE    float
+#define AA_KERNEL_WIDE      0
+#else
+#define AA_KERNEL_WIDE      1
+#endif
+
+#if AA_KERNEL_WIDE
+#define AA_KERNEL_SCALAR    aa_bell_kernel_scalar_double
+#elif AA_KERNEL_RAMP
+#define AA_KERNEL_SCALAR    aa_bell_kernel_scalar_ramp
+#else
+#define AA_KERNEL_SCALAR    aa_bell_kernel_scalar
+#endif
+
+#if !AA_KERNEL_RAMP
+typedef AA_KERNEL_SAMPLE AA_KERNEL_VEC
+    __attribute__((vector_size(AA_KERNEL_LANES * sizeof(AA_KERNEL_SAMPLE))));
+#endif
+
+/** Advances AA_KERNEL_LANES modes per vector operation. Modes are
+    taken AA_BELL_KERNEL_TILE at a time through the whole block, with
+    the sample loop inside, so that every mode of the tile contributes
+    to a lane accumulator, which is reduced horizontally once per sample
+    and tile. The first tile stores into output if asked to. Force at
+    other points than the bell's own is added to the tile's new outputs
+    in a pass of its own, at only the samples where it is nonzero.
+ */
+AA_KERNEL_ATTR double
+AA_KERNEL_NAME(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store
+) {
+	double total = 0.0;
+	int nsamples = self->bufferSize;
+	int vbegin = (begin + AA_KERNEL_LANES - 1) & ~(AA_KERNEL_LANES - 1);
+	int vend;
+	const float *restrict cosForce = self->cosForce;
+	const float *restrict pointForce = self->pointForce;
+	const int *restrict pointForced = self->pointForced;
+	int pointCount = self->pointForcedCount;
+	int pointStride = AA_BELL_PADDED_MODE_COUNT(self->nf);
+#if AA_KERNEL_WIDE
+	const AA_KERNEL_SAMPLE *restrict R2 = self->wideR2;
+	const AA_KERNEL_SAMPLE *restrict twoRCosTheta = self->wideTwoRCosTheta;
+	const AA_KERNEL_SAMPLE *restrict ampR = self->wideAmpR;
+	const AA_KERNEL_SAMPLE *restrict pointAmpR = self->widePointAmpR;
+	AA_KERNEL_SAMPLE *restrict yt_1 = self->wideYt_1;
+	AA_KERNEL_SAMPLE *restrict yt_2 = self->wideYt_2;
+#else
+	const float *restrict R2 = self->R2;
+	const float *restrict twoRCosTheta = self->twoRCosTheta;
+	const float *restrict ampR = self->ampR;
+	const float *restrict pointAmpR = self->pointAmpR;
+	float *restrict yt_1 = self->yt_1;
+	float *restrict yt_2 = self->yt_2;
+#endif
+#if AA_KERNEL_RAMP
+	aa_bell_t owner = self->model ? self->model : self;
+	const float *restrict fromR2 = owner->rampR2;
+	const float *restrict fromTwoRCosTheta = owner->rampTwoRCosTheta;
+	const float *restrict fromAmpR = self->ownGains ? ampR
+	    : owner->rampAmpR;
+	float step = 1.0f / nsamples;
+	int rampBegin, rampEnd;
+#endif
+
+	// The padding past nf is all zero, so when the range runs to the
+	// last mode we can let the final vector spill into it.
+	if(end == self->nf)
+		vend = AA_BELL_PADDED_MODE_COUNT(end);
+	else
+		vend = end & ~(AA_KERNEL_LANES - 1);
+
+	// A range within one vector is left to the scalar kernel entirely.
+	if(vbegin >= end)
+		return AA_KERNEL_SCALAR(self, output, begin, end, store);
+	if(vend < vbegin)
+		vend = vbegin;
+
+#if AA_KERNEL_RAMP
+	// Only the modes that changed ramp; the rest run as usual.
+	rampBegin = owner->rampBegin & ~(AA_KERNEL_LANES - 1);
+	rampEnd = (owner->rampEnd + AA_KERNEL_LANES - 1) & ~(AA_KERNEL_LANES - 1);
+#endif
+
+// Advances the modes in [from, to) one sample with fixed coefficients.
+#define AA_KERNEL_MODES(from, to) \
+	for(int i = (from); i < (to); i += AA_KERNEL_LANES) { \
+		AA_KERNEL_VEC tmp_yt_1 = *(AA_KERNEL_VEC*)(yt_1 + i); \
+		AA_KERNEL_VEC tmp_yt_2 = *(AA_KERNEL_VEC*)(yt_2 + i); \
+		AA_KERNEL_VEC ynew = \
+		    *(const AA_KERNEL_VEC*)(twoRCosTheta + i) * tmp_yt_1 \
+		    - *(const AA_KERNEL_VEC*)(R2 + i) * tmp_yt_2 \
+		    + *(const AA_KERNEL_VEC*)(ampR + i) * x; \
+		*(AA_KERNEL_VEC*)(yt_2 + i) = tmp_yt_1; \
+		*(AA_KERNEL_VEC*)(yt_1 + i) = ynew; \
+		acc += ynew; \
+	}
+
+// Adds the force at other points of this sample to the new outputs of
+// the modes in [from, to), through the gains of each point.
+#define AA_KERNEL_POINTS(from, to) \
+	for(int j = 0; j < pointCount; j++) { \
+		int p = pointForced[j]; \
+		float xp = pointForce[p * nsamples + k]; \
+		const AA_KERNEL_SAMPLE *g = pointAmpR + p * pointStride; \
+		AA_KERNEL_VEC v = (AA_KERNEL_VEC) { 0 } + xp; \
+		if(xp == 0.0f) \
+			continue; \
+		for(int i = (from); i < (to); i += AA_KERNEL_LANES) { \
+			AA_KERNEL_VEC u = *(const AA_KERNEL_VEC*)(g + i) * v; \
+			*(AA_KERNEL_VEC*)(yt_1 + i) += u; \
+			acc += u; \
+		} \
+	}
+
+	for(int from = vbegin; from < vend; from += AA_BELL_KERNEL_TILE) {
+		int to = vend - from < AA_BELL_KERNEL_TILE ? vend
+		    : from + AA_BELL_KERNEL_TILE;
+		bool first = store && (from == vbegin);
+#if AA_KERNEL_RAMP
+		int rb = rampBegin < from ? from : rampBegin > to ? to : rampBegin;
+		int re = rampEnd < rb ? rb : rampEnd > to ? to : rampEnd;
+#endif
+
+		for(int k = 0; k < nsamples; k++) {
+			AA_KERNEL_VEC x = (AA_KERNEL_VEC) { 0 } + cosForce[k];
+			AA_KERNEL_VEC acc = { 0 };
+			AA_KERNEL_SAMPLE sum = 0;
+
+#if AA_KERNEL_RAMP
+			AA_KERNEL_VEC t = (AA_KERNEL_VEC) { 0 } + (k + 1) * step;
+
+			AA_KERNEL_MODES(from, rb);
+			for(int i = rb; i < re; i += AA_KERNEL_LANES) {
+				AA_KERNEL_VEC tmp_yt_1 = *(AA_KERNEL_VEC*)(yt_1 + i);
+				AA_KERNEL_VEC tmp_yt_2 = *(AA_KERNEL_VEC*)(yt_2 + i);
+				AA_KERNEL_VEC c0 = *(const AA_KERNEL_VEC*)(fromTwoRCosTheta + i);
+				AA_KERNEL_VEC r0 = *(const AA_KERNEL_VEC*)(fromR2 + i);
+				AA_KERNEL_VEC a0 = *(const AA_KERNEL_VEC*)(fromAmpR + i);
+				AA_KERNEL_VEC ynew =
+				    (c0 + (*(const AA_KERNEL_VEC*)(twoRCosTheta + i) - c0) * t)
+				    * tmp_yt_1
+				    - (r0 + (*(const AA_KERNEL_VEC*)(R2 + i) - r0) * t)
+				    * tmp_yt_2
+				    + (a0 + (*(const AA_KERNEL_VEC*)(ampR + i) - a0) * t) * x;
+				*(AA_KERNEL_VEC*)(yt_2 + i) = tmp_yt_1;
+				*(AA_KERNEL_VEC*)(yt_1 + i) = ynew;
+				acc += ynew;
+			}
+			AA_KERNEL_MODES(re, to);
+#else
+			AA_KERNEL_MODES(from, to);
+#endif
+			AA_KERNEL_POINTS(from, to);
+
+			for(int l = 0; l < AA_KERNEL_LANES; l++)
+				sum += acc[l];
+			if(first)
+				output[k] = (float)sum;
+			else
+				output[k] += (float)sum;
+
+			if(from == 0)       // only total f0
+				total += fabs(yt_1[0]);
+		}
+	}
+
+	// The vector modes have initialized output, if they were to.
+	store = store && (vbegin == vend);
+
+	if(begin < vbegin) {
+		total += AA_KERNEL_SCALAR(self, output, begin, vbegin, store);
+		store = false;
+	}
+	if(vend < end)
+		total += AA_KERNEL_SCALAR(self, output, vend, end, store);
+
+	return total;
+}
+
+#undef AA_KERNEL_NAME
+#undef AA_KERNEL_LANES
+#undef AA_KERNEL_VEC
+#undef AA_KERNEL_ATTR
+#undef AA_KERNEL_RAMP
+#undef AA_KERNEL_SCALAR
+#undef AA_KERNEL_MODES
+#undef AA_KERNEL_POINTS
+#undef AA_KERNEL_SAMPLE
+#undef AA_KERNEL_WIDE
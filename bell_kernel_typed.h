@@ -0,0 +1,101 @@
+//
+//  bell_kernel_typed.h
+//
+//  Portable reson kernel body over the sample type of a bell's wide
+//  arrays. This file is included once per precision by bell_kernel.c,
+//  which defines beforehand:
+//
+//  AA_TYPED_NAME           name of the kernel
+//  AA_TYPED_SAMPLE         type of the state and coefficients
+//  AA_TYPED_SUM            type modes are summed in each sample
+//  AA_TYPED_INPUT(x)       the force sample x as an AA_TYPED_SAMPLE
+//  AA_TYPED_STEP(c, r, a, y1, y2, x)
+//                          the next output of a reson
+//  AA_TYPED_INJECT(y, a, x)
+//                          output y with input a * x added
+//  AA_TYPED_OUTPUT(y)      a sample or sum as a float
+//
+
+/** Advances the modes of a tile one sample at a time, with the mode
+    loop innermost, so that the modes are summed in AA_TYPED_SUM and
+    converted to float once per sample and tile. Fixed point kernels
+    thus stay in integers but for that conversion.
+ */
+double
+AA_TYPED_NAME(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store
+) {
+	double total = 0.0;
+	int nsamples = self->bufferSize;
+	const float *restrict cosForce = self->cosForce;
+	const AA_TYPED_SAMPLE *restrict R2 = self->wideR2;
+	const AA_TYPED_SAMPLE *restrict twoRCosTheta = self->wideTwoRCosTheta;
+	const AA_TYPED_SAMPLE *restrict ampR = self->wideAmpR;
+	const AA_TYPED_SAMPLE *restrict pointAmpR = self->widePointAmpR;
+	const float *restrict pointForce = self->pointForce;
+	int pointStride = AA_BELL_PADDED_MODE_COUNT(self->nf);
+	AA_TYPED_SAMPLE *restrict yt_1 = self->wideYt_1;
+	AA_TYPED_SAMPLE *restrict yt_2 = self->wideYt_2;
+
+	if(store && (begin >= end))
+		memset(output, 0, sizeof(float) * nsamples);
+
+	for(int from = begin; from < end; from += AA_BELL_KERNEL_TILE) {
+		int to = end - from < AA_BELL_KERNEL_TILE ? end
+		    : from + AA_BELL_KERNEL_TILE;
+		bool first = store && (from == begin);
+
+		for(int k = 0; k < nsamples; k++) {
+			AA_TYPED_SAMPLE x = AA_TYPED_INPUT(cosForce[k]);
+			AA_TYPED_SUM sum = 0;
+			float y;
+
+			for(int i = from; i < to; i++) {
+				AA_TYPED_SAMPLE ynew = AA_TYPED_STEP(twoRCosTheta[i], R2[i],
+					ampR[i], yt_1[i], yt_2[i], x);
+
+				yt_2[i] = yt_1[i];
+				yt_1[i] = ynew;
+				sum += ynew;
+			}
+
+			// Force at other points, through the gains of each.
+			for(int j = 0; j < self->pointForcedCount; j++) {
+				int p = self->pointForced[j];
+				const AA_TYPED_SAMPLE *g = pointAmpR + p * pointStride;
+				float xp = pointForce[p * nsamples + k];
+				AA_TYPED_SAMPLE xw;
+
+				if(xp == 0.0f)
+					continue;
+
+				xw = AA_TYPED_INPUT(xp);
+				for(int i = from; i < to; i++) {
+					AA_TYPED_SAMPLE ynew = AA_TYPED_INJECT(yt_1[i], g[i], xw);
+
+					sum += ynew - yt_1[i];
+					yt_1[i] = ynew;
+				}
+			}
+
+			y = AA_TYPED_OUTPUT(sum);
+			if(first)
+				output[k] = y;
+			else
+				output[k] += y;
+
+			if(from == 0)       // only total f0
+				total += fabs(AA_TYPED_OUTPUT(yt_1[0]));
+		}
+	}
+
+	return total;
+}
+
+#undef AA_TYPED_NAME
+#undef AA_TYPED_SAMPLE
+#undef AA_TYPED_SUM
+#undef AA_TYPED_INPUT
+#undef AA_TYPED_STEP
+#undef AA_TYPED_INJECT
+#undef AA_TYPED_OUTPUT
@@ -0,0 +1,247 @@
+//
+//  bell_params.c
+//
+//  Parameter queue: a single-producer, single-consumer lock-free ring
+//  of mode parameter changes. A control thread posts changes; the audio
+//  thread applies them at the start of the next block, recomputing the
+//  coefficients of each touched mode once however many changes it got.
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bell_private.h"
+
+struct aa_bell_param_msg_s {
+	aa_bell_param_t param;
+	int			point;
+	int			mode;
+	float		value;
+};
+
+struct aa_bell_params_s {
+	/** Next slot to write. Written by the producer only. */
+	unsigned	head;
+	char		head_pad[64 - sizeof(unsigned)];
+
+	/** Next slot to read. Written by the consumer only. */
+	unsigned	tail;
+	char		tail_pad[64 - sizeof(unsigned)];
+
+	/** Messages dropped because the ring was full. Producer only. */
+	uint64_t	overflow;
+	char		overflow_pad[64 - sizeof(uint64_t)];
+
+	unsigned	mask;
+
+	/** Modes touched by the messages being applied, each listed once. */
+	int *		dirty;
+	bool *		is_dirty;
+
+	/** Statistics, written by the consumer only. */
+	int			depth;
+	int			max_depth;
+	int			modes;
+	uint64_t	applied;
+	uint64_t	block_overflow;
+	uint64_t	seen_overflow;
+
+	struct aa_bell_param_msg_s msgs[];
+};
+
+/** Gives self a parameter queue of at least capacity messages. Call it
+    before audio starts; afterwards one thread may post to the queue
+    while another renders. A shared bell gets its own copy of its
+    model's modes here, so that applying changes on the audio thread
+    never allocates.
+ */
+int
+aa_bell_create_param_queue(
+	aa_bell_t self, int capacity
+) {
+	struct aa_bell_params_s *params = NULL;
+	unsigned size = 1;
+
+	if(self->params || (capacity <= 0) || aa_bell_unshare(self))
+		return -1;
+
+	while(size < (unsigned)capacity)
+		size *= 2;
+
+	params = calloc(sizeof(*params)
+		+ sizeof(struct aa_bell_param_msg_s) * size, 1);
+
+	if(!params)
+		goto bail;
+
+	params->mask = size - 1;
+	params->dirty = calloc(sizeof(int), self->nf);
+	params->is_dirty = calloc(sizeof(bool), self->nf);
+
+	if(!params->dirty || !params->is_dirty) {
+		free(params->dirty);
+		free(params->is_dirty);
+		free(params);
+		params = NULL;
+		goto bail;
+	}
+
+	self->params = params;
+
+bail:
+	return params ? 0 : -1;
+}
+
+void
+aa_bell_release_params(aa_bell_t self) {
+	struct aa_bell_params_s *params = self->params;
+
+	if(!params)
+		return;
+
+	free(params->dirty);
+	free(params->is_dirty);
+	free(params);
+	self->params = NULL;
+}
+
+/** Posts a parameter change from the control thread. Never blocks;
+    returns nonzero if mode, or the point of a gain, is not one of
+    self's, and nonzero with an overflow counted if the queue is full.
+ */
+int
+aa_bell_post_param(
+	aa_bell_t self, aa_bell_param_t param, int point, int mode, float value
+) {
+	struct aa_bell_params_s *params = self->params;
+	struct aa_bell_param_msg_s *msg;
+	unsigned head, tail;
+
+	if(!params || (mode < 0) || (mode >= self->nf)
+	    || ((param == AA_BELL_PARAM_GAIN)
+	        && ((point < 0) || (point >= self->np))))
+		return -1;
+
+	head = params->head;
+	tail = __atomic_load_n(&params->tail, __ATOMIC_ACQUIRE);
+
+	if(head - tail > params->mask) {
+		__atomic_store_n(&params->overflow, params->overflow + 1,
+			__ATOMIC_RELAXED);
+		return -1;
+	}
+
+	msg = &params->msgs[head & params->mask];
+	msg->param = param;
+	msg->point = point;
+	msg->mode = mode;
+	msg->value = value;
+
+	__atomic_store_n(&params->head, head + 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/** Applies every change posted so far, then recomputes the
+    coefficients of the modes they touched, once each, and gets the
+    bell ready for the block: starts its coefficient ramp if it is
+    smoothed, and follows its model's gains if it has its own. Called by
+    aa_bell_mix_sound_buffer(); anything rendering a bell's modes some
+    other way must call it at the start of each block. Returns the
+    number of messages applied.
+ */
+int
+aa_bell_apply_params(aa_bell_t self) {
+	struct aa_bell_params_s *params = self->params;
+	unsigned head, tail;
+	uint64_t overflow;
+	int count = 0, modes = 0;
+
+	if(!params)
+		goto bail;
+
+	head = __atomic_load_n(&params->head, __ATOMIC_ACQUIRE);
+	tail = params->tail;
+	count = (int)(head - tail);
+
+	for(; tail != head; tail++) {
+		const struct aa_bell_param_msg_s *msg =
+		    &params->msgs[tail & params->mask];
+
+		if((msg->mode < 0) || (msg->mode >= self->nf))
+			continue;
+
+		switch(msg->param) {
+		case AA_BELL_PARAM_FREQ:
+			aa_bell_set_mode_freq(self, msg->mode, msg->value);
+			break;
+		case AA_BELL_PARAM_DECAY:
+			aa_bell_set_angular_decay(self, msg->mode, msg->value);
+			break;
+		case AA_BELL_PARAM_GAIN:
+			if((msg->point < 0) || (msg->point >= self->np))
+				continue;
+			aa_bell_set_gain(self, msg->point, msg->mode, msg->value);
+			break;
+		default:
+			continue;
+		}
+
+		if(!params->is_dirty[msg->mode]) {
+			params->is_dirty[msg->mode] = true;
+			params->dirty[modes++] = msg->mode;
+		}
+	}
+
+	__atomic_store_n(&params->tail, tail, __ATOMIC_RELEASE);
+
+	for(int i = 0; i < modes; i++) {
+		int mode = params->dirty[i];
+
+		aa_bell_compute_reson_coeff(self, mode);
+		aa_bell_compute_location(self, mode);
+		params->is_dirty[mode] = false;
+	}
+
+	overflow = __atomic_load_n(&params->overflow, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&params->depth, count, __ATOMIC_RELAXED);
+	__atomic_store_n(&params->modes, modes, __ATOMIC_RELAXED);
+	if(count > params->max_depth)
+		__atomic_store_n(&params->max_depth, count, __ATOMIC_RELAXED);
+	__atomic_store_n(&params->applied, params->applied + count,
+		__ATOMIC_RELAXED);
+	__atomic_store_n(&params->block_overflow,
+		overflow - params->seen_overflow, __ATOMIC_RELAXED);
+	params->seen_overflow = overflow;
+
+bail:
+	aa_bell_start_block(self);
+	return count;
+}
+
+/** Reads the queue statistics. Safe from either thread.
+ */
+void
+aa_bell_get_param_stats(
+	aa_bell_t self, struct aa_bell_param_stats_s *stats
+) {
+	struct aa_bell_params_s *params = self->params;
+
+	memset(stats, 0, sizeof(*stats));
+
+	if(!params)
+		return;
+
+	stats->depth = __atomic_load_n(&params->depth, __ATOMIC_RELAXED);
+	stats->max_depth = __atomic_load_n(&params->max_depth, __ATOMIC_RELAXED);
+	stats->modes = __atomic_load_n(&params->modes, __ATOMIC_RELAXED);
+	stats->applied = __atomic_load_n(&params->applied, __ATOMIC_RELAXED);
+	stats->overflow = __atomic_load_n(&params->overflow, __ATOMIC_RELAXED);
+	stats->block_overflow = __atomic_load_n(&params->block_overflow,
+		__ATOMIC_RELAXED);
+	stats->capacity = (int)params->mask + 1;
+}
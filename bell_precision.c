@@ -0,0 +1,291 @@
+//
+//  bell_precision.c
+//
+//  Rendering at double precision or in fixed point. Everything but the
+//  kernels keeps working on the float arrays: a bell at another
+//  precision holds its coefficients and state once more at that
+//  precision, recomputes the coefficients wherever the float ones are
+//  recomputed, and copies its state into yt_1 and yt_2 after every
+//  block. Whatever changes yt_1 or yt_2 in between, such as culling or
+//  aa_bell_clear_history(), is picked up before the next block.
+//
+//  Coefficients are computed from the mode parameters in double
+//  precision whatever the coefficient accuracy, since rounding them is
+//  most of what a long render at float precision gets wrong.
+//
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bell_private.h"
+
+#ifndef M_PI
+#define M_PI                    3.14159265358979323846
+#endif
+
+static size_t
+aa_precision_size(aa_bell_precision_t precision) {
+	return precision == AA_BELL_PRECISION_DOUBLE ? sizeof(double)
+	    : sizeof(int32_t);
+}
+
+/** Allocates a zeroed wide per-mode array, padded and aligned like
+    the float ones.
+ */
+void *
+aa_bell_precision_alloc_modes(
+	aa_bell_precision_t precision, int nf
+) {
+	size_t size = aa_precision_size(precision)
+	    * AA_BELL_PADDED_MODE_COUNT(nf);
+	void *ret;
+
+	if(posix_memalign(&ret, sizeof(float) * AA_BELL_MODE_PAD, size))
+		return NULL;
+
+	memset(ret, 0, size);
+
+	return ret;
+}
+
+/** Copies the wide per-mode array src, or returns NULL if it is NULL.
+ */
+void *
+aa_bell_precision_copy_modes(
+	aa_bell_precision_t precision, const void *src, int nf
+) {
+	void *ret;
+
+	if(!src)
+		return NULL;
+
+	ret = aa_bell_precision_alloc_modes(precision, nf);
+	if(ret)
+		memcpy(ret, src, aa_precision_size(precision) * nf);
+
+	return ret;
+}
+
+/** v in fixed point with bits fraction bits, saturated.
+ */
+static int32_t
+aa_precision_fixed(
+	double v, int bits
+) {
+	double q = nearbyint(ldexp(v, bits));
+
+	return q >= INT32_MAX ? INT32_MAX : q <= -INT32_MAX ? -INT32_MAX
+	    : (int32_t)q;
+}
+
+static double
+aa_precision_unfixed(
+	int32_t q, int bits
+) {
+	return ldexp((double)q, -bits);
+}
+
+/** Recomputes the wide R2 and twoRCosTheta of modes [begin, end) from
+    the mode parameters.
+ */
+void
+aa_bell_precision_coeffs(
+	aa_bell_t self, int begin, int end
+) {
+	for(int i = begin; i < end; i++) {
+		double r = exp(-(double)self->dscale * self->d[i] / self->srate);
+		double c = 2. * cos(2. * M_PI * self->fscale * self->f[i]
+		    / self->srate) * r;
+
+		if(self->precision == AA_BELL_PRECISION_DOUBLE) {
+			((double*)self->wideR2)[i] = r * r;
+			((double*)self->wideTwoRCosTheta)[i] = c;
+		} else {
+			((int32_t*)self->wideR2)[i] = aa_precision_fixed(r * r,
+				AA_BELL_Q31_COEFF_BITS);
+			((int32_t*)self->wideTwoRCosTheta)[i] = aa_precision_fixed(c,
+				AA_BELL_Q31_COEFF_BITS);
+		}
+	}
+}
+
+/** Copies ampR of modes [begin, end) into the wide ampR of self.
+ */
+void
+aa_bell_precision_gains(
+	aa_bell_t self, int begin, int end
+) {
+	for(int i = begin; i < end; i++) {
+		if(self->precision == AA_BELL_PRECISION_DOUBLE)
+			((double*)self->wideAmpR)[i] = self->ampR[i];
+		else
+			((int32_t*)self->wideAmpR)[i] = aa_precision_fixed(
+				self->ampR[i], AA_BELL_Q31_STATE_BITS);
+	}
+}
+
+/** Copies the point gains of modes [begin, end) into the wide point
+    gains of self.
+ */
+void
+aa_bell_precision_point_gains(
+	aa_bell_t self, int begin, int end
+) {
+	int stride = AA_BELL_PADDED_MODE_COUNT(self->nf);
+
+	for(int p = 0; p < self->np; p++) {
+		const float *g = self->pointAmpR + p * stride;
+
+		for(int i = begin; i < end; i++) {
+			if(self->precision == AA_BELL_PRECISION_DOUBLE)
+				((double*)self->widePointAmpR)[p * stride + i] = g[i];
+			else
+				((int32_t*)self->widePointAmpR)[p * stride + i] =
+				    aa_precision_fixed(g[i], AA_BELL_Q31_STATE_BITS);
+		}
+	}
+}
+
+/** Sets the wide state of mode i from yt_1 and yt_2.
+ */
+static void
+aa_precision_seed(
+	aa_bell_t self, int i
+) {
+	if(self->precision == AA_BELL_PRECISION_DOUBLE) {
+		((double*)self->wideYt_1)[i] = self->yt_1[i];
+		((double*)self->wideYt_2)[i] = self->yt_2[i];
+	} else {
+		((int32_t*)self->wideYt_1)[i] = aa_precision_fixed(
+			self->yt_1[i], AA_BELL_Q31_STATE_BITS);
+		((int32_t*)self->wideYt_2)[i] = aa_precision_fixed(
+			self->yt_2[i], AA_BELL_Q31_STATE_BITS);
+	}
+}
+
+/** Picks up state changed in yt_1 or yt_2 since the last block, for
+    modes [begin, end), or copies the wide state into them if to_float.
+ */
+static void
+aa_precision_sync(
+	aa_bell_t self, int begin, int end, bool to_float
+) {
+	for(int i = begin; i < end; i++) {
+		double y1, y2;
+
+		if(self->precision == AA_BELL_PRECISION_DOUBLE) {
+			y1 = ((double*)self->wideYt_1)[i];
+			y2 = ((double*)self->wideYt_2)[i];
+		} else {
+			y1 = aa_precision_unfixed(((int32_t*)self->wideYt_1)[i],
+				AA_BELL_Q31_STATE_BITS);
+			y2 = aa_precision_unfixed(((int32_t*)self->wideYt_2)[i],
+				AA_BELL_Q31_STATE_BITS);
+		}
+
+		if(to_float) {
+			self->yt_1[i] = (float)y1;
+			self->yt_2[i] = (float)y2;
+			continue;
+		}
+
+		if(((float)y1 != self->yt_1[i]) || ((float)y2 != self->yt_2[i]))
+			aa_precision_seed(self, i);
+	}
+}
+
+/** Renders modes [begin, end) of a bell above float precision, as
+    aa_bell_run_kernel() does. Coefficients do not ramp at these
+    precisions; a smoothed bell steps to new ones.
+ */
+double
+aa_bell_precision_run(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store
+) {
+	double total;
+
+	aa_precision_sync(self, begin, end, false);
+	total = aa_bell_kernel_get_wide_func(self->precision, self->kernel)(
+		self, output, begin, end, store);
+	aa_precision_sync(self, begin, end, true);
+
+	return total;
+}
+
+static void
+aa_precision_release(aa_bell_t self) {
+	free(self->wideR2);
+	free(self->wideTwoRCosTheta);
+	free(self->wideAmpR);
+	free(self->widePointAmpR);
+	free(self->wideYt_1);
+	free(self->wideYt_2);
+	self->wideR2 = self->wideTwoRCosTheta = self->wideAmpR = NULL;
+	self->widePointAmpR = NULL;
+	self->wideYt_1 = self->wideYt_2 = NULL;
+}
+
+/** Selects the precision self renders at. It is chosen for a model
+    before shared bells or banks are made from it, which follow it; a
+    shared bell, a model already shared and a bell with channels set
+    up keep their precision. Culling at other than float precision
+    still finds quiet modes, but renders them anyway, and mode budgets
+    leave such bells whole. A bell switched while ringing rings on from
+    its current state. Returns the precision in use.
+ */
+aa_bell_precision_t
+aa_bell_set_precision(
+	aa_bell_t self, aa_bell_precision_t precision
+) {
+	int nf = self->nf;
+
+	if((precision < AA_BELL_PRECISION_FLOAT)
+	    || (precision > AA_BELL_PRECISION_Q31) || self->model
+	    || self->channelGain
+	    || (__atomic_load_n(&self->refCount, __ATOMIC_RELAXED) > 1)
+	    || (precision == self->precision))
+		return self->precision;
+
+	aa_precision_release(self);
+	self->precision = precision;
+
+	if(precision == AA_BELL_PRECISION_FLOAT)
+		return precision;
+
+	self->wideR2 = aa_bell_precision_alloc_modes(precision, nf);
+	self->wideTwoRCosTheta = aa_bell_precision_alloc_modes(precision, nf);
+	self->wideAmpR = aa_bell_precision_alloc_modes(precision, nf);
+	self->wideYt_1 = aa_bell_precision_alloc_modes(precision, nf);
+	self->wideYt_2 = aa_bell_precision_alloc_modes(precision, nf);
+	if(self->pointAmpR)
+		self->widePointAmpR = aa_bell_precision_alloc_modes(precision,
+			AA_BELL_PADDED_MODE_COUNT(nf) * self->np);
+
+	if(!self->wideR2 || !self->wideTwoRCosTheta || !self->wideAmpR
+	    || !self->wideYt_1 || !self->wideYt_2
+	    || (self->pointAmpR && !self->widePointAmpR)) {
+		aa_precision_release(self);
+		self->precision = AA_BELL_PRECISION_FLOAT;
+		return self->precision;
+	}
+
+	aa_bell_precision_coeffs(self, 0, nf);
+	aa_bell_precision_gains(self, 0, nf);
+	if(self->widePointAmpR)
+		aa_bell_precision_point_gains(self, 0, nf);
+
+	// A ringing bell rings on at the new precision.
+	for(int i = 0; i < nf; i++)
+		aa_precision_seed(self, i);
+
+	return precision;
+}
+
+aa_bell_precision_t
+aa_bell_get_precision(aa_bell_t self) {
+	return self->precision;
+}
@@ -0,0 +1,421 @@
+//
+//  bell_private.h
+//
+
+#ifndef __AA_BELL_PRIVATE_H__
+#define __AA_BELL_PRIVATE_H__ 1
+
+#include "bell.h"
+
+__BEGIN_DECLS
+
+/** Per-mode arrays are padded to this many floats so that a SIMD
+    kernel of any supported width never needs a scalar tail when all
+    modes are in use. Sixteen floats is one 64-byte cache line. */
+#define AA_BELL_MODE_PAD            (16)
+
+#define AA_BELL_PADDED_MODE_COUNT(n) \
+	(((n) + AA_BELL_MODE_PAD - 1) & ~(AA_BELL_MODE_PAD - 1))
+
+/** Modes the SIMD kernels take through a whole block at a time, so
+    that their state, at most eight floats each, stays in L1 from one
+    sample to the next. The output is added to once per tile. A
+    multiple of AA_BELL_MODE_PAD. */
+#define AA_BELL_KERNEL_TILE         (512)
+
+/** Fraction bits of the Q31 precision's state, gains and force, which
+    leaves headroom for amplitudes up to 16, and of its filter
+    coefficients, which lie within +-2. */
+#define AA_BELL_Q31_STATE_BITS      (27)
+#define AA_BELL_Q31_COEFF_BITS      (30)
+
+/** Number of samples the block kernel produces from one state. */
+#define AA_BELL_BLOCK_LEN           (32)
+
+/** A strike at point whose force spans samples [start, start + length)
+    of the bell's clock. Noise strikes read the noise from phase on. */
+struct aa_bell_strike_s {
+	int64_t	start;
+	int		length;
+	float	energy;
+	float	point;
+	aa_bell_excite_t shape;
+	uint32_t phase;
+};
+
+struct aa_bell_s {
+	int		bufferSize;
+
+	/** Bell whose mode data this one shares, or NULL if it owns its
+	    own. Only yt_1, yt_2 and cosForce are private to a shared bell.
+	    Holds a reference to the model. */
+	aa_bell_t model;
+
+	/** Mode frequencies in Hertz. */
+	float * f;
+
+	/**  Angular decay rates in Hertz. */
+	float * d;
+
+	/** Gains. a[p][k] is gain at point p for mode k. */
+	float * a;
+
+	/** Strike position. Point p + t, 0 <= t < 1, takes the gains of
+	    measured point p and p + 1 mixed linearly by t. */
+	float	point;
+
+	/** Number of modes available. */
+	int		nf;
+
+	/** Number of modes used. */
+	int		nfUsed;
+
+	/** Number of points. */
+	int		np;
+
+	/** Multiplies all frequencies. */
+	float	fscale;
+
+	/** Multiplies all dampings. */
+	float	dscale;
+
+	/** Multiplies all gains. */
+	float	ascale;
+
+
+	float * cosForce;
+
+
+	/** Sampling rate in Hertz. */
+	float	srate;
+
+	/** Rendering kernel, already resolved against the running CPU. */
+	aa_bell_kernel_t kernel;
+
+	/** Accuracy of coefficients computed in bulk. */
+	aa_bell_coeff_t coeff;
+
+	/** State of filters. */
+	float * yt_1, *yt_2;
+
+	/** The transfer function of a reson filter is H(z) = 1/(1-twoRCosTheta/z + R2/z*z). */
+	float * R2;
+
+	/** The transfer function of a reson filter is H(z) = 1/(1-twoRCosTheta/z + R2/z*z). */
+	float * twoRCosTheta;
+
+	/** Cached values. */
+	float * c_i;
+
+	/** Reson filter gain vector, ascale * c_i * gain at point. */
+	float * ampR;
+
+	/** A shared bell with an ampR of its own, for a strike point of its
+	    own. It follows its model's coefficients and gains. */
+	bool	ownGains;
+
+	/** Changes whenever ampR is recomputed, so that shared bells with
+	    their own gains know to recompute theirs. */
+	unsigned gainSerial;
+
+	/** The ampR and wideAmpR a shared bell of several points takes once
+	    it is moved, made with it so that moving it never allocates;
+	    NULL otherwise. */
+	float *	ownAmpR;
+	void *	ownWideAmpR;
+
+	/** Gains of each measured point, ascale * c_i * a[p], in rows of
+	    AA_BELL_PADDED_MODE_COUNT(nf), and at precision; NULL for a bell
+	    of one point. Shared like ampR. They do not ramp: force at other
+	    points takes new gains at once. */
+	float *	pointAmpR;
+	void *	widePointAmpR;
+
+	/** Force of strikes at other points than self's, split between the
+	    measured points around theirs, in rows of bufferSize samples;
+	    NULL for a bell of one point. The pointForcedCount rows listed in
+	    pointForced hold force for the block about to be rendered, within
+	    [forceBegin, forceEnd). Private to each bell. */
+	float *	pointForce;
+	int *	pointForced;
+	int		pointForcedCount;
+
+	/** Block kernel state-transition tables, AA_BELL_BLOCK_LEN per mode.
+	    With R = sqrt(R2), blockP[i][j] = R^(j+1) cos((j+1) theta) and
+	    blockQ[i][j] = -R^(j+1) sin((j+1) theta). NULL until the block
+	    kernel is selected. */
+	float * blockP, *blockQ;
+
+	/** Precision of the reson state and coefficients. Above float, the
+	    kernels run on the wide arrays below, as doubles or as int32_t
+	    in fixed point, and yt_1 and yt_2 mirror the wide state after
+	    every block for everything else that reads it. */
+	aa_bell_precision_t precision;
+
+	/** R2, twoRCosTheta and ampR at precision, NULL at float. Shared
+	    like the float ones. */
+	void *	wideR2, *wideTwoRCosTheta, *wideAmpR;
+
+	/** Filter state at precision, NULL at float. Private to each
+	    bell. */
+	void *	wideYt_1, *wideYt_2;
+
+	/** How blocks are synthesized, and the spectral engine's frames,
+	    allocated when spectral synthesis is selected or a shared bell
+	    is made of a model using it, and NULL otherwise. The state is
+	    private to each bell, shared or not. */
+	aa_bell_synthesis_t synthesis;
+	struct aa_bell_spectral_s *spectral;
+
+	/** Model file mapped by the binary loader, or NULL. Any of f, d, a,
+	    R2, twoRCosTheta and c_i may point into it, copy-on-write. */
+	void *	map;
+	size_t	mapSize;
+
+	/** Size of the block self and its arrays were created in, starting
+	    at self, or 0 if its arrays were allocated one by one. Arrays
+	    inside the block are not freed on their own. */
+	size_t	arenaSize;
+
+	/** The block belongs to whoever placed self in it, or to pool if
+	    set, and is not freed with self. */
+	bool	placed;
+	struct aa_bell_pool_s *pool;
+
+	/** Parameter queue, or NULL. Not shared with shared bells. */
+	struct aa_bell_params_s *params;
+
+	/** While smoothing, the R2, twoRCosTheta and ampR the last block
+	    ended with; NULL otherwise. A block that starts with these
+	    different from the targets ramps linearly to the targets.
+	    Shared bells use their model's. */
+	float * rampR2, *rampTwoRCosTheta, *rampAmpR;
+
+	/** Modes [rampBegin, rampEnd) hold every coefficient that differs
+	    from its ramp start; only they are ramped. */
+	int		rampBegin, rampEnd;
+
+	/** Coefficients changed since the current block started. */
+	bool	rampNext;
+
+	/** The current block ramps. */
+	bool	rampBlock;
+
+	/** Samples rendered so far; the block about to be rendered starts
+	    here. */
+	int64_t	time;
+
+	/** Strikes still to be written into cosForce in later blocks. */
+	struct aa_bell_strike_s strikes[AA_BELL_MAX_STRIKES];
+	int		strikeCount;
+
+	/** Force envelope of new strikes. */
+	aa_bell_excite_t excite;
+
+	/** Where the next noise strike starts reading the noise. */
+	uint32_t noisePhase;
+
+	/** Modes quieter than this stop being rendered until the next
+	    strike; 0 renders every mode. */
+	float	cullThreshold;
+
+	/** While culling or under a mode budget, the modes still ringing
+	    in increasing order, and a bell that holds those rendered packed
+	    for the kernels; NULL otherwise. Private to each bell, shared or
+	    not. */
+	int *	live;
+	int		liveCount;
+	aa_bell_t pack;
+
+	/** The live modes the current block renders, in increasing order;
+	    the rest are dropped by a mode budget. */
+	int *	render;
+	int		renderCount;
+	bool *	drop;
+
+	/** Squared amplitude of each live mode after the last block. */
+	float *	power;
+
+	/** Decay of each mode over a block, kept by the budget ranking
+	    self, or NULL to compute it. */
+	const float *dropDecay;
+
+	/** A mode budget ranks the modes of self. */
+	bool	budgeted;
+
+	/** Force has been written into the current block, within samples
+	    [forceBegin, forceEnd). */
+	bool	forced;
+	int		forceBegin;
+	int		forceEnd;
+
+	/** Mode budget of self alone, or NULL. */
+	aa_bell_budget_t budget;
+
+	/** The current block renders from the pack. */
+	bool	packed;
+
+	/** A strike came while packed; wake every mode after the block. */
+	bool	wakeNext;
+
+	/** Output channels of aa_bell_compute_channels(). Private to each
+	    bell, shared or not. */
+	int		channels;
+
+	/** Gain of each channel, and the point it picks up at, or -1 to
+	    hear every mode as the mono output does. */
+	float	channelPan[AA_BELL_MAX_CHANNELS];
+	float	channelPoint[AA_BELL_MAX_CHANNELS];
+
+	/** Per-mode gain of each channel, pan times pickup, in rows
+	    channelStride apart; NULL until channels are set up. A pack
+	    holds the rows of its modes. */
+	float *	channelGain;
+	int		channelStride;
+
+	/** The rows need recomputing, or the owner's gainSerial they were
+	    computed at. */
+	bool	channelStale;
+	unsigned channelSerial;
+
+	/** References held by the creator, shared bells and model banks.
+	    Updated atomically, so it is kept last and left out when a shared
+	    bell copies its model. */
+	int		refCount;
+};
+
+void aa_bell_init(
+	aa_bell_t self, int nf, int np, int bufferSize, int srate);
+int aa_bell_alloc_arrays(aa_bell_t self);
+float* aa_bell_alloc_modes(int nf);
+aa_bell_t aa_bell_create_shared_sized(
+	aa_bell_t model, int bufferSize);
+void aa_bell_release_params(aa_bell_t self);
+void aa_bell_arena_place(
+	aa_bell_t self, bool shared);
+void aa_bell_pool_put(
+	aa_bell_pool_t self, aa_bell_t bell);
+void aa_bell_start_block(aa_bell_t self);
+void aa_bell_end_block(aa_bell_t self);
+int aa_bell_unshare(aa_bell_t self);
+void aa_bell_compute_reson_coeff_at(
+	aa_bell_t self, int i, float srate,
+	float *R2, float *twoRCosTheta, float *c_i);
+void aa_bell_compute_coeffs(
+	aa_bell_t self, int begin, int end, bool decay);
+void aa_bell_compute_gains(
+	aa_bell_t self, int begin, int end);
+void aa_bell_compute_point_gains(
+	aa_bell_t self, int begin, int end);
+int aa_bell_enable_pack(aa_bell_t self);
+void aa_bell_release_cull(aa_bell_t self);
+void aa_bell_cull_wake(aa_bell_t self);
+void aa_bell_cull_pack(aa_bell_t self);
+void aa_bell_cull_update(aa_bell_t self);
+double aa_bell_cull_run(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store);
+double aa_bell_cull_run_channels(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store,
+	bool interleaved);
+void aa_bell_excite_write(
+	const struct aa_bell_strike_s *strike, float *output,
+	int64_t from, int begin, int end);
+
+/** A kernel adds the output of modes [begin, end) driven by cosForce,
+    and by the forced rows of pointForce through pointAmpR, into
+    output, or stores it there if store is set, and advances their
+    state by bufferSize samples. Returns the sum of |y| of mode 0 when
+    it lies in the range. */
+typedef double (*aa_bell_kernel_func_t)(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store);
+
+double aa_bell_kernel_scalar(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store);
+double aa_bell_kernel_simd4(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store);
+double aa_bell_kernel_simd8(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store);
+double aa_bell_kernel_simd16(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store);
+double aa_bell_kernel_block(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store);
+
+void aa_bell_kernel_block_coeff(
+	aa_bell_t self, int i);
+
+double aa_bell_kernel_scalar_ramp(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store);
+double aa_bell_kernel_simd4_ramp(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store);
+double aa_bell_kernel_simd8_ramp(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store);
+double aa_bell_kernel_simd16_ramp(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store);
+
+double aa_bell_kernel_scalar_double(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store);
+double aa_bell_kernel_simd4_double(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store);
+double aa_bell_kernel_simd8_double(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store);
+double aa_bell_kernel_simd16_double(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store);
+double aa_bell_kernel_scalar_q31(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store);
+
+/** A channel kernel renders modes [begin, end) as a kernel does, into
+    self->channels channels, each mode's output weighted by the
+    channel's row of channelGain. Channel c of sample k is at
+    output[c * bufferSize + k], or output[k * channels + c] if
+    interleaved. Coefficients ramp when the owner's block does. */
+typedef double (*aa_bell_channels_func_t)(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store,
+	bool interleaved);
+
+double aa_bell_kernel_scalar_channels(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store,
+	bool interleaved);
+double aa_bell_kernel_simd4_channels(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store,
+	bool interleaved);
+double aa_bell_kernel_simd8_channels(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store,
+	bool interleaved);
+double aa_bell_kernel_simd16_channels(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store,
+	bool interleaved);
+
+aa_bell_kernel_t aa_bell_kernel_resolve(aa_bell_kernel_t kernel);
+aa_bell_kernel_func_t aa_bell_kernel_get_func(aa_bell_kernel_t kernel);
+aa_bell_kernel_func_t aa_bell_kernel_get_ramp_func(aa_bell_kernel_t kernel);
+aa_bell_kernel_func_t aa_bell_kernel_get_wide_func(
+	aa_bell_precision_t precision, aa_bell_kernel_t kernel);
+aa_bell_channels_func_t aa_bell_kernel_get_channels_func(
+	aa_bell_kernel_t kernel);
+double aa_bell_run_kernel(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store);
+double aa_bell_render_sound_buffer(
+	aa_bell_t self, float *restrict output, bool store);
+
+void *aa_bell_precision_alloc_modes(
+	aa_bell_precision_t precision, int nf);
+void *aa_bell_precision_copy_modes(
+	aa_bell_precision_t precision, const void *src, int nf);
+void aa_bell_precision_coeffs(
+	aa_bell_t self, int begin, int end);
+void aa_bell_precision_gains(
+	aa_bell_t self, int begin, int end);
+void aa_bell_precision_point_gains(
+	aa_bell_t self, int begin, int end);
+double aa_bell_precision_run(
+	aa_bell_t self, float *restrict output, int begin, int end, bool store);
+
+double aa_bell_spectral_run(
+	aa_bell_t self, float *restrict output, int end, bool store);
+void aa_bell_release_spectral(aa_bell_t self);
+
+int aa_bell_channels_alloc_pack(aa_bell_t self);
+void aa_bell_channels_update(aa_bell_t self);
+
+__END_DECLS
+#endif                          // #ifndef __AA_BELL_PRIVATE_H__
@@ -0,0 +1,614 @@
+//
+//  bell_spectral.c
+//
+//  Spectral synthesis of ringing modes. Between strikes each reson
+//  rings freely, y[n] = 2 Re(C z^n) with z its pole, and a block of
+//  such sinusoids can be built in the frequency domain at a cost per
+//  mode that does not grow with the block. Each block starts a frame
+//  twice its length, windowed so that overlapping frames add up to
+//  one, whose spectrum is C times a few bins around the mode that only
+//  depend on its coefficients, and brings it back by one inverse FFT.
+//  A block plays the first half of its frame and the second half of
+//  the one before.
+//
+//  Blocks with force in them, coefficient ramps or packed modes are
+//  rendered by the kernels as usual, as is the block after them, whose
+//  frame is only started; the frames take over again from the block
+//  after that.
+//
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bell_private.h"
+
+#ifndef M_PI
+#define M_PI                    3.14159265358979323846
+#endif
+
+/** Bins written on each side of a mode's nearest bin. The error bound
+    given with aa_bell_synthesis_t is for this many. */
+#define AA_SPECTRAL_BINS        (8)
+#define AA_SPECTRAL_WIDTH       (2 * AA_SPECTRAL_BINS + 1)
+
+/** Floats each mode's kernel takes per part, the bins rounded up to
+    whole vectors. */
+#define AA_SPECTRAL_STRIDE      ((AA_SPECTRAL_WIDTH + 3) & ~3)
+
+/** The window is 1/2 - 9/16 cos(x) + 1/16 cos(3x) over a frame: it and
+    its first three derivatives vanish at the ends, so its spectrum
+    falls off as the fifth power of the distance from its centre, and
+    it sums to one with itself shifted by half a frame. Its spectrum
+    spans AA_SPECTRAL_REACH bins beyond the ones written. */
+#define AA_SPECTRAL_A0          (0.5)
+#define AA_SPECTRAL_A1          (-9.0 / 16.0)
+#define AA_SPECTRAL_A3          (1.0 / 16.0)
+#define AA_SPECTRAL_REACH       (AA_SPECTRAL_BINS + 3)
+
+/** Modes whose state is below this add nothing audible to a frame,
+    only denormals; they are advanced without being written. */
+#define AA_SPECTRAL_QUIET       (1e-30)
+
+typedef float aa_spectral_vec __attribute__((vector_size(16)));
+typedef float aa_spectral_uvec __attribute__((vector_size(16), aligned(4)));
+
+struct aa_bell_spectral_s {
+	/** Frame length, twice the block. */
+	int		size;
+
+	/** R2 and twoRCosTheta the rest was derived from, per mode. */
+	float *	R2;
+	float *	twoRCosTheta;
+
+	/** Per mode, with z = R cos(theta) + i R sin(theta) its pole: z,
+	    R / (2 sin(theta)) and cos(theta) / sin(theta), which take the
+	    filter state to C, and z^(bufferSize - 2), which takes C to the
+	    state after the block. */
+	double *zr, *zi;
+	double *p, *q;
+	double *er, *ei;
+
+	/** First bin each mode writes, or -1 for a mode rendered sample
+	    by sample: a real pole has no sinusoid to write. */
+	int *	bin;
+
+	/** Spectrum of each mode's frame for C = 1, AA_SPECTRAL_STRIDE
+	    real parts and then as many imaginary parts per mode, zero past
+	    AA_SPECTRAL_WIDTH. */
+	float *	kernel;
+
+	/** e^(-2 pi i m / size), to derive the kernels. */
+	double *rotr, *roti;
+
+	/** The inverse FFT runs at half the frame on two real samples per
+	    complex one: e^(2 pi i k / size) to pack the spectrum, the
+	    twiddles of each stage of h butterflies from index h on, and
+	    the bit reversal permutation. */
+	float *	packr, *packi;
+	float *	twr, *twi;
+	int *	reverse;
+
+	/** Spectrum of the frame, with room for a last mode's whole
+	    kernel, the packed FFT and the frame in time. */
+	float *	specRe, *specIm;
+	float *	fftRe, *fftIm;
+	float *	frame;
+
+	/** Second half of the last frame, the time it starts at and the
+	    modes it holds, or tailTime -1 if there is none. */
+	float *	tail;
+	int64_t	tailTime;
+	int		tailEnd;
+
+	/** Filter state after the last block, to tell whether anything but
+	    rendering changed it since. */
+	float *	yt_1, *yt_2;
+};
+
+/** Whether frames can be built for blocks of bufferSize samples: the
+    FFT takes powers of two, and a mode's bins must not wrap onto each
+    other.
+ */
+static bool
+aa_spectral_fits(int bufferSize) {
+	return !(bufferSize & (bufferSize - 1))
+	    && (2 * bufferSize >= AA_SPECTRAL_WIDTH);
+}
+
+static void
+aa_spectral_free(struct aa_bell_spectral_s *s) {
+	if(!s)
+		return;
+
+	free(s->R2);
+	free(s->twoRCosTheta);
+	free(s->zr);
+	free(s->zi);
+	free(s->p);
+	free(s->q);
+	free(s->er);
+	free(s->ei);
+	free(s->bin);
+	free(s->kernel);
+	free(s->rotr);
+	free(s->roti);
+	free(s->packr);
+	free(s->packi);
+	free(s->twr);
+	free(s->twi);
+	free(s->reverse);
+	free(s->specRe);
+	free(s->specIm);
+	free(s->fftRe);
+	free(s->fftIm);
+	free(s->frame);
+	free(s->tail);
+	free(s->yt_1);
+	free(s->yt_2);
+	free(s);
+}
+
+void
+aa_bell_release_spectral(aa_bell_t self) {
+	aa_spectral_free(self->spectral);
+	self->spectral = NULL;
+}
+
+static struct aa_bell_spectral_s*
+aa_spectral_create(aa_bell_t self) {
+	struct aa_bell_spectral_s *ret = calloc(sizeof(*ret), 1);
+	int nf = self->nf;
+	int half = self->bufferSize;
+	int size = 2 * half;
+	int bits = 0;
+
+	if(!ret)
+		goto bail;
+
+	ret->size = size;
+	ret->tailTime = -1;
+
+	ret->R2 = aa_bell_alloc_modes(nf);
+	ret->twoRCosTheta = aa_bell_alloc_modes(nf);
+	ret->zr = calloc(sizeof(double), nf);
+	ret->zi = calloc(sizeof(double), nf);
+	ret->p = calloc(sizeof(double), nf);
+	ret->q = calloc(sizeof(double), nf);
+	ret->er = calloc(sizeof(double), nf);
+	ret->ei = calloc(sizeof(double), nf);
+	ret->bin = calloc(sizeof(int), nf);
+	ret->kernel = aa_bell_alloc_modes(2 * AA_SPECTRAL_STRIDE * nf);
+	ret->rotr = calloc(sizeof(double), size);
+	ret->roti = calloc(sizeof(double), size);
+	ret->packr = aa_bell_alloc_modes(half);
+	ret->packi = aa_bell_alloc_modes(half);
+	ret->twr = aa_bell_alloc_modes(half);
+	ret->twi = aa_bell_alloc_modes(half);
+	ret->reverse = calloc(sizeof(int), half);
+	ret->specRe = aa_bell_alloc_modes(size + AA_SPECTRAL_STRIDE);
+	ret->specIm = aa_bell_alloc_modes(size + AA_SPECTRAL_STRIDE);
+	ret->fftRe = aa_bell_alloc_modes(half);
+	ret->fftIm = aa_bell_alloc_modes(half);
+	ret->frame = aa_bell_alloc_modes(size);
+	ret->tail = aa_bell_alloc_modes(half);
+	ret->yt_1 = aa_bell_alloc_modes(nf);
+	ret->yt_2 = aa_bell_alloc_modes(nf);
+
+	if(!ret->R2 || !ret->twoRCosTheta || !ret->zr || !ret->zi || !ret->p
+	    || !ret->q || !ret->er || !ret->ei || !ret->bin || !ret->kernel
+	    || !ret->rotr || !ret->roti || !ret->packr || !ret->packi
+	    || !ret->twr || !ret->twi || !ret->reverse || !ret->specRe
+	    || !ret->specIm || !ret->fftRe || !ret->fftIm || !ret->frame
+	    || !ret->tail || !ret->yt_1 || !ret->yt_2) {
+		aa_spectral_free(ret);
+		ret = NULL;
+		goto bail;
+	}
+
+	for(int m = 0; m < size; m++) {
+		ret->rotr[m] = cos(2.0 * M_PI * m / size);
+		ret->roti[m] = -sin(2.0 * M_PI * m / size);
+	}
+	for(int k = 0; k < half; k++) {
+		ret->packr[k] = (float)ret->rotr[k];
+		ret->packi[k] = (float)-ret->roti[k];
+	}
+	for(int h = 1; h < half; h *= 2) {
+		for(int k = 0; k < h; k++) {
+			ret->twr[h + k] = (float)cos(M_PI * k / h);
+			ret->twi[h + k] = (float)sin(M_PI * k / h);
+		}
+	}
+	while((1 << bits) < half)
+		bits++;
+	for(int k = 0; k < half; k++) {
+		int r = 0;
+
+		for(int b = 0; b < bits; b++)
+			r |= ((k >> b) & 1) << (bits - 1 - b);
+		ret->reverse[k] = r;
+	}
+
+	// Derive every mode on the first block.
+	for(int i = 0; i < nf; i++)
+		ret->R2[i] = NAN;
+
+bail:
+	return ret;
+}
+
+/** Selects how self renders. The spectral engine is exact to the
+    bound given with aa_bell_synthesis_t and only used for blocks of a
+    power of two samples, at least 16. AA_BELL_SYNTHESIS_AUTO renders
+    in time, so that output stays identical across block sizes: the
+    bench finds the frames faster for bells left ringing, but at a
+    crossover that moves with the machine and loses to the blocks a
+    struck bell renders in time anyway. Shared bells choose for
+    themselves, starting with their model's choice. Returns the
+    synthesis in use.
+ */
+aa_bell_synthesis_t
+aa_bell_set_synthesis(
+	aa_bell_t self, aa_bell_synthesis_t synthesis
+) {
+	if((synthesis < AA_BELL_SYNTHESIS_AUTO)
+	    || (synthesis > AA_BELL_SYNTHESIS_SPECTRAL)
+	    || ((synthesis == AA_BELL_SYNTHESIS_SPECTRAL)
+	        && !aa_spectral_fits(self->bufferSize)))
+		return aa_bell_get_synthesis(self);
+
+	self->synthesis = synthesis;
+
+	if(aa_bell_get_synthesis(self) == AA_BELL_SYNTHESIS_TIME) {
+		aa_bell_release_spectral(self);
+		return AA_BELL_SYNTHESIS_TIME;
+	}
+
+	if(!self->spectral && !(self->spectral = aa_spectral_create(self))) {
+		self->synthesis = AA_BELL_SYNTHESIS_TIME;
+		return AA_BELL_SYNTHESIS_TIME;
+	}
+
+	return AA_BELL_SYNTHESIS_SPECTRAL;
+}
+
+aa_bell_synthesis_t
+aa_bell_get_synthesis(aa_bell_t self) {
+	if(self->synthesis == AA_BELL_SYNTHESIS_AUTO)
+		return AA_BELL_SYNTHESIS_TIME;
+
+	return self->synthesis;
+}
+
+/** Derives the kernel of mode i, whose pole is at angle theta, from
+    the spectrum of z^n over a frame, D(m) = (1 - z^size) / (1 - z
+    e^(-2 pi i m / size)), summed over the window's cosines.
+ */
+static void
+aa_spectral_derive_kernel(
+	struct aa_bell_spectral_s *s, int i, double theta
+) {
+	int size = s->size;
+	int mask = size - 1;
+	int m0 = s->bin[i] - 3;
+	double zr = s->zr[i], zi = s->zi[i];
+	double rn = pow(sqrt(zr * zr + zi * zi), size);
+	double gr = 1.0 - rn * cos(size * theta);
+	double gi = -rn * sin(size * theta);
+	double dr[2 * AA_SPECTRAL_REACH + 1], di[2 * AA_SPECTRAL_REACH + 1];
+	float *kernel = s->kernel + 2 * AA_SPECTRAL_STRIDE * i;
+
+	for(int j = 0; j <= 2 * AA_SPECTRAL_REACH; j++) {
+		int m = (m0 + j) & mask;
+		double ur = 1.0 - (zr * s->rotr[m] - zi * s->roti[m]);
+		double ui = -(zr * s->roti[m] + zi * s->rotr[m]);
+		double norm = 1.0 / (ur * ur + ui * ui);
+
+		dr[j] = (gr * ur + gi * ui) * norm;
+		di[j] = (gi * ur - gr * ui) * norm;
+	}
+
+	for(int j = 0; j < AA_SPECTRAL_WIDTH; j++) {
+		int c = j + 3;
+
+		kernel[j] = (float)(AA_SPECTRAL_A0 * dr[c]
+		    + 0.5 * AA_SPECTRAL_A1 * (dr[c - 1] + dr[c + 1])
+		    + 0.5 * AA_SPECTRAL_A3 * (dr[c - 3] + dr[c + 3]));
+		kernel[AA_SPECTRAL_STRIDE + j] = (float)(AA_SPECTRAL_A0 * di[c]
+		    + 0.5 * AA_SPECTRAL_A1 * (di[c - 1] + di[c + 1])
+		    + 0.5 * AA_SPECTRAL_A3 * (di[c - 3] + di[c + 3]));
+	}
+}
+
+/** Derives what the frames need of the modes below end whose
+    coefficients changed. Returns whether any did.
+ */
+static bool
+aa_spectral_derive(
+	aa_bell_t self, int end
+) {
+	struct aa_bell_spectral_s *s = self->spectral;
+	int size = s->size;
+	int nsamples = self->bufferSize;
+	bool changed = false;
+
+	for(int i = 0; i < end; i++) {
+		double r2 = self->R2[i];
+		double tc = self->twoRCosTheta[i];
+		double R, cosTheta, sinTheta, theta, rn;
+
+		if((self->R2[i] == s->R2[i])
+		    && (self->twoRCosTheta[i] == s->twoRCosTheta[i]))
+			continue;
+
+		s->R2[i] = self->R2[i];
+		s->twoRCosTheta[i] = self->twoRCosTheta[i];
+		changed = true;
+
+		R = sqrt(r2);
+		cosTheta = R > 0.0 ? tc / (2.0 * R) : 1.0;
+
+		if(!(r2 > 0.0) || (fabs(cosTheta) >= 1.0 - 1e-12)) {
+			s->bin[i] = -1;
+			continue;
+		}
+
+		theta = acos(cosTheta);
+		sinTheta = sin(theta);
+		s->zr[i] = tc / 2.0;
+		s->zi[i] = R * sinTheta;
+		s->p[i] = R / (2.0 * sinTheta);
+		s->q[i] = cosTheta / sinTheta;
+
+		rn = pow(R, nsamples - 2);
+		s->er[i] = rn * cos((nsamples - 2) * theta);
+		s->ei[i] = rn * sin((nsamples - 2) * theta);
+
+		s->bin[i] = ((int)lround(theta * size / (2.0 * M_PI))
+		    - AA_SPECTRAL_BINS) & (size - 1);
+		aa_spectral_derive_kernel(s, i, theta);
+	}
+
+	return changed;
+}
+
+/** Brings the spectrum back to time as the frame: packs it into a
+    complex FFT of half its length, whose real and imaginary parts are
+    the even and odd samples of 2 Re of the inverse transform. The FFT
+    decimates in frequency, so that it takes the packed spectrum in
+    order and leaves the samples in bit reversed order, and its last
+    two stages only add.
+ */
+static void
+aa_spectral_inverse(struct aa_bell_spectral_s *s) {
+	int size = s->size;
+	int half = size / 2;
+	int mask = size - 1;
+	const float *xr = s->specRe, *xi = s->specIm;
+	float *restrict re = s->fftRe, *restrict im = s->fftIm;
+	float scale = 1.0f / size;
+
+	for(int k = 0; k < half; k++) {
+		int neg = (size - k) & mask;
+		float hr = xr[k] + xr[neg], hi = xi[k] - xi[neg];
+		float ur = xr[k + half] + xr[half - k];
+		float ui = xi[k + half] - xi[half - k];
+		float dr = hr - ur, di = hi - ui;
+		float tr = dr * s->packr[k] - di * s->packi[k];
+		float ti = dr * s->packi[k] + di * s->packr[k];
+
+		re[k] = hr + ur - ti;
+		im[k] = hi + ui + tr;
+	}
+
+	for(int h = half / 2; h >= 4; h /= 2) {
+		for(int base = 0; base < half; base += 2 * h) {
+			for(int k = 0; k < h; k += 4) {
+				aa_spectral_vec *ar = (aa_spectral_vec*)(re + base + k);
+				aa_spectral_vec *ai = (aa_spectral_vec*)(im + base + k);
+				aa_spectral_vec *br = (aa_spectral_vec*)(re + base + k + h);
+				aa_spectral_vec *bi = (aa_spectral_vec*)(im + base + k + h);
+				aa_spectral_vec wr = *(aa_spectral_vec*)(s->twr + h + k);
+				aa_spectral_vec wi = *(aa_spectral_vec*)(s->twi + h + k);
+				aa_spectral_vec dr = *ar - *br, di = *ai - *bi;
+
+				*ar += *br;
+				*ai += *bi;
+				*br = dr * wr - di * wi;
+				*bi = dr * wi + di * wr;
+			}
+		}
+	}
+
+	// Twiddles 1 and i, then 1.
+	for(int base = 0; base < half; base += 4) {
+		float *r = re + base, *i = im + base;
+		float s0r = r[0] + r[2], s0i = i[0] + i[2];
+		float d0r = r[0] - r[2], d0i = i[0] - i[2];
+		float s1r = r[1] + r[3], s1i = i[1] + i[3];
+		float d1r = i[3] - i[1], d1i = r[1] - r[3];
+
+		r[0] = s0r + s1r;
+		i[0] = s0i + s1i;
+		r[1] = s0r - s1r;
+		i[1] = s0i - s1i;
+		r[2] = d0r + d1r;
+		i[2] = d0i + d1i;
+		r[3] = d0r - d1r;
+		i[3] = d0i - d1i;
+	}
+
+	for(int n = 0; n < half; n++) {
+		s->frame[2 * n] = re[s->reverse[n]] * scale;
+		s->frame[2 * n + 1] = im[s->reverse[n]] * scale;
+	}
+}
+
+/** Builds the frame of the modes below end from their state. If
+    advance is set, also moves their state to the end of the block.
+ */
+static void
+aa_spectral_frame(
+	aa_bell_t self, int end, bool advance
+) {
+	struct aa_bell_spectral_s *s = self->spectral;
+	int mask = s->size - 1;
+	float *restrict specRe = s->specRe, *restrict specIm = s->specIm;
+
+	memset(specRe, 0, sizeof(float) * s->size);
+	memset(specIm, 0, sizeof(float) * s->size);
+
+	for(int i = 0; i < end; i++) {
+		double y1 = self->yt_1[i], y2 = self->yt_2[i];
+		double zr, zi, ar, ai;
+		const float *kernel = s->kernel + 2 * AA_SPECTRAL_STRIDE * i;
+		int m0 = s->bin[i];
+		float cr, ci;
+
+		if((m0 < 0) || ((y1 == 0.0) && (y2 == 0.0)))
+			continue;
+
+		// y[-1] = 2 Re(C / z) and y[-2] = 2 Re(C / z^2).
+		zr = s->zr[i];
+		zi = s->zi[i];
+		ar = 0.5 * y1;
+		ai = s->p[i] * y2 - s->q[i] * ar;
+		cr = (float)(ar * zr - ai * zi);
+		ci = (float)(ar * zi + ai * zr);
+
+		if(fabs(y1) + fabs(y2) < AA_SPECTRAL_QUIET) {
+			// Nothing to write.
+		} else if(m0 + AA_SPECTRAL_WIDTH <= s->size) {
+			for(int j = 0; j < AA_SPECTRAL_STRIDE; j += 4) {
+				aa_spectral_vec kr = *(const aa_spectral_vec*)(kernel + j);
+				aa_spectral_vec ki = *(const aa_spectral_vec*)
+				    (kernel + AA_SPECTRAL_STRIDE + j);
+
+				*(aa_spectral_uvec*)(specRe + m0 + j) += cr * kr - ci * ki;
+				*(aa_spectral_uvec*)(specIm + m0 + j) += cr * ki + ci * kr;
+			}
+		} else {
+			for(int j = 0; j < AA_SPECTRAL_WIDTH; j++) {
+				float kr = kernel[j], ki = kernel[AA_SPECTRAL_STRIDE + j];
+				int m = (m0 + j) & mask;
+
+				specRe[m] += cr * kr - ci * ki;
+				specIm[m] += cr * ki + ci * kr;
+			}
+		}
+
+		if(advance) {
+			double er = s->er[i], ei = s->ei[i];
+			double pr = cr * er - ci * ei;
+			double pi = cr * ei + ci * er;
+
+			self->yt_2[i] = (float)(2.0 * pr);
+			self->yt_1[i] = (float)(2.0 * (pr * zr - pi * zi));
+		}
+	}
+
+	aa_spectral_inverse(s);
+}
+
+/** Rings one mode through the block from *y1 and *y2 without force,
+    adding it to output if given. Returns the sum of |y|.
+ */
+static double
+aa_spectral_ring(
+	float tc, float r2, float *y1, float *y2, float *restrict output,
+	int nsamples
+) {
+	float a = *y1, b = *y2;
+	double total = 0.0;
+
+	for(int k = 0; k < nsamples; k++) {
+		float y = tc * a - r2 * b;
+
+		b = a;
+		a = y;
+		if(output)
+			output[k] += y;
+		total += fabsf(y);
+	}
+
+	*y1 = a;
+	*y2 = b;
+
+	return total;
+}
+
+/** Renders the modes below end of the block about to be rendered, as
+    aa_bell_run_kernel() would, from frames where it can. The frames
+    are allocated when the synthesis is chosen, never here; without
+    them every block renders in time.
+ */
+double
+aa_bell_spectral_run(
+	aa_bell_t self, float *restrict output, int end, bool store
+) {
+	struct aa_bell_spectral_s *s;
+	aa_bell_t owner = self->model ? self->model : self;
+	int nsamples = self->bufferSize;
+	double total = 0.0;
+	bool valid, ringing;
+
+	if(!self->spectral)
+		return aa_bell_run_kernel(self, output, 0, end, store);
+
+	s = self->spectral;
+	ringing = (self->precision == AA_BELL_PRECISION_FLOAT)
+	    && !self->packed && !owner->rampBlock && !self->forced;
+
+	if(!ringing) {
+		s->tailTime = -1;
+		return aa_bell_run_kernel(self, output, 0, end, store);
+	}
+
+	valid = !aa_spectral_derive(self, end)
+	    && (s->tailTime == self->time) && (s->tailEnd == end)
+	    && !memcmp(s->yt_1, self->yt_1, sizeof(float) * end)
+	    && !memcmp(s->yt_2, self->yt_2, sizeof(float) * end);
+
+	if(valid) {
+		const float *frame = s->frame;
+
+		if(end > 0) {
+			float y1 = self->yt_1[0], y2 = self->yt_2[0];
+
+			total = aa_spectral_ring(self->twoRCosTheta[0], self->R2[0],
+				&y1, &y2, NULL, nsamples);
+		}
+
+		aa_spectral_frame(self, end, true);
+
+		for(int k = 0; k < nsamples; k++) {
+			if(store)
+				output[k] = s->tail[k] + frame[k];
+			else
+				output[k] += s->tail[k] + frame[k];
+		}
+
+		// Modes with a real pole ring on sample by sample.
+		for(int i = 0; i < end; i++)
+			if(s->bin[i] < 0)
+				aa_spectral_ring(self->twoRCosTheta[i], self->R2[i],
+					&self->yt_1[i], &self->yt_2[i], output, nsamples);
+	} else {
+		// The frame starts from the state the kernel starts from, and
+		// is only heard from the next block on.
+		aa_spectral_frame(self, end, false);
+		total = aa_bell_run_kernel(self, output, 0, end, store);
+	}
+
+	memcpy(s->tail, s->frame + nsamples, sizeof(float) * nsamples);
+	s->tailTime = self->time + nsamples;
+	s->tailEnd = end;
+	memcpy(s->yt_1, self->yt_1, sizeof(float) * end);
+	memcpy(s->yt_2, self->yt_2, sizeof(float) * end);
+
+	return total;
+}
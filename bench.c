@@ -0,0 +1,3899 @@
+//
+//  bench.c
+//
+//  Benchmark and profiling suite for the bell engine. Results are
+//  printed one per line and can also be written as JSON (-o) so that
+//  they can be compared between commits.
+//
+
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "audio.h"
+#include "bank.h"
+#include "bell.h"
+#include "bell_private.h"
+#include "input.h"
+#include "output.h"
+#include "scheduler.h"
+#include "voices.h"
+
+#ifndef BENCH_REVISION
+#define BENCH_REVISION          "unknown"
+#endif
+
+#define BENCH_SRATE             (44100)
+#define BENCH_BUFFER_SIZE       (256)
+#define BENCH_SECONDS           (0.25)
+
+/** Each measurement repeats until it has run for at least this long. */
+#define BENCH_MIN_SECONDS       (0.05)
+#define BENCH_QUICK_MIN_SECONDS (0.005)
+
+/** Largest difference tolerated between a kernel and the scalar
+    reference over one second, relative to the peak of the reference.
+    The SIMD kernels evolve modes identically and only sum them in a
+    different order; the block kernel rounds differently but must not
+    drift audibly. */
+#define BENCH_KERNEL_TOLERANCE  (1e-4)
+
+#define BENCH_MAX_VOICES        (4096)
+
+#define BENCH_TIMING_SECONDS    (1.5)
+
+/** Modes of the larger model the timing suite renders besides wok.sy,
+    enough to fill several tiles of every kernel. */
+#define BENCH_TIMING_MODES      (256)
+
+#define BENCH_POINT_MODES       (60)
+#define BENCH_POINT_COUNT       (32)
+#define BENCH_POINT_VOICES      (16)
+
+#define BENCH_SCHEDULER_MODES   (10000)
+#define BENCH_SCHEDULER_VOICES  (256)
+
+#define BENCH_BANK_INSTANCES    (1000)
+
+#define BENCH_PARAM_MODES       (1000)
+#define BENCH_PARAM_QUEUE_SIZE  (256)
+
+/** Largest error of the approximate coefficient tiers, in cents of
+    frequency and relative error of decay. Single precision coefficients
+    alone put the exact tier up to about half a cent and 0.1% of decay
+    off for slow, low modes. */
+#define BENCH_COEFF_MAX_CENTS   (2.0)
+#define BENCH_COEFF_MAX_DECAY_ERR (2e-3)
+
+/** The smoothing suite changes a frequency this often, in seconds of
+    audio, whatever the buffer size. */
+#define BENCH_SMOOTHING_CHANGE_SECONDS  (0.005)
+#define BENCH_SMOOTHING_MODES   (1000)
+
+/** The cull suite strikes wok.sy this often over this long, and a
+    voice pool once per interval. */
+#define BENCH_CULL_SECONDS      (6.0)
+#define BENCH_CULL_STRIKE_SECONDS (2.0)
+#define BENCH_CULL_VOICES       (256)
+#define BENCH_CULL_VOICE_SECONDS (0.05)
+#define BENCH_CULL_REPEATS      (5)
+
+/** Cull threshold of the voices the budget suite renders. */
+#define BENCH_BUDGET_THRESHOLD  (1e-5f)
+
+/** Buffers summed into the bus of the output suite. */
+#define BENCH_OUTPUT_PARTS      (4)
+
+/** Length of the renders the precision suite checks, in full and quick
+    runs. */
+#define BENCH_PRECISION_SECONDS (60)
+#define BENCH_PRECISION_QUICK_SECONDS (10)
+
+/** Measured points of the bells the channels suite picks up from. */
+#define BENCH_CHANNEL_POINTS    (4)
+
+/** Input suite: samples streamed through the ring, chunk size of the
+    simulated capture device, and input impulses for the onset check. */
+#define BENCH_INPUT_SAMPLES     (1 << 22)
+#define BENCH_INPUT_QUICK_SAMPLES (1 << 19)
+#define BENCH_INPUT_CHUNK       (64)
+#define BENCH_INPUT_IMPULSES    (3)
+
+/** Seconds the audio engine plays into the null sink for each period
+    and ring size, and periods it writes to a file to check its output. */
+#define BENCH_AUDIO_SECONDS     (1.0)
+#define BENCH_AUDIO_QUICK_SECONDS (0.25)
+#define BENCH_AUDIO_FILE_PERIODS (200)
+
+/** Bells rendered one after the other to compare how their arrays are
+    laid out, and the modes each has: a small struck object. */
+#define BENCH_ARENA_BELLS       (64)
+#define BENCH_ARENA_MODES       (60)
+
+/** Spectral suite: the error bound documented with
+    aa_bell_synthesis_t, the seconds it renders to check against it,
+    and how often it restrikes the bells it times. Strikes and the
+    block after them render in time, so the engine is timed ringing
+    for longer than the kernels usually are, short of denormals. */
+#define BENCH_SPECTRAL_BOUND    (3e-4)
+#define BENCH_SPECTRAL_SECONDS  (2.0)
+#define BENCH_SPECTRAL_RESTRIKE_SECONDS (1.0)
+
+/** Frozen suite: noise floor of the cached responses, how often its
+    score strikes, and most strikes playing at once. A strike may be off
+    by the floor, and the rounding of scaling its response by its
+    energy. */
+#define BENCH_FROZEN_FLOOR      (1e-4f)
+#define BENCH_FROZEN_ROUNDING   (1e-6)
+#define BENCH_FROZEN_STRIKE_SECONDS (0.05)
+#define BENCH_FROZEN_STRIKES    (1024)
+
+#define BENCH_DRIFT_SECONDS     (60)
+#define BENCH_DRIFT_BUFFER_SIZE (4096)
+
+static const char *gModelPaths[] = {
+	"sy/sine1.sy", "sy/tmp.sy", "sy/glass.sy", "sy/wok.sy",
+};
+
+static struct {
+	bool	quick;
+	double	min_seconds;
+
+	FILE *	json;
+	bool	json_first;
+	bool	text_first;
+
+	int		counter_fd;
+	int		l1d_fd;
+	long long l1d_misses;
+} gBench = {
+	.min_seconds = BENCH_MIN_SECONDS,
+	.counter_fd = -1,
+	.l1d_fd = -1,
+	.l1d_misses = -1,
+};
+
+#define BENCH_COUNT(x)          ((int)(sizeof(x) / sizeof(*(x))))
+
+/* ------------------------------------------------------------------ */
+// Reporting
+
+/** Starts a result line. Results are key/value pairs, added with the
+    bench_result_*() functions and finished with bench_result_end().
+ */
+static void
+bench_result_begin(const char *suite) {
+	printf("%-11s", suite);
+	gBench.text_first = true;
+
+	if(gBench.json) {
+		fprintf(gBench.json, "%s\n\t\t{ \"suite\": \"%s\"",
+			gBench.json_first ? "" : ",", suite);
+		gBench.json_first = false;
+	}
+}
+
+static void
+bench_result_str(
+	const char *key, const char *value
+) {
+	printf(" %s=%s", key, value);
+	if(gBench.json)
+		fprintf(gBench.json, ", \"%s\": \"%s\"", key, value);
+}
+
+static void
+bench_result_int(
+	const char *key, long long value
+) {
+	printf(" %s=%lld", key, value);
+	if(gBench.json)
+		fprintf(gBench.json, ", \"%s\": %lld", key, value);
+}
+
+static void
+bench_result_num(
+	const char *key, double value
+) {
+	printf(" %s=%.4g", key, value);
+	if(gBench.json) {
+		if(isfinite(value))
+			fprintf(gBench.json, ", \"%s\": %.6g", key, value);
+		else
+			fprintf(gBench.json, ", \"%s\": null", key);
+	}
+}
+
+static void
+bench_result_end(void) {
+	printf("\n");
+	fflush(stdout);
+	if(gBench.json)
+		fprintf(gBench.json, " }");
+}
+
+/* ------------------------------------------------------------------ */
+// Timing and hardware counters
+
+static double
+bench_now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#if defined(__linux__)
+static int
+bench_counter_open_event(
+	uint32_t type, uint64_t config
+) {
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void
+bench_counter_enable(int fd) {
+	if(fd >= 0) {
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+}
+
+static long long
+bench_counter_read(int fd) {
+	long long count = -1;
+
+	if(fd >= 0) {
+		ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+		if(read(fd, &count, sizeof(count)) != sizeof(count))
+			count = -1;
+	}
+
+	return count;
+}
+#endif
+
+/** Opens user-space counters of last-level cache misses and of L1 data
+    cache read misses for this thread, if the platform and its
+    permissions allow it. The L1 misses show the memory traffic of the
+    kernels, whose working set rarely leaves L2.
+ */
+static void
+bench_counter_open(void) {
+#if defined(__linux__)
+	gBench.counter_fd = bench_counter_open_event(PERF_TYPE_HARDWARE,
+		PERF_COUNT_HW_CACHE_MISSES);
+	gBench.l1d_fd = bench_counter_open_event(PERF_TYPE_HW_CACHE,
+		PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+		| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+#endif
+}
+
+static void
+bench_counter_start(void) {
+#if defined(__linux__)
+	bench_counter_enable(gBench.counter_fd);
+	bench_counter_enable(gBench.l1d_fd);
+#endif
+}
+
+/** Returns the cache misses since bench_counter_start(), or -1 if no
+    counter is available. The L1 data cache read misses are left in
+    gBench.l1d_misses, also -1 if not counted.
+ */
+static long long
+bench_counter_stop(void) {
+	long long count = -1;
+
+#if defined(__linux__)
+	count = bench_counter_read(gBench.counter_fd);
+	gBench.l1d_misses = bench_counter_read(gBench.l1d_fd);
+#endif
+
+	return count;
+}
+
+typedef void (*bench_func_t)(void *context);
+
+/** Calls func in doubling batches until it has run for the minimum
+    measurement time. Returns seconds per call, and stores the number of
+    calls and the cache misses of the last batch if asked to.
+ */
+static double
+bench_measure(
+	bench_func_t func, void *context, long long *calls, long long *misses
+) {
+	long long n = 1;
+	double elapsed;
+
+	for(;;) {
+		double start;
+
+		bench_counter_start();
+		start = bench_now();
+		for(long long i = 0; i < n; i++)
+			(*func)(context);
+		elapsed = bench_now() - start;
+
+		if(misses)
+			*misses = bench_counter_stop();
+		if(elapsed >= gBench.min_seconds)
+			break;
+		n *= 2;
+	}
+
+	if(calls)
+		*calls = n;
+
+	return elapsed / n;
+}
+
+/* ------------------------------------------------------------------ */
+// Models
+
+static const char *
+bench_kernel_name(aa_bell_kernel_t kernel) {
+	switch(kernel) {
+	case AA_BELL_KERNEL_SCALAR: return "scalar";
+	case AA_BELL_KERNEL_SIMD4: return "simd4";
+	case AA_BELL_KERNEL_SIMD8: return "simd8";
+	case AA_BELL_KERNEL_SIMD16: return "simd16";
+	case AA_BELL_KERNEL_BLOCK: return "block";
+	default: return "auto";
+	}
+}
+
+/** Gives a bell nf pseudo-random audible modes. The same seed always
+    gives the same model.
+ */
+static aa_bell_t
+bench_fill_bell(
+	aa_bell_t bell, int nf
+) {
+	unsigned int seed = 12345;
+
+	for(int i = 0; i < nf; i++) {
+		seed = seed * 1103515245 + 12345;
+		aa_bell_set_mode_freq(bell, i, 100.0f + (seed >> 16) % 8000);
+		seed = seed * 1103515245 + 12345;
+		aa_bell_set_angular_decay(bell, i, 1.0f + (seed >> 16) % 50);
+		seed = seed * 1103515245 + 12345;
+		aa_bell_set_gain(bell, 0, i, ((seed >> 16) % 1000) / 1000.0f / nf);
+	}
+	aa_bell_compute_filter(bell);
+
+	return bell;
+}
+
+/** Makes a bell with nf pseudo-random audible modes.
+ */
+static aa_bell_t
+bench_make_bell(
+	int nf, int bufferSize, int srate
+) {
+	aa_bell_t bell = aa_bell_create(nf, 1, bufferSize, srate);
+
+	if(!bell)
+		return NULL;
+
+	return bench_fill_bell(bell, nf);
+}
+
+/** Restrike rendered bells this often so that long measurements are
+    not skewed by modes decaying into denormals. */
+#define BENCH_RESTRIKE_SECONDS  (0.25)
+
+struct bench_render_s {
+	aa_bell_t	bell;
+	float *		buffer;
+	int			restrike;
+	int			count;
+};
+
+static void
+bench_render_func(void *context) {
+	struct bench_render_s *render = context;
+
+	if(render->count-- <= 0) {
+		aa_bell_clear_history(render->bell);
+		aa_bell_add_energy(render->bell, 0.01, 0.002);
+		render->count = render->restrike;
+	}
+	aa_bell_compute_sound_buffer(render->bell, render->buffer);
+}
+
+/* ------------------------------------------------------------------ */
+// Suites
+
+/** Renders the same strike with every kernel and compares the
+    result against the scalar reference. Returns nonzero on mismatch.
+ */
+static int
+bench_suite_check(void) {
+	static const int mode_counts[] = { 10, 60, 1000 };
+	int ret = 0;
+	int nbuffers = BENCH_SRATE / BENCH_BUFFER_SIZE;
+	float ref[BENCH_BUFFER_SIZE], out[BENCH_BUFFER_SIZE];
+
+	for(int m = 0; m < BENCH_COUNT(mode_counts); m++) {
+		int nf = mode_counts[m];
+
+		for(aa_bell_kernel_t kernel = AA_BELL_KERNEL_SIMD4;
+		    kernel <= AA_BELL_KERNEL_BLOCK; kernel++) {
+			aa_bell_t a = bench_make_bell(nf, BENCH_BUFFER_SIZE, BENCH_SRATE);
+			aa_bell_t b = bench_make_bell(nf, BENCH_BUFFER_SIZE, BENCH_SRATE);
+			double maxerr = 0.0, peak = 0.0;
+
+			aa_bell_set_kernel(a, AA_BELL_KERNEL_SCALAR);
+			if(aa_bell_set_kernel(b, kernel) != kernel) {
+				aa_bell_release(a);
+				aa_bell_release(b);
+				continue;
+			}
+
+			aa_bell_add_energy(a, 0.01, 0.002);
+			aa_bell_add_energy(b, 0.01, 0.002);
+
+			for(int n = 0; n < nbuffers; n++) {
+				aa_bell_compute_sound_buffer(a, ref);
+				aa_bell_compute_sound_buffer(b, out);
+				for(int k = 0; k < BENCH_BUFFER_SIZE; k++) {
+					double err = fabs(ref[k] - out[k]);
+					if(fabs(ref[k]) > peak)
+						peak = fabs(ref[k]);
+					if(err > maxerr)
+						maxerr = err;
+				}
+			}
+			maxerr /= peak;
+
+			bench_result_begin("check");
+			bench_result_str("kernel", bench_kernel_name(kernel));
+			bench_result_int("modes", nf);
+			bench_result_num("max_rel_err", maxerr);
+			bench_result_str("status",
+				maxerr <= BENCH_KERNEL_TOLERANCE ? "ok" : "MISMATCH");
+			bench_result_end();
+
+			if(maxerr > BENCH_KERNEL_TOLERANCE)
+				ret = 1;
+
+			aa_bell_release(a);
+			aa_bell_release(b);
+		}
+	}
+
+	return ret;
+}
+
+/** Mode-samples per second of every kernel the CPU supports.
+ */
+static int
+bench_suite_kernel(void) {
+	static const int mode_counts[] = { 10, 60, 1000 };
+	float out[BENCH_BUFFER_SIZE];
+
+	for(int m = 0; m < BENCH_COUNT(mode_counts); m++) {
+		int nf = mode_counts[m];
+
+		for(aa_bell_kernel_t kernel = AA_BELL_KERNEL_SCALAR;
+		    kernel <= AA_BELL_KERNEL_BLOCK; kernel++) {
+			struct bench_render_s render = {
+				.bell = bench_make_bell(nf, BENCH_BUFFER_SIZE, BENCH_SRATE),
+				.buffer = out,
+				.restrike = (int)(BENCH_RESTRIKE_SECONDS * BENCH_SRATE
+				    / BENCH_BUFFER_SIZE),
+			};
+			double seconds;
+
+			if(aa_bell_set_kernel(render.bell, kernel) != kernel) {
+				aa_bell_release(render.bell);
+				continue;
+			}
+
+			seconds = bench_measure(&bench_render_func, &render, NULL, NULL);
+
+			bench_result_begin("kernel");
+			bench_result_str("kernel", bench_kernel_name(kernel));
+			bench_result_int("modes", nf);
+			bench_result_num("mode_samples_per_s",
+				nf * BENCH_BUFFER_SIZE / seconds);
+			bench_result_end();
+
+			aa_bell_release(render.bell);
+		}
+	}
+
+	return 0;
+}
+
+/** aa_bell_compute_sound_buffer() over mode counts, buffer sizes and
+    sample rates with the default kernel and synthesis.
+ */
+static int
+bench_suite_engine(void) {
+	static const int mode_counts[] = { 1, 7, 60, 1000, 10000, 100000 };
+	static const int buffer_sizes[] = { 10, 64, 256, 1024, 8192 };
+	static const int srates[] = { 44100, 96000, 192000 };
+	int srate_count = gBench.quick ? 1 : BENCH_COUNT(srates);
+
+	for(int r = 0; r < srate_count; r++)
+	for(int m = 0; m < BENCH_COUNT(mode_counts); m++)
+	for(int b = 0; b < BENCH_COUNT(buffer_sizes); b++) {
+		int nf = mode_counts[m];
+		int bufferSize = buffer_sizes[b];
+		struct bench_render_s render = {
+			.bell = bench_make_bell(nf, bufferSize, srates[r]),
+			.buffer = calloc(sizeof(float), bufferSize),
+			.restrike = (int)(BENCH_RESTRIKE_SECONDS * srates[r] / bufferSize),
+		};
+		long long calls, misses;
+		double seconds;
+
+		if(!render.bell || !render.buffer) {
+			free(render.buffer);
+			if(render.bell)
+				aa_bell_release(render.bell);
+			return 1;
+		}
+
+		// Past the strike, so that a spectral bell has derived its
+		// modes before it is timed.
+		bench_render_func(&render);
+		bench_render_func(&render);
+		seconds = bench_measure(&bench_render_func, &render, &calls, &misses);
+
+		bench_result_begin("engine");
+		bench_result_str("kernel",
+			bench_kernel_name(aa_bell_get_kernel(render.bell)));
+		bench_result_str("synthesis",
+			aa_bell_get_synthesis(render.bell) == AA_BELL_SYNTHESIS_SPECTRAL
+			? "spectral" : "time");
+		bench_result_int("modes", nf);
+		bench_result_int("buffer", bufferSize);
+		bench_result_int("srate", srates[r]);
+		bench_result_num("ns_per_sample", seconds * 1e9 / bufferSize);
+		bench_result_num("ns_per_mode_sample",
+			seconds * 1e9 / bufferSize / nf);
+		bench_result_num("realtime_headroom",
+			(double)bufferSize / srates[r] / seconds);
+		if(misses >= 0) {
+			bench_result_num("cache_misses_per_sample",
+				(double)misses / calls / bufferSize);
+		}
+		if(gBench.l1d_misses >= 0) {
+			bench_result_num("l1d_misses_per_sample",
+				(double)gBench.l1d_misses / calls / bufferSize);
+		}
+		bench_result_end();
+
+		free(render.buffer);
+		aa_bell_release(render.bell);
+	}
+
+	return 0;
+}
+
+static void
+bench_filter_func(void *context) {
+	aa_bell_compute_filter((aa_bell_t)context);
+}
+
+/** aa_bell_compute_filter() over mode counts.
+ */
+static int
+bench_suite_filter(void) {
+	static const int mode_counts[] = { 1, 7, 60, 1000, 10000 };
+
+	for(int m = 0; m < BENCH_COUNT(mode_counts); m++) {
+		int nf = mode_counts[m];
+		aa_bell_t bell = bench_make_bell(nf, BENCH_BUFFER_SIZE, BENCH_SRATE);
+		double seconds;
+
+		if(!bell)
+			return 1;
+
+		seconds = bench_measure(&bench_filter_func, bell, NULL, NULL);
+
+		bench_result_begin("filter");
+		bench_result_int("modes", nf);
+		bench_result_num("ns_per_call", seconds * 1e9);
+		bench_result_num("ns_per_mode", seconds * 1e9 / nf);
+		bench_result_end();
+
+		aa_bell_release(bell);
+	}
+
+	return 0;
+}
+
+struct bench_energy_s {
+	aa_bell_t	bell;
+	float		dur;
+};
+
+static void
+bench_energy_func(void *context) {
+	struct bench_energy_s *energy = context;
+
+	aa_bell_add_energy(energy->bell, 1e-9f, energy->dur);
+}
+
+/** aa_bell_add_energy() over contact durations and excitations.
+ */
+static int
+bench_suite_energy(void) {
+	static const float durations[] = { 0.0f, 0.001f, 0.002f, 0.01f, 0.1f };
+	static const struct {
+		const char *name;
+		aa_bell_excite_t excite;
+	} excites[] = {
+		{ "raised_cosine", AA_BELL_EXCITE_RAISED_COSINE },
+		{ "half_sine", AA_BELL_EXCITE_HALF_SINE },
+		{ "noise", AA_BELL_EXCITE_NOISE },
+	};
+	int bufferSize = 8192;
+
+	for(int e = 0; e < BENCH_COUNT(excites); e++)
+	for(int d = 0; d < BENCH_COUNT(durations); d++) {
+		struct bench_energy_s energy = {
+			.bell = bench_make_bell(1, bufferSize, BENCH_SRATE),
+			.dur = durations[d],
+		};
+		double seconds;
+
+		if(!energy.bell)
+			return 1;
+
+		aa_bell_set_excitation(energy.bell, excites[e].excite);
+		seconds = bench_measure(&bench_energy_func, &energy, NULL, NULL);
+
+		bench_result_begin("energy");
+		bench_result_str("excite", excites[e].name);
+		bench_result_num("dur", energy.dur);
+		bench_result_int("samples", (int)(energy.dur * BENCH_SRATE));
+		bench_result_num("ns_per_strike", seconds * 1e9);
+		bench_result_end();
+
+		aa_bell_release(energy.bell);
+	}
+
+	return 0;
+}
+
+static void
+bench_load_func(void *context) {
+	aa_bell_t bell = aa_bell_create_from_file((const char*)context,
+		BENCH_BUFFER_SIZE, BENCH_SRATE);
+
+	if(bell)
+		aa_bell_release(bell);
+}
+
+/** aa_bell_create_from_file() for every bundled model, from its text
+    file and from a binary copy with coefficients for BENCH_SRATE.
+ */
+static int
+bench_suite_load(void) {
+	static const int srates[] = { BENCH_SRATE };
+	int ret = 0;
+
+	for(int i = 0; !ret && (i < BENCH_COUNT(gModelPaths)); i++) {
+		const char *path = gModelPaths[i];
+		aa_bell_t bell = aa_bell_create_from_file(path,
+			BENCH_BUFFER_SIZE, BENCH_SRATE);
+		char binary_path[] = "/tmp/bench-model-XXXXXX";
+		int fd = -1;
+		FILE *fp = NULL;
+		int written = -1;
+		double seconds;
+
+		ret = 1;
+
+		if(!bell) {
+			fprintf(stderr, "bench: unable to load %s\n", path);
+			goto next;
+		}
+
+		fd = mkstemp(binary_path);
+		if(fd >= 0)
+			fp = fdopen(fd, "wb");
+		if(fp) {
+			written = aa_bell_write_binary(bell, fp, srates,
+				BENCH_COUNT(srates));
+			written |= fclose(fp);
+		} else if(fd >= 0) {
+			close(fd);
+		}
+		if(written) {
+			perror("bench: binary model");
+			goto next;
+		}
+
+		seconds = bench_measure(&bench_load_func, (void*)path, NULL, NULL);
+
+		bench_result_begin("load");
+		bench_result_str("model", path);
+		bench_result_str("format", "text");
+		bench_result_int("modes", aa_bell_get_mode_count(bell));
+		bench_result_num("us_per_load", seconds * 1e6);
+		bench_result_end();
+
+		seconds = bench_measure(&bench_load_func, binary_path, NULL, NULL);
+
+		bench_result_begin("load");
+		bench_result_str("model", path);
+		bench_result_str("format", "binary");
+		bench_result_int("modes", aa_bell_get_mode_count(bell));
+		bench_result_num("us_per_load", seconds * 1e6);
+		bench_result_end();
+
+		ret = 0;
+
+next:
+		if(fd >= 0)
+			unlink(binary_path);
+		if(bell)
+			aa_bell_release(bell);
+	}
+
+	return ret;
+}
+
+static void
+bench_bank_func(void *context) {
+	aa_bell_t bell = aa_bank_create_bell((const char*)context,
+		BENCH_BUFFER_SIZE, BENCH_SRATE);
+
+	if(bell)
+		aa_bell_release(bell);
+}
+
+/** Bells made through the model bank, once it holds the model, and
+    what BENCH_BANK_INSTANCES of them share.
+ */
+static int
+bench_suite_bank(void) {
+	const char *path = "sy/wok.sy";
+	aa_bell_t bells[BENCH_BANK_INSTANCES];
+	struct aa_bank_stats_s stats;
+	double seconds;
+	int count = 0;
+
+	for(count = 0; count < BENCH_BANK_INSTANCES; count++) {
+		bells[count] = aa_bank_create_bell(path, BENCH_BUFFER_SIZE,
+			BENCH_SRATE);
+		if(!bells[count])
+			break;
+	}
+
+	seconds = bench_measure(&bench_bank_func, (void*)path, NULL, NULL);
+	aa_bank_get_stats(&stats);
+
+	bench_result_begin("bank");
+	bench_result_str("model", path);
+	bench_result_num("us_per_load", seconds * 1e6);
+	bench_result_int("instances", stats.instance_count);
+	bench_result_int("bytes_held", (long long)stats.bytes_held);
+	bench_result_int("bytes_shared", (long long)stats.bytes_shared);
+	bench_result_end();
+
+	while(count--)
+		aa_bell_release(bells[count]);
+	aa_bank_purge();
+
+	return stats.instance_count != BENCH_BANK_INSTANCES;
+}
+
+struct bench_params_s {
+	struct bench_render_s render;
+	int			updates;
+	int			distinct;
+	unsigned	seed;
+};
+
+static void
+bench_params_func(void *context) {
+	struct bench_params_s *params = context;
+
+	for(int i = 0; i < params->updates; i++) {
+		params->seed = params->seed * 1103515245 + 12345;
+		aa_bell_post_param(params->render.bell, AA_BELL_PARAM_FREQ, 0,
+			(params->seed >> 16) % params->distinct,
+			100.0f + (params->seed >> 16) % 8000);
+	}
+	bench_render_func(&params->render);
+}
+
+/** Renders blocks while a burst of frequency changes is posted before
+    each one, spread over a few modes so that most of them coalesce.
+    Also checks that a full queue counts its overflow.
+ */
+static int
+bench_suite_params(void) {
+	static const int updates[] = { 0, 1, 16, 64, 256 };
+	float out[BENCH_BUFFER_SIZE];
+	int ret = 0;
+
+	for(int u = 0; u < BENCH_COUNT(updates); u++) {
+		struct bench_params_s params = {
+			.render = {
+				.bell = bench_make_bell(BENCH_PARAM_MODES, BENCH_BUFFER_SIZE,
+					BENCH_SRATE),
+				.buffer = out,
+				.restrike = (int)(BENCH_RESTRIKE_SECONDS * BENCH_SRATE
+				    / BENCH_BUFFER_SIZE),
+			},
+			.updates = updates[u],
+			.distinct = 8,
+			.seed = 12345,
+		};
+		struct aa_bell_param_stats_s stats;
+		double seconds;
+
+		if(!params.render.bell
+		    || aa_bell_create_param_queue(params.render.bell,
+			    BENCH_PARAM_QUEUE_SIZE)) {
+			ret = 1;
+			break;
+		}
+
+		seconds = bench_measure(&bench_params_func, &params, NULL, NULL);
+		aa_bell_get_param_stats(params.render.bell, &stats);
+
+		bench_result_begin("params");
+		bench_result_int("modes", BENCH_PARAM_MODES);
+		bench_result_int("updates_per_block", params.updates);
+		bench_result_num("us_per_block", seconds * 1e6);
+		bench_result_int("max_depth", stats.max_depth);
+		bench_result_int("modes_recomputed", stats.modes);
+		bench_result_int("overflow", (long long)stats.overflow);
+		bench_result_end();
+
+		if(stats.overflow)
+			ret = 1;
+
+		// Fill the queue past its size without rendering.
+		for(int i = 0; i < BENCH_PARAM_QUEUE_SIZE + 10; i++)
+			aa_bell_post_param(params.render.bell, AA_BELL_PARAM_GAIN, 0, 0,
+				0.5f);
+		aa_bell_compute_sound_buffer(params.render.bell, out);
+		aa_bell_get_param_stats(params.render.bell, &stats);
+
+		if((stats.depth != BENCH_PARAM_QUEUE_SIZE)
+		    || (stats.block_overflow != 10)) {
+			fprintf(stderr, "bench: parameter queue overflow miscounted\n");
+			ret = 1;
+		}
+
+		aa_bell_release(params.render.bell);
+	}
+
+	return ret;
+}
+
+static const char *
+bench_coeff_name(aa_bell_coeff_t coeff) {
+	switch(coeff) {
+	case AA_BELL_COEFF_POLY: return "poly";
+	case AA_BELL_COEFF_TABLE: return "table";
+	default: return "exact";
+	}
+}
+
+/** Largest error of the frequency and decay the filters of bell
+    actually have, against what its modes and scales ask for.
+ */
+static void
+bench_coeff_error(
+	aa_bell_t bell, double *cents, double *decay
+) {
+	for(int i = 0; i < bell->nf; i++) {
+		double f = bell->fscale * bell->f[i];
+		double d = bell->dscale * bell->d[i];
+		double r = sqrt(bell->R2[i]);
+		double c = bell->twoRCosTheta[i] / (2. * r);
+		double feff, deff;
+
+		if((f <= 0.) || (f >= bell->srate / 2) || (d <= 0.))
+			continue;
+
+		feff = acos(c < -1. ? -1. : c > 1. ? 1. : c)
+		    * bell->srate / (2. * M_PI);
+		deff = -log(r) * bell->srate;
+
+		if(fabs(1200. * log2(feff / f)) > *cents)
+			*cents = fabs(1200. * log2(feff / f));
+		if(fabs(deff / d - 1.) > *decay)
+			*decay = fabs(deff / d - 1.);
+	}
+}
+
+struct bench_coeff_s {
+	aa_bell_t	bell;
+	bool		decay;
+	int			count;
+};
+
+static void
+bench_coeff_func(void *context) {
+	struct bench_coeff_s *coeff = context;
+	float scale = 1.0f + 0.001f * (++coeff->count & 15);
+
+	if(coeff->decay)
+		aa_bell_set_scales(coeff->bell, 1.0f, scale, 1.0f);
+	else
+		aa_bell_set_scales(coeff->bell, scale, 1.0f, 1.0f);
+}
+
+/** Whole-model retunes per second with each coefficient tier, for a
+    pitch sweep (frequency scale only) and a damping sweep, and the
+    largest frequency and decay error each tier leaves.
+ */
+static int
+bench_suite_coeff(void) {
+	static const int mode_counts[] = { 1000, 10000 };
+	int ret = 0;
+
+	for(int m = 0; m < BENCH_COUNT(mode_counts); m++)
+	for(aa_bell_coeff_t tier = AA_BELL_COEFF_EXACT;
+	    tier <= AA_BELL_COEFF_TABLE; tier++) {
+		int nf = mode_counts[m];
+		struct bench_coeff_s coeff = {
+			.bell = bench_make_bell(nf, BENCH_BUFFER_SIZE, BENCH_SRATE),
+		};
+		double pitch, damping, cents = 0., decay = 0.;
+		bool ok;
+
+		if(!coeff.bell) {
+			ret = 1;
+			continue;
+		}
+
+		aa_bell_set_coeff_accuracy(coeff.bell, tier);
+		pitch = bench_measure(&bench_coeff_func, &coeff, NULL, NULL);
+		coeff.decay = true;
+		damping = bench_measure(&bench_coeff_func, &coeff, NULL, NULL);
+
+		// Both the full and the pitch-only path.
+		aa_bell_set_scales(coeff.bell, 1.5f, 1.25f, 1.0f);
+		bench_coeff_error(coeff.bell, &cents, &decay);
+		aa_bell_set_scales(coeff.bell, 0.75f, 1.25f, 1.0f);
+		bench_coeff_error(coeff.bell, &cents, &decay);
+
+		ok = (tier == AA_BELL_COEFF_EXACT)
+		    || ((cents <= BENCH_COEFF_MAX_CENTS)
+		        && (decay <= BENCH_COEFF_MAX_DECAY_ERR));
+
+		bench_result_begin("coeff");
+		bench_result_str("tier", bench_coeff_name(tier));
+		bench_result_int("modes", nf);
+		bench_result_num("pitch_retunes_per_s", 1. / pitch);
+		bench_result_num("decay_retunes_per_s", 1. / damping);
+		bench_result_num("max_cents_err", cents);
+		bench_result_num("max_decay_err", decay);
+		bench_result_str("status", ok ? "ok" : "INACCURATE");
+		bench_result_end();
+
+		if(!ok)
+			ret = 1;
+
+		aa_bell_release(coeff.bell);
+	}
+
+	return ret;
+}
+
+/** Checks each vector kernel's ramping variant against the scalar one
+    while a frequency changes every block. Returns nonzero on mismatch.
+ */
+static int
+bench_smoothing_check(int nf, int bufferSize) {
+	int ret = 0;
+	int nbuffers = BENCH_SRATE / bufferSize;
+	float *ref = calloc(sizeof(float), bufferSize);
+	float *out = calloc(sizeof(float), bufferSize);
+
+	for(aa_bell_kernel_t kernel = AA_BELL_KERNEL_SIMD4;
+	    ref && out && (kernel <= AA_BELL_KERNEL_SIMD16); kernel++) {
+		aa_bell_t a = bench_make_bell(nf, bufferSize, BENCH_SRATE);
+		aa_bell_t b = bench_make_bell(nf, bufferSize, BENCH_SRATE);
+		double maxerr = 0.0, peak = 0.0;
+
+		if(!a || !b || aa_bell_set_smoothing(a, true)
+		    || aa_bell_set_smoothing(b, true)) {
+			ret = 1;
+		} else if(aa_bell_set_kernel(b, kernel) == kernel) {
+			aa_bell_set_kernel(a, AA_BELL_KERNEL_SCALAR);
+			aa_bell_add_energy(a, 0.01, 0.002);
+			aa_bell_add_energy(b, 0.01, 0.002);
+
+			for(int n = 0; n < nbuffers; n++) {
+				int mode = (n * 7) % nf;
+				float freq = 200.0f + (n * 37) % 4000;
+
+				aa_bell_set_mode_freq(a, mode, freq);
+				aa_bell_compute_reson_coeff(a, mode);
+				aa_bell_set_mode_freq(b, mode, freq);
+				aa_bell_compute_reson_coeff(b, mode);
+
+				aa_bell_compute_sound_buffer(a, ref);
+				aa_bell_compute_sound_buffer(b, out);
+				for(int k = 0; k < bufferSize; k++) {
+					double err = fabs(ref[k] - out[k]);
+					if(fabs(ref[k]) > peak)
+						peak = fabs(ref[k]);
+					if(err > maxerr)
+						maxerr = err;
+				}
+			}
+			maxerr /= peak;
+
+			bench_result_begin("smoothing");
+			bench_result_str("kernel", bench_kernel_name(kernel));
+			bench_result_int("modes", nf);
+			bench_result_num("max_rel_err", maxerr);
+			bench_result_str("status",
+				maxerr <= BENCH_KERNEL_TOLERANCE ? "ok" : "MISMATCH");
+			bench_result_end();
+
+			if(maxerr > BENCH_KERNEL_TOLERANCE)
+				ret = 1;
+		}
+
+		if(a)
+			aa_bell_release(a);
+		if(b)
+			aa_bell_release(b);
+	}
+
+	free(ref);
+	free(out);
+
+	return ret;
+}
+
+struct bench_smoothing_s {
+	struct bench_render_s render;
+	int			bufferSize;
+	int			interval;
+	int			until;
+	unsigned	seed;
+};
+
+static void
+bench_smoothing_func(void *context) {
+	struct bench_smoothing_s *smoothing = context;
+
+	smoothing->until -= smoothing->bufferSize;
+	if(smoothing->until <= 0) {
+		smoothing->seed = smoothing->seed * 1103515245 + 12345;
+		aa_bell_post_param(smoothing->render.bell, AA_BELL_PARAM_FREQ, 0,
+			(smoothing->seed >> 16) % BENCH_SMOOTHING_MODES,
+			100.0f + (smoothing->seed >> 16) % 8000);
+		smoothing->until += smoothing->interval;
+	}
+	bench_render_func(&smoothing->render);
+}
+
+/** Cost per sample of small buffers against large smoothed ones while
+    a frequency changes every few milliseconds, which is what smoothing
+    is for: big buffers without zipper noise.
+ */
+static int
+bench_suite_smoothing(void) {
+	static const int buffer_sizes[] = { 10, 64, 256, 1024 };
+	int ret = 0;
+
+	ret |= bench_smoothing_check(60, 1024);
+	ret |= bench_smoothing_check(BENCH_SMOOTHING_MODES, 1024);
+
+	for(int b = 0; b < BENCH_COUNT(buffer_sizes); b++)
+	for(int smooth = 0; smooth <= 1; smooth++) {
+		int bufferSize = buffer_sizes[b];
+		struct bench_smoothing_s smoothing = {
+			.render = {
+				.bell = bench_make_bell(BENCH_SMOOTHING_MODES, bufferSize,
+					BENCH_SRATE),
+				.buffer = calloc(sizeof(float), bufferSize),
+				.restrike = (int)(BENCH_RESTRIKE_SECONDS * BENCH_SRATE
+				    / bufferSize),
+			},
+			.bufferSize = bufferSize,
+			.interval = (int)(BENCH_SMOOTHING_CHANGE_SECONDS * BENCH_SRATE),
+			.seed = 12345,
+		};
+		double seconds;
+
+		if(!smoothing.render.bell || !smoothing.render.buffer
+		    || aa_bell_create_param_queue(smoothing.render.bell,
+			    BENCH_PARAM_QUEUE_SIZE)
+		    || aa_bell_set_smoothing(smoothing.render.bell, smooth)) {
+			ret = 1;
+		} else {
+			seconds = bench_measure(&bench_smoothing_func, &smoothing,
+				NULL, NULL);
+
+			bench_result_begin("smoothing");
+			bench_result_int("modes", BENCH_SMOOTHING_MODES);
+			bench_result_int("buffer", bufferSize);
+			bench_result_str("smoothing", smooth ? "on" : "off");
+			bench_result_num("ns_per_sample", seconds * 1e9 / bufferSize);
+			bench_result_end();
+		}
+
+		if(smoothing.render.bell)
+			aa_bell_release(smoothing.render.bell);
+		free(smoothing.render.buffer);
+	}
+
+	return ret;
+}
+
+/** Makes a bell of BENCH_POINT_MODES modes and BENCH_POINT_COUNT
+    strike points, each with its own pseudo-random gains, rendering
+    buffers of bufferSize samples.
+ */
+static aa_bell_t
+bench_make_point_bell(int bufferSize) {
+	aa_bell_t bell = aa_bell_create(BENCH_POINT_MODES, BENCH_POINT_COUNT,
+		bufferSize, BENCH_SRATE);
+	unsigned int seed = 54321;
+
+	if(!bell)
+		return NULL;
+
+	for(int i = 0; i < BENCH_POINT_MODES; i++) {
+		seed = seed * 1103515245 + 12345;
+		aa_bell_set_mode_freq(bell, i, 100.0f + (seed >> 16) % 8000);
+		seed = seed * 1103515245 + 12345;
+		aa_bell_set_angular_decay(bell, i, 1.0f + (seed >> 16) % 50);
+		for(int p = 0; p < BENCH_POINT_COUNT; p++) {
+			seed = seed * 1103515245 + 12345;
+			aa_bell_set_gain(bell, p, i,
+				((seed >> 16) % 1000) / 1000.0f / BENCH_POINT_MODES);
+		}
+	}
+	aa_bell_compute_filter(bell);
+
+	return bell;
+}
+
+/** Strikes of the timing suite: start in seconds, energy, duration.
+    Some overlap, and some last longer than the largest buffer. */
+static const struct {
+	double	time;
+	float	energy;
+	float	dur;
+} gTimingScore[] = {
+	{ 0.0, 0.01, 0.002 },
+	{ 0.0123, 0.02, 0.05 },
+	{ 0.0124, 0.01, 0.3 },
+	{ 0.5, 0.02, 0.001 },
+	{ 0.77777, 0.005, 0.0 },
+	{ 0.77778, 0.005, 0.003 },
+	{ 1.2, 0.005, 0.1 },
+};
+
+/** Strikes of the timing suite at several points of one bell: start in
+    seconds, energy, duration, point. Points change within a buffer of
+    every size, while force at the point before is still to come. */
+static const struct {
+	double	time;
+	float	energy;
+	float	dur;
+	float	point;
+} gTimingPointScore[] = {
+	{ 0.0, 0.01, 0.002, 0.0f },
+	{ 0.001, 0.01, 0.002, 1.0f },
+	{ 0.0015, 0.005, 0.02, 2.5f },
+	{ 0.0016, 0.005, 0.001, 0.0f },
+	{ 0.3, 0.01, 0.001, 7.0f },
+	{ 0.3005, 0.01, 0.004, 3.0f },
+	{ 0.30051, 0.01, 0.003, 7.0f },
+	{ 0.9, 0.02, 0.0, 1.25f },
+};
+
+/** Renders gTimingScore with wok.sy, or with nf pseudo-random modes if
+    nf is nonzero, in buffers of bufferSize samples, striking each at
+    its own sample offset with excite. Returns the output, or NULL.
+ */
+static float *
+bench_timing_render(
+	int bufferSize, aa_bell_excite_t excite, int nf
+) {
+	int nsamples = (int)(BENCH_TIMING_SECONDS * BENCH_SRATE);
+	aa_bell_t bell = nf ? bench_make_bell(nf, bufferSize, BENCH_SRATE)
+	    : aa_bell_create_from_file("sy/wok.sy", bufferSize, BENCH_SRATE);
+	float *ret = calloc(sizeof(float), nsamples + bufferSize);
+	int next = 0;
+
+	if(!bell || !ret) {
+		free(ret);
+		ret = NULL;
+		goto bail;
+	}
+
+	aa_bell_set_excitation(bell, excite);
+
+	for(int written = 0; written < nsamples; written += bufferSize) {
+		while((next < BENCH_COUNT(gTimingScore))
+		    && ((int)(gTimingScore[next].time * BENCH_SRATE)
+		        < written + bufferSize)) {
+			int at = (int)(gTimingScore[next].time * BENCH_SRATE);
+
+			aa_bell_add_energy_at(bell, gTimingScore[next].energy,
+				gTimingScore[next].dur, at - written);
+			next++;
+		}
+		aa_bell_compute_sound_buffer(bell, ret + written);
+	}
+
+bail:
+	if(bell)
+		aa_bell_release(bell);
+	return ret;
+}
+
+/** Renders gTimingPointScore with a bell of several points at double
+    precision in buffers of bufferSize samples, through a scheduler of
+    two threads if scheduled. Returns the output, or NULL.
+ */
+static float *
+bench_timing_points_render(
+	int bufferSize, bool scheduled
+) {
+	int nsamples = (int)(BENCH_TIMING_SECONDS * BENCH_SRATE);
+	aa_bell_t bell = bench_make_point_bell(bufferSize);
+	aa_scheduler_t scheduler = NULL;
+	float *ret = calloc(sizeof(float), nsamples + bufferSize);
+	int next = 0;
+
+	if(!bell || !ret || (aa_bell_set_precision(bell,
+		    AA_BELL_PRECISION_DOUBLE) != AA_BELL_PRECISION_DOUBLE))
+		goto fail;
+
+	if(scheduled) {
+		scheduler = aa_scheduler_create(2, bufferSize);
+		if(!scheduler || aa_scheduler_add_bell(scheduler, bell,
+			    BENCH_POINT_MODES / 3))
+			goto fail;
+	}
+
+	for(int written = 0; written < nsamples; written += bufferSize) {
+		while((next < BENCH_COUNT(gTimingPointScore))
+		    && ((int)(gTimingPointScore[next].time * BENCH_SRATE)
+		        < written + bufferSize)) {
+			int at = (int)(gTimingPointScore[next].time * BENCH_SRATE);
+
+			if(aa_bell_set_strike_point(bell,
+				    gTimingPointScore[next].point)
+			    || aa_bell_add_energy_at(bell,
+				    gTimingPointScore[next].energy,
+				    gTimingPointScore[next].dur, at - written))
+				goto fail;
+			next++;
+		}
+		if(scheduler)
+			aa_scheduler_compute_sound_buffer(scheduler, ret + written);
+		else
+			aa_bell_compute_sound_buffer(bell, ret + written);
+	}
+	goto bail;
+
+fail:
+	free(ret);
+	ret = NULL;
+
+bail:
+	if(scheduler)
+		aa_scheduler_release(scheduler);
+	if(bell)
+		aa_bell_release(bell);
+	return ret;
+}
+
+/** Renders a score of overlapping and long strikes with wok.sy and
+    with a model of BENCH_TIMING_MODES modes, left to choose its own
+    synthesis, at buffer sizes from 10 to 4096 samples and checks that
+    every output is identical to the one at 10. Then a score striking several points within one
+    buffer, whose outputs may only differ by rounding, since each
+    buffer size sums the force of different points apart at different
+    samples. Returns nonzero if any differs.
+ */
+static int
+bench_suite_timing(void) {
+	static const int buffer_sizes[] = { 10, 37, 256, 4096 };
+	static const aa_bell_excite_t excites[] = {
+		AA_BELL_EXCITE_RAISED_COSINE, AA_BELL_EXCITE_NOISE,
+	};
+	static const int models[] = { 0, BENCH_TIMING_MODES };
+	int nsamples = (int)(BENCH_TIMING_SECONDS * BENCH_SRATE);
+	float *points;
+	int ret = 0;
+
+	for(int m = 0; m < BENCH_COUNT(models); m++)
+	for(int e = 0; e < BENCH_COUNT(excites); e++) {
+		float *ref = bench_timing_render(buffer_sizes[0], excites[e],
+			models[m]);
+
+		if(!ref)
+			ret = 1;
+
+		for(int b = 1; ref && (b < BENCH_COUNT(buffer_sizes)); b++) {
+			float *out = bench_timing_render(buffer_sizes[b], excites[e],
+				models[m]);
+			bool same = out && !memcmp(ref, out, sizeof(float) * nsamples);
+
+			bench_result_begin("timing");
+			bench_result_str("model", models[m] ? "random" : "wok.sy");
+			bench_result_str("excite", excites[e] == AA_BELL_EXCITE_NOISE
+				? "noise" : "raised_cosine");
+			bench_result_int("buffer", buffer_sizes[b]);
+			bench_result_int("reference_buffer", buffer_sizes[0]);
+			bench_result_int("strikes", BENCH_COUNT(gTimingScore));
+			bench_result_str("status", same ? "ok" : "MISMATCH");
+			bench_result_end();
+
+			if(!same)
+				ret = 1;
+			free(out);
+		}
+
+		free(ref);
+	}
+
+	points = bench_timing_points_render(buffer_sizes[0], false);
+	if(!points)
+		ret = 1;
+
+	for(int b = 1; points && (b < BENCH_COUNT(buffer_sizes)); b++) {
+		float *ref = points;
+		float *out = bench_timing_points_render(buffer_sizes[b], b == 2);
+		double maxerr = 0.0, peak = 0.0;
+
+		for(int k = 0; ref && out && (k < nsamples); k++) {
+			if(fabs(ref[k]) > peak)
+				peak = fabs(ref[k]);
+			if(fabs(out[k] - ref[k]) > maxerr)
+				maxerr = fabs(out[k] - ref[k]);
+		}
+		maxerr = peak > 0.0 ? maxerr / peak : 1.0;
+
+		bench_result_begin("timing");
+		bench_result_str("excite", "points");
+		bench_result_int("buffer", buffer_sizes[b]);
+		bench_result_int("reference_buffer", buffer_sizes[0]);
+		bench_result_int("strikes", BENCH_COUNT(gTimingPointScore));
+		bench_result_int("threads", b == 2 ? 2 : 1);
+		bench_result_num("max_rel_err", maxerr);
+		bench_result_str("status", maxerr <= BENCH_KERNEL_TOLERANCE
+			? "ok" : "MISMATCH");
+		bench_result_end();
+
+		if(maxerr > BENCH_KERNEL_TOLERANCE)
+			ret = 1;
+		free(out);
+	}
+
+	free(points);
+
+	return ret;
+}
+
+/** Renders BENCH_CULL_SECONDS of wok.sy struck every
+    BENCH_CULL_STRIKE_SECONDS into out, culling modes below threshold,
+    BENCH_CULL_REPEATS times. Stores the seconds the fastest took and the
+    mean number of live modes. Returns nonzero if the model could not be
+    loaded.
+ */
+static int
+bench_cull_render(
+	float threshold, float *out, double *seconds, double *live
+) {
+	int nbuffers = (int)(BENCH_CULL_SECONDS * BENCH_SRATE / BENCH_BUFFER_SIZE);
+	int every = (int)(BENCH_CULL_STRIKE_SECONDS * BENCH_SRATE
+	    / BENCH_BUFFER_SIZE);
+
+	*seconds = HUGE_VAL;
+
+	for(int r = 0; r < BENCH_CULL_REPEATS; r++) {
+		aa_bell_t bell = aa_bell_create_from_file("sy/wok.sy",
+			BENCH_BUFFER_SIZE, BENCH_SRATE);
+		long long live_sum = 0;
+		double start, elapsed;
+
+		if(!bell || aa_bell_set_cull_threshold(bell, threshold)) {
+			if(bell)
+				aa_bell_release(bell);
+			return 1;
+		}
+
+		start = bench_now();
+		for(int b = 0; b < nbuffers; b++) {
+			if(!(b % every))
+				aa_bell_add_energy(bell, 0.01, 0.002);
+			live_sum += aa_bell_get_live_mode_count(bell);
+			aa_bell_compute_sound_buffer(bell,
+				out + b * BENCH_BUFFER_SIZE);
+		}
+		elapsed = bench_now() - start;
+
+		if(elapsed < *seconds)
+			*seconds = elapsed;
+		*live = (double)live_sum / nbuffers;
+
+		aa_bell_release(bell);
+	}
+
+	return 0;
+}
+
+/** Renders a pool of BENCH_CULL_VOICES voices of wok.sy, striking one
+    every BENCH_CULL_VOICE_SECONDS, culling modes below threshold.
+    Stores the seconds per buffer of the fastest of BENCH_CULL_REPEATS
+    runs and the mean number of active voices.
+ */
+static int
+bench_cull_voices(
+	float threshold, double *seconds, double *active
+) {
+	int nbuffers = (int)(BENCH_CULL_SECONDS * BENCH_SRATE / BENCH_BUFFER_SIZE);
+	double every = BENCH_CULL_VOICE_SECONDS * BENCH_SRATE / BENCH_BUFFER_SIZE;
+	aa_bell_t model = aa_bell_create_from_file("sy/wok.sy",
+		BENCH_BUFFER_SIZE, BENCH_SRATE);
+	aa_voices_t voices = NULL;
+	float out[BENCH_BUFFER_SIZE];
+	int ret = 1;
+
+	if(!model || aa_bell_set_cull_threshold(model, threshold))
+		goto bail;
+
+	*seconds = HUGE_VAL;
+
+	for(int r = 0; r < BENCH_CULL_REPEATS; r++) {
+		long long active_sum = 0;
+		double next = 0.0, start, elapsed;
+
+		voices = aa_voices_create(model, BENCH_CULL_VOICES);
+
+		if(!voices)
+			goto bail;
+
+		start = bench_now();
+		for(int b = 0; b < nbuffers; b++) {
+			for(; next < b + 1; next += every)
+				aa_voices_strike_at(voices, 0.01, 0.002, 0.0f,
+					(int)((next - b) * BENCH_BUFFER_SIZE));
+			aa_voices_compute_sound_buffer(voices, out);
+			active_sum += aa_voices_get_active_count(voices);
+		}
+		elapsed = (bench_now() - start) / nbuffers;
+
+		if(elapsed < *seconds)
+			*seconds = elapsed;
+		*active = (double)active_sum / nbuffers;
+
+		aa_voices_release(voices);
+		voices = NULL;
+	}
+	ret = 0;
+
+bail:
+	if(voices)
+		aa_voices_release(voices);
+	if(model)
+		aa_bell_release(model);
+	return ret;
+}
+
+/** Renders wok.sy and a voice pool of it with and without culling,
+    and checks that culled renders stay within the threshold of every
+    mode of the full one. Returns nonzero if one does not.
+ */
+static int
+bench_suite_cull(void) {
+	static const float thresholds[] = { 0.0f, 1e-6f, 1e-5f, 1e-4f };
+	int nsamples = (int)(BENCH_CULL_SECONDS * BENCH_SRATE
+	    / BENCH_BUFFER_SIZE) * BENCH_BUFFER_SIZE;
+	float *ref = calloc(sizeof(float), nsamples);
+	float *out = calloc(sizeof(float), nsamples);
+	double base = 0.0, voices_base = 0.0;
+	int nf = 0, ret = 0;
+	aa_bell_t bell = aa_bell_create_from_file("sy/wok.sy",
+		BENCH_BUFFER_SIZE, BENCH_SRATE);
+
+	if(!ref || !out || !bell) {
+		ret = 1;
+		goto bail;
+	}
+
+	nf = aa_bell_get_mode_count(bell);
+
+	for(int t = 0; t < BENCH_COUNT(thresholds); t++) {
+		float *dest = t ? out : ref;
+		double seconds, live, voice_seconds, active, max_err = 0.0;
+		bool accurate;
+
+		if(bench_cull_render(thresholds[t], dest, &seconds, &live)
+		    || bench_cull_voices(thresholds[t], &voice_seconds, &active)) {
+			ret = 1;
+			goto bail;
+		}
+
+		if(!t) {
+			base = seconds;
+			voices_base = voice_seconds;
+		}
+
+		for(int k = 0; k < nsamples; k++) {
+			double err = fabs(dest[k] - ref[k]);
+
+			if(err > max_err)
+				max_err = err;
+		}
+
+		// Rounding aside, the culled render only lacks modes that were
+		// below the threshold when they were culled.
+		accurate = max_err <= nf * thresholds[t] + 1e-6;
+
+		bench_result_begin("cull");
+		bench_result_num("threshold", thresholds[t]);
+		bench_result_num("live_modes", live);
+		bench_result_int("modes", nf);
+		bench_result_num("ns_per_sample", seconds * 1e9 / nsamples);
+		bench_result_num("speedup", base / seconds);
+		bench_result_num("max_error", max_err);
+		bench_result_num("active_voices", active);
+		bench_result_num("us_per_voice_buffer", voice_seconds * 1e6);
+		bench_result_num("voices_speedup", voices_base / voice_seconds);
+		bench_result_str("status", accurate ? "ok" : "INACCURATE");
+		bench_result_end();
+
+		if(!accurate)
+			ret = 1;
+	}
+
+bail:
+	if(bell)
+		aa_bell_release(bell);
+	free(ref);
+	free(out);
+	return ret;
+}
+
+/** Renders the pool of bench_cull_voices() under a budget of modes per
+    buffer into out, BENCH_CULL_REPEATS times. Stores the seconds per
+    buffer of the fastest run and the mean number of modes dropped per
+    buffer. Returns nonzero if the pool could not be made.
+ */
+static int
+bench_budget_voices(
+	int modes, float *out, double *seconds, double *dropped
+) {
+	int nbuffers = (int)(BENCH_CULL_SECONDS * BENCH_SRATE / BENCH_BUFFER_SIZE);
+	double every = BENCH_CULL_VOICE_SECONDS * BENCH_SRATE / BENCH_BUFFER_SIZE;
+	aa_bell_t model = aa_bell_create_from_file("sy/wok.sy",
+		BENCH_BUFFER_SIZE, BENCH_SRATE);
+	aa_voices_t voices = NULL;
+	int ret = 1;
+
+	if(!model || aa_bell_set_cull_threshold(model, BENCH_BUDGET_THRESHOLD))
+		goto bail;
+
+	*seconds = HUGE_VAL;
+
+	for(int r = 0; r < BENCH_CULL_REPEATS; r++) {
+		long long dropped_sum = 0;
+		double next = 0.0, start, elapsed;
+
+		voices = aa_voices_create(model, BENCH_CULL_VOICES);
+
+		if(!voices || aa_voices_set_mode_budget(voices, modes))
+			goto bail;
+
+		start = bench_now();
+		for(int b = 0; b < nbuffers; b++) {
+			for(; next < b + 1; next += every)
+				aa_voices_strike_at(voices, 0.01, 0.002, 0.0f,
+					(int)((next - b) * BENCH_BUFFER_SIZE));
+			aa_voices_compute_sound_buffer(voices,
+				out + b * BENCH_BUFFER_SIZE);
+			dropped_sum += aa_voices_get_dropped_mode_count(voices);
+		}
+		elapsed = (bench_now() - start) / nbuffers;
+
+		if(elapsed < *seconds)
+			*seconds = elapsed;
+		*dropped = (double)dropped_sum / nbuffers;
+
+		aa_voices_release(voices);
+		voices = NULL;
+	}
+	ret = 0;
+
+bail:
+	if(voices)
+		aa_voices_release(voices);
+	if(model)
+		aa_bell_release(model);
+	return ret;
+}
+
+/** Renders a crowded voice pool of wok.sy under shrinking mode budgets
+    and reports the time per buffer against the signal-to-error ratio
+    of the result. A budget too large to drop anything must leave the
+    output unchanged. Returns nonzero if it does not.
+ */
+static int
+bench_suite_budget(void) {
+	static const int budgets[] = { 0, 1 << 20, 4096, 2048, 1024, 512, 256 };
+	int nsamples = (int)(BENCH_CULL_SECONDS * BENCH_SRATE
+	    / BENCH_BUFFER_SIZE) * BENCH_BUFFER_SIZE;
+	float *ref = calloc(sizeof(float), nsamples);
+	float *out = calloc(sizeof(float), nsamples);
+	double base = 0.0;
+	int ret = 0;
+
+	if(!ref || !out) {
+		ret = 1;
+		goto bail;
+	}
+
+	for(int m = 0; m < BENCH_COUNT(budgets); m++) {
+		float *dest = m ? out : ref;
+		double seconds, dropped, signal = 0.0, noise = 0.0;
+		const char *status = "ok";
+
+		if(bench_budget_voices(budgets[m], dest, &seconds, &dropped)) {
+			ret = 1;
+			goto bail;
+		}
+
+		if(!m)
+			base = seconds;
+
+		for(int k = 0; k < nsamples; k++) {
+			double err = dest[k] - ref[k];
+
+			signal += (double)ref[k] * ref[k];
+			noise += err * err;
+		}
+
+		if(!isfinite(noise) || (!dropped && (noise > 0.0)))
+			status = "MISMATCH";
+
+		bench_result_begin("budget");
+		bench_result_int("modes_per_buffer", budgets[m]);
+		bench_result_num("dropped_modes", dropped);
+		bench_result_num("us_per_buffer", seconds * 1e6);
+		bench_result_num("speedup", base / seconds);
+		bench_result_num("snr_db", noise > 0.0
+		    ? 10.0 * log10(signal / noise) : HUGE_VAL);
+		bench_result_str("status", status);
+		bench_result_end();
+
+		if(strcmp(status, "ok"))
+			ret = 1;
+	}
+
+bail:
+	free(ref);
+	free(out);
+	return ret;
+}
+
+/** Moves bell, or strikes one of voices, to the next quarter point. */
+struct bench_points_s {
+	aa_bell_t	bell;
+	aa_voices_t	voices;
+	int			count;
+};
+
+static void
+bench_points_func(void *context) {
+	struct bench_points_s *points = context;
+	float point;
+
+	points->count = (points->count + 7) % (4 * (BENCH_POINT_COUNT - 1));
+	point = points->count * 0.25f;
+
+	if(points->voices)
+		aa_voices_strike_at(points->voices, 0.01, 0.002, point, 0);
+	else
+		aa_bell_set_strike_point(points->bell, point);
+}
+
+/** Strikes between two measured points against a bell whose gains are
+    mixed by hand, and voices struck at a point against a bell moved
+    there. Then the cost of moving a bell and a voice.
+ */
+static int
+bench_suite_points(void) {
+	int ret = 1;
+	int nbuffers = BENCH_SRATE / BENCH_BUFFER_SIZE;
+	aa_bell_t at = bench_make_point_bell(BENCH_BUFFER_SIZE);
+	aa_bell_t mixed = bench_make_point_bell(BENCH_BUFFER_SIZE);
+	aa_bell_t model = bench_make_point_bell(BENCH_BUFFER_SIZE);
+	aa_voices_t voices = NULL;
+	float a[BENCH_BUFFER_SIZE], b[BENCH_BUFFER_SIZE], c[BENCH_BUFFER_SIZE];
+	double maxerr = 0.0, voiceerr = 0.0, peak = 0.0;
+	struct bench_points_s points = { 0 };
+	double owned, shared;
+
+	if(!at || !mixed || !model)
+		goto bail;
+
+	voices = aa_voices_create(model, BENCH_POINT_VOICES);
+
+	if(!voices)
+		goto bail;
+
+	// 2.25 is three quarters point 2 and one quarter point 3.
+	for(int i = 0; i < BENCH_POINT_MODES; i++) {
+		const float *g = mixed->a + i;
+
+		aa_bell_set_gain(mixed, 0, i, 0.75f * g[2 * BENCH_POINT_MODES]
+			+ 0.25f * g[3 * BENCH_POINT_MODES]);
+		aa_bell_compute_location(mixed, i);
+	}
+
+	if(aa_bell_set_strike_point(at, 2.25f)
+	    || (aa_voices_strike_at(voices, 0.01, 0.002, 2.25f, 0) < 0))
+		goto bail;
+
+	aa_bell_add_energy(at, 0.01, 0.002);
+	aa_bell_add_energy(mixed, 0.01, 0.002);
+
+	for(int n = 0; n < nbuffers; n++) {
+		aa_bell_compute_sound_buffer(at, a);
+		aa_bell_compute_sound_buffer(mixed, b);
+		// The voice is retired once all of its modes die down.
+		if(aa_voices_get_active_count(voices))
+			aa_voices_compute_sound_buffer(voices, c);
+		else
+			memcpy(c, a, sizeof(c));
+		for(int k = 0; k < BENCH_BUFFER_SIZE; k++) {
+			if(fabs(b[k]) > peak)
+				peak = fabs(b[k]);
+			if(fabs(a[k] - b[k]) > maxerr)
+				maxerr = fabs(a[k] - b[k]);
+			if(fabs(a[k] - c[k]) > voiceerr)
+				voiceerr = fabs(a[k] - c[k]);
+		}
+	}
+	maxerr /= peak;
+	voiceerr /= peak;
+
+	points.bell = at;
+	owned = bench_measure(&bench_points_func, &points, NULL, NULL);
+	points.voices = voices;
+	shared = bench_measure(&bench_points_func, &points, NULL, NULL);
+
+	bench_result_begin("points");
+	bench_result_int("modes", BENCH_POINT_MODES);
+	bench_result_int("points", BENCH_POINT_COUNT);
+	bench_result_num("max_rel_err", maxerr);
+	bench_result_num("voice_max_rel_err", voiceerr);
+	bench_result_num("ns_per_move", owned * 1e9);
+	bench_result_num("ns_per_voice_strike", shared * 1e9);
+	bench_result_str("status", (maxerr <= BENCH_KERNEL_TOLERANCE)
+		&& (voiceerr == 0.0) ? "ok" : "MISMATCH");
+	bench_result_end();
+
+	ret = (maxerr > BENCH_KERNEL_TOLERANCE) || (voiceerr != 0.0);
+
+bail:
+	if(ret)
+		fprintf(stderr, "bench: strike points failed\n");
+	if(voices)
+		aa_voices_release(voices);
+	if(at)
+		aa_bell_release(at);
+	if(mixed)
+		aa_bell_release(mixed);
+	if(model)
+		aa_bell_release(model);
+	return ret;
+}
+
+/** Renders a model for BENCH_DRIFT_SECONDS with the block kernel and
+    the direct recurrence, and reports how far apart they end up.
+ */
+static int
+bench_drift_model(const char *path) {
+	int ret = 1;
+	aa_bell_t ref = aa_bell_create_from_file(path,
+		BENCH_DRIFT_BUFFER_SIZE, BENCH_SRATE);
+	aa_bell_t blk = aa_bell_create_from_file(path,
+		BENCH_DRIFT_BUFFER_SIZE, BENCH_SRATE);
+	int nbuffers = BENCH_DRIFT_SECONDS * BENCH_SRATE
+	    / BENCH_DRIFT_BUFFER_SIZE;
+	static float a[BENCH_DRIFT_BUFFER_SIZE], b[BENCH_DRIFT_BUFFER_SIZE];
+	double maxerr = 0.0, lasterr = 0.0, peak = 0.0;
+
+	if(!ref || !blk) {
+		fprintf(stderr, "bench: unable to load %s\n", path);
+		goto bail;
+	}
+
+	aa_bell_set_kernel(ref, AA_BELL_KERNEL_SCALAR);
+	aa_bell_set_kernel(blk, AA_BELL_KERNEL_BLOCK);
+	aa_bell_add_energy(ref, 0.01, 0.002);
+	aa_bell_add_energy(blk, 0.01, 0.002);
+
+	for(int n = 0; n < nbuffers; n++) {
+		aa_bell_compute_sound_buffer(ref, a);
+		aa_bell_compute_sound_buffer(blk, b);
+		lasterr = 0.0;
+		for(int k = 0; k < BENCH_DRIFT_BUFFER_SIZE; k++) {
+			double err = fabs(a[k] - b[k]);
+			if(fabs(a[k]) > peak)
+				peak = fabs(a[k]);
+			if(err > lasterr)
+				lasterr = err;
+		}
+		if(lasterr > maxerr)
+			maxerr = lasterr;
+	}
+
+	bench_result_begin("drift");
+	bench_result_str("kernel", "block");
+	bench_result_str("model", path);
+	bench_result_int("seconds", BENCH_DRIFT_SECONDS);
+	bench_result_num("max_abs_err", maxerr);
+	bench_result_num("final_abs_err", lasterr);
+	bench_result_num("peak", peak);
+	bench_result_end();
+
+	ret = 0;
+
+bail:
+	if(ref)
+		aa_bell_release(ref);
+	if(blk)
+		aa_bell_release(blk);
+	return ret;
+}
+
+static int
+bench_suite_drift(void) {
+	return bench_drift_model("sy/wok.sy") | bench_drift_model("sy/sine1.sy");
+}
+
+/** Doubles the number of simultaneously sounding voices of a model
+    until rendering falls behind real time, and reports how many voices
+    a single core can carry.
+ */
+static int
+bench_suite_voices(void) {
+	const char *path = "sy/wok.sy";
+	aa_bell_t model = aa_bell_create_from_file(path,
+		BENCH_BUFFER_SIZE, BENCH_SRATE);
+	int nbuffers = (int)(BENCH_SECONDS * BENCH_SRATE / BENCH_BUFFER_SIZE);
+	float out[BENCH_BUFFER_SIZE];
+	double max_voices = 0.0;
+
+	if(!model) {
+		fprintf(stderr, "bench: unable to load %s\n", path);
+		return 1;
+	}
+
+	for(int n = 1; n <= BENCH_MAX_VOICES; n *= 2) {
+		aa_voices_t voices = aa_voices_create(model, n);
+		double start, elapsed, realtime;
+
+		if(!voices)
+			break;
+
+		start = bench_now();
+		for(int b = 0; b < nbuffers; b++) {
+			while(aa_voices_get_active_count(voices) < n)
+				aa_voices_strike(voices, 0.01, 0.002);
+			aa_voices_compute_sound_buffer(voices, out);
+		}
+		elapsed = bench_now() - start;
+		realtime = BENCH_SECONDS / elapsed;
+
+		bench_result_begin("voices");
+		bench_result_str("model", path);
+		bench_result_int("voices", n);
+		bench_result_num("ns_per_voice_sample",
+			elapsed * 1e9 / ((double)n * nbuffers * BENCH_BUFFER_SIZE));
+		bench_result_num("realtime", realtime);
+		bench_result_end();
+
+		aa_voices_release(voices);
+
+		max_voices = n * realtime;
+		if(realtime < 1.0)
+			break;
+	}
+
+	bench_result_begin("voices");
+	bench_result_str("model", path);
+	bench_result_int("max_realtime_voices", (long long)max_voices);
+	bench_result_end();
+
+	aa_bell_release(model);
+
+	return 0;
+}
+
+/** Renders the same ensemble on 1 to N threads, where N is the number
+    of online CPUs (at least 4, so that stealing is exercised), and
+    checks that the output is bit-identical to the single-threaded one.
+    Returns nonzero if any thread count differs.
+ */
+static int
+bench_suite_scheduler(void) {
+	const char *path = "sy/wok.sy";
+	int ret = 0;
+	int nbuffers = (int)(BENCH_SECONDS * BENCH_SRATE / BENCH_BUFFER_SIZE);
+	int nsamples = nbuffers * BENCH_BUFFER_SIZE;
+	float *ref = calloc(sizeof(float), nsamples);
+	float *out = calloc(sizeof(float), nsamples);
+	int max_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	double base = 0.0;
+
+	if(max_threads < 4)
+		max_threads = 4;
+
+	for(int t = 1; ref && out && (t <= max_threads); t++) {
+		aa_bell_t big = bench_make_bell(BENCH_SCHEDULER_MODES,
+			BENCH_BUFFER_SIZE, BENCH_SRATE);
+		aa_bell_t model = aa_bell_create_from_file(path,
+			BENCH_BUFFER_SIZE, BENCH_SRATE);
+		aa_voices_t voices = NULL;
+		aa_scheduler_t scheduler = NULL;
+		double start, elapsed, rate;
+		bool identical;
+
+		if(!big || !model) {
+			ret = 1;
+			goto next;
+		}
+
+		voices = aa_voices_create(model, BENCH_SCHEDULER_VOICES);
+		scheduler = aa_scheduler_create(t, BENCH_BUFFER_SIZE);
+
+		if(!voices || !scheduler
+		    || aa_scheduler_add_bell(scheduler, big, 0)
+		    || aa_scheduler_add_voices(scheduler, voices)) {
+			ret = 1;
+			goto next;
+		}
+
+		aa_bell_add_energy(big, 0.01, 0.002);
+		for(int v = 0; v < BENCH_SCHEDULER_VOICES; v++)
+			aa_voices_strike(voices, 0.01, 0.002);
+
+		start = bench_now();
+		for(int n = 0; n < nbuffers; n++) {
+			aa_scheduler_compute_sound_buffer(scheduler,
+				(t == 1 ? ref : out) + n * BENCH_BUFFER_SIZE);
+		}
+		elapsed = bench_now() - start;
+
+		rate = (double)nsamples * (BENCH_SCHEDULER_MODES
+		    + BENCH_SCHEDULER_VOICES * aa_bell_get_mode_count(model))
+		    / elapsed;
+		if(t == 1)
+			base = rate;
+
+		identical = (t == 1) || !memcmp(ref, out, sizeof(float) * nsamples);
+		if(!identical)
+			ret = 1;
+
+		bench_result_begin("scheduler");
+		bench_result_int("threads", t);
+		bench_result_int("jobs", aa_scheduler_get_job_count(scheduler));
+		bench_result_num("mode_samples_per_s", rate);
+		bench_result_num("speedup", rate / base);
+		bench_result_str("status", identical ? "identical" : "DIFFERS");
+		bench_result_end();
+
+next:
+		if(scheduler)
+			aa_scheduler_release(scheduler);
+		if(voices)
+			aa_voices_release(voices);
+		if(model)
+			aa_bell_release(model);
+		if(big)
+			aa_bell_release(big);
+	}
+
+	free(ref);
+	free(out);
+
+	return ret;
+}
+
+/** One row of the output suite: how the bus is summed from its parts
+    and kept within +-1, one buffer at a time.
+ */
+struct bench_output_s {
+	int			how;
+	aa_output_t	stage;
+	float *		parts[BENCH_OUTPUT_PARTS];
+	float *		bus;
+	int			nsamples;
+	int			offset;
+};
+
+enum {
+	BENCH_OUTPUT_BRANCHY,       // the clamp aa_bell_clamp_buffer() had
+	BENCH_OUTPUT_BELL_CLAMP,    // aa_bell_clamp_buffer()
+	BENCH_OUTPUT_SEPARATE,      // sum, then aa_output_process()
+	BENCH_OUTPUT_FUSED,         // aa_output_mix() on the last part
+};
+
+static void
+bench_output_branchy_clamp(
+	float *output, int nsamples
+) {
+	for(int i = 0; i < nsamples; i++) {
+		if(output[i] > 1.0)
+			output[i] = 1.0;
+		if(output[i] < -1.0)
+			output[i] = -1.0;
+	}
+}
+
+/** Sums the parts into the next buffer of the bus and runs the stage. */
+static void
+bench_output_func(void *context) {
+	struct bench_output_s *out = context;
+	float *bus = out->bus + out->offset;
+	int last = BENCH_OUTPUT_PARTS - 1;
+
+	memcpy(bus, out->parts[0] + out->offset,
+		sizeof(float) * BENCH_BUFFER_SIZE);
+	for(int p = 1; p < last; p++)
+		for(int k = 0; k < BENCH_BUFFER_SIZE; k++)
+			bus[k] += out->parts[p][out->offset + k];
+
+	if(out->how == BENCH_OUTPUT_FUSED) {
+		aa_output_mix(out->stage, bus, out->parts[last] + out->offset,
+			BENCH_BUFFER_SIZE);
+	} else {
+		for(int k = 0; k < BENCH_BUFFER_SIZE; k++)
+			bus[k] += out->parts[last][out->offset + k];
+
+		if(out->how == BENCH_OUTPUT_BRANCHY)
+			bench_output_branchy_clamp(bus, BENCH_BUFFER_SIZE);
+		else if(out->how == BENCH_OUTPUT_BELL_CLAMP)
+			aa_bell_clamp_buffer(bus, BENCH_BUFFER_SIZE);
+		else
+			aa_output_process(out->stage, bus, BENCH_BUFFER_SIZE);
+	}
+
+	out->offset += BENCH_BUFFER_SIZE;
+	if(out->offset == out->nsamples)
+		out->offset = 0;
+}
+
+/** Whether the soft clipper is monotone, odd and within the ceiling
+    from -4 to 4 times it.
+ */
+static bool
+bench_output_soft_is_sane(void) {
+	aa_output_t stage = aa_output_create(AA_OUTPUT_SOFT_CLIP, 0.5f, 0.0f,
+		BENCH_SRATE);
+	float ramp[801], neg[801];
+	bool ret = !!stage;
+
+	if(!stage)
+		return false;
+
+	for(int k = 0; k < BENCH_COUNT(ramp); k++) {
+		ramp[k] = (k - 400) / 200.0f;
+		neg[k] = -ramp[k];
+	}
+	aa_output_process(stage, ramp, BENCH_COUNT(ramp));
+	aa_output_process(stage, neg, BENCH_COUNT(neg));
+
+	for(int k = 0; k < BENCH_COUNT(ramp); k++) {
+		ret &= fabsf(ramp[k]) <= 0.5f;
+		ret &= neg[k] == -ramp[k];
+		if(k)
+			ret &= ramp[k] >= ramp[k - 1];
+	}
+
+	aa_output_release(stage);
+	return ret;
+}
+
+/** Whether the limiter passes a signal that never reaches the ceiling
+    exactly, only delayed by its look-ahead.
+ */
+static bool
+bench_output_limit_is_transparent(
+	const float *input, int nsamples
+) {
+	aa_output_t stage = aa_output_create(AA_OUTPUT_LIMIT, 1.0f,
+		AA_OUTPUT_DEFAULT_LOOKAHEAD, BENCH_SRATE);
+	float *buffer = malloc(sizeof(float) * nsamples);
+	bool ret = stage && buffer;
+	int latency;
+
+	if(!ret)
+		goto bail;
+
+	latency = aa_output_get_latency(stage);
+	for(int k = 0; k < nsamples; k++)
+		buffer[k] = 0.25f * input[k];
+	aa_output_process(stage, buffer, nsamples);
+
+	for(int k = 0; k < nsamples; k++)
+		ret &= buffer[k] == (k < latency ? 0.0f
+		    : 0.25f * input[k - latency]);
+
+bail:
+	if(stage)
+		aa_output_release(stage);
+	free(buffer);
+	return ret;
+}
+
+/** Clamp, soft clipper and look-ahead limiter on a bus of several
+    parts peaking at about twice the ceiling, against the old clamp, and
+    with the stage fused into the sum of the last part.
+ */
+static int
+bench_suite_output(void) {
+	static const struct {
+		const char *name;
+		aa_output_shape_t shape;
+		int how;
+	} rows[] = {
+		{ "branchy", AA_OUTPUT_CLAMP, BENCH_OUTPUT_BRANCHY },
+		{ "bell", AA_OUTPUT_CLAMP, BENCH_OUTPUT_BELL_CLAMP },
+		{ "clamp", AA_OUTPUT_CLAMP, BENCH_OUTPUT_SEPARATE },
+		{ "clamp", AA_OUTPUT_CLAMP, BENCH_OUTPUT_FUSED },
+		{ "soft", AA_OUTPUT_SOFT_CLIP, BENCH_OUTPUT_SEPARATE },
+		{ "soft", AA_OUTPUT_SOFT_CLIP, BENCH_OUTPUT_FUSED },
+		{ "limit", AA_OUTPUT_LIMIT, BENCH_OUTPUT_SEPARATE },
+		{ "limit", AA_OUTPUT_LIMIT, BENCH_OUTPUT_FUSED },
+	};
+	struct bench_output_s out = {
+		.nsamples = (int)(BENCH_SECONDS * BENCH_SRATE / BENCH_BUFFER_SIZE)
+		    * BENCH_BUFFER_SIZE,
+	};
+	int nsamples = out.nsamples;
+	float *sum = calloc(sizeof(float), nsamples);
+	float *ref = calloc(sizeof(float), nsamples);
+	float *separate = calloc(sizeof(float), nsamples);
+	unsigned int seed = 24680;
+	double base = 0.0;
+	int ret = 0;
+
+	out.bus = calloc(sizeof(float), nsamples);
+	if(!sum || !ref || !separate || !out.bus) {
+		ret = 1;
+		goto bail;
+	}
+
+	// Each part is a few partials; together they peak near 2.
+	for(int p = 0; p < BENCH_OUTPUT_PARTS; p++) {
+		if(!(out.parts[p] = calloc(sizeof(float), nsamples))) {
+			ret = 1;
+			goto bail;
+		}
+
+		for(int j = 0; j < 4; j++) {
+			double freq, phase;
+
+			seed = seed * 1103515245 + 12345;
+			freq = 60.0 + (seed >> 16) % 4000;
+			seed = seed * 1103515245 + 12345;
+			phase = (seed >> 16) % 1000 / 1000.0 * 2.0 * M_PI;
+
+			for(int k = 0; k < nsamples; k++)
+				out.parts[p][k] += (float)(0.5 / 4 * sin(
+				    2.0 * M_PI * freq * k / BENCH_SRATE + phase));
+		}
+		for(int k = 0; k < nsamples; k++)
+			sum[k] += out.parts[p][k];
+	}
+
+	for(int r = 0; r < BENCH_COUNT(rows); r++) {
+		const char *status = "ok";
+		double seconds;
+		float peak = 0.0f;
+
+		out.how = rows[r].how;
+		out.stage = NULL;
+		out.offset = 0;
+
+		if(out.how >= BENCH_OUTPUT_SEPARATE) {
+			out.stage = aa_output_create(rows[r].shape, 1.0f,
+				AA_OUTPUT_DEFAULT_LOOKAHEAD, BENCH_SRATE);
+			if(!out.stage) {
+				ret = 1;
+				goto bail;
+			}
+		}
+
+		// One pass over the signal from rest, to check, then timing.
+		for(int k = 0; k < nsamples; k += BENCH_BUFFER_SIZE)
+			bench_output_func(&out);
+
+		for(int k = 0; k < nsamples; k++) {
+			float a = fabsf(out.bus[k]);
+
+			peak = a > peak ? a : peak;
+		}
+
+		if(!(peak <= 1.0f))
+			status = "INACCURATE";
+		else if(out.how == BENCH_OUTPUT_BRANCHY)
+			memcpy(ref, out.bus, sizeof(float) * nsamples);
+		else if((rows[r].shape == AA_OUTPUT_CLAMP)
+		    && memcmp(ref, out.bus, sizeof(float) * nsamples))
+			status = "MISMATCH";
+		else if(out.how == BENCH_OUTPUT_SEPARATE)
+			memcpy(separate, out.bus, sizeof(float) * nsamples);
+		else if((out.how == BENCH_OUTPUT_FUSED)
+		    && memcmp(separate, out.bus, sizeof(float) * nsamples))
+			status = "MISMATCH";
+
+		if((out.how == BENCH_OUTPUT_SEPARATE)
+		    && (rows[r].shape == AA_OUTPUT_SOFT_CLIP)
+		    && !bench_output_soft_is_sane())
+			status = "INACCURATE";
+		if((out.how == BENCH_OUTPUT_SEPARATE)
+		    && (rows[r].shape == AA_OUTPUT_LIMIT)
+		    && !bench_output_limit_is_transparent(sum, nsamples))
+			status = "MISMATCH";
+
+		seconds = bench_measure(&bench_output_func, &out, NULL, NULL)
+		    / BENCH_BUFFER_SIZE;
+		if(!r)
+			base = seconds;
+
+		bench_result_begin("output");
+		bench_result_str("stage", rows[r].name);
+		bench_result_str("pass", out.how == BENCH_OUTPUT_FUSED ? "fused"
+		    : "separate");
+		bench_result_int("latency", out.stage
+		    ? aa_output_get_latency(out.stage) : 0);
+		bench_result_num("ns_per_sample", seconds * 1e9);
+		bench_result_num("speedup", base / seconds);
+		bench_result_num("peak", peak);
+		bench_result_str("status", status);
+		bench_result_end();
+
+		if(strcmp(status, "ok"))
+			ret = 1;
+
+		if(out.stage)
+			aa_output_release(out.stage);
+		out.stage = NULL;
+	}
+
+bail:
+	if(out.stage)
+		aa_output_release(out.stage);
+	for(int p = 0; p < BENCH_OUTPUT_PARTS; p++)
+		free(out.parts[p]);
+	free(out.bus);
+	free(sum);
+	free(ref);
+	free(separate);
+	return ret;
+}
+
+/** Makes a bell with nf pseudo-random modes measured at
+    BENCH_CHANNEL_POINTS points, rendering channels channels that pick
+    up at points spread evenly over them, or mono if channels is 0.
+ */
+static aa_bell_t
+bench_make_channel_bell(
+	int nf, int channels
+) {
+	aa_bell_t bell = aa_bell_create(nf, BENCH_CHANNEL_POINTS,
+		BENCH_BUFFER_SIZE, BENCH_SRATE);
+	unsigned int seed = 97531;
+
+	if(!bell)
+		return NULL;
+
+	for(int i = 0; i < nf; i++) {
+		seed = seed * 1103515245 + 12345;
+		aa_bell_set_mode_freq(bell, i, 100.0f + (seed >> 16) % 8000);
+		seed = seed * 1103515245 + 12345;
+		aa_bell_set_angular_decay(bell, i, 1.0f + (seed >> 16) % 50);
+		for(int p = 0; p < BENCH_CHANNEL_POINTS; p++) {
+			seed = seed * 1103515245 + 12345;
+			aa_bell_set_gain(bell, p, i, ((seed >> 16) % 1000) / 1000.0f / nf);
+		}
+	}
+	aa_bell_compute_filter(bell);
+
+	if(channels && aa_bell_set_channel_count(bell, channels)) {
+		aa_bell_release(bell);
+		return NULL;
+	}
+	for(int c = 0; c < channels; c++)
+		aa_bell_set_channel_point(bell, c, channels > 1
+		    ? (float)c * (BENCH_CHANNEL_POINTS - 1) / (channels - 1) : -1.0f);
+
+	return bell;
+}
+
+/** Renders a strike on a bell with 8 channels with every kernel, in
+    both layouts, and compares it against the scalar kernel, and a bell
+    with one unpanned channel against its mono output. Returns nonzero
+    on mismatch.
+ */
+static int
+bench_channels_check(int nf) {
+	enum { channels = 8 };
+	static float ref[channels * BENCH_BUFFER_SIZE];
+	static float planar[channels * BENCH_BUFFER_SIZE];
+	static float interleaved[channels * BENCH_BUFFER_SIZE];
+	int nbuffers = BENCH_SRATE / BENCH_BUFFER_SIZE / 4;
+	int ret = 0;
+
+	for(aa_bell_kernel_t kernel = AA_BELL_KERNEL_SIMD4;
+	    kernel <= AA_BELL_KERNEL_BLOCK; kernel++) {
+		aa_bell_t a = bench_make_channel_bell(nf, channels);
+		aa_bell_t b = bench_make_channel_bell(nf, channels);
+		aa_bell_t c = bench_make_channel_bell(nf, channels);
+		double maxerr = 0.0, peak = 0.0;
+		bool same = true;
+
+		if(!a || !b || !c || (aa_bell_set_kernel(b, kernel) != kernel)) {
+			ret |= !a || !b || !c;
+			goto next;
+		}
+		aa_bell_set_kernel(a, AA_BELL_KERNEL_SCALAR);
+		aa_bell_set_kernel(c, kernel);
+		aa_bell_add_energy(a, 0.01, 0.002);
+		aa_bell_add_energy(b, 0.01, 0.002);
+		aa_bell_add_energy(c, 0.01, 0.002);
+
+		for(int n = 0; n < nbuffers; n++) {
+			aa_bell_compute_channels(a, ref, AA_BELL_LAYOUT_PLANAR);
+			aa_bell_compute_channels(b, planar, AA_BELL_LAYOUT_PLANAR);
+			aa_bell_compute_channels(c, interleaved,
+				AA_BELL_LAYOUT_INTERLEAVED);
+
+			for(int k = 0; k < channels * BENCH_BUFFER_SIZE; k++) {
+				double err = fabs(ref[k] - planar[k]);
+
+				peak = fabs(ref[k]) > peak ? fabs(ref[k]) : peak;
+				maxerr = err > maxerr ? err : maxerr;
+				same = same && (planar[k] == interleaved[
+				    k % BENCH_BUFFER_SIZE * channels + k / BENCH_BUFFER_SIZE]);
+			}
+		}
+		maxerr /= peak;
+
+		bench_result_begin("channels");
+		bench_result_str("kernel", bench_kernel_name(kernel));
+		bench_result_int("modes", nf);
+		bench_result_int("channels", channels);
+		bench_result_num("max_rel_err", maxerr);
+		bench_result_str("status", !same ? "DIFFERS"
+		    : maxerr <= BENCH_KERNEL_TOLERANCE ? "ok" : "MISMATCH");
+		bench_result_end();
+
+		if(!same || (maxerr > BENCH_KERNEL_TOLERANCE))
+			ret = 1;
+
+	next:
+		if(a)
+			aa_bell_release(a);
+		if(b)
+			aa_bell_release(b);
+		if(c)
+			aa_bell_release(c);
+	}
+
+	{
+		aa_bell_t mono = bench_make_channel_bell(nf, 0);
+		aa_bell_t one = bench_make_channel_bell(nf, 1);
+		double maxerr = 0.0, peak = 0.0;
+
+		if(!mono || !one) {
+			ret = 1;
+		} else {
+			aa_bell_add_energy(mono, 0.01, 0.002);
+			aa_bell_add_energy(one, 0.01, 0.002);
+			for(int n = 0; n < nbuffers; n++) {
+				aa_bell_compute_sound_buffer(mono, ref);
+				aa_bell_compute_channels(one, planar, AA_BELL_LAYOUT_PLANAR);
+				for(int k = 0; k < BENCH_BUFFER_SIZE; k++) {
+					double err = fabs(ref[k] - planar[k]);
+
+					peak = fabs(ref[k]) > peak ? fabs(ref[k]) : peak;
+					maxerr = err > maxerr ? err : maxerr;
+				}
+			}
+			maxerr /= peak;
+
+			bench_result_begin("channels");
+			bench_result_str("kernel", "mono");
+			bench_result_int("modes", nf);
+			bench_result_int("channels", 1);
+			bench_result_num("max_rel_err", maxerr);
+			bench_result_str("status",
+				maxerr <= BENCH_KERNEL_TOLERANCE ? "ok" : "MISMATCH");
+			bench_result_end();
+
+			if(maxerr > BENCH_KERNEL_TOLERANCE)
+				ret = 1;
+		}
+
+		if(mono)
+			aa_bell_release(mono);
+		if(one)
+			aa_bell_release(one);
+	}
+
+	return ret;
+}
+
+struct bench_channels_s {
+	aa_bell_t	bell;
+	float *		buffer;
+	aa_bell_layout_t layout;
+	int			restrike;
+	int			count;
+};
+
+static void
+bench_channels_func(void *context) {
+	struct bench_channels_s *render = context;
+
+	if(render->count-- <= 0) {
+		aa_bell_clear_history(render->bell);
+		aa_bell_add_energy(render->bell, 0.01, 0.002);
+		render->count = render->restrike;
+	}
+	aa_bell_compute_channels(render->bell, render->buffer, render->layout);
+}
+
+/** Cost of rendering 2, 8 and 16 channels in one pass, in either
+    layout, against mono and against rendering the bell once per
+    channel.
+ */
+static int
+bench_suite_channels(void) {
+	static const int mode_counts[] = { 1000, 10000 };
+	static const int channel_counts[] = { 2, 8, 16 };
+	static float buffer[AA_BELL_MAX_CHANNELS * BENCH_BUFFER_SIZE];
+	int ret = bench_channels_check(60) | bench_channels_check(1000);
+
+	for(int m = 0; m < BENCH_COUNT(mode_counts); m++) {
+		int nf = mode_counts[m];
+		double mono = 0.0;
+
+		for(int n = -1; n < BENCH_COUNT(channel_counts); n++)
+		for(aa_bell_layout_t layout = AA_BELL_LAYOUT_PLANAR;
+		    layout <= AA_BELL_LAYOUT_INTERLEAVED; layout++) {
+			int channels = n < 0 ? 0 : channel_counts[n];
+			struct bench_channels_s render = {
+				.bell = bench_make_channel_bell(nf, channels),
+				.buffer = buffer,
+				.layout = layout,
+				.restrike = (int)(BENCH_RESTRIKE_SECONDS * BENCH_SRATE
+				    / BENCH_BUFFER_SIZE),
+			};
+			double seconds;
+
+			// Mono has no layout.
+			if((n < 0) && (layout != AA_BELL_LAYOUT_PLANAR)) {
+				if(render.bell)
+					aa_bell_release(render.bell);
+				continue;
+			}
+			if(!render.bell) {
+				ret = 1;
+				continue;
+			}
+
+			seconds = bench_measure(&bench_channels_func, &render, NULL, NULL);
+			if(n < 0)
+				mono = seconds;
+
+			bench_result_begin("channels");
+			bench_result_int("modes", nf);
+			bench_result_int("channels", channels ? channels : 1);
+			bench_result_str("layout", n < 0 ? "mono"
+			    : layout == AA_BELL_LAYOUT_PLANAR ? "planar" : "interleaved");
+			bench_result_num("ns_per_mode_sample",
+				seconds * 1e9 / nf / BENCH_BUFFER_SIZE);
+			bench_result_num("cost_vs_mono", seconds / mono);
+			bench_result_num("speedup_vs_per_channel",
+				(channels ? channels : 1) * mono / seconds);
+			bench_result_end();
+
+			aa_bell_release(render.bell);
+		}
+	}
+
+	return ret;
+}
+
+static const char *
+bench_precision_name(aa_bell_precision_t precision) {
+	switch(precision) {
+	case AA_BELL_PRECISION_DOUBLE: return "double";
+	case AA_BELL_PRECISION_Q31: return "q31";
+	default: return "float";
+	}
+}
+
+/** Strikes a single mode of freq Hz and angular decay decay at every
+    precision, with a gain that keeps it clear of the clamp, renders it
+    for the suite's length and reports the signal to noise ratio of each
+    against a long double recurrence with exact coefficients. Returns
+    nonzero if double precision does worse than float.
+ */
+static int
+bench_precision_mode(
+	const char *name, int srate, float freq, float decay, float gain
+) {
+	int seconds = gBench.quick ? BENCH_PRECISION_QUICK_SECONDS
+	    : BENCH_PRECISION_SECONDS;
+	int nbuffers = (int)((long long)seconds * srate
+	    / BENCH_DRIFT_BUFFER_SIZE);
+	static float out[BENCH_DRIFT_BUFFER_SIZE];
+	aa_bell_t bells[AA_BELL_PRECISION_Q31 + 1] = { NULL };
+	double signal = 0.0, noise[AA_BELL_PRECISION_Q31 + 1] = { 0.0 };
+	long double r, c, r2, a, y1 = 0.0L, y2 = 0.0L;
+	int ret = 1;
+
+	for(int p = AA_BELL_PRECISION_FLOAT; p <= AA_BELL_PRECISION_Q31; p++) {
+		bells[p] = aa_bell_create(1, 1, BENCH_DRIFT_BUFFER_SIZE, srate);
+		if(!bells[p])
+			goto bail;
+
+		aa_bell_set_mode_freq(bells[p], 0, freq);
+		aa_bell_set_angular_decay(bells[p], 0, decay);
+		aa_bell_set_gain(bells[p], 0, 0, gain);
+		aa_bell_compute_filter(bells[p]);
+		if(aa_bell_set_precision(bells[p], p) != (aa_bell_precision_t)p)
+			goto bail;
+		aa_bell_add_energy(bells[p], 0.01, 0.002);
+	}
+
+	r = expl(-(long double)bells[0]->dscale * bells[0]->d[0] / srate);
+	c = 2.0L * cosl(2.0L * (long double)M_PI * bells[0]->fscale
+	    * bells[0]->f[0] / srate) * r;
+	r2 = r * r;
+	a = bells[0]->ampR[0];
+
+	for(int n = 0; n < nbuffers; n++) {
+		static long double ref[BENCH_DRIFT_BUFFER_SIZE];
+		const float *force = bells[0]->cosForce;
+
+		for(int k = 0; k < BENCH_DRIFT_BUFFER_SIZE; k++) {
+			long double y = c * y1 - r2 * y2 + a * force[k];
+
+			y2 = y1;
+			y1 = ref[k] = y;
+			signal += (double)(y * y);
+		}
+
+		for(int p = AA_BELL_PRECISION_FLOAT; p <= AA_BELL_PRECISION_Q31;
+		    p++) {
+			aa_bell_compute_sound_buffer(bells[p], out);
+			for(int k = 0; k < BENCH_DRIFT_BUFFER_SIZE; k++) {
+				double err = (double)(out[k] - ref[k]);
+
+				noise[p] += err * err;
+			}
+		}
+	}
+
+	ret = 0;
+	for(int p = AA_BELL_PRECISION_FLOAT; p <= AA_BELL_PRECISION_Q31; p++) {
+		bool ok = (p != AA_BELL_PRECISION_DOUBLE)
+		    || (noise[p] <= noise[AA_BELL_PRECISION_FLOAT]);
+
+		bench_result_begin("precision");
+		bench_result_str("mode", name);
+		bench_result_str("precision", bench_precision_name(p));
+		bench_result_int("srate", srate);
+		bench_result_int("seconds", seconds);
+		bench_result_num("snr_db", 10.0 * log10(signal / noise[p]));
+		bench_result_str("status", ok ? "ok" : "INACCURATE");
+		bench_result_end();
+
+		if(!ok)
+			ret = 1;
+	}
+
+bail:
+	for(int p = AA_BELL_PRECISION_FLOAT; p <= AA_BELL_PRECISION_Q31; p++)
+		if(bells[p])
+			aa_bell_release(bells[p]);
+	return ret;
+}
+
+/** How far each precision keeps a long render from drifting, on a
+    sustained mode and a high Q low mode at a high rate, and what each
+    costs per mode sample.
+ */
+static int
+bench_suite_precision(void) {
+	static const int mode_counts[] = { 60, 1000 };
+	int ret = 0;
+
+	ret |= bench_precision_mode("sustain", BENCH_SRATE, 1000.0f, 0.0f, 1.0f);
+	ret |= bench_precision_mode("low_q", 192000, 30.0f, 0.5f, 0.1f);
+
+	for(int m = 0; m < BENCH_COUNT(mode_counts); m++)
+	for(int p = AA_BELL_PRECISION_FLOAT; p <= AA_BELL_PRECISION_Q31; p++) {
+		int nf = mode_counts[m];
+		float buffer[BENCH_BUFFER_SIZE];
+		struct bench_render_s render = {
+			.bell = bench_make_bell(nf, BENCH_BUFFER_SIZE, BENCH_SRATE),
+			.buffer = buffer,
+			.restrike = (int)(BENCH_RESTRIKE_SECONDS * BENCH_SRATE
+			    / BENCH_BUFFER_SIZE),
+		};
+		double seconds;
+
+		if(!render.bell) {
+			ret = 1;
+			continue;
+		}
+
+		aa_bell_set_precision(render.bell, p);
+		seconds = bench_measure(&bench_render_func, &render, NULL, NULL);
+
+		bench_result_begin("precision");
+		bench_result_str("precision", bench_precision_name(p));
+		bench_result_str("kernel",
+		    bench_kernel_name(aa_bell_get_kernel(render.bell)));
+		bench_result_int("modes", nf);
+		bench_result_num("mode_samples_per_s",
+		    (double)nf * BENCH_BUFFER_SIZE / seconds);
+		bench_result_end();
+
+		aa_bell_release(render.bell);
+	}
+
+	return ret;
+}
+
+/** Streams a counting sequence through the input ring from a thread
+    of its own, in chunks of varying size, and checks that every sample
+    comes out once and in order. */
+struct bench_input_producer_s {
+	aa_input_t	input;
+	int			total;
+};
+
+static void*
+bench_input_producer(void *context) {
+	struct bench_input_producer_s *producer = context;
+	float chunk[97];
+	unsigned int seed = 13579;
+
+	for(int sent = 0; sent < producer->total;) {
+		int n, written = 0;
+
+		seed = seed * 1103515245 + 12345;
+		n = 1 + (seed >> 16) % BENCH_COUNT(chunk);
+		if(n > producer->total - sent)
+			n = producer->total - sent;
+
+		for(int j = 0; j < n; j++)
+			chunk[j] = (float)((sent + j) & 0xFFFFFF);
+		for(;;) {
+			written += aa_input_write(producer->input, chunk + written,
+				n - written);
+			if(written == n)
+				break;
+			sched_yield();
+		}
+		sent += n;
+	}
+
+	return NULL;
+}
+
+static int
+bench_input_ring(void) {
+	int total = gBench.quick ? BENCH_INPUT_QUICK_SAMPLES : BENCH_INPUT_SAMPLES;
+	struct bench_input_producer_s producer = {
+		.input = aa_input_create(4 * BENCH_BUFFER_SIZE, BENCH_BUFFER_SIZE,
+			BENCH_SRATE),
+		.total = total,
+	};
+	struct aa_input_stats_s stats;
+	float block[BENCH_BUFFER_SIZE];
+	pthread_t thread;
+	int received = 0, errors = 0;
+	double start, seconds;
+
+	if(!producer.input)
+		return 1;
+
+	start = bench_now();
+	if(pthread_create(&thread, NULL, &bench_input_producer, &producer)) {
+		aa_input_release(producer.input);
+		return 1;
+	}
+
+	while(received < total) {
+		int n = aa_input_read(producer.input, block, BENCH_BUFFER_SIZE);
+
+		if(!n)
+			sched_yield();
+		for(int j = 0; j < n; j++)
+			errors += block[j] != (float)((received + j) & 0xFFFFFF);
+		received += n;
+	}
+
+	pthread_join(thread, NULL);
+	seconds = bench_now() - start;
+	aa_input_get_stats(producer.input, &stats);
+
+	// The producer retries whatever did not fit, so the overruns
+	// counted are the times it found the ring full.
+	bench_result_begin("input");
+	bench_result_str("test", "ring");
+	bench_result_int("samples", total);
+	bench_result_int("capacity", stats.capacity);
+	bench_result_num("ns_per_sample", seconds * 1e9 / total);
+	bench_result_int("full_writes", (long long)stats.overruns);
+	bench_result_str("status", errors ? "MISMATCH" : "ok");
+	bench_result_end();
+
+	aa_input_release(producer.input);
+
+	return errors != 0;
+}
+
+/** Plays an impulse in through a simulated capture device delivering
+    BENCH_INPUT_CHUNK samples at a time, renders it as an output device
+    asking for a buffer every BENCH_BUFFER_SIZE samples would, with one
+    buffer queued for playing, and compares when the impulse comes out
+    with the delay the input reports. */
+static int
+bench_input_latency(int phase) {
+	int impulse = 10 * BENCH_BUFFER_SIZE + 37;
+	aa_bell_t bell = bench_make_bell(60, BENCH_BUFFER_SIZE, BENCH_SRATE);
+	aa_input_t input = aa_input_create(8 * BENCH_BUFFER_SIZE,
+		BENCH_BUFFER_SIZE, BENCH_SRATE);
+	float chunk[BENCH_INPUT_CHUNK], out[BENCH_BUFFER_SIZE];
+	struct aa_input_stats_s stats = { 0 };
+	long long measured = -1;
+	int ret = 1;
+
+	if(!bell || !input)
+		goto bail;
+
+	aa_input_set_extra_latency(input, BENCH_BUFFER_SIZE);
+
+	for(int t = BENCH_INPUT_CHUNK; measured < 0; t += BENCH_INPUT_CHUNK) {
+		int b = (t - phase) / BENCH_BUFFER_SIZE - 1;
+
+		// Samples [t - chunk, t) arrive at time t.
+		for(int j = 0; j < BENCH_INPUT_CHUNK; j++)
+			chunk[j] = t - BENCH_INPUT_CHUNK + j == impulse ? 1.0f : 0.0f;
+		aa_input_write(input, chunk, BENCH_INPUT_CHUNK);
+
+		if((t < phase + BENCH_BUFFER_SIZE)
+		    || ((t - phase) % BENCH_BUFFER_SIZE))
+			continue;
+
+		// Block b is rendered now and plays a buffer later.
+		aa_input_excite(input, bell);
+		aa_bell_compute_sound_buffer(bell, out);
+		for(int k = 0; k < BENCH_BUFFER_SIZE; k++) {
+			if(out[k] != 0.0f) {
+				measured = t + BENCH_BUFFER_SIZE + k - impulse;
+				aa_input_get_stats(input, &stats);
+				break;
+			}
+		}
+		if(b > impulse / BENCH_BUFFER_SIZE + 4)
+			goto bail;
+	}
+
+	ret = llabs(measured - stats.delay) > BENCH_INPUT_CHUNK;
+
+	bench_result_begin("input");
+	bench_result_str("test", "latency");
+	bench_result_int("chunk", BENCH_INPUT_CHUNK);
+	bench_result_int("buffer", BENCH_BUFFER_SIZE);
+	bench_result_int("phase", phase);
+	bench_result_int("measured_samples", measured);
+	bench_result_int("reported_samples", stats.delay);
+	bench_result_num("measured_ms", measured * 1000.0 / BENCH_SRATE);
+	bench_result_str("status", ret ? "MISMATCH" : "ok");
+	bench_result_end();
+
+bail:
+	if(bell)
+		aa_bell_release(bell);
+	aa_input_release(input);
+	return ret;
+}
+
+/** Renders input and strikes together and checks the result against
+    the sum of each rendered alone, then turns impulses into onsets and
+    checks them against the same strikes scheduled by hand. */
+static int
+bench_input_excite(aa_input_mode_t mode) {
+	int nbuffers = BENCH_SRATE / BENCH_BUFFER_SIZE;
+	int spacing = BENCH_SRATE / 5;
+	float *signal = calloc(sizeof(float), nbuffers * BENCH_BUFFER_SIZE);
+	aa_bell_t bells[3] = { NULL };
+	aa_input_t inputs[2] = { NULL };
+	static float out[3][BENCH_BUFFER_SIZE];
+	struct aa_input_stats_s stats = { 0 };
+	double maxerr = 0.0, peak = 0.0;
+	unsigned int seed = 97531;
+	bool onsets = mode == AA_INPUT_ONSETS;
+	int ret = 1;
+
+	if(!signal)
+		goto bail;
+
+	for(int i = 0; i < 3; i++)
+		if(!(bells[i] = bench_make_bell(60, BENCH_BUFFER_SIZE, BENCH_SRATE)))
+			goto bail;
+	for(int i = 0; i < 2; i++) {
+		inputs[i] = aa_input_create(BENCH_BUFFER_SIZE, BENCH_BUFFER_SIZE,
+			BENCH_SRATE);
+		if(!inputs[i])
+			goto bail;
+		aa_input_set_mode(inputs[i], mode);
+	}
+
+	// A burst of noise for the force, impulses for the onsets.
+	for(int k = 0; k < nbuffers * BENCH_BUFFER_SIZE; k++) {
+		seed = seed * 1103515245 + 12345;
+		if(onsets)
+			signal[k] = (k % spacing == spacing / 2)
+			    && (k / spacing < BENCH_INPUT_IMPULSES) ? 0.5f : 0.0f;
+		else if(k < BENCH_SRATE / 10)
+			signal[k] = ((seed >> 16) % 2001 - 1000) / 1000.0f;
+	}
+
+	// Both: strikes and input. Then input alone, as is, or as the
+	// strikes its onsets should be. Then the strikes alone.
+	aa_bell_add_energy(bells[0], 0.01, 0.002);
+	aa_bell_add_energy(bells[2], 0.01, 0.002);
+	if(onsets)
+		aa_bell_add_energy(bells[1], 0.01, 0.002);
+
+	for(int n = 0; n < nbuffers; n++) {
+		const float *in = signal + n * BENCH_BUFFER_SIZE;
+
+		aa_input_write(inputs[0], in, BENCH_BUFFER_SIZE);
+		aa_input_excite(inputs[0], bells[0]);
+		if(onsets) {
+			for(int k = 0; k < BENCH_BUFFER_SIZE; k++)
+				if(in[k] != 0.0f)
+					aa_bell_add_energy_at(bells[1],
+						AA_INPUT_DEFAULT_ONSET_ENERGY * in[k],
+						AA_INPUT_DEFAULT_ONSET_DUR, k);
+		} else {
+			aa_input_write(inputs[1], in, BENCH_BUFFER_SIZE);
+			aa_input_excite(inputs[1], bells[1]);
+		}
+
+		for(int i = 0; i < 3; i++) {
+			memset(out[i], 0, sizeof(out[i]));
+			aa_bell_mix_sound_buffer(bells[i], out[i]);
+		}
+		for(int k = 0; k < BENCH_BUFFER_SIZE; k++) {
+			double want = onsets ? out[1][k] : out[1][k] + out[2][k];
+			double err = fabs(out[0][k] - want);
+
+			peak = fabs(want) > peak ? fabs(want) : peak;
+			maxerr = err > maxerr ? err : maxerr;
+		}
+	}
+	maxerr /= peak;
+	aa_input_get_stats(inputs[0], &stats);
+
+	ret = (maxerr > BENCH_KERNEL_TOLERANCE)
+	    || (onsets && (stats.onsets != BENCH_INPUT_IMPULSES));
+
+	bench_result_begin("input");
+	bench_result_str("test", onsets ? "onsets" : "mix");
+	if(onsets) {
+		bench_result_int("onsets", (long long)stats.onsets);
+		bench_result_int("expected", BENCH_INPUT_IMPULSES);
+	}
+	bench_result_num("max_rel_err", maxerr);
+	bench_result_str("status", ret ? "MISMATCH" : "ok");
+	bench_result_end();
+
+bail:
+	for(int i = 0; i < 3; i++)
+		if(bells[i])
+			aa_bell_release(bells[i]);
+	for(int i = 0; i < 2; i++)
+		aa_input_release(inputs[i]);
+	free(signal);
+	return ret;
+}
+
+static int
+bench_suite_input(void) {
+	int ret = bench_input_ring();
+
+	ret |= bench_input_latency(0);
+	ret |= bench_input_latency(3 * BENCH_INPUT_CHUNK);
+	ret |= bench_input_excite(AA_INPUT_FORCE);
+	ret |= bench_input_excite(AA_INPUT_ONSETS);
+
+	return ret;
+}
+
+static void
+bench_audio_render(
+	void *context, float *output, int nsamples
+) {
+	// The engine asks for a whole buffer of the bell every time.
+	(void)nsamples;
+	aa_bell_compute_sound_buffer((aa_bell_t)context, output);
+}
+
+/** Plays a bell through the engine into a file as fast as it renders,
+    and checks the file against the same bell rendered directly. */
+static int
+bench_audio_file(int periods) {
+	aa_bell_t bells[2] = { NULL };
+	aa_audio_t audio = NULL;
+	aa_input_file_t file = NULL;
+	aa_input_t input = NULL;
+	struct aa_audio_stats_s stats;
+	float got[BENCH_BUFFER_SIZE], want[BENCH_BUFFER_SIZE];
+	char path[64];
+	double maxerr = 0.0;
+	int ret = 1;
+
+	snprintf(path, sizeof(path), "/tmp/bench_audio_%d.wav", (int)getpid());
+
+	for(int i = 0; i < 2; i++) {
+		if(!(bells[i] = bench_make_bell(60, BENCH_BUFFER_SIZE, BENCH_SRATE)))
+			goto bail;
+		aa_bell_add_energy(bells[i], 0.01, 0.002);
+	}
+
+	audio = aa_audio_create(BENCH_BUFFER_SIZE, periods, BENCH_SRATE,
+		&bench_audio_render, bells[0]);
+	if(!audio || aa_audio_start_file(audio, path, false))
+		goto bail;
+	do {
+		usleep(1000);
+		aa_audio_get_stats(audio, &stats);
+	} while(stats.periods < BENCH_AUDIO_FILE_PERIODS);
+	aa_audio_stop(audio);
+
+	file = aa_input_file_open(path);
+	input = aa_input_create(BENCH_BUFFER_SIZE, BENCH_BUFFER_SIZE,
+		BENCH_SRATE);
+	if(!file || !input)
+		goto bail;
+
+	for(int n = 0; n < BENCH_AUDIO_FILE_PERIODS; n++) {
+		aa_input_file_pump(file, input, BENCH_BUFFER_SIZE);
+		aa_input_read(input, got, BENCH_BUFFER_SIZE);
+		aa_bell_compute_sound_buffer(bells[1], want);
+		for(int k = 0; k < BENCH_BUFFER_SIZE; k++) {
+			double err = fabs(got[k] - want[k]);
+
+			maxerr = err > maxerr ? err : maxerr;
+		}
+	}
+
+	ret = (maxerr != 0.0) || stats.underruns;
+
+	bench_result_begin("audio");
+	bench_result_str("sink", "file");
+	bench_result_int("period", BENCH_BUFFER_SIZE);
+	bench_result_int("periods", periods);
+	bench_result_int("played", (long long)stats.periods);
+	bench_result_int("underruns", (long long)stats.underruns);
+	bench_result_num("max_abs_err", maxerr);
+	bench_result_str("status", ret ? "MISMATCH" : "ok");
+	bench_result_end();
+
+bail:
+	if(audio)
+		aa_audio_release(audio);
+	if(file)
+		aa_input_file_release(file);
+	if(input)
+		aa_input_release(input);
+	for(int i = 0; i < 2; i++)
+		if(bells[i])
+			aa_bell_release(bells[i]);
+	remove(path);
+	return ret;
+}
+
+/** Plays a bell through the engine into the null sink at the pace of
+    a device, and reports the xruns, the jitter of the sink's periods
+    and the render thread's load. Xruns depend on the machine and what
+    else it runs, so they are reported rather than failed on. */
+static int
+bench_audio_null(
+	int nf, int period, int periods
+) {
+	double seconds = gBench.quick ? BENCH_AUDIO_QUICK_SECONDS
+	    : BENCH_AUDIO_SECONDS;
+	aa_bell_t bell = bench_make_bell(nf, period, BENCH_SRATE);
+	aa_audio_t audio = NULL;
+	struct aa_audio_stats_s stats;
+	double period_s = (double)period / BENCH_SRATE;
+	int ret = 1;
+
+	if(!bell)
+		goto bail;
+
+	audio = aa_audio_create(period, periods, BENCH_SRATE,
+		&bench_audio_render, bell);
+	if(!audio || aa_audio_start_null(audio))
+		goto bail;
+	usleep((useconds_t)(seconds * 1e6));
+	aa_audio_stop(audio);
+	aa_audio_get_stats(audio, &stats);
+
+	ret = stats.periods == 0;
+
+	bench_result_begin("audio");
+	bench_result_str("sink", "null");
+	bench_result_int("modes", nf);
+	bench_result_int("period", period);
+	bench_result_int("periods", periods);
+	bench_result_num("latency_ms", (double)period * periods * 1000.0
+	    / BENCH_SRATE);
+	bench_result_int("played", (long long)stats.periods);
+	bench_result_int("xruns", (long long)stats.underruns);
+	bench_result_int("min_ready", stats.min_ready);
+	bench_result_num("jitter_mean_us", stats.jitter_mean * 1e6);
+	bench_result_num("jitter_max_us", stats.jitter_max * 1e6);
+	bench_result_num("load", stats.render_mean / period_s);
+	bench_result_num("load_max", stats.render_max / period_s);
+	bench_result_str("realtime", stats.realtime ? "yes" : "no");
+	bench_result_str("status", ret ? "fail" : "ok");
+	bench_result_end();
+
+bail:
+	if(audio)
+		aa_audio_release(audio);
+	if(bell)
+		aa_bell_release(bell);
+	return ret;
+}
+
+static int
+bench_suite_audio(void) {
+	static const int periods[] = { 64, 256 };
+	int ret = bench_audio_file(2);
+
+	ret |= bench_audio_file(AA_AUDIO_DEFAULT_PERIODS);
+	for(int p = 0; p < BENCH_COUNT(periods); p++)
+	for(int n = 2; n <= AA_AUDIO_DEFAULT_PERIODS; n++)
+		ret |= bench_audio_null(1000, periods[p], n);
+
+	return ret;
+}
+
+/** Makes count bells of nf modes the way they were made before they
+    had a block of their own, one allocation per array, with the arrays
+    of all the bells interleaved on the heap as happens when bells are
+    made while other things are allocated. */
+static int
+bench_arena_scatter(
+	aa_bell_t *bells, int count, int nf
+) {
+	static const size_t fields[] = {
+		offsetof(struct aa_bell_s, f),
+		offsetof(struct aa_bell_s, d),
+		offsetof(struct aa_bell_s, a),
+		offsetof(struct aa_bell_s, cosForce),
+		offsetof(struct aa_bell_s, R2),
+		offsetof(struct aa_bell_s, twoRCosTheta),
+		offsetof(struct aa_bell_s, yt_1),
+		offsetof(struct aa_bell_s, yt_2),
+		offsetof(struct aa_bell_s, c_i),
+		offsetof(struct aa_bell_s, ampR),
+	};
+
+	memset(bells, 0, sizeof(*bells) * count);
+
+	for(int b = 0; b < count; b++) {
+		if(!(bells[b] = calloc(sizeof(struct aa_bell_s), 1)))
+			return -1;
+		aa_bell_init(bells[b], nf, 1, BENCH_BUFFER_SIZE, BENCH_SRATE);
+	}
+
+	for(int k = 0; k < BENCH_COUNT(fields); k++)
+	for(int b = 0; b < count; b++) {
+		float **array = (float**)((char*)bells[b] + fields[k]);
+
+		*array = aa_bell_alloc_modes(fields[k]
+		    == offsetof(struct aa_bell_s, cosForce) ? BENCH_BUFFER_SIZE : nf);
+	}
+
+	for(int b = 0; b < count; b++) {
+		if(aa_bell_alloc_arrays(bells[b]))
+			return -1;
+		bench_fill_bell(bells[b], nf);
+	}
+
+	return 0;
+}
+
+struct bench_arena_create_s {
+	const char *layout;
+	aa_bell_t	model;
+	aa_bell_pool_t pool;
+	int			nf;
+};
+
+static void
+bench_arena_create_func(void *context) {
+	struct bench_arena_create_s *create = context;
+	aa_bell_t bell = NULL;
+
+	if(create->pool) {
+		bell = aa_bell_pool_acquire(create->pool);
+	} else if(create->model) {
+		bell = aa_bell_create_shared(create->model);
+	} else if(!strcmp(create->layout, "block")) {
+		bell = aa_bell_create(create->nf, 1, BENCH_BUFFER_SIZE, BENCH_SRATE);
+	} else if((bell = calloc(sizeof(struct aa_bell_s), 1))) {
+		aa_bell_init(bell, create->nf, 1, BENCH_BUFFER_SIZE, BENCH_SRATE);
+		aa_bell_alloc_arrays(bell);
+	}
+
+	if(bell)
+		aa_bell_release(bell);
+}
+
+/** Creates and releases bells of nf modes one array at a time, in one
+    block, as shared bells of a model, and from a pool of them. */
+static int
+bench_arena_create(int nf) {
+	static const char *layouts[] = { "scattered", "block", "shared", "pool" };
+	aa_bell_t model = bench_make_bell(nf, BENCH_BUFFER_SIZE, BENCH_SRATE);
+	double base = 0.0;
+
+	if(!model)
+		return 1;
+
+	for(int l = 0; l < BENCH_COUNT(layouts); l++) {
+		struct bench_arena_create_s create = {
+			.layout = layouts[l],
+			.model = l >= 2 ? model : NULL,
+			.pool = l == 3 ? aa_bell_pool_create(model, 1, BENCH_BUFFER_SIZE)
+			    : NULL,
+			.nf = nf,
+		};
+		double seconds;
+
+		if((l == 3) && !create.pool) {
+			aa_bell_release(model);
+			return 1;
+		}
+
+		seconds = bench_measure(&bench_arena_create_func, &create, NULL,
+			NULL);
+		if(!l)
+			base = seconds;
+
+		bench_result_begin("arena");
+		bench_result_str("test", "create");
+		bench_result_str("layout", layouts[l]);
+		bench_result_int("modes", nf);
+		bench_result_num("ns_per_bell", seconds * 1e9);
+		bench_result_num("speedup", base / seconds);
+		bench_result_end();
+
+		if(create.pool)
+			aa_bell_pool_release(create.pool);
+	}
+
+	aa_bell_release(model);
+
+	return 0;
+}
+
+struct bench_arena_render_s {
+	aa_bell_t	bells[BENCH_ARENA_BELLS];
+	float		buffer[BENCH_BUFFER_SIZE];
+	int			restrike;
+	int			count;
+};
+
+static void
+bench_arena_render_func(void *context) {
+	struct bench_arena_render_s *render = context;
+
+	if(!(render->count++ % render->restrike))
+		for(int b = 0; b < BENCH_ARENA_BELLS; b++)
+			aa_bell_add_energy(render->bells[b], 0.01, 0.002);
+
+	for(int b = 0; b < BENCH_ARENA_BELLS; b++)
+		aa_bell_compute_sound_buffer(render->bells[b], render->buffer);
+}
+
+/** Renders BENCH_ARENA_BELLS bells one after the other with their
+    arrays scattered over the heap, each in its own block, and as
+    shared bells from a pool, and checks that the first two sound the
+    same. */
+static int
+bench_arena_render(void) {
+	static const char *layouts[] = { "scattered", "block", "pool" };
+	static struct bench_arena_render_s renders[3];
+	aa_bell_t model = bench_make_bell(BENCH_ARENA_MODES, BENCH_BUFFER_SIZE,
+		BENCH_SRATE);
+	aa_bell_pool_t pool = NULL;
+	double maxerr = 0.0, base = 0.0;
+	int ret = 1;
+
+	memset(renders, 0, sizeof(renders));
+
+	if(!model || bench_arena_scatter(renders[0].bells, BENCH_ARENA_BELLS,
+		    BENCH_ARENA_MODES))
+		goto bail;
+	for(int b = 0; b < BENCH_ARENA_BELLS; b++)
+		if(!(renders[1].bells[b] = bench_make_bell(BENCH_ARENA_MODES,
+			    BENCH_BUFFER_SIZE, BENCH_SRATE)))
+			goto bail;
+	pool = aa_bell_pool_create(model, BENCH_ARENA_BELLS, BENCH_BUFFER_SIZE);
+	if(!pool)
+		goto bail;
+	for(int b = 0; b < BENCH_ARENA_BELLS; b++)
+		if(!(renders[2].bells[b] = aa_bell_pool_acquire(pool)))
+			goto bail;
+
+	// Strike once, then compare the last bell of each for a while.
+	renders[0].restrike = renders[1].restrike = INT_MAX;
+	for(int n = 0; n < 20; n++) {
+		bench_arena_render_func(&renders[0]);
+		bench_arena_render_func(&renders[1]);
+		for(int k = 0; k < BENCH_BUFFER_SIZE; k++) {
+			double err = fabs(renders[1].buffer[k] - renders[0].buffer[k]);
+
+			maxerr = err > maxerr ? err : maxerr;
+		}
+	}
+
+	for(int l = 0; l < BENCH_COUNT(layouts); l++) {
+		struct bench_arena_render_s *render = &renders[l];
+		long long calls, misses;
+		double seconds;
+
+		render->restrike = (int)(BENCH_RESTRIKE_SECONDS * BENCH_SRATE
+		    / BENCH_BUFFER_SIZE);
+		seconds = bench_measure(&bench_arena_render_func, render, &calls,
+			&misses);
+		if(!l)
+			base = seconds;
+
+		bench_result_begin("arena");
+		bench_result_str("test", "render");
+		bench_result_str("layout", layouts[l]);
+		bench_result_int("bells", BENCH_ARENA_BELLS);
+		bench_result_int("modes", BENCH_ARENA_MODES);
+		bench_result_num("ns_per_bell_sample",
+		    seconds * 1e9 / BENCH_ARENA_BELLS / BENCH_BUFFER_SIZE);
+		bench_result_num("speedup", base / seconds);
+		if(misses >= 0) {
+			bench_result_num("cache_misses_per_sample",
+				(double)misses / calls / BENCH_BUFFER_SIZE);
+		}
+		if(gBench.l1d_misses >= 0) {
+			bench_result_num("l1d_misses_per_sample",
+				(double)gBench.l1d_misses / calls / BENCH_BUFFER_SIZE);
+		}
+		if(l == 1) {
+			bench_result_num("max_abs_err", maxerr);
+			bench_result_str("status", maxerr != 0.0 ? "MISMATCH" : "ok");
+		}
+		bench_result_end();
+	}
+
+	ret = maxerr != 0.0;
+
+bail:
+	for(int l = 0; l < 3; l++)
+		for(int b = 0; b < BENCH_ARENA_BELLS; b++)
+			if(renders[l].bells[b])
+				aa_bell_release(renders[l].bells[b]);
+	if(pool)
+		aa_bell_pool_release(pool);
+	if(model)
+		aa_bell_release(model);
+	return ret;
+}
+
+static int
+bench_suite_arena(void) {
+	int ret = bench_arena_create(BENCH_ARENA_MODES);
+
+	ret |= bench_arena_create(1000);
+	ret |= bench_arena_render();
+
+	return ret;
+}
+
+/** Sum over the modes of bell of the amplitude they ring at, from
+    their state: y[n] = 2 Re(C z^n) has amplitude 2 |C|.
+ */
+static double
+bench_spectral_amplitude(aa_bell_t bell) {
+	double total = 0.0;
+
+	for(int i = 0; i < bell->nfUsed; i++) {
+		double R = sqrt(bell->R2[i]);
+		double cosTheta = bell->twoRCosTheta[i] / (2.0 * R);
+		double sinTheta = sqrt(1.0 - cosTheta * cosTheta);
+		double a = 0.5 * bell->yt_1[i];
+		double b = (0.5 * R * bell->yt_2[i] - a * cosTheta) / sinTheta;
+
+		total += 2.0 * sqrt(a * a + b * b);
+	}
+
+	return total;
+}
+
+/** Renders nf modes struck twice with both engines in blocks of
+    bufferSize, and reports the largest error of a block relative to
+    the sum of the amplitudes of its modes when the block before
+    started. The documented bound is for the time domain render from
+    the same state, so the reference takes the spectral bell's state
+    before each block unless free_running is set. Free running, the two
+    drift apart by the rounding of the float kernels, which is large
+    next to the amplitude of a bell nearly rung out, so the error is
+    taken relative to the largest amplitude so far instead. Stores the
+    error in *worst. Returns nonzero if out of memory.
+ */
+static int
+bench_spectral_error(
+	int nf, int bufferSize, bool free_running, double *worst
+) {
+	int nbuffers = (int)(BENCH_SPECTRAL_SECONDS * BENCH_SRATE / bufferSize);
+	aa_bell_t time = bench_make_bell(nf, bufferSize, BENCH_SRATE);
+	aa_bell_t spectral = bench_make_bell(nf, bufferSize, BENCH_SRATE);
+	float *ref = malloc(sizeof(float) * bufferSize);
+	float *out = malloc(sizeof(float) * bufferSize);
+	double amplitude = 0.0;
+	int ret = 1;
+
+	*worst = 0.0;
+
+	if(!time || !spectral || !ref || !out
+	    || (aa_bell_set_synthesis(time, AA_BELL_SYNTHESIS_TIME)
+	        != AA_BELL_SYNTHESIS_TIME)
+	    || (aa_bell_set_synthesis(spectral, AA_BELL_SYNTHESIS_SPECTRAL)
+	        != AA_BELL_SYNTHESIS_SPECTRAL))
+		goto bail;
+
+	for(int n = 0; n < nbuffers; n++) {
+		double next, err = 0.0;
+
+		if(!free_running) {
+			memcpy(time->yt_1, spectral->yt_1, sizeof(float) * nf);
+			memcpy(time->yt_2, spectral->yt_2, sizeof(float) * nf);
+		}
+		next = bench_spectral_amplitude(time);
+
+		if(!n || (n == nbuffers / 2)) {
+			aa_bell_add_energy(time, 0.01, 0.002);
+			aa_bell_add_energy(spectral, 0.01, 0.002);
+		}
+
+		aa_bell_compute_sound_buffer(time, ref);
+		aa_bell_compute_sound_buffer(spectral, out);
+		for(int k = 0; k < bufferSize; k++)
+			err = fmax(err, fabs((double)out[k] - ref[k]));
+
+		if(err > 0.0)
+			*worst = fmax(*worst, amplitude > 0.0 ? err / amplitude
+			    : INFINITY);
+		amplitude = free_running ? fmax(amplitude, next) : next;
+	}
+
+	ret = 0;
+
+bail:
+	free(ref);
+	free(out);
+	if(time)
+		aa_bell_release(time);
+	if(spectral)
+		aa_bell_release(spectral);
+	return ret;
+}
+
+/** Checks the spectral engine against the documented bounds at nf
+    modes and blocks of bufferSize, from the same state and free
+    running. Returns nonzero if either is exceeded.
+ */
+static int
+bench_spectral_check(
+	int nf, int bufferSize
+) {
+	double worst, drift;
+	int ret;
+
+	if(bench_spectral_error(nf, bufferSize, false, &worst)
+	    || bench_spectral_error(nf, bufferSize, true, &drift))
+		return 1;
+
+	ret = !(worst <= BENCH_SPECTRAL_BOUND)
+	    || !(drift <= BENCH_SPECTRAL_BOUND);
+
+	bench_result_begin("spectral");
+	bench_result_str("test", "accuracy");
+	bench_result_int("modes", nf);
+	bench_result_int("buffer", bufferSize);
+	bench_result_num("max_rel_err", worst);
+	bench_result_num("bound", BENCH_SPECTRAL_BOUND);
+	bench_result_num("free_running_rel_err", drift);
+	bench_result_str("status", ret ? "INACCURATE" : "ok");
+	bench_result_end();
+
+	return ret;
+}
+
+/** Times both engines on a restruck bell of each mode count in blocks
+    of bufferSize, and reports the fewest modes from which on the
+    spectral engine is faster, or -1.
+ */
+static int
+bench_spectral_crossover(int bufferSize) {
+	static const int mode_counts[] = { 16, 64, 256, 1000, 3000, 10000 };
+	int crossover = -1;
+	int ret = 0;
+
+	for(int m = 0; m < BENCH_COUNT(mode_counts); m++) {
+		int nf = mode_counts[m];
+		double seconds[2];
+		float *buffer = malloc(sizeof(float) * bufferSize);
+
+		for(int e = 0; e < 2; e++) {
+			aa_bell_synthesis_t synthesis = e ? AA_BELL_SYNTHESIS_SPECTRAL
+			    : AA_BELL_SYNTHESIS_TIME;
+			struct bench_render_s render = {
+				.bell = bench_make_bell(nf, bufferSize, BENCH_SRATE),
+				.buffer = buffer,
+				.restrike = (int)(BENCH_SPECTRAL_RESTRIKE_SECONDS
+				    * BENCH_SRATE / bufferSize),
+			};
+
+			if(!buffer || !render.bell
+			    || (aa_bell_set_synthesis(render.bell, synthesis)
+			        != synthesis)) {
+				if(render.bell)
+					aa_bell_release(render.bell);
+				free(buffer);
+				return 1;
+			}
+
+			// The strike renders in time, and the first block ringing
+			// after it derives every mode.
+			bench_render_func(&render);
+			bench_render_func(&render);
+			seconds[e] = bench_measure(&bench_render_func, &render, NULL,
+				NULL);
+			aa_bell_release(render.bell);
+		}
+		free(buffer);
+
+		if(seconds[1] < seconds[0]) {
+			if(crossover < 0)
+				crossover = nf;
+		} else {
+			crossover = -1;
+		}
+
+		bench_result_begin("spectral");
+		bench_result_str("test", "speed");
+		bench_result_int("modes", nf);
+		bench_result_int("buffer", bufferSize);
+		bench_result_num("time_ns_per_mode_sample",
+		    seconds[0] * 1e9 / nf / bufferSize);
+		bench_result_num("spectral_ns_per_mode_sample",
+		    seconds[1] * 1e9 / nf / bufferSize);
+		bench_result_num("spectral_realtime",
+		    (double)bufferSize / BENCH_SRATE / seconds[1]);
+		bench_result_num("speedup", seconds[0] / seconds[1]);
+		bench_result_end();
+	}
+
+	bench_result_begin("spectral");
+	bench_result_str("test", "crossover");
+	bench_result_int("buffer", bufferSize);
+	bench_result_int("modes", crossover);
+	bench_result_end();
+
+	return ret;
+}
+
+/** How closely and how fast the spectral engine renders ringing modes
+    against the reson kernels, and where it starts to pay.
+ */
+static int
+bench_suite_spectral(void) {
+	static const int buffer_sizes[] = { 256, 1024, 4096 };
+	int ret = 0;
+
+	ret |= bench_spectral_check(60, 256);
+	ret |= bench_spectral_check(1000, 1024);
+	ret |= bench_spectral_check(10000, 4096);
+
+	for(int b = 0; b < BENCH_COUNT(buffer_sizes); b++)
+		ret |= bench_spectral_crossover(buffer_sizes[b]);
+
+	return ret;
+}
+
+/** Strike n of the frozen suite's score: it moves over points points
+    and alternates two contact durations, at three energies. */
+static void
+bench_frozen_score(
+	int n, int points, float *energy, float *dur, float *point
+) {
+	*energy = 0.01f * (1 + n % 3);
+	*dur = (n / points) % 2 ? 0.001f : 0.002f;
+	*point = (float)(n % points);
+}
+
+/** Plays the score on a live bell or a frozen model, a block per call,
+    striking every restrike blocks. */
+struct bench_frozen_s {
+	aa_bell_t	live;
+	aa_bell_frozen_t frozen;
+	float *		buffer;
+	int			points;
+	int			restrike;
+	int			count;
+	int			strikes;
+	long long	heard;
+};
+
+static void
+bench_frozen_func(void *context) {
+	struct bench_frozen_s *play = context;
+
+	if(play->count-- <= 0) {
+		float energy, dur, point;
+
+		bench_frozen_score(play->strikes++, play->points, &energy, &dur,
+			&point);
+		if(play->frozen) {
+			aa_bell_frozen_strike(play->frozen, energy, dur, point, 0);
+		} else {
+			aa_bell_set_strike_point(play->live, point);
+			aa_bell_add_energy(play->live, energy, dur);
+		}
+		play->count = play->restrike;
+	}
+
+	if(play->frozen)
+		play->heard += aa_bell_frozen_mix_sound_buffer(play->frozen,
+			play->buffer);
+	else
+		aa_bell_mix_sound_buffer(play->live, play->buffer);
+}
+
+/** Strikes a shared bell of model and model frozen once, a few samples
+    into a block, and returns the largest difference between them over
+    the longest response, relative to the peak of the bell, or a
+    negative number if out of memory.
+ */
+static double
+bench_frozen_error(
+	aa_bell_t model, aa_bell_frozen_t frozen, float point
+) {
+	int bufferSize = aa_bell_get_buffer_size(model);
+	aa_bell_t live = aa_bell_create_shared(model);
+	float *a = malloc(sizeof(float) * bufferSize);
+	float *b = malloc(sizeof(float) * bufferSize);
+	struct aa_bell_frozen_stats_s stats;
+	double err = 0.0, peak = 0.0;
+	int nbuffers;
+
+	aa_bell_frozen_get_stats(frozen, &stats);
+	nbuffers = stats.longest / bufferSize + 2;
+
+	if(!live || !a || !b || aa_bell_set_strike_point(live, point)
+	    || aa_bell_frozen_strike(frozen, 0.01f, 0.002f, point, 37)) {
+		err = -1.0;
+		goto bail;
+	}
+	aa_bell_add_energy_at(live, 0.01f, 0.002f, 37);
+
+	for(int n = 0; n < nbuffers; n++) {
+		memset(a, 0, sizeof(float) * bufferSize);
+		memset(b, 0, sizeof(float) * bufferSize);
+		aa_bell_mix_sound_buffer(live, a);
+		aa_bell_frozen_mix_sound_buffer(frozen, b);
+		for(int k = 0; k < bufferSize; k++) {
+			peak = fmax(peak, fabs(a[k]));
+			err = fmax(err, fabs((double)a[k] - b[k]));
+		}
+	}
+	err /= peak;
+
+bail:
+	free(a);
+	free(b);
+	if(live)
+		aa_bell_release(live);
+	return err;
+}
+
+/** Freezes model, struck at its first points points, and reports what
+    the responses cost to render and hold, how closely a strike matches
+    the live bell, and how fast the score plays from them against a
+    live bell. Returns nonzero on error, if a strike is further off
+    than the noise floor, or if a strike that was not prepared plays.
+ */
+static int
+bench_frozen_model(
+	aa_bell_t model, int points
+) {
+	int bufferSize = aa_bell_get_buffer_size(model);
+	aa_bell_frozen_t frozen = aa_bell_frozen_create(model,
+		BENCH_FROZEN_STRIKES, BENCH_FROZEN_FLOOR);
+	float *buffer = calloc(sizeof(float), bufferSize);
+	struct aa_bell_frozen_stats_s stats;
+	struct bench_frozen_s play = {
+		.buffer = buffer,
+		.points = points,
+		.restrike = (int)(BENCH_FROZEN_STRIKE_SECONDS * BENCH_SRATE
+		    / bufferSize),
+	};
+	double start, prepare, err = 0.0, live, cached;
+	int ret = 1;
+
+	if(!frozen || !buffer)
+		goto bail;
+
+	start = bench_now();
+	for(int p = 0; p < points; p++) {
+		if(aa_bell_frozen_prepare(frozen, (float)p, 0.001f)
+		    || aa_bell_frozen_prepare(frozen, (float)p, 0.002f))
+			goto bail;
+	}
+	prepare = bench_now() - start;
+
+	// A strike never renders a response of its own.
+	if(!aa_bell_frozen_strike(frozen, 0.01f, 0.003f, 0.0f, 0))
+		goto bail;
+
+	for(int p = 0; p < points; p++)
+		err = fmax(err, bench_frozen_error(model, frozen, (float)p));
+	if(err < 0.0)
+		goto bail;
+
+	play.live = aa_bell_create_shared(model);
+	if(!play.live)
+		goto bail;
+	live = bench_measure(&bench_frozen_func, &play, NULL, NULL);
+	aa_bell_release(play.live);
+	play.live = NULL;
+
+	// Play the score until as many strikes ring as ever will.
+	play.frozen = frozen;
+	play.count = play.strikes = 0;
+	aa_bell_frozen_get_stats(frozen, &stats);
+	for(int n = 0; n < stats.longest / bufferSize + 1; n++)
+		bench_frozen_func(&play);
+	play.heard = 0;
+	cached = bench_measure(&bench_frozen_func, &play, NULL, NULL);
+	aa_bell_frozen_get_stats(frozen, &stats);
+
+	ret = !(err <= BENCH_FROZEN_FLOOR + BENCH_FROZEN_ROUNDING)
+	    || (stats.misses != 1);
+
+	bench_result_begin("frozen");
+	bench_result_int("modes", stats.modes);
+	bench_result_int("responses", stats.responses);
+	bench_result_num("mbytes", stats.bytes / 1048576.0);
+	bench_result_num("longest_s", (double)stats.longest / BENCH_SRATE);
+	bench_result_num("freeze_ms", prepare * 1e3);
+	bench_result_num("max_rel_err", err);
+	bench_result_num("floor", BENCH_FROZEN_FLOOR);
+	bench_result_int("misses", (long long)stats.misses);
+	bench_result_num("strikes_heard", stats.heard);
+	bench_result_num("live_ns_per_sample", live * 1e9 / bufferSize);
+	bench_result_num("frozen_ns_per_sample", cached * 1e9 / bufferSize);
+	bench_result_num("speedup", live / cached);
+	bench_result_str("status", ret ? "INACCURATE" : "ok");
+	bench_result_end();
+
+bail:
+	if(ret)
+		fprintf(stderr, "bench: frozen model failed\n");
+	if(frozen)
+		aa_bell_frozen_release(frozen);
+	free(buffer);
+	return ret;
+}
+
+/** Strikes played from cached responses against rendered by the
+    model's modes, at two sizes of model.
+ */
+static int
+bench_suite_frozen(void) {
+	aa_bell_t points = bench_make_point_bell(BENCH_BUFFER_SIZE);
+	aa_bell_t modes = bench_make_bell(1000, BENCH_BUFFER_SIZE, BENCH_SRATE);
+	int ret = 1;
+
+	if(points && modes)
+		ret = bench_frozen_model(points, 4) | bench_frozen_model(modes, 1);
+
+	if(points)
+		aa_bell_release(points);
+	if(modes)
+		aa_bell_release(modes);
+	return ret;
+}
+
+/* ------------------------------------------------------------------ */
+
+static const struct {
+	const char *name;
+	int (*func)(void);
+} gSuites[] = {
+	{ "check", &bench_suite_check },
+	{ "kernel", &bench_suite_kernel },
+	{ "engine", &bench_suite_engine },
+	{ "filter", &bench_suite_filter },
+	{ "coeff", &bench_suite_coeff },
+	{ "energy", &bench_suite_energy },
+	{ "load", &bench_suite_load },
+	{ "bank", &bench_suite_bank },
+	{ "params", &bench_suite_params },
+	{ "smoothing", &bench_suite_smoothing },
+	{ "drift", &bench_suite_drift },
+	{ "voices", &bench_suite_voices },
+	{ "points", &bench_suite_points },
+	{ "timing", &bench_suite_timing },
+	{ "cull", &bench_suite_cull },
+	{ "budget", &bench_suite_budget },
+	{ "output", &bench_suite_output },
+	{ "precision", &bench_suite_precision },
+	{ "channels", &bench_suite_channels },
+	{ "input", &bench_suite_input },
+	{ "audio", &bench_suite_audio },
+	{ "arena", &bench_suite_arena },
+	{ "spectral", &bench_suite_spectral },
+	{ "frozen", &bench_suite_frozen },
+	{ "scheduler", &bench_suite_scheduler },
+};
+
+static void
+bench_usage(const char *argv0) {
+	fprintf(stderr, "usage: %s [-q] [-o results.json] [suite ...]\n"
+		"\n"
+		"  -q  quick run: shorter measurements, fewer sample rates\n"
+		"  -o  also write results as JSON\n"
+		"\n"
+		"suites:", argv0);
+	for(int i = 0; i < BENCH_COUNT(gSuites); i++)
+		fprintf(stderr, " %s", gSuites[i].name);
+	fprintf(stderr, "\n");
+}
+
+int
+main(
+	int argc, char *argv[]
+) {
+	int ret = 0;
+	const char *json_path = NULL;
+	aa_bell_t probe;
+	int c;
+
+	while((c = getopt(argc, argv, "qo:h")) != -1) {
+		switch(c) {
+		case 'q':
+			gBench.quick = true;
+			gBench.min_seconds = BENCH_QUICK_MIN_SECONDS;
+			break;
+		case 'o':
+			json_path = optarg;
+			break;
+		default:
+			bench_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	for(int i = optind; i < argc; i++) {
+		int s;
+		for(s = 0; s < BENCH_COUNT(gSuites); s++) {
+			if(!strcmp(argv[i], gSuites[s].name))
+				break;
+		}
+		if(s == BENCH_COUNT(gSuites)) {
+			bench_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if(json_path) {
+		gBench.json = fopen(json_path, "w");
+		if(!gBench.json) {
+			perror(json_path);
+			return 1;
+		}
+	}
+
+	bench_counter_open();
+
+	probe = aa_bell_create(1, 1, 1, BENCH_SRATE);
+	if(gBench.json) {
+		fprintf(gBench.json, "{\n\t\"revision\": \"%s\",\n"
+			"\t\"time\": %lld,\n\t\"cpus\": %ld,\n"
+			"\t\"default_kernel\": \"%s\",\n"
+			"\t\"cache_counters\": %s,\n\t\"results\": [",
+			BENCH_REVISION, (long long)time(NULL),
+			sysconf(_SC_NPROCESSORS_ONLN),
+			bench_kernel_name(aa_bell_get_kernel(probe)),
+			gBench.counter_fd >= 0 ? "true" : "false");
+		gBench.json_first = true;
+	}
+	aa_bell_release(probe);
+
+	for(int s = 0; s < BENCH_COUNT(gSuites); s++) {
+		bool selected = (optind == argc);
+
+		for(int i = optind; i < argc; i++)
+			selected |= !strcmp(argv[i], gSuites[s].name);
+
+		if(selected)
+			ret |= (*gSuites[s].func)();
+	}
+
+	if(gBench.json) {
+		fprintf(gBench.json, "\n\t],\n\t\"status\": \"%s\"\n}\n",
+			ret ? "failed" : "ok");
+		fclose(gBench.json);
+	}
+
+	if(gBench.counter_fd >= 0)
+		close(gBench.counter_fd);
+	if(gBench.l1d_fd >= 0)
+		close(gBench.l1d_fd);
+
+	return ret;
+}
@@ -0,0 +1,99 @@
+//
+//  convert.c
+//
+//  Converts models between the text (.sy) and binary (.syb) formats.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bell.h"
+
+#define CONVERT_MAX_SRATES      (16)
+
+static void
+convert_usage(const char *argv0) {
+	fprintf(stderr,
+		"usage: %s [-r srate ...] in.sy|in.syb out.sy|out.syb\n"
+		"\n"
+		"The output is binary if its name ends in .syb, text otherwise.\n"
+		"Each -r stores filter coefficients for that sample rate in a\n"
+		"binary output, so loading at that rate does no math.\n",
+		argv0);
+}
+
+static int
+convert_is_binary_path(const char *path) {
+	size_t len = strlen(path);
+
+	return (len >= 4) && !strcmp(path + len - 4, ".syb");
+}
+
+int
+main(
+	int argc, char *argv[]
+) {
+	int ret = 1;
+	int srates[CONVERT_MAX_SRATES];
+	int srate_count = 0;
+	aa_bell_t bell = NULL;
+	FILE *out = NULL;
+	int c;
+
+	while((c = getopt(argc, argv, "r:h")) != -1) {
+		switch(c) {
+		case 'r':
+			if((srate_count == CONVERT_MAX_SRATES) || (atoi(optarg) <= 0)) {
+				convert_usage(argv[0]);
+				goto bail;
+			}
+			srates[srate_count++] = atoi(optarg);
+			break;
+		default:
+			convert_usage(argv[0]);
+			goto bail;
+		}
+	}
+
+	if(argc - optind != 2) {
+		convert_usage(argv[0]);
+		goto bail;
+	}
+
+	bell = aa_bell_create_from_file(argv[optind], 1, 0);
+
+	if(!bell) {
+		fprintf(stderr, "%s: unable to load model\n", argv[optind]);
+		goto bail;
+	}
+
+	out = fopen(argv[optind + 1], "wb");
+
+	if(!out) {
+		perror(argv[optind + 1]);
+		goto bail;
+	}
+
+	if(convert_is_binary_path(argv[optind + 1]))
+		ret = aa_bell_write_binary(bell, out, srates, srate_count);
+	else
+		ret = aa_bell_write_text(bell, out);
+
+	if(fclose(out))
+		ret = 1;
+	out = NULL;
+
+	if(ret) {
+		fprintf(stderr, "%s: unable to write model\n", argv[optind + 1]);
+		ret = 1;
+	}
+
+bail:
+	if(out)
+		fclose(out);
+	if(bell)
+		aa_bell_release(bell);
+	return ret;
+}
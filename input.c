@@ -0,0 +1,636 @@
+//
+//  input.c
+//
+//  Audio input as excitation. A capture thread writes samples into a
+//  single-producer, single-consumer lock-free ring; the audio thread
+//  takes one block of them per buffer and adds them to the force of a
+//  bell, on top of its strikes, and can turn transients in them into
+//  strikes of their own. Neither side ever blocks the other: a full
+//  ring drops what the capture thread brings, an empty one gives
+//  silence.
+//
+//  A sound file can stand in for the capture device, either pumped by
+//  hand a block at a time for headless renders, or from a thread that
+//  delivers it at the pace a device would.
+//
+
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "input.h"
+
+/** The onset detector's fast envelope falls with this time constant,
+    and its slow one follows the fast one with this one, in seconds. */
+#define AA_INPUT_FAST_SECONDS       (0.005f)
+#define AA_INPUT_SLOW_SECONDS       (0.1f)
+
+/** A transient is the fast envelope rising above the threshold and
+    this many times the slow one. */
+#define AA_INPUT_ONSET_RATIO        (2.0f)
+
+/** Time after an onset during which no other is found, in seconds. */
+#define AA_INPUT_ONSET_HOLD         (0.05f)
+
+struct aa_input_s {
+	/** Samples written so far. Written by the producer only. */
+	unsigned	head;
+	char		head_pad[64 - sizeof(unsigned)];
+
+	/** Samples read so far. Written by the consumer only. */
+	unsigned	tail;
+	char		tail_pad[64 - sizeof(unsigned)];
+
+	/** Samples dropped because the ring was full. Producer only. */
+	uint64_t	overruns;
+	char		overruns_pad[64 - sizeof(uint64_t)];
+
+	unsigned	mask;
+	int			bufferSize;
+	int			srate;
+
+	aa_input_mode_t mode;
+	float		gain;
+
+	/** Onset detector state. */
+	float		onsetThreshold;
+	float		onsetEnergy;
+	float		onsetDur;
+	float		fast;
+	float		slow;
+	float		fastDecay;
+	float		slowCoeff;
+	int			hold;
+	int			sinceOnset;
+
+	/** One block of input, as handed to the bell. */
+	float *		block;
+
+	int			extraLatency;
+	bool		started;
+
+	/** Statistics, written by the consumer only. */
+	int			depth;
+	int			max_depth;
+	int			delay;
+	int			max_delay;
+	uint64_t	read;
+	uint64_t	underruns;
+	uint64_t	onsets;
+
+	float		samples[];
+};
+
+/** Creates a ring of at least capacity samples of input at srate, for
+    bells rendering bufferSize samples per block. The capacity bounds
+    how far the capture thread may run ahead of the audio thread.
+ */
+aa_input_t
+aa_input_create(
+	int capacity, int bufferSize, int srate
+) {
+	aa_input_t self = NULL;
+	unsigned size = 1;
+
+	if((capacity < bufferSize) || (bufferSize <= 0) || (srate <= 0))
+		goto bail;
+
+	while(size < (unsigned)capacity)
+		size *= 2;
+
+	self = calloc(sizeof(*self) + sizeof(float) * size, 1);
+	if(!self)
+		goto bail;
+
+	self->block = calloc(sizeof(float), bufferSize);
+	if(!self->block) {
+		free(self);
+		self = NULL;
+		goto bail;
+	}
+
+	self->mask = size - 1;
+	self->bufferSize = bufferSize;
+	self->srate = srate;
+	self->mode = AA_INPUT_FORCE;
+	self->gain = AA_INPUT_DEFAULT_GAIN;
+	self->fastDecay = expf(-1.0f / (AA_INPUT_FAST_SECONDS * srate));
+	self->slowCoeff = 1.0f - expf(-1.0f / (AA_INPUT_SLOW_SECONDS * srate));
+	self->hold = (int)(AA_INPUT_ONSET_HOLD * srate);
+	self->sinceOnset = self->hold;
+	aa_input_set_onsets(self, AA_INPUT_DEFAULT_ONSET_THRESHOLD,
+		AA_INPUT_DEFAULT_ONSET_ENERGY,
+		AA_INPUT_DEFAULT_ONSET_DUR);
+
+bail:
+	return self;
+}
+
+void
+aa_input_release(aa_input_t self) {
+	if(!self)
+		return;
+
+	free(self->block);
+	free(self);
+}
+
+/** Writes up to nsamples samples from the capture thread. Never
+    blocks; returns the number written, counting the rest as overruns
+    if the ring is full.
+ */
+int
+aa_input_write(
+	aa_input_t self, const float *samples, int nsamples
+) {
+	unsigned head = self->head;
+	unsigned tail = __atomic_load_n(&self->tail, __ATOMIC_ACQUIRE);
+	unsigned space = self->mask + 1 - (head - tail);
+	int n = (unsigned)nsamples < space ? nsamples : (int)space;
+	int first = (int)(self->mask + 1 - (head & self->mask));
+
+	if(first > n)
+		first = n;
+
+	memcpy(self->samples + (head & self->mask), samples,
+		sizeof(float) * first);
+	memcpy(self->samples, samples + first, sizeof(float) * (n - first));
+
+	__atomic_store_n(&self->head, head + n, __ATOMIC_RELEASE);
+
+	if(n < nsamples)
+		__atomic_store_n(&self->overruns, self->overruns + nsamples - n,
+			__ATOMIC_RELAXED);
+
+	return n;
+}
+
+/** Reads up to nsamples samples on the audio thread, filling what the
+    ring does not have with silence. Returns the number read.
+ */
+int
+aa_input_read(
+	aa_input_t self, float *samples, int nsamples
+) {
+	unsigned head = __atomic_load_n(&self->head, __ATOMIC_ACQUIRE);
+	unsigned tail = self->tail;
+	unsigned avail = head - tail;
+	int n = (unsigned)nsamples < avail ? nsamples : (int)avail;
+	int first = (int)(self->mask + 1 - (tail & self->mask));
+
+	if(first > n)
+		first = n;
+
+	memcpy(samples, self->samples + (tail & self->mask),
+		sizeof(float) * first);
+	memcpy(samples + first, self->samples, sizeof(float) * (n - first));
+	memset(samples + n, 0, sizeof(float) * (nsamples - n));
+
+	__atomic_store_n(&self->tail, tail + n, __ATOMIC_RELEASE);
+
+	return n;
+}
+
+void
+aa_input_set_mode(
+	aa_input_t self, aa_input_mode_t mode
+) {
+	if((mode >= AA_INPUT_FORCE) && (mode <= AA_INPUT_FORCE_AND_ONSETS))
+		self->mode = mode;
+}
+
+aa_input_mode_t
+aa_input_get_mode(aa_input_t self) {
+	return self->mode;
+}
+
+/** Sets the force each unit of input adds.
+ */
+void
+aa_input_set_gain(
+	aa_input_t self, float gain
+) {
+	self->gain = gain;
+}
+
+/** Sets what counts as an onset: the input's envelope rising above
+    threshold, and well above its recent level. Each onset strikes with
+    energy times the envelope for dur seconds, with the bell's own
+    excitation; call aa_bell_prepare_excitation() with dur before audio
+    starts. Returns nonzero if any of them is not positive.
+ */
+int
+aa_input_set_onsets(
+	aa_input_t self, float threshold, float energy, float dur
+) {
+	if(!(threshold > 0.0f) || !(energy > 0.0f) || !(dur > 0.0f))
+		return -1;
+
+	self->onsetThreshold = threshold;
+	self->onsetEnergy = energy;
+	self->onsetDur = dur;
+
+	return 0;
+}
+
+/** Sets the latency after the bell, such as the output stage's and
+    the output device's buffering, that the reported input-to-output
+    delay includes.
+ */
+void
+aa_input_set_extra_latency(
+	aa_input_t self, int nsamples
+) {
+	self->extraLatency = nsamples > 0 ? nsamples : 0;
+}
+
+/** Strikes bell at each onset in the block, returning how many.
+ */
+static int
+aa_input_onsets(
+	aa_input_t self, aa_bell_t bell
+) {
+	const float *block = self->block;
+	float fast = self->fast, slow = self->slow;
+	int since = self->sinceOnset;
+	int count = 0;
+
+	for(int k = 0; k < self->bufferSize; k++) {
+		float a = fabsf(block[k]);
+
+		fast = a > fast ? a : fast * self->fastDecay;
+		slow += (fast - slow) * self->slowCoeff;
+
+		if(since < self->hold) {
+			since++;
+			continue;
+		}
+
+		if((fast >= self->onsetThreshold)
+		    && (fast > AA_INPUT_ONSET_RATIO * slow)) {
+			if(!aa_bell_add_energy_at(bell, self->onsetEnergy * fast,
+				    self->onsetDur, k))
+				count++;
+			since = 0;
+		}
+	}
+
+	self->fast = fast;
+	self->slow = slow;
+	self->sinceOnset = since;
+
+	return count;
+}
+
+/** Takes one block of input on the audio thread and excites bell with
+    it, as the mode says, before the bell renders that block. Force is
+    added to whatever strikes have written, so scheduled strikes still
+    sound; a silent block adds none, leaving culled modes asleep.
+    Returns the number of onsets struck, or -1 if bell renders blocks
+    of another size.
+ */
+int
+aa_input_excite(
+	aa_input_t self, aa_bell_t bell
+) {
+	unsigned head = __atomic_load_n(&self->head, __ATOMIC_ACQUIRE);
+	int depth = (int)(head - self->tail);
+	int n = self->bufferSize, got, onsets = 0;
+	float peak = 0.0f;
+
+	if(aa_bell_get_buffer_size(bell) != n)
+		return -1;
+
+	got = aa_input_read(self, self->block, n);
+
+	for(int k = 0; k < got; k++) {
+		float a = fabsf(self->block[k]);
+
+		peak = a > peak ? a : peak;
+	}
+
+	if(self->mode & AA_INPUT_ONSETS)
+		onsets = aa_input_onsets(self, bell);
+	if((self->mode & AA_INPUT_FORCE) && (peak > 0.0f)
+	    && (self->gain != 0.0f))
+		aa_bell_add_force(bell, self->block, self->gain);
+
+	// The newest sample was captured just now and the oldest depth
+	// samples ago; sample k of the block plays k samples after the
+	// block starts, so every one of them comes out about depth
+	// samples, and whatever follows the bell, after it went in.
+	if(got) {
+		int delay = depth + self->extraLatency;
+
+		self->started = true;
+		__atomic_store_n(&self->depth, depth, __ATOMIC_RELAXED);
+		__atomic_store_n(&self->delay, delay, __ATOMIC_RELAXED);
+		if(depth > self->max_depth)
+			__atomic_store_n(&self->max_depth, depth, __ATOMIC_RELAXED);
+		if(delay > self->max_delay)
+			__atomic_store_n(&self->max_delay, delay, __ATOMIC_RELAXED);
+	}
+	if(self->started && (got < n))
+		__atomic_store_n(&self->underruns, self->underruns + 1,
+			__ATOMIC_RELAXED);
+	__atomic_store_n(&self->read, self->read + got, __ATOMIC_RELAXED);
+	__atomic_store_n(&self->onsets, self->onsets + onsets,
+		__ATOMIC_RELAXED);
+
+	return onsets;
+}
+
+/** Reads the input statistics. Safe from any thread.
+ */
+void
+aa_input_get_stats(
+	aa_input_t self, struct aa_input_stats_s *stats
+) {
+	memset(stats, 0, sizeof(*stats));
+
+	stats->depth = __atomic_load_n(&self->depth, __ATOMIC_RELAXED);
+	stats->max_depth = __atomic_load_n(&self->max_depth, __ATOMIC_RELAXED);
+	stats->delay = __atomic_load_n(&self->delay, __ATOMIC_RELAXED);
+	stats->max_delay = __atomic_load_n(&self->max_delay, __ATOMIC_RELAXED);
+	stats->read = __atomic_load_n(&self->read, __ATOMIC_RELAXED);
+	stats->overruns = __atomic_load_n(&self->overruns, __ATOMIC_RELAXED);
+	stats->underruns = __atomic_load_n(&self->underruns, __ATOMIC_RELAXED);
+	stats->onsets = __atomic_load_n(&self->onsets, __ATOMIC_RELAXED);
+	stats->capacity = (int)self->mask + 1;
+}
+
+struct aa_input_file_s {
+	float *		samples;
+	int64_t		length;
+	int			srate;
+
+	/** Next sample to deliver. */
+	int64_t		pos;
+
+	pthread_t	thread;
+	bool		running;
+	bool		stop;
+	aa_input_t	input;
+	int			chunk;
+};
+
+static uint32_t
+aa_input_get_le(
+	const unsigned char *p, int bytes
+) {
+	uint32_t value = 0;
+
+	for(int i = bytes - 1; i >= 0; i--)
+		value = (value << 8) | p[i];
+
+	return value;
+}
+
+/** Decodes the first channel of the WAV file in data, which must be
+    16-bit PCM or 32-bit float. Returns nonzero if it is not one.
+ */
+static int
+aa_input_file_parse_wav(
+	aa_input_file_t self, const unsigned char *data, size_t size
+) {
+	const unsigned char *fmt = NULL, *samples = NULL;
+	size_t fmt_size = 0, samples_size = 0;
+	int format, channels, bits, frame;
+
+	for(size_t at = 12; at + 8 <= size;) {
+		size_t chunk = aa_input_get_le(data + at + 4, 4);
+
+		if(chunk > size - at - 8)
+			chunk = size - at - 8;
+		if(!memcmp(data + at, "fmt ", 4)) {
+			fmt = data + at + 8;
+			fmt_size = chunk;
+		} else if(!memcmp(data + at, "data", 4)) {
+			samples = data + at + 8;
+			samples_size = chunk;
+		}
+		at += 8 + chunk + (chunk & 1);
+	}
+
+	if(!fmt || (fmt_size < 16) || !samples)
+		return -1;
+
+	format = (int)aa_input_get_le(fmt, 2);
+	channels = (int)aa_input_get_le(fmt + 2, 2);
+	self->srate = (int)aa_input_get_le(fmt + 4, 4);
+	bits = (int)aa_input_get_le(fmt + 14, 2);
+	if((format == 0xFFFE) && (fmt_size >= 26))     // WAVE_FORMAT_EXTENSIBLE
+		format = (int)aa_input_get_le(fmt + 24, 2);
+
+	if((channels < 1) || !(((format == 1) && (bits == 16))
+	        || ((format == 3) && (bits == 32))))
+		return -1;
+
+	frame = channels * bits / 8;
+	self->length = (int64_t)(samples_size / frame);
+	self->samples = malloc(sizeof(float) * (self->length + 1));
+	if(!self->samples)
+		return -1;
+
+	for(int64_t i = 0; i < self->length; i++) {
+		uint32_t bits32 = aa_input_get_le(samples + i * frame, bits / 8);
+
+		if(format == 3)
+			memcpy(&self->samples[i], &bits32, sizeof(float));
+		else
+			self->samples[i] = (int16_t)bits32 / 32768.0f;
+	}
+
+	return 0;
+}
+
+/** Loads a WAV file, 16-bit PCM or 32-bit float, of which only the
+    first channel is used, or raw little-endian floats, to play as
+    input. It is not resampled.
+ */
+aa_input_file_t
+aa_input_file_open(const char *path) {
+	aa_input_file_t self = NULL;
+	unsigned char *data = NULL;
+	size_t size = 0, capacity = 0, got;
+	FILE *fp = fopen(path, "rb");
+
+	if(!fp) {
+		perror(path);
+		goto bail;
+	}
+
+	do {
+		if(size == capacity) {
+			unsigned char *more;
+
+			capacity = capacity ? capacity * 2 : 65536;
+			more = realloc(data, capacity);
+			if(!more) {
+				perror(path);
+				goto bail;
+			}
+			data = more;
+		}
+		got = fread(data + size, 1, capacity - size, fp);
+		size += got;
+	} while(got);
+
+	if(ferror(fp)) {
+		perror(path);
+		goto bail;
+	}
+
+	self = calloc(sizeof(*self), 1);
+	if(!self)
+		goto bail;
+
+	if((size >= 12) && !memcmp(data, "RIFF", 4)
+	    && !memcmp(data + 8, "WAVE", 4)) {
+		if(aa_input_file_parse_wav(self, data, size)) {
+			fprintf(stderr, "%s: not 16-bit PCM or float WAV\n", path);
+			aa_input_file_release(self);
+			self = NULL;
+		}
+		goto bail;
+	}
+
+	self->length = (int64_t)(size / sizeof(float));
+	self->samples = malloc(sizeof(float) * (self->length + 1));
+	if(!self->samples) {
+		aa_input_file_release(self);
+		self = NULL;
+		goto bail;
+	}
+	for(int64_t i = 0; i < self->length; i++) {
+		uint32_t bits = aa_input_get_le(data + i * sizeof(float), 4);
+
+		memcpy(&self->samples[i], &bits, sizeof(float));
+	}
+
+bail:
+	if(fp)
+		fclose(fp);
+	free(data);
+	return self;
+}
+
+/** Stops delivering, if it was, and frees self.
+ */
+void
+aa_input_file_release(aa_input_file_t self) {
+	if(!self)
+		return;
+
+	if(self->running) {
+		__atomic_store_n(&self->stop, true, __ATOMIC_RELAXED);
+		pthread_join(self->thread, NULL);
+	}
+
+	free(self->samples);
+	free(self);
+}
+
+/** The sample rate of the file, or 0 for raw samples.
+ */
+int
+aa_input_file_get_srate(aa_input_file_t self) {
+	return self->srate;
+}
+
+int64_t
+aa_input_file_get_length(aa_input_file_t self) {
+	return self->length;
+}
+
+/** Writes the next nsamples samples of the file, or what is left of
+    them, into input, as a capture callback would. Returns the number
+    that fit.
+ */
+int
+aa_input_file_pump(
+	aa_input_file_t self, aa_input_t input, int nsamples
+) {
+	int64_t pos = __atomic_load_n(&self->pos, __ATOMIC_RELAXED);
+	int64_t left = self->length - pos;
+	int n = left < nsamples ? (int)left : nsamples;
+
+	n = aa_input_write(input, self->samples + pos, n);
+	__atomic_store_n(&self->pos, pos + n, __ATOMIC_RELAXED);
+
+	return n;
+}
+
+static void*
+aa_input_file_thread(void *context) {
+	aa_input_file_t self = context;
+	double period = (double)self->chunk / self->input->srate;
+	struct timespec next;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
+	while(!__atomic_load_n(&self->stop, __ATOMIC_RELAXED)) {
+		int64_t pos = __atomic_load_n(&self->pos, __ATOMIC_RELAXED);
+		int64_t left = self->length - pos;
+		int n = left < self->chunk ? (int)left : self->chunk;
+		struct timespec now, wait;
+		double remaining;
+
+		if(n <= 0)
+			break;
+
+		// A device delivers every chunk on time, full ring or not.
+		aa_input_write(self->input, self->samples + pos, n);
+		__atomic_store_n(&self->pos, pos + n, __ATOMIC_RELAXED);
+
+		next.tv_nsec += (long)(period * 1e9);
+		next.tv_sec += next.tv_nsec / 1000000000L;
+		next.tv_nsec %= 1000000000L;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		remaining = (next.tv_sec - now.tv_sec)
+		    + (next.tv_nsec - now.tv_nsec) * 1e-9;
+		if(remaining > 0.0) {
+			wait.tv_sec = (time_t)remaining;
+			wait.tv_nsec = (long)((remaining - wait.tv_sec) * 1e9);
+			nanosleep(&wait, NULL);
+		}
+	}
+
+	return NULL;
+}
+
+/** Starts a thread that delivers the file into input chunk samples at
+    a time, at input's sample rate, as a capture device would. Returns
+    nonzero if it could not be started.
+ */
+int
+aa_input_file_start(
+	aa_input_file_t self, aa_input_t input, int chunk
+) {
+	if(self->running || (chunk <= 0))
+		return -1;
+
+	self->input = input;
+	self->chunk = chunk;
+	self->stop = false;
+
+	if(pthread_create(&self->thread, NULL, &aa_input_file_thread, self))
+		return -1;
+
+	self->running = true;
+
+	return 0;
+}
+
+/** Whether the whole file has been delivered.
+ */
+bool
+aa_input_file_is_done(aa_input_file_t self) {
+	return __atomic_load_n(&self->pos, __ATOMIC_RELAXED) >= self->length;
+}
@@ -0,0 +1,101 @@
+//
+//  input.h
+//
+
+#ifndef __AA_INPUT_H__
+#define __AA_INPUT_H__ 1
+
+#if !defined(__BEGIN_DECLS) || !defined(__END_DECLS)
+#if defined(__cplusplus)
+#define __BEGIN_DECLS   extern "C" {
+#define __END_DECLS \
+	}
+#else
+#define __BEGIN_DECLS
+#define __END_DECLS
+#endif
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bell.h"
+
+__BEGIN_DECLS
+
+/** Force per unit of input when none is set: full-scale input pushes
+    about as hard as a default strike. */
+#define AA_INPUT_DEFAULT_GAIN           (0.01f)
+
+/** Level the input must reach for an onset, the strike an onset of
+    full-scale input turns into, and its length in seconds, when none
+    are set. */
+#define AA_INPUT_DEFAULT_ONSET_THRESHOLD (0.1f)
+#define AA_INPUT_DEFAULT_ONSET_ENERGY   (0.01f)
+#define AA_INPUT_DEFAULT_ONSET_DUR      (0.002f)
+
+/** What the input does to the bells it excites. */
+typedef enum {
+	AA_INPUT_FORCE = 1,             //!< Pushes the modes sample by sample.
+	AA_INPUT_ONSETS = 2,            //!< Strikes them at each transient.
+	AA_INPUT_FORCE_AND_ONSETS = 3,  //!< Both.
+} aa_input_mode_t;
+
+struct aa_input_stats_s {
+	int			depth;          //!< Samples queued at the last block.
+	int			max_depth;
+	int			delay;          //!< Input-to-output delay, in samples.
+	int			max_delay;
+	uint64_t	read;           //!< Samples taken by blocks.
+	uint64_t	overruns;       //!< Samples dropped on a full ring.
+	uint64_t	underruns;      //!< Blocks the input ran short for.
+	uint64_t	onsets;
+	int			capacity;
+};
+
+struct aa_input_s;
+typedef struct aa_input_s *aa_input_t;
+
+aa_input_t aa_input_create(
+	int capacity, int bufferSize, int srate);
+void aa_input_release(aa_input_t self);
+
+int aa_input_write(
+	aa_input_t self, const float *samples, int nsamples);
+int aa_input_read(
+	aa_input_t self, float *samples, int nsamples);
+
+void aa_input_set_mode(
+	aa_input_t self, aa_input_mode_t mode);
+aa_input_mode_t aa_input_get_mode(aa_input_t self);
+void aa_input_set_gain(
+	aa_input_t self, float gain);
+int aa_input_set_onsets(
+	aa_input_t self, float threshold, float energy, float dur);
+void aa_input_set_extra_latency(
+	aa_input_t self, int nsamples);
+
+int aa_input_excite(
+	aa_input_t self, aa_bell_t bell);
+
+void aa_input_get_stats(
+	aa_input_t self, struct aa_input_stats_s *stats);
+
+/** A sound file standing in for the capture device. */
+struct aa_input_file_s;
+typedef struct aa_input_file_s *aa_input_file_t;
+
+aa_input_file_t aa_input_file_open(const char *path);
+void aa_input_file_release(aa_input_file_t self);
+
+int aa_input_file_get_srate(aa_input_file_t self);
+int64_t aa_input_file_get_length(aa_input_file_t self);
+int aa_input_file_pump(
+	aa_input_file_t self, aa_input_t input, int nsamples);
+int aa_input_file_start(
+	aa_input_file_t self, aa_input_t input, int chunk);
+bool aa_input_file_is_done(aa_input_file_t self);
+
+__END_DECLS
+#endif                          // #ifndef __AA_INPUT_H__
@@ -7,6 +7,8 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <pthread.h>
+#include <string.h>
 #include <unistd.h>
 #include <signal.h>
 #include <sys/select.h>
@@ -14,7 +16,10 @@
 
 #include <pablio.h>
 
+#include "audio.h"
 #include "bell.h"
+#include "input.h"
+#include "output.h"
 #include "sliders.h"
 
 #ifndef MAX
@@ -23,9 +28,104 @@
               _b ? _a : _b; })
 #endif
 
+/** Slider changes that can be queued between two audio buffers. */
+#define MAIN_PARAM_QUEUE_SIZE   (256)
+
+/** Modes quieter than this, about -100 dBFS, are not rendered. */
+#define MAIN_CULL_THRESHOLD     (1e-5f)
+
+/** Level the output saturates towards instead of clipping. */
+#define MAIN_OUTPUT_CEILING     (1.0f)
+
+/** Buffers of audio input the capture thread may run ahead by. */
+#define MAIN_INPUT_BUFFERS      (8)
+
+/** Microseconds the capture thread sleeps while less than a buffer of
+    input is waiting, between looks at its stop flag. */
+#define MAIN_CAPTURE_POLL_USEC  (1000)
+
+/** Buffers the render thread may run ahead of the output device by. */
+#define MAIN_OUTPUT_PERIODS     (AA_AUDIO_DEFAULT_PERIODS)
+
+/** Energy and length in seconds of a strike from the keyboard. */
+#define MAIN_STRIKE_ENERGY      (0.01f)
+#define MAIN_STRIKE_DUR         (0.002f)
+
 static bool gDidGetInterrupt;
 static int gInterruptFDs[2];
 
+static struct {
+	PABLIO_Stream *stream;
+	aa_input_t	input;
+	int			bufferSize;
+	bool		stop;
+} gCapture;
+
+/** Reads the input device on its own thread, so that waiting for it
+    never holds up the select() loop, and hands what it reads to the
+    audio loop through the input ring. It only reads once a whole
+    buffer is waiting, so a read never blocks and the thread sees its
+    stop flag even if the device stops delivering.
+ */
+static void*
+capture_thread_main(void *context) {
+	float buffer[gCapture.bufferSize];
+
+	while(!__atomic_load_n(&gCapture.stop, __ATOMIC_RELAXED)) {
+		if(GetAudioStreamReadable(gCapture.stream) < gCapture.bufferSize) {
+			usleep(MAIN_CAPTURE_POLL_USEC);
+			continue;
+		}
+		ReadAudioStream(gCapture.stream, buffer, gCapture.bufferSize);
+		aa_input_write(gCapture.input, buffer, gCapture.bufferSize);
+	}
+
+	return NULL;
+}
+
+/** What the render thread renders, and the requests the control
+    thread leaves for it, which it takes at its next buffer so that the
+    bell is only ever touched from one thread.
+ */
+static struct {
+	aa_bell_t	bell;
+	aa_output_t stage;
+	aa_input_t	input;
+	int			strikes;
+	bool		clear;
+} gRender;
+
+static void
+render_callback(
+	void *context, float *output, int nsamples
+) {
+	aa_bell_t bell = gRender.bell;
+	int strikes = __atomic_exchange_n(&gRender.strikes, 0, __ATOMIC_RELAXED);
+
+	if(__atomic_exchange_n(&gRender.clear, false, __ATOMIC_RELAXED))
+		aa_bell_clear_history(bell);
+	for(; strikes > 0; strikes--)
+		aa_bell_add_energy(bell, MAIN_STRIKE_ENERGY, MAIN_STRIKE_DUR);
+
+	if(gRender.input)
+		aa_input_excite(gRender.input, bell);
+
+	memset(output, 0, sizeof(float) * nsamples);
+	aa_bell_mix_sound_buffer(bell, output);
+	aa_output_process(gRender.stage, output, nsamples);
+}
+
+/** Hands a buffer to the output device, blocking until it has room,
+    which paces the render thread.
+ */
+static int
+write_audio_callback(
+	void *context, const float *input, int nsamples
+) {
+	WriteAudioStream((PABLIO_Stream*)context, (void*)input, nsamples);
+	return 0;
+}
+
 void
 sliders_changed_callback(
 	void *context,
@@ -39,23 +139,22 @@ sliders_changed_callback(
 	int index = slider_index % aa_bell_get_mode_count(bell);
 
 	if(index < aa_bell_get_mode_count(bell)) {
+		// Changes go through the bell's parameter queue, which the render
+		// thread applies at the start of its next buffer.
 		if(type == 0) {
 			value = pow(value,2);
 			value *= 7000;
 			value += 100;
-			aa_bell_set_mode_freq(bell, index, value);
+			aa_bell_post_param(bell, AA_BELL_PARAM_FREQ, 0, index, value);
 		} else if(type == 1) {
 			value = pow(1.0-value,2) * 50 + 0.6;
-			aa_bell_set_angular_decay(bell, index, value);
+			aa_bell_post_param(bell, AA_BELL_PARAM_DECAY, 0, index, value);
 		} else if(type == 2) {
 			value = pow(value,3);
 			// value = value*1.1-0.05;
-			aa_bell_set_gain(bell, 0, index, value);
+			aa_bell_post_param(bell, AA_BELL_PARAM_GAIN, 0, index, value);
 		}
 
-		aa_bell_compute_reson_coeff(bell, index);
-		aa_bell_compute_location(bell, index);
-
 		//printf("slider=%d index=%d type=%d value=%f\n",slider_index,index,type,value);
 	}
 }
@@ -73,12 +172,19 @@ main(void) {
 	int ret = 1;
 
 	int srate = AA_BELL_DEFAULT_SRATE;
-	int bufferSize = 10;
+	// Coefficient smoothing keeps slider moves free of zipper noise at
+	// this size, so we no longer need tiny buffers to hide the steps.
+	int bufferSize = 256;
 	struct termios Otty, Ntty;
 	sliders_t sliders;
 	aa_bell_t bell;
+	aa_output_t stage = NULL;
 	PABLIO_Stream *outStream = NULL;
 	PABLIO_Stream *inStream = NULL;
+	aa_input_t input = NULL;
+	aa_audio_t audio = NULL;
+	pthread_t captureThread;
+	bool capturing = false;
 	bool useInStream = true;
 
 	useInStream = false; // Uncomment to enable audio input.
@@ -106,9 +212,10 @@ main(void) {
 	sliders = sliders_create("/dev/tty.usbserial-pplug01", 0);
 
 	if(sliders) {
-		sliders_set_callback(sliders, &sliders_changed_callback, bell);
-
 		bell = aa_bell_create(10 , 1, bufferSize, srate);
+
+		if(bell)
+			sliders_set_callback(sliders, &sliders_changed_callback, bell);
 	} else {
 		fprintf(stderr, "Unable to make sliders object\nTrying sy/wok.sy instead...\n");
 
@@ -120,6 +227,28 @@ main(void) {
 		goto bail;
 	}
 
+	if(aa_bell_create_param_queue(bell, MAIN_PARAM_QUEUE_SIZE)) {
+		fprintf(stderr, "Unable to make parameter queue\n");
+		goto bail;
+	}
+
+	if(aa_bell_set_smoothing(bell, true))
+		fprintf(stderr, "Unable to smooth parameter changes\n");
+
+	if(aa_bell_set_cull_threshold(bell, MAIN_CULL_THRESHOLD))
+		fprintf(stderr, "Unable to cull quiet modes\n");
+
+	// Strikes on the render thread must find their envelope cached.
+	aa_bell_prepare_excitation(bell, MAIN_STRIKE_DUR);
+
+	stage = aa_output_create(AA_OUTPUT_SOFT_CLIP, MAIN_OUTPUT_CEILING, 0.0f,
+		srate);
+
+	if(!stage) {
+		fprintf(stderr, "Unable to make output stage\n");
+		goto bail;
+	}
+
 	OpenAudioStream(&outStream,
 		srate,
 		paFloat32,
@@ -132,28 +261,54 @@ main(void) {
 		}
 	}
 
+	if(inStream) {
+		input = aa_input_create(MAIN_INPUT_BUFFERS * bufferSize, bufferSize,
+			srate);
+
+		if(input) {
+			// Input plays through the output ring and the stage.
+			aa_input_set_extra_latency(input,
+				MAIN_OUTPUT_PERIODS * bufferSize
+				+ aa_output_get_latency(stage));
+			gCapture.stream = inStream;
+			gCapture.input = input;
+			gCapture.bufferSize = bufferSize;
+			capturing = !pthread_create(&captureThread, NULL,
+				&capture_thread_main, NULL);
+		}
+		if(!capturing)
+			fprintf(stderr, "Unable to start audio input\n");
+	}
+
 	if(!outStream) {
 		fprintf(stderr, "Unable to open output audio stream\n");
 		goto bail;
 	}
 
-	aa_bell_add_energy(bell, 0.01, 0.002);
+	aa_bell_add_energy(bell, MAIN_STRIKE_ENERGY, MAIN_STRIKE_DUR);
+
+	gRender.bell = bell;
+	gRender.stage = stage;
+	gRender.input = capturing ? input : NULL;
+
+	audio = aa_audio_create(bufferSize, MAIN_OUTPUT_PERIODS, srate,
+		&render_callback, NULL);
+
+	if(!audio || aa_audio_start(audio, &write_audio_callback, outStream)) {
+		fprintf(stderr, "Unable to start audio output\n");
+		goto bail;
+	}
 
 	fprintf(stderr, "Press spacebar to hit.\n");
 	fprintf(stderr, "Press 'x' to clear history.\n");
+	fprintf(stderr, "Press 'l' to show latency and xruns.\n");
 	fprintf(stderr, "Press 'q' to quit.\n");
 
-	// select() based runloop
+	// Control runloop. Audio is rendered on its own thread, so this
+	// only wakes for the keyboard, the sliders and interrupts.
 	while(!gDidGetInterrupt) {
-		struct timeval timeout = {
-			.tv_usec	=
-			    ((long long)bufferSize * 1000000ll /
-			        (long long)srate) * 0.65
-		};
 		int fd = sliders?sliders_get_fd(sliders):-1;
 		fd_set readfs, exceptfs;
-		float buffer[bufferSize];
-		float total;
 
 		FD_ZERO(&readfs);
 		FD_ZERO(&exceptfs);
@@ -168,25 +323,51 @@ main(void) {
 		FD_SET(gInterruptFDs[0], &exceptfs);
 
 		select(MAX(fd, gInterruptFDs[0]) + 1, &readfs, NULL, &exceptfs,
-			&timeout);
+			NULL);
 
 		if(FD_ISSET(gInterruptFDs[0], &readfs))
 			break;
 
-		if (useInStream && inStream)
-			ReadAudioStream(inStream, aa_bell_get_cos_force_ptr(bell), bufferSize);
-
 		if(FD_ISSET(0, &readfs)) {
 			char c;
-			read(0, &c, 1);
+			if(read(0, &c, 1) <= 0)
+				c = 0;
 			if(c == ' ')
-				aa_bell_add_energy(bell, 0.01, 0.002);
+				__atomic_add_fetch(&gRender.strikes, 1, __ATOMIC_RELAXED);
 			else if(c == 'q')
 				break;
+			// Dumped from here, so that the render thread never waits
+			// on stdout; it shows the bell as it is mid-render.
 			else if(c == 'd')
 				aa_bell_dump(bell, stdout);
 			else if(c == 'x')
-				aa_bell_clear_history(bell);
+				__atomic_store_n(&gRender.clear, true, __ATOMIC_RELAXED);
+			else if(c == 'l') {
+				struct aa_audio_stats_s stats;
+
+				aa_audio_get_stats(audio, &stats);
+				fprintf(stderr, "output: %.1fms buffered, %llu xruns in "
+					"%llu buffers, jitter %.2fms (max %.2fms), "
+					"load %.0f%% (max %.0f%%)%s\n",
+					aa_audio_get_latency(audio) * 1000.0 / srate,
+					(unsigned long long)stats.underruns,
+					(unsigned long long)stats.periods,
+					stats.jitter_mean * 1000.0, stats.jitter_max * 1000.0,
+					stats.render_mean * srate * 100.0 / bufferSize,
+					stats.render_max * srate * 100.0 / bufferSize,
+					stats.realtime ? "" : ", not real-time");
+			}
+			if((c == 'l') && capturing) {
+				struct aa_input_stats_s stats;
+
+				aa_input_get_stats(input, &stats);
+				fprintf(stderr, "input: %.1fms in to out (max %.1fms), "
+					"%llu overruns, %llu underruns\n",
+					stats.delay * 1000.0 / srate,
+					stats.max_delay * 1000.0 / srate,
+					(unsigned long long)stats.overruns,
+					(unsigned long long)stats.underruns);
+			}
 		}
 		if(fd>0) {
 			if(FD_ISSET(fd, &readfs))
@@ -197,19 +378,28 @@ main(void) {
 				break;
 			}
 		}
-
-		total = aa_bell_compute_sound_buffer(bell, buffer);
-
-		WriteAudioStream(outStream, buffer, bufferSize);
 	}
 
 	ret = 0;
 
 bail:
+	// The render thread goes first, as it uses everything below.
+	if(audio)
+		aa_audio_release(audio);
+	if(capturing) {
+		__atomic_store_n(&gCapture.stop, true, __ATOMIC_RELAXED);
+		pthread_join(captureThread, NULL);
+	}
+	if(input)
+		aa_input_release(input);
+	if(inStream)
+		CloseAudioStream(inStream);
 	close(gInterruptFDs[0]);
 	close(gInterruptFDs[1]);
 	if(bell)
 		aa_bell_release(bell);
+	if(stage)
+		aa_output_release(stage);
 	if(sliders)
 		sliders_release(sliders);
 	if(outStream)
@@ -0,0 +1,409 @@
+//
+//  output.c
+//
+//  Output stage for the mixed bus: a clamp, a soft clipper or a
+//  look-ahead peak limiter, run once on the sum of everything playing.
+//  The clamp and the clipper are a few vector operations per sample.
+//  The limiter computes the gain each sample needs on vectors, and
+//  smooths it in one serial pass.
+//
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "output.h"
+
+#define AA_OUTPUT_LANES         (4)
+
+/** Samples the limiter works on at a time. */
+#define AA_OUTPUT_CHUNK         (64)
+
+/** The soft clipper reaches the ceiling, with zero slope, at this
+    multiple of it. */
+#define AA_OUTPUT_KNEE          (1.5f)
+
+typedef float aa_output_vec
+    __attribute__((vector_size(AA_OUTPUT_LANES * sizeof(float))));
+typedef int32_t aa_output_ivec
+    __attribute__((vector_size(AA_OUTPUT_LANES * sizeof(int32_t))));
+
+struct aa_output_s {
+	aa_output_shape_t shape;
+
+	float	ceiling;
+
+	/** Limiter look-ahead, in samples, and the rate its gain recovers
+	    at per sample. */
+	int		lookahead;
+	float	release;
+
+	/** Samples in the look-ahead, oldest at delayPos. */
+	float *	delay;
+	int		delayPos;
+
+	/** Minimum over the look-ahead of the gain each sample needs, as a
+	    queue of increasing gains and when they leave the window. */
+	float *	minGain;
+	int64_t * minUntil;
+	int		minHead;
+	int		minCount;
+
+	/** Gain after release, and its moving average over the look-ahead,
+	    which is what is applied. */
+	float	held;
+	float *	average;
+	int		averagePos;
+	double	averageSum;
+
+	int64_t	time;
+};
+
+static inline aa_output_vec
+aa_output_vmin(
+	aa_output_vec a, aa_output_vec b
+) {
+	aa_output_ivec m = a < b;
+
+	return (aa_output_vec)(((aa_output_ivec)a & m) | ((aa_output_ivec)b & ~m));
+}
+
+static inline aa_output_vec
+aa_output_vmax(
+	aa_output_vec a, aa_output_vec b
+) {
+	aa_output_ivec m = a > b;
+
+	return (aa_output_vec)(((aa_output_ivec)a & m) | ((aa_output_ivec)b & ~m));
+}
+
+static inline aa_output_vec
+aa_output_vabs(aa_output_vec a) {
+	return (aa_output_vec)((aa_output_ivec)a & 0x7fffffff);
+}
+
+/** Clips x at +-ceiling.
+ */
+static inline aa_output_vec
+aa_output_clamp_vec(
+	aa_output_t self, aa_output_vec x
+) {
+	aa_output_vec hi = (aa_output_vec) { 0 } + self->ceiling;
+
+	return aa_output_vmax(aa_output_vmin(x, hi), -hi);
+}
+
+/** c (t - 4/27 t^3) with t = x / c clipped to +-1.5: unity gain near
+    zero, reaching c with zero slope at 1.5 c.
+ */
+static inline aa_output_vec
+aa_output_soft_clip_vec(
+	aa_output_t self, aa_output_vec x
+) {
+	aa_output_vec knee = (aa_output_vec) { 0 } + AA_OUTPUT_KNEE;
+	aa_output_vec t = aa_output_vmax(aa_output_vmin(x / self->ceiling, knee),
+		-knee);
+
+	return self->ceiling * (t - (4.0f / 27.0f) * t * t * t);
+}
+
+static inline float
+aa_output_clamp(
+	aa_output_t self, float x
+) {
+	x = x < self->ceiling ? x : self->ceiling;
+
+	return x > -self->ceiling ? x : -self->ceiling;
+}
+
+static inline float
+aa_output_soft_clip(
+	aa_output_t self, float x
+) {
+	float t = x / self->ceiling;
+
+	t = t < AA_OUTPUT_KNEE ? t : AA_OUTPUT_KNEE;
+	t = t > -AA_OUTPUT_KNEE ? t : -AA_OUTPUT_KNEE;
+
+	return self->ceiling * (t - (4.0f / 27.0f) * t * t * t);
+}
+
+/** Limits the n <= AA_OUTPUT_CHUNK samples of input into output, which
+    may be the same buffer.
+
+    Each sample needs a gain of ceiling / max(|x|, ceiling). The gain
+    applied is the moving average, over lookahead + 1 samples, of the
+    minimum needed over the same span, so it starts falling a look-ahead
+    early and every gain averaged is at most the need of the sample
+    leaving the delay. Recovery is slowed further by the release.
+ */
+static void
+aa_output_limit_chunk(
+	aa_output_t self, float *output, const float *input, int n
+) {
+	float need[AA_OUTPUT_CHUNK];
+	int span = self->lookahead + 1;
+	aa_output_vec ceiling = (aa_output_vec) { 0 } + self->ceiling;
+	int k = 0;
+
+	for(; k + AA_OUTPUT_LANES <= n; k += AA_OUTPUT_LANES) {
+		aa_output_vec x;
+
+		memcpy(&x, input + k, sizeof(x));
+		x = ceiling / aa_output_vmax(aa_output_vabs(x), ceiling);
+		memcpy(need + k, &x, sizeof(x));
+	}
+	for(; k < n; k++) {
+		float a = fabsf(input[k]);
+
+		need[k] = self->ceiling / (a > self->ceiling ? a : self->ceiling);
+	}
+
+	for(k = 0; k < n; k++) {
+		int64_t t = self->time++;
+		float x = input[k], g, y;
+		int tail;
+
+		if(self->minCount && (self->minUntil[self->minHead] <= t)) {
+			self->minHead = (self->minHead + 1) % span;
+			self->minCount--;
+		}
+		while(self->minCount) {
+			tail = (self->minHead + self->minCount - 1) % span;
+			if(self->minGain[tail] < need[k])
+				break;
+			self->minCount--;
+		}
+		tail = (self->minHead + self->minCount++) % span;
+		self->minGain[tail] = need[k];
+		self->minUntil[tail] = t + span;
+
+		g = self->minGain[self->minHead];
+		if(g > self->held)
+			g = self->held + self->release * (g - self->held);
+		self->held = g;
+
+		self->averageSum += g - self->average[self->averagePos];
+		self->average[self->averagePos] = g;
+		self->averagePos = (self->averagePos + 1) % span;
+		g = (float)(self->averageSum / span);
+
+		if(self->lookahead) {
+			y = self->delay[self->delayPos];
+			self->delay[self->delayPos] = x;
+			self->delayPos = (self->delayPos + 1) % self->lookahead;
+		} else {
+			y = x;
+		}
+
+		// Rounding in the average must not let a peak through.
+		output[k] = aa_output_clamp(self, y * g);
+	}
+}
+
+/** Creates an output stage of shape keeping the bus within +-ceiling.
+    The limiter looks lookahead seconds ahead, which delays its output
+    by as much; other shapes ignore it.
+ */
+aa_output_t
+aa_output_create(
+	aa_output_shape_t shape, float ceiling, float lookahead, int srate
+) {
+	aa_output_t ret = NULL;
+	int span;
+
+	if((shape < AA_OUTPUT_CLAMP) || (shape > AA_OUTPUT_LIMIT)
+	    || !(ceiling > 0.0f) || !(lookahead >= 0.0f) || (srate <= 0))
+		goto bail;
+
+	ret = calloc(sizeof(*ret), 1);
+
+	if(!ret)
+		goto bail;
+
+	ret->shape = shape;
+	ret->ceiling = ceiling;
+
+	if(shape == AA_OUTPUT_LIMIT) {
+		ret->lookahead = (int)(lookahead * srate + 0.5f);
+		ret->release = 1.0f
+		    - expf(-1.0f / (AA_OUTPUT_RELEASE_SECONDS * srate));
+		span = ret->lookahead + 1;
+		ret->delay = calloc(sizeof(float), span);
+		ret->minGain = calloc(sizeof(float), span);
+		ret->minUntil = calloc(sizeof(int64_t), span);
+		ret->average = calloc(sizeof(float), span);
+
+		if(!ret->delay || !ret->minGain || !ret->minUntil
+		    || !ret->average) {
+			aa_output_release(ret);
+			ret = NULL;
+			goto bail;
+		}
+
+		aa_output_reset(ret);
+	}
+
+bail:
+	return ret;
+}
+
+void
+aa_output_release(aa_output_t self) {
+	free(self->delay);
+	free(self->minGain);
+	free(self->minUntil);
+	free(self->average);
+	free(self);
+}
+
+aa_output_shape_t
+aa_output_get_shape(aa_output_t self) {
+	return self->shape;
+}
+
+/** Changes the level the bus is kept within. Returns nonzero if
+    ceiling is not positive.
+ */
+int
+aa_output_set_ceiling(
+	aa_output_t self, float ceiling
+) {
+	if(!(ceiling > 0.0f))
+		return -1;
+
+	self->ceiling = ceiling;
+
+	return 0;
+}
+
+float
+aa_output_get_ceiling(aa_output_t self) {
+	return self->ceiling;
+}
+
+/** Samples by which the stage delays the bus.
+ */
+int
+aa_output_get_latency(aa_output_t self) {
+	return self->lookahead;
+}
+
+/** Forgets the samples in the look-ahead and restores full gain.
+ */
+void
+aa_output_reset(aa_output_t self) {
+	int span = self->lookahead + 1;
+
+	if(self->shape != AA_OUTPUT_LIMIT)
+		return;
+
+	memset(self->delay, 0, sizeof(float) * span);
+	for(int j = 0; j < span; j++)
+		self->average[j] = 1.0f;
+	self->delayPos = 0;
+	self->minHead = self->minCount = 0;
+	self->averagePos = 0;
+	self->averageSum = span;
+	self->held = 1.0f;
+	self->time = 0;
+}
+
+/** Runs the stage over buffer in place.
+ */
+void
+aa_output_process(
+	aa_output_t self, float *buffer, int nsamples
+) {
+	int k = 0;
+
+	switch(self->shape) {
+	case AA_OUTPUT_CLAMP:
+		for(; k + AA_OUTPUT_LANES <= nsamples; k += AA_OUTPUT_LANES) {
+			aa_output_vec x;
+
+			memcpy(&x, buffer + k, sizeof(x));
+			x = aa_output_clamp_vec(self, x);
+			memcpy(buffer + k, &x, sizeof(x));
+		}
+		for(; k < nsamples; k++)
+			buffer[k] = aa_output_clamp(self, buffer[k]);
+		break;
+	case AA_OUTPUT_SOFT_CLIP:
+		for(; k + AA_OUTPUT_LANES <= nsamples; k += AA_OUTPUT_LANES) {
+			aa_output_vec x;
+
+			memcpy(&x, buffer + k, sizeof(x));
+			x = aa_output_soft_clip_vec(self, x);
+			memcpy(buffer + k, &x, sizeof(x));
+		}
+		for(; k < nsamples; k++)
+			buffer[k] = aa_output_soft_clip(self, buffer[k]);
+		break;
+	case AA_OUTPUT_LIMIT:
+		for(; k < nsamples; k += AA_OUTPUT_CHUNK) {
+			int n = nsamples - k < AA_OUTPUT_CHUNK ? nsamples - k
+			    : AA_OUTPUT_CHUNK;
+
+			aa_output_limit_chunk(self, buffer + k, buffer + k, n);
+		}
+		break;
+	}
+}
+
+/** Adds input into output and runs the stage over the sum, in one pass
+    over output. Use it for the last buffer summed into a bus, so that
+    the stage does not go over the bus again.
+ */
+void
+aa_output_mix(
+	aa_output_t self, float *output, const float *input, int nsamples
+) {
+	int k = 0;
+
+	switch(self->shape) {
+	case AA_OUTPUT_CLAMP:
+	case AA_OUTPUT_SOFT_CLIP:
+		for(; k + AA_OUTPUT_LANES <= nsamples; k += AA_OUTPUT_LANES) {
+			aa_output_vec x, y;
+
+			memcpy(&x, output + k, sizeof(x));
+			memcpy(&y, input + k, sizeof(y));
+			x += y;
+			x = self->shape == AA_OUTPUT_CLAMP ? aa_output_clamp_vec(self, x)
+			    : aa_output_soft_clip_vec(self, x);
+			memcpy(output + k, &x, sizeof(x));
+		}
+		for(; k < nsamples; k++) {
+			float x = output[k] + input[k];
+
+			output[k] = self->shape == AA_OUTPUT_CLAMP ? aa_output_clamp(self, x)
+			    : aa_output_soft_clip(self, x);
+		}
+		break;
+	case AA_OUTPUT_LIMIT:
+		for(; k < nsamples; k += AA_OUTPUT_CHUNK) {
+			float sum[AA_OUTPUT_CHUNK];
+			int n = nsamples - k < AA_OUTPUT_CHUNK ? nsamples - k
+			    : AA_OUTPUT_CHUNK;
+			int j = 0;
+
+			for(; j + AA_OUTPUT_LANES <= n; j += AA_OUTPUT_LANES) {
+				aa_output_vec x, y;
+
+				memcpy(&x, output + k + j, sizeof(x));
+				memcpy(&y, input + k + j, sizeof(y));
+				x += y;
+				memcpy(sum + j, &x, sizeof(x));
+			}
+			for(; j < n; j++)
+				sum[j] = output[k + j] + input[k + j];
+
+			aa_output_limit_chunk(self, output + k, sum, n);
+		}
+		break;
+	}
+}
@@ -0,0 +1,57 @@
+//
+//  output.h
+//
+
+#ifndef __AA_OUTPUT_H__
+#define __AA_OUTPUT_H__ 1
+
+#if !defined(__BEGIN_DECLS) || !defined(__END_DECLS)
+#if defined(__cplusplus)
+#define __BEGIN_DECLS   extern "C" {
+#define __END_DECLS \
+	}
+#else
+#define __BEGIN_DECLS
+#define __END_DECLS
+#endif
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+__BEGIN_DECLS
+
+/** Look-ahead of the limiter when none is given, in seconds. */
+#define AA_OUTPUT_DEFAULT_LOOKAHEAD     (0.0015f)
+
+/** Time the limiter takes to recover most of its gain, in seconds. */
+#define AA_OUTPUT_RELEASE_SECONDS       (0.05f)
+
+/** How the output stage keeps the mixed bus within its ceiling. */
+typedef enum {
+	AA_OUTPUT_CLAMP = 0,        //!< Clip at the ceiling.
+	AA_OUTPUT_SOFT_CLIP,        //!< Cubic saturation towards the ceiling.
+	AA_OUTPUT_LIMIT,            //!< Look-ahead peak limiter.
+} aa_output_shape_t;
+
+struct aa_output_s;
+typedef struct aa_output_s *aa_output_t;
+
+aa_output_t aa_output_create(
+	aa_output_shape_t shape, float ceiling, float lookahead, int srate);
+void aa_output_release(aa_output_t self);
+
+aa_output_shape_t aa_output_get_shape(aa_output_t self);
+int aa_output_set_ceiling(
+	aa_output_t self, float ceiling);
+float aa_output_get_ceiling(aa_output_t self);
+int aa_output_get_latency(aa_output_t self);
+void aa_output_reset(aa_output_t self);
+
+void aa_output_process(
+	aa_output_t self, float *buffer, int nsamples);
+void aa_output_mix(
+	aa_output_t self, float *output, const float *input, int nsamples);
+
+__END_DECLS
+#endif                          // #ifndef __AA_OUTPUT_H__
@@ -0,0 +1,744 @@
+//
+//  render.c
+//
+//  Headless batch renderer: plays a score of strikes on a model and
+//  writes the result to a WAV or raw float file, faster than real time
+//  and without audio hardware.
+//
+
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bank.h"
+#include "bell.h"
+#include "input.h"
+#include "output.h"
+
+#define RENDER_DEFAULT_BUFFER_SIZE  (1024)
+#define RENDER_DEFAULT_TAIL         (2.0)
+
+/** Strikes of a frozen model ringing at once. */
+#define RENDER_FROZEN_STRIKES       (1024)
+
+struct strike_s {
+	double	time;
+	float	energy;
+	float	dur;
+	float	point;
+};
+
+struct render_job_s {
+	const char *		model_path;
+	const char *		score_path;
+	const char *		out_path;
+
+	struct strike_s *	strikes;
+	int					strike_count;
+
+	int					status;
+	double				seconds;
+	double				elapsed;
+};
+
+static struct {
+	int					bufferSize;
+	int					srate;
+	double				tail;
+	bool				raw;
+	aa_bell_kernel_t	kernel;
+	aa_bell_excite_t	excite;
+	aa_bell_precision_t	precision;
+	aa_bell_synthesis_t	synthesis;
+	float				cull;
+	int					budget;
+	int					shape;      // aa_output_shape_t, or -1 to clamp
+	float				ceiling;
+	int					channels;
+	const char *		input_path;
+	float				onset;      // onset threshold, or 0 to drive
+	float				frozen;     // noise floor, or 0 to render live
+
+	struct render_job_s *jobs;
+	int					job_count;
+	int					next_job;
+} gRender = {
+	.bufferSize = RENDER_DEFAULT_BUFFER_SIZE,
+	.srate = (int)AA_BELL_DEFAULT_SRATE,
+	.tail = RENDER_DEFAULT_TAIL,
+	.kernel = AA_BELL_KERNEL_AUTO,
+	.precision = AA_BELL_PRECISION_FLOAT,
+	.synthesis = AA_BELL_SYNTHESIS_AUTO,
+	.shape = -1,
+	.ceiling = 1.0f,
+	.channels = 1,
+	.excite = AA_BELL_EXCITE_RAISED_COSINE,
+};
+
+static double
+render_now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/** Most frames an output file can hold: what the sizes in a WAV header
+    can count, or for raw floats what a double still counts exactly. */
+static double
+render_max_samples(int channels) {
+	if(gRender.raw)
+		return 9007199254740992.0;     // 2^53
+
+	return (double)((UINT32_MAX - 36) / (channels * sizeof(float)));
+}
+
+static int
+strike_compare(const void *a, const void *b) {
+	double ta = ((const struct strike_s*)a)->time;
+	double tb = ((const struct strike_s*)b)->time;
+
+	return (ta > tb) - (ta < tb);
+}
+
+/** Reads a score: one strike per line as "time energy duration point",
+    times in seconds. The point is optional and may lie between two of
+    the model's points. Blank lines and lines starting with '#' are
+    ignored. Times and durations must be finite and not negative, and
+    no strike may start past the longest output file. Strikes are
+    sorted by time.
+ */
+static int
+render_read_score(struct render_job_s *job) {
+	int ret = -1;
+	char line[256];
+	int lineno = 0;
+	int capacity = 0;
+	FILE *fp = fopen(job->score_path, "r");
+
+	if(!fp) {
+		perror(job->score_path);
+		goto bail;
+	}
+
+	while(fgets(line, sizeof(line), fp)) {
+		struct strike_s strike = { 0 };
+		char *s = line;
+
+		lineno++;
+
+		while((*s == ' ') || (*s == '\t'))
+			s++;
+		if((*s == '#') || (*s == '\n') || (*s == '\r') || !*s)
+			continue;
+
+		if(sscanf(s, "%lf %f %f %f", &strike.time, &strike.energy,
+				&strike.dur, &strike.point) < 3) {
+			fprintf(stderr, "%s:%d: expected \"time energy duration point\"\n",
+				job->score_path, lineno);
+			goto bail;
+		}
+
+		if(!isfinite(strike.time) || (strike.time < 0.0)
+		    || !isfinite(strike.dur) || (strike.dur < 0.0f)
+		    || !isfinite(strike.energy) || !isfinite(strike.point)) {
+			fprintf(stderr, "%s:%d: times and durations must be finite "
+				"and not negative\n", job->score_path, lineno);
+			goto bail;
+		}
+
+		// Bells count a strike's samples in an int, from a float.
+		if(strike.dur * (float)gRender.srate >= (float)INT_MAX) {
+			fprintf(stderr, "%s:%d: strike of %g s is longer than %d "
+				"samples\n", job->score_path, lineno, strike.dur, INT_MAX);
+			goto bail;
+		}
+
+		if((strike.time + gRender.tail) * gRender.srate
+		    >= render_max_samples(gRender.channels)) {
+			fprintf(stderr, "%s:%d: strike at %g s is past the longest "
+				"output file\n", job->score_path, lineno, strike.time);
+			goto bail;
+		}
+
+		if(job->strike_count == capacity) {
+			struct strike_s *strikes;
+			capacity = capacity ? capacity * 2 : 64;
+			strikes = realloc(job->strikes, sizeof(*strikes) * capacity);
+			if(!strikes) {
+				perror("render_read_score:realloc");
+				goto bail;
+			}
+			job->strikes = strikes;
+		}
+		job->strikes[job->strike_count++] = strike;
+	}
+
+	qsort(job->strikes, job->strike_count, sizeof(*job->strikes),
+		&strike_compare);
+
+	ret = 0;
+
+bail:
+	if(fp)
+		fclose(fp);
+	return ret;
+}
+
+static void
+render_put_le(
+	FILE *fp, uint32_t value, int bytes
+) {
+	for(int i = 0; i < bytes; i++)
+		fputc((value >> (8 * i)) & 0xFF, fp);
+}
+
+/** Writes an IEEE float WAV header for nsamples frames of channels
+    samples each.
+ */
+static void
+render_write_wav_header(
+	FILE *fp, int srate, int channels, uint32_t nsamples
+) {
+	uint32_t frame_size = channels * sizeof(float);
+	uint32_t data_size = nsamples * frame_size;
+
+	fwrite("RIFF", 1, 4, fp);
+	render_put_le(fp, 36 + data_size, 4);
+	fwrite("WAVEfmt ", 1, 8, fp);
+	render_put_le(fp, 16, 4);
+	render_put_le(fp, 3, 2);            // WAVE_FORMAT_IEEE_FLOAT
+	render_put_le(fp, channels, 2);
+	render_put_le(fp, srate, 4);
+	render_put_le(fp, srate * frame_size, 4);
+	render_put_le(fp, frame_size, 2);
+	render_put_le(fp, 32, 2);
+	fwrite("data", 1, 4, fp);
+	render_put_le(fp, data_size, 4);
+}
+
+/** Writes nsamples frames of native float samples as little-endian,
+    interleaving channels planar rows of stride samples each.
+ */
+static void
+render_write_samples(
+	FILE *fp, const float *buffer, int channels, int stride, int nsamples
+) {
+	for(int i = 0; i < nsamples; i++) {
+		for(int c = 0; c < channels; c++) {
+			uint32_t bits;
+			memcpy(&bits, &buffer[c * stride + i], sizeof(bits));
+			render_put_le(fp, bits, 4);
+		}
+	}
+}
+
+/** Spreads the channels of bell evenly over the model's points, the
+    first picking up at point 0 and the last at the last point.
+ */
+static int
+render_set_channels(
+	aa_bell_t bell, int channels
+) {
+	int last = aa_bell_get_point_count(bell) - 1;
+
+	if(aa_bell_set_channel_count(bell, channels))
+		return -1;
+
+	for(int c = 0; c < channels; c++)
+		aa_bell_set_channel_point(bell, c, (float)last * c / (channels - 1));
+
+	return 0;
+}
+
+static void
+render_job(struct render_job_s *job) {
+	aa_bell_t bell = NULL;
+	aa_bell_frozen_t frozen = NULL;
+	aa_output_t stages[AA_BELL_MAX_CHANNELS] = { NULL };
+	aa_input_file_t input_file = NULL;
+	aa_input_t input = NULL;
+	int channels = gRender.channels;
+	FILE *out = NULL;
+	float *buffer = NULL;
+	int bufferSize = gRender.bufferSize;
+	int next_strike = 0;
+	uint64_t nsamples, written = 0, rendered = 0, skip = 0;
+	double start = render_now();
+	bool warned_point = false;
+
+	job->status = -1;
+
+	if(render_read_score(job))
+		goto bail;
+
+	// Jobs that play the same model share one copy of it, unless it
+	// renders at another precision, which is chosen per model.
+	if(gRender.precision == AA_BELL_PRECISION_FLOAT)
+		bell = aa_bank_create_bell(job->model_path, bufferSize,
+			gRender.srate);
+	else
+		bell = aa_bell_create_from_file(job->model_path, bufferSize,
+			gRender.srate);
+
+	if(!bell) {
+		fprintf(stderr, "%s: unable to load model\n", job->model_path);
+		goto bail;
+	}
+
+	aa_bell_set_kernel(bell, gRender.kernel);
+	aa_bell_set_excitation(bell, gRender.excite);
+	if(aa_bell_set_precision(bell, gRender.precision) != gRender.precision) {
+		fprintf(stderr, "%s: out of memory\n", job->model_path);
+		goto bail;
+	}
+	aa_bell_set_synthesis(bell, gRender.synthesis);
+	if(gRender.cull > 0.0f)
+		aa_bell_set_cull_threshold(bell, gRender.cull);
+	if(gRender.budget > 0)
+		aa_bell_set_mode_budget(bell, gRender.budget);
+	if((channels > 1) && render_set_channels(bell, channels)) {
+		fprintf(stderr, "%s: unable to render %d channels\n",
+			job->model_path, channels);
+		goto bail;
+	}
+
+	if(gRender.frozen > 0.0f) {
+		frozen = aa_bell_frozen_create(bell, RENDER_FROZEN_STRIKES,
+			gRender.frozen);
+
+		if(!frozen) {
+			fprintf(stderr, "%s: unable to freeze model\n",
+				job->model_path);
+			goto bail;
+		}
+
+		// Strikes only play responses rendered ahead of time.
+		for(int i = 0; i < job->strike_count; i++) {
+			if(aa_bell_frozen_prepare(frozen, job->strikes[i].point,
+				    job->strikes[i].dur)) {
+				fprintf(stderr, "%s: unable to prepare strike at %gs\n",
+					job->score_path, job->strikes[i].time);
+			}
+		}
+	}
+
+	// Each channel is shaped on its own.
+	for(int c = 0; (gRender.shape >= 0) && (c < channels); c++) {
+		stages[c] = aa_output_create((aa_output_shape_t)gRender.shape,
+			gRender.ceiling, AA_OUTPUT_DEFAULT_LOOKAHEAD, gRender.srate);
+
+		if(!stages[c]) {
+			fprintf(stderr, "%s: bad output ceiling %g\n", job->out_path,
+				gRender.ceiling);
+			goto bail;
+		}
+
+		// Start the file where the limiter's delayed output does. The
+		// loop below renders until the file is full, latency samples
+		// past its end, which flushes the delay through the last one.
+		skip = (uint64_t)aa_output_get_latency(stages[c]);
+	}
+
+	if(gRender.input_path) {
+		input_file = aa_input_file_open(gRender.input_path);
+		input = aa_input_create(bufferSize, bufferSize, gRender.srate);
+
+		if(!input_file || !input) {
+			fprintf(stderr, "%s: unable to play as input\n",
+				gRender.input_path);
+			goto bail;
+		}
+
+		if(aa_input_file_get_srate(input_file)
+		    && (aa_input_file_get_srate(input_file) != gRender.srate))
+			fprintf(stderr, "%s: %d Hz input played at %d Hz\n",
+				gRender.input_path, aa_input_file_get_srate(input_file),
+				gRender.srate);
+
+		if(gRender.onset > 0.0f) {
+			aa_input_set_mode(input, AA_INPUT_ONSETS);
+			aa_input_set_onsets(input, gRender.onset,
+				AA_INPUT_DEFAULT_ONSET_ENERGY, AA_INPUT_DEFAULT_ONSET_DUR);
+			aa_bell_prepare_excitation(bell, AA_INPUT_DEFAULT_ONSET_DUR);
+		}
+	}
+
+	buffer = calloc(sizeof(float), bufferSize * channels);
+	out = fopen(job->out_path, "wb");
+
+	if(!buffer || !out) {
+		perror(job->out_path);
+		goto bail;
+	}
+
+	job->seconds = 0.0;
+	if(job->strike_count)
+		job->seconds = job->strikes[job->strike_count - 1].time;
+	if(input_file && ((double)aa_input_file_get_length(input_file)
+	        / gRender.srate > job->seconds))
+		job->seconds = (double)aa_input_file_get_length(input_file)
+		    / gRender.srate;
+	job->seconds += gRender.tail;
+
+	if(job->seconds * gRender.srate >= render_max_samples(channels)) {
+		fprintf(stderr, "%s: %g s of audio is longer than the longest "
+			"output file\n", job->out_path, job->seconds);
+		goto bail;
+	}
+
+	nsamples = (uint64_t)(job->seconds * gRender.srate);
+
+	if(!gRender.raw)
+		render_write_wav_header(out, gRender.srate, channels,
+			(uint32_t)nsamples);
+
+	while(written < nsamples) {
+		int n = bufferSize, from = 0;
+
+		// Strikes start at their own sample, whatever the buffer size.
+		while((next_strike < job->strike_count)
+		    && (job->strikes[next_strike].time * gRender.srate
+		        < rendered + bufferSize)) {
+			struct strike_s *strike = &job->strikes[next_strike++];
+			uint64_t at = (uint64_t)(strike->time * gRender.srate);
+			int offset = at > rendered ? (int)(at - rendered) : 0;
+
+			if(frozen) {
+				if(aa_bell_frozen_strike(frozen, strike->energy, strike->dur,
+					    strike->point, offset)) {
+					fprintf(stderr, "%s: strike at %gs dropped\n",
+						job->score_path, strike->time);
+				}
+				continue;
+			}
+
+			// Each strike keeps the gains of its own point, however
+			// many points one buffer strikes at.
+			if((strike->point != aa_bell_get_strike_point(bell))
+			    && aa_bell_set_strike_point(bell, strike->point)
+			    && !warned_point) {
+				fprintf(stderr,
+					"%s: cannot strike at point %g of 0 to %d\n",
+					job->score_path, strike->point,
+					aa_bell_get_point_count(bell) - 1);
+				warned_point = true;
+			}
+			if(aa_bell_add_energy_at(bell, strike->energy, strike->dur,
+				    offset)) {
+				fprintf(stderr, "%s: more than %d overlapping strikes, "
+					"strike at %gs dropped\n", job->score_path,
+					AA_BELL_MAX_STRIKES, strike->time);
+			}
+		}
+
+		// The file is captured a buffer at a time, just in time.
+		if(input) {
+			aa_input_file_pump(input_file, input, bufferSize);
+			aa_input_excite(input, bell);
+		}
+
+		if(frozen && stages[0]) {
+			memset(buffer, 0, sizeof(float) * bufferSize);
+			aa_bell_frozen_mix_sound_buffer(frozen, buffer);
+			aa_output_process(stages[0], buffer, bufferSize);
+		} else if(frozen) {
+			aa_bell_frozen_compute_sound_buffer(frozen, buffer);
+		} else if(stages[0]) {
+			memset(buffer, 0, sizeof(float) * bufferSize * channels);
+			aa_bell_mix_channels(bell, buffer, AA_BELL_LAYOUT_PLANAR);
+			for(int c = 0; c < channels; c++)
+				aa_output_process(stages[c], buffer + c * bufferSize,
+					bufferSize);
+		} else {
+			aa_bell_compute_channels(bell, buffer, AA_BELL_LAYOUT_PLANAR);
+		}
+		rendered += bufferSize;
+
+		if(skip) {
+			from = skip < (uint64_t)bufferSize ? (int)skip : bufferSize;
+			skip -= from;
+			n -= from;
+		}
+		if((uint64_t)n > nsamples - written)
+			n = (int)(nsamples - written);
+		render_write_samples(out, buffer + from, channels, bufferSize, n);
+		written += n;
+	}
+
+	if(ferror(out)) {
+		perror(job->out_path);
+		goto bail;
+	}
+
+	if(frozen) {
+		struct aa_bell_frozen_stats_s stats;
+
+		aa_bell_frozen_get_stats(frozen, &stats);
+		fprintf(stderr, "%s: %d responses of up to %.2fs cached in %.1f MB, "
+			"in place of %d modes\n", job->out_path, stats.responses,
+			(double)stats.longest / gRender.srate,
+			stats.bytes / 1048576.0, stats.modes);
+	}
+
+	if(input && (gRender.onset > 0.0f)) {
+		struct aa_input_stats_s stats;
+
+		aa_input_get_stats(input, &stats);
+		fprintf(stderr, "%s: %llu onsets struck\n", job->out_path,
+			(unsigned long long)stats.onsets);
+	}
+
+	job->status = 0;
+
+bail:
+	job->elapsed = render_now() - start;
+	if(out)
+		fclose(out);
+	for(int c = 0; c < channels; c++)
+		if(stages[c])
+			aa_output_release(stages[c]);
+	aa_input_file_release(input_file);
+	aa_input_release(input);
+	if(frozen)
+		aa_bell_frozen_release(frozen);
+	free(buffer);
+	if(bell)
+		aa_bell_release(bell);
+}
+
+static void*
+render_thread_main(void *context) {
+	(void)context;
+
+	for(;;) {
+		int j = __atomic_fetch_add(&gRender.next_job, 1, __ATOMIC_RELAXED);
+
+		if(j >= gRender.job_count)
+			break;
+
+		render_job(&gRender.jobs[j]);
+	}
+
+	return NULL;
+}
+
+static void
+render_usage(const char *argv0) {
+	fprintf(stderr,
+		"usage: %s [-b buffer-size] [-r srate] [-t tail-seconds]\n"
+		"          [-k auto|scalar|simd4|simd8|simd16|block] [-j threads] [-R]\n"
+		"          [-x cosine|sine|noise] [-c cull-threshold] [-m modes]\n"
+		"          [-s clamp|soft|limit] [-l ceiling] [-p float|double|q31]\n"
+		"          [-e auto|time|spectral] [-n channels] [-i input.wav]\n"
+		"          [-o onset-threshold] [-f noise-floor]\n"
+		"          model.sy score.txt out.wav [model.sy score.txt out.wav ...]\n"
+		"\n"
+		"Each score line is \"time energy duration point\". Models are\n"
+		"rendered in parallel, one per thread. -R writes raw floats.\n"
+		"-x sets the force envelope of every strike. -c stops rendering\n"
+		"modes once they are quieter than the threshold. -m renders only\n"
+		"the most audible modes, at most this many per buffer. -s keeps\n"
+		"the output within -l ceiling (default 1) by clipping, soft\n"
+		"clipping or look-ahead limiting instead of clamping at 1. -p\n"
+		"renders in double precision or 32-bit fixed point; each job\n"
+		"then loads its own copy of its model. -e spectral renders modes\n"
+		"ringing between strikes from inverse FFTs, for models of many\n"
+		"modes in buffers of a power of two; auto, the default, renders\n"
+		"in time. -n writes that many channels, picking the model up at\n"
+		"points spread evenly from the first to the last, each shaped on\n"
+		"its own; it needs -p float.\n"
+		"-i plays a sound file into every model as it renders, adding to\n"
+		"the strikes of its score; with -o, the file strikes the model\n"
+		"wherever its level jumps past the threshold instead.\n"
+		"-f plays each strike from the model's response to it, rendered\n"
+		"once per point and duration of the score before the first\n"
+		"buffer and cut off once what is left of it is below the noise\n"
+		"floor times its peak, such as 1e-4; it cannot take -n or -i.\n",
+		argv0);
+}
+
+int
+main(
+	int argc, char *argv[]
+) {
+	int ret = 1;
+	int thread_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	pthread_t *threads = NULL;
+	double start, elapsed, seconds = 0.0;
+	int c;
+
+	while((c = getopt(argc, argv, "b:r:t:k:j:x:c:m:s:l:p:e:n:i:o:f:Rh")) != -1) {
+		switch(c) {
+		case 'b':
+			gRender.bufferSize = atoi(optarg);
+			break;
+		case 'r':
+			gRender.srate = atoi(optarg);
+			break;
+		case 't':
+			gRender.tail = atof(optarg);
+			break;
+		case 'k':
+			if(!strcmp(optarg, "scalar"))
+				gRender.kernel = AA_BELL_KERNEL_SCALAR;
+			else if(!strcmp(optarg, "simd4"))
+				gRender.kernel = AA_BELL_KERNEL_SIMD4;
+			else if(!strcmp(optarg, "simd8"))
+				gRender.kernel = AA_BELL_KERNEL_SIMD8;
+			else if(!strcmp(optarg, "simd16"))
+				gRender.kernel = AA_BELL_KERNEL_SIMD16;
+			else if(!strcmp(optarg, "block"))
+				gRender.kernel = AA_BELL_KERNEL_BLOCK;
+			else
+				gRender.kernel = AA_BELL_KERNEL_AUTO;
+			break;
+		case 'x':
+			if(!strcmp(optarg, "sine"))
+				gRender.excite = AA_BELL_EXCITE_HALF_SINE;
+			else if(!strcmp(optarg, "noise"))
+				gRender.excite = AA_BELL_EXCITE_NOISE;
+			else
+				gRender.excite = AA_BELL_EXCITE_RAISED_COSINE;
+			break;
+		case 'c':
+			gRender.cull = (float)atof(optarg);
+			break;
+		case 'm':
+			gRender.budget = atoi(optarg);
+			break;
+		case 's':
+			if(!strcmp(optarg, "soft"))
+				gRender.shape = AA_OUTPUT_SOFT_CLIP;
+			else if(!strcmp(optarg, "limit"))
+				gRender.shape = AA_OUTPUT_LIMIT;
+			else
+				gRender.shape = AA_OUTPUT_CLAMP;
+			break;
+		case 'l':
+			gRender.ceiling = (float)atof(optarg);
+			break;
+		case 'p':
+			if(!strcmp(optarg, "double"))
+				gRender.precision = AA_BELL_PRECISION_DOUBLE;
+			else if(!strcmp(optarg, "q31"))
+				gRender.precision = AA_BELL_PRECISION_Q31;
+			else
+				gRender.precision = AA_BELL_PRECISION_FLOAT;
+			break;
+		case 'e':
+			if(!strcmp(optarg, "time"))
+				gRender.synthesis = AA_BELL_SYNTHESIS_TIME;
+			else if(!strcmp(optarg, "spectral"))
+				gRender.synthesis = AA_BELL_SYNTHESIS_SPECTRAL;
+			else
+				gRender.synthesis = AA_BELL_SYNTHESIS_AUTO;
+			break;
+		case 'n':
+			gRender.channels = atoi(optarg);
+			break;
+		case 'i':
+			gRender.input_path = optarg;
+			break;
+		case 'o':
+			gRender.onset = (float)atof(optarg);
+			break;
+		case 'f':
+			gRender.frozen = (float)atof(optarg);
+			break;
+		case 'j':
+			thread_count = atoi(optarg);
+			break;
+		case 'R':
+			gRender.raw = true;
+			break;
+		default:
+			render_usage(argv[0]);
+			goto bail;
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if(!argc || (argc % 3) || (gRender.bufferSize <= 0)
+	    || !isfinite(gRender.tail) || (gRender.tail < 0.0)
+	    || (gRender.srate <= 0) || (gRender.channels < 1)
+	    || (gRender.channels > AA_BELL_MAX_CHANNELS)
+	    || ((gRender.channels > 1)
+	        && (gRender.precision != AA_BELL_PRECISION_FLOAT))
+	    || ((gRender.frozen > 0.0f)
+	        && ((gRender.channels > 1) || gRender.input_path))) {
+		render_usage(argv[-optind]);
+		goto bail;
+	}
+
+	gRender.job_count = argc / 3;
+	gRender.jobs = calloc(sizeof(*gRender.jobs), gRender.job_count);
+
+	if(thread_count < 1)
+		thread_count = 1;
+	if(thread_count > gRender.job_count)
+		thread_count = gRender.job_count;
+
+	threads = calloc(sizeof(*threads), thread_count);
+
+	if(!gRender.jobs || !threads) {
+		perror("calloc");
+		goto bail;
+	}
+
+	for(int j = 0; j < gRender.job_count; j++) {
+		gRender.jobs[j].model_path = argv[3 * j];
+		gRender.jobs[j].score_path = argv[3 * j + 1];
+		gRender.jobs[j].out_path = argv[3 * j + 2];
+	}
+
+	start = render_now();
+
+	for(int t = 1; t < thread_count; t++) {
+		if(pthread_create(&threads[t], NULL, &render_thread_main, NULL)) {
+			perror("pthread_create");
+			thread_count = t;
+			break;
+		}
+	}
+	render_thread_main(NULL);
+	for(int t = 1; t < thread_count; t++)
+		pthread_join(threads[t], NULL);
+
+	elapsed = render_now() - start;
+
+	ret = 0;
+	for(int j = 0; j < gRender.job_count; j++) {
+		struct render_job_s *job = &gRender.jobs[j];
+
+		free(job->strikes);
+
+		if(job->status) {
+			ret = 1;
+			continue;
+		}
+
+		seconds += job->seconds;
+		fprintf(stderr, "%s: %.2fs of audio in %.3fs, %.1fx real time\n",
+			job->out_path, job->seconds, job->elapsed,
+			job->seconds / job->elapsed);
+	}
+
+	fprintf(stderr, "total: %.2fs of audio in %.3fs on %d threads, "
+		"%.1fx real time\n", seconds, elapsed, thread_count,
+		seconds / elapsed);
+
+bail:
+	free(threads);
+	free(gRender.jobs);
+	return ret;
+}
@@ -0,0 +1,522 @@
+//
+//  scheduler.c
+//
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include "bell_private.h"
+#include "scheduler.h"
+
+enum {
+	AA_SCHEDULER_SOURCE_BELL = 0,
+	AA_SCHEDULER_SOURCE_VOICES = 1,
+};
+
+struct aa_scheduler_source_s {
+	int				type;
+	aa_bell_t		bell;
+	aa_voices_t		voices;
+};
+
+/** One unit of work: a mode range of a bell, or one voice of a pool.
+    Every job renders into its own partial buffer so that the final sum
+    can be taken in job order, whichever thread ran the job. */
+struct aa_scheduler_job_s {
+	int				source;
+	int				begin, end;
+	int				voice;
+	float *			partial;
+	double			total;
+	bool			wrote;
+};
+
+/** The jobs [next, end) still to be taken from one worker's share. Other
+    workers steal from it once their own share is exhausted. */
+struct aa_scheduler_range_s {
+	int				next;
+	int				end;
+	char			pad[64 - 2 * sizeof(int)];
+};
+
+struct aa_scheduler_worker_s {
+	aa_scheduler_t	scheduler;
+	int				index;
+	pthread_t		thread;
+	bool			started;
+};
+
+struct aa_scheduler_s {
+	int				bufferSize;
+
+	int				thread_count;
+
+	int				source_count;
+	struct aa_scheduler_source_s *sources;
+
+	int				job_count;
+	struct aa_scheduler_job_s *jobs;
+
+	struct aa_scheduler_range_s *ranges;
+
+	/** Jobs of the current block not yet finished, plus workers still
+	    taking jobs. The caller parks on it until the last of them wakes
+	    it, so that no worker is left between claiming a job index and
+	    checking it when ranges are reset or jobs added for the next
+	    block. */
+	int				pending;
+
+	/** Output stage of aa_scheduler_compute_sound_buffer(), or NULL to
+	    clamp. Not owned. */
+	aa_output_t		output;
+
+	/** Bumped for every block and to quit; workers park on it. */
+	int				generation;
+	bool			quit;
+
+#if !defined(__linux__)
+	/** Parking without futexes. */
+	pthread_mutex_t lock;
+	pthread_cond_t	wake;
+#endif
+
+	struct aa_scheduler_worker_s *workers;
+};
+
+/** Blocks the calling thread while *word holds value. It may return
+    early; callers check *word again. On Linux this is a futex wait, so
+    neither parking nor waking takes a lock.
+ */
+static void
+aa_scheduler_park(
+	aa_scheduler_t self, int *word, int value
+) {
+#if defined(__linux__)
+	(void)self;
+	syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+#else
+	pthread_mutex_lock(&self->lock);
+	while(__atomic_load_n(word, __ATOMIC_ACQUIRE) == value)
+		pthread_cond_wait(&self->wake, &self->lock);
+	pthread_mutex_unlock(&self->lock);
+#endif
+}
+
+/** Wakes every thread parked on word, once it has been changed.
+ */
+static void
+aa_scheduler_unpark(
+	aa_scheduler_t self, int *word
+) {
+#if defined(__linux__)
+	(void)self;
+	syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#else
+	(void)word;
+	pthread_mutex_lock(&self->lock);
+	pthread_cond_broadcast(&self->wake);
+	pthread_mutex_unlock(&self->lock);
+#endif
+}
+
+static void
+aa_scheduler_run_job(
+	aa_scheduler_t self, struct aa_scheduler_job_s *job
+) {
+	struct aa_scheduler_source_s *source = &self->sources[job->source];
+
+	job->total = 0.0;
+	job->wrote = false;
+
+	if(source->type == AA_SCHEDULER_SOURCE_BELL) {
+		aa_bell_t bell = source->bell;
+		int end = job->end < bell->nfUsed ? job->end : bell->nfUsed;
+
+		if(job->begin < end) {
+			job->total = aa_bell_run_kernel(bell, job->partial, job->begin,
+				end, true);
+			job->wrote = true;
+		}
+	} else {
+		if(aa_voices_is_voice_active(source->voices, job->voice)) {
+			job->total = aa_voices_render_voice(source->voices,
+				job->voice, job->partial, true);
+			job->wrote = true;
+		}
+	}
+}
+
+/** Runs jobs until none are left, starting with the share of the given
+    worker and then stealing from the others.
+ */
+static void
+aa_scheduler_run_jobs(
+	aa_scheduler_t self, int worker
+) {
+	for(int n = 0; n < self->thread_count; n++) {
+		struct aa_scheduler_range_s *range =
+		    &self->ranges[(worker + n) % self->thread_count];
+
+		for(;;) {
+			int j = __atomic_fetch_add(&range->next, 1, __ATOMIC_ACQ_REL);
+
+			if(j >= __atomic_load_n(&range->end, __ATOMIC_RELAXED))
+				break;
+
+			aa_scheduler_run_job(self, &self->jobs[j]);
+			if(__atomic_sub_fetch(&self->pending, 1, __ATOMIC_ACQ_REL) == 0)
+				aa_scheduler_unpark(self, &self->pending);
+		}
+	}
+}
+
+static void*
+aa_scheduler_worker_main(void *context) {
+	struct aa_scheduler_worker_s *worker = context;
+	aa_scheduler_t self = worker->scheduler;
+	int generation = 0;
+
+	for(;;) {
+		int next;
+
+		while((next = __atomic_load_n(&self->generation, __ATOMIC_ACQUIRE))
+		    == generation)
+			aa_scheduler_park(self, &self->generation, generation);
+		generation = next;
+
+		if(__atomic_load_n(&self->quit, __ATOMIC_ACQUIRE))
+			break;
+
+		aa_scheduler_run_jobs(self, worker->index);
+		if(__atomic_sub_fetch(&self->pending, 1, __ATOMIC_ACQ_REL) == 0)
+			aa_scheduler_unpark(self, &self->pending);
+	}
+
+	return NULL;
+}
+
+/** Creates a scheduler that renders with thread_count threads,
+    including the calling thread.
+ */
+aa_scheduler_t
+aa_scheduler_create(
+	int thread_count, int bufferSize
+) {
+	aa_scheduler_t ret = NULL;
+
+	if(thread_count < 1)
+		thread_count = 1;
+
+	ret = calloc(sizeof(*ret), 1);
+
+	if(!ret)
+		goto bail;
+
+	ret->bufferSize = bufferSize;
+	ret->thread_count = thread_count;
+
+#if !defined(__linux__)
+	pthread_mutex_init(&ret->lock, NULL);
+	pthread_cond_init(&ret->wake, NULL);
+#endif
+
+	ret->ranges = calloc(sizeof(*ret->ranges), thread_count);
+	ret->workers = calloc(sizeof(*ret->workers), thread_count);
+
+	if(!ret->ranges || !ret->workers) {
+		aa_scheduler_release(ret);
+		ret = NULL;
+		goto bail;
+	}
+
+	for(int i = 1; i < thread_count; i++) {
+		ret->workers[i].scheduler = ret;
+		ret->workers[i].index = i;
+		if(pthread_create(&ret->workers[i].thread, NULL,
+				&aa_scheduler_worker_main, &ret->workers[i])) {
+			perror("aa_scheduler_create:pthread_create");
+			aa_scheduler_release(ret);
+			ret = NULL;
+			goto bail;
+		}
+		ret->workers[i].started = true;
+	}
+
+bail:
+	return ret;
+}
+
+void
+aa_scheduler_release(aa_scheduler_t self) {
+	__atomic_store_n(&self->quit, true, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&self->generation, 1, __ATOMIC_RELEASE);
+	aa_scheduler_unpark(self, &self->generation);
+
+	for(int i = 1; self->workers && (i < self->thread_count); i++) {
+		if(self->workers[i].started)
+			pthread_join(self->workers[i].thread, NULL);
+	}
+
+	for(int i = 0; i < self->job_count; i++)
+		free(self->jobs[i].partial);
+
+#if !defined(__linux__)
+	pthread_cond_destroy(&self->wake);
+	pthread_mutex_destroy(&self->lock);
+#endif
+	free(self->jobs);
+	free(self->sources);
+	free(self->ranges);
+	free(self->workers);
+	free(self);
+}
+
+static int
+aa_scheduler_add_source(
+	aa_scheduler_t self, int type, aa_bell_t bell, aa_voices_t voices,
+	int job_count
+) {
+	struct aa_scheduler_source_s *sources;
+	struct aa_scheduler_job_s *jobs;
+
+	sources = realloc(self->sources,
+		sizeof(*sources) * (self->source_count + 1));
+	if(!sources)
+		return -1;
+	self->sources = sources;
+
+	jobs = realloc(self->jobs,
+		sizeof(*jobs) * (self->job_count + job_count));
+	if(!jobs)
+		return -1;
+	self->jobs = jobs;
+
+	memset(jobs + self->job_count, 0, sizeof(*jobs) * job_count);
+
+	for(int i = self->job_count; i < self->job_count + job_count; i++) {
+		jobs[i].source = self->source_count;
+		jobs[i].partial = calloc(sizeof(float), self->bufferSize);
+
+		if(!jobs[i].partial) {
+			while(i-- > self->job_count)
+				free(jobs[i].partial);
+			return -1;
+		}
+	}
+
+	sources[self->source_count].type = type;
+	sources[self->source_count].bell = bell;
+	sources[self->source_count].voices = voices;
+	self->source_count++;
+
+	return 0;
+}
+
+/** Renders bell split into jobs of modes_per_job modes. Job boundaries
+    are rounded to AA_BELL_MODE_PAD so that SIMD kernels working on
+    neighbouring jobs never touch the same vector.
+ */
+int
+aa_scheduler_add_bell(
+	aa_scheduler_t self, aa_bell_t bell, int modes_per_job
+) {
+	int first = self->job_count;
+	int job_count;
+
+	if(bell->bufferSize != self->bufferSize)
+		return -1;
+
+	if(modes_per_job <= 0)
+		modes_per_job = AA_SCHEDULER_DEFAULT_MODES_PER_JOB;
+	modes_per_job = AA_BELL_PADDED_MODE_COUNT(modes_per_job);
+	job_count = (bell->nf + modes_per_job - 1) / modes_per_job;
+
+	if(aa_scheduler_add_source(self, AA_SCHEDULER_SOURCE_BELL, bell, NULL,
+			job_count))
+		return -1;
+
+	for(int i = 0; i < job_count; i++) {
+		self->jobs[first + i].begin = i * modes_per_job;
+		self->jobs[first + i].end = (i + 1) * modes_per_job;
+		if(self->jobs[first + i].end > bell->nf)
+			self->jobs[first + i].end = bell->nf;
+	}
+	self->job_count += job_count;
+
+	return 0;
+}
+
+/** Renders every voice of a pool as its own job.
+ */
+int
+aa_scheduler_add_voices(
+	aa_scheduler_t self, aa_voices_t voices
+) {
+	int first = self->job_count;
+	int job_count = aa_voices_get_voice_count(voices);
+
+	if(aa_bell_get_buffer_size(aa_voices_get_model(voices))
+	    != self->bufferSize)
+		return -1;
+
+	if(aa_scheduler_add_source(self, AA_SCHEDULER_SOURCE_VOICES, NULL, voices,
+			job_count))
+		return -1;
+
+	for(int i = 0; i < job_count; i++)
+		self->jobs[first + i].voice = i;
+	self->job_count += job_count;
+
+	return 0;
+}
+
+int
+aa_scheduler_get_thread_count(aa_scheduler_t self) {
+	return self->thread_count;
+}
+
+int
+aa_scheduler_get_job_count(aa_scheduler_t self) {
+	return self->job_count;
+}
+
+/** Runs stage, unless NULL, over the bus in compute_sound_buffer()
+    instead of clamping it. The stage is fused into the sum of the last
+    partial buffer, so it costs no extra pass over the bus.
+ */
+void
+aa_scheduler_set_output(
+	aa_scheduler_t self, aa_output_t stage
+) {
+	self->output = stage;
+}
+
+aa_output_t
+aa_scheduler_get_output(aa_scheduler_t self) {
+	return self->output;
+}
+
+/** Renders the block and adds it into output, or stores it there if
+    store is set, running stage over the result unless it is NULL.
+ */
+static double
+aa_scheduler_render(
+	aa_scheduler_t self, float *output, aa_output_t stage, bool store
+) {
+	double total = 0.0;
+	int last = -1;
+
+	for(int i = 0; i < self->source_count; i++) {
+		struct aa_scheduler_source_s *source = &self->sources[i];
+
+		if(source->type == AA_SCHEDULER_SOURCE_BELL)
+			aa_bell_apply_params(source->bell);
+		else
+			aa_voices_start_block(source->voices);
+	}
+
+	__atomic_store_n(&self->pending,
+		self->job_count + self->thread_count - 1, __ATOMIC_RELAXED);
+
+	for(int w = 0; w < self->thread_count; w++) {
+		__atomic_store_n(&self->ranges[w].end,
+			self->job_count * (w + 1) / self->thread_count, __ATOMIC_RELAXED);
+		__atomic_store_n(&self->ranges[w].next,
+			self->job_count * w / self->thread_count, __ATOMIC_RELEASE);
+	}
+
+	if(self->thread_count > 1) {
+		__atomic_add_fetch(&self->generation, 1, __ATOMIC_RELEASE);
+		aa_scheduler_unpark(self, &self->generation);
+	}
+
+	aa_scheduler_run_jobs(self, 0);
+
+	// Only the job or worker that brings pending to zero wakes the
+	// caller.
+	for(;;) {
+		int pending = __atomic_load_n(&self->pending, __ATOMIC_ACQUIRE);
+
+		if(pending <= 0)
+			break;
+		aa_scheduler_park(self, &self->pending, pending);
+	}
+
+	for(int j = 0; j < self->job_count; j++) {
+		if(self->jobs[j].wrote)
+			last = j;
+	}
+
+	for(int j = 0; j < self->job_count; j++) {
+		struct aa_scheduler_job_s *job = &self->jobs[j];
+
+		if(!job->wrote)
+			continue;
+
+		if(store) {
+			memcpy(output, job->partial, sizeof(float) * self->bufferSize);
+			if(stage && (j == last))
+				aa_output_process(stage, output, self->bufferSize);
+			store = false;
+		} else if(stage && (j == last)) {
+			aa_output_mix(stage, output, job->partial, self->bufferSize);
+		} else {
+			for(int k = 0; k < self->bufferSize; k++)
+				output[k] += job->partial[k];
+		}
+		total += job->total;
+	}
+
+	if(store)
+		memset((void*)output, 0, sizeof(float) * self->bufferSize);
+	if(stage && (last < 0))
+		aa_output_process(stage, output, self->bufferSize);
+
+	for(int i = 0; i < self->source_count; i++) {
+		struct aa_scheduler_source_s *source = &self->sources[i];
+
+		if(source->type == AA_SCHEDULER_SOURCE_BELL) {
+			aa_bell_end_block(source->bell);
+		} else {
+			aa_voices_retire_silent(source->voices);
+		}
+	}
+
+	return total;
+}
+
+/** Applies pending parameter changes to every source, then renders all
+    jobs on the worker pool and adds their partial buffers into output in
+    job order. Since the jobs and the order of the sum do not depend on
+    the number of threads, neither does the output.
+ */
+double
+aa_scheduler_mix_sound_buffer(
+	aa_scheduler_t self, float *output
+) {
+	return aa_scheduler_render(self, output, NULL, false);
+}
+
+double
+aa_scheduler_compute_sound_buffer(
+	aa_scheduler_t self, float *output
+) {
+	double total = 0.0;
+
+	total = aa_scheduler_render(self, output, self->output, true);
+
+	if(!self->output)
+		aa_bell_clamp_buffer(output, self->bufferSize);
+
+	return total;
+}
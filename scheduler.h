@@ -0,0 +1,56 @@
+//
+//  scheduler.h
+//
+
+#ifndef __AA_SCHEDULER_H__
+#define __AA_SCHEDULER_H__ 1
+
+#if !defined(__BEGIN_DECLS) || !defined(__END_DECLS)
+#if defined(__cplusplus)
+#define __BEGIN_DECLS   extern "C" {
+#define __END_DECLS \
+	}
+#else
+#define __BEGIN_DECLS
+#define __END_DECLS
+#endif
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bell.h"
+#include "output.h"
+#include "voices.h"
+
+__BEGIN_DECLS
+
+/** Default number of modes rendered by one job when splitting a bell
+    by mode range. */
+#define AA_SCHEDULER_DEFAULT_MODES_PER_JOB  (256)
+
+struct aa_scheduler_s;
+typedef struct aa_scheduler_s *aa_scheduler_t;
+
+aa_scheduler_t aa_scheduler_create(
+	int thread_count, int bufferSize);
+void aa_scheduler_release(aa_scheduler_t self);
+
+int aa_scheduler_add_bell(
+	aa_scheduler_t self, aa_bell_t bell, int modes_per_job);
+int aa_scheduler_add_voices(
+	aa_scheduler_t self, aa_voices_t voices);
+
+int aa_scheduler_get_thread_count(aa_scheduler_t self);
+int aa_scheduler_get_job_count(aa_scheduler_t self);
+void aa_scheduler_set_output(
+	aa_scheduler_t self, aa_output_t stage);
+aa_output_t aa_scheduler_get_output(aa_scheduler_t self);
+
+double aa_scheduler_mix_sound_buffer(
+	aa_scheduler_t self, float *output);
+double aa_scheduler_compute_sound_buffer(
+	aa_scheduler_t self, float *output);
+
+__END_DECLS
+#endif                          // #ifndef __AA_SCHEDULER_H__
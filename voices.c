@@ -0,0 +1,389 @@
+//
+//  voices.c
+//
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bell_private.h"
+#include "voices.h"
+
+struct aa_voice_s {
+	aa_bell_t	bell;
+
+	/** Struck since its last buffer, so not yet heard; such voices are
+	    stolen last. */
+	bool		struck;
+
+	bool		active;
+};
+
+struct aa_voices_s {
+	/** Mode data shared by every voice. Not owned. */
+	aa_bell_t	model;
+
+	int			bufferSize;
+
+	int			voice_count;
+
+	int			active_count;
+
+	/** Limit on the modes rendered per block across all voices, and
+	    room for the bells it ranks; NULL renders every mode. */
+	aa_bell_budget_t budget;
+	aa_bell_t *	ranked;
+
+	struct aa_voice_s voices[];
+};
+
+/** Half the sum of |yt_1| + |yt_2| over the modes bell renders: how
+    loud all of them together can be as the last buffer ends, whichever
+    mode still rings.
+ */
+static double
+aa_voices_level(aa_bell_t bell) {
+	double level = 0.0;
+
+	for(int i = 0; i < bell->nfUsed; i++)
+		level += fabsf(bell->yt_1[i]) + fabsf(bell->yt_2[i]);
+
+	return 0.5 * level;
+}
+
+/** Creates a pool of voice_count voices sharing the modes of model.
+    All allocation happens here; striking and rendering never allocate.
+    If the model has several strike points, each voice gets gains of its
+    own so that it can be struck anywhere. Voices cull modes as the
+    model does when they are made.
+ */
+aa_voices_t
+aa_voices_create(
+	aa_bell_t model, int voice_count
+) {
+	aa_voices_t ret = NULL;
+
+	ret = calloc(sizeof(*ret) + sizeof(struct aa_voice_s) * voice_count, 1);
+
+	if(!ret)
+		goto bail;
+
+	ret->model = model;
+	ret->bufferSize = aa_bell_get_buffer_size(model);
+	ret->voice_count = voice_count;
+
+	for(int i = 0; i < voice_count; i++) {
+		ret->voices[i].bell = aa_bell_create_shared(model);
+
+		if(!ret->voices[i].bell
+		    || ((aa_bell_get_point_count(model) > 1)
+		        && aa_bell_set_strike_point(ret->voices[i].bell,
+			        aa_bell_get_strike_point(model)))) {
+			aa_voices_release(ret);
+			ret = NULL;
+			goto bail;
+		}
+	}
+
+bail:
+	return ret;
+}
+
+void
+aa_voices_release(aa_voices_t self) {
+	aa_voices_set_mode_budget(self, 0);
+
+	for(int i = 0; i < self->voice_count; i++) {
+		if(self->voices[i].bell)
+			aa_bell_release(self->voices[i].bell);
+	}
+	free(self);
+}
+
+/** Starts a new strike at the model's strike point.
+ */
+int
+aa_voices_strike(
+	aa_voices_t self, float energy, float dur
+) {
+	return aa_voices_strike_at(self, energy, dur,
+		aa_bell_get_strike_point(self->model), 0);
+}
+
+/** Starts a new strike at point, as aa_bell_set_strike_point(), offset
+    samples into the next buffer, as aa_bell_add_energy_at(). It goes to
+    a free voice, or if none is free steals the voice whose modes are
+    quietest together, as aa_voices_retire_silent() judges. Returns
+    the index of the voice used, or -1 if point is out of range.
+ */
+int
+aa_voices_strike_at(
+	aa_voices_t self, float energy, float dur, float point, int offset
+) {
+	struct aa_voice_s *voice = NULL;
+	double quietest = HUGE_VAL;
+	int ret = -1;
+
+	if(!(point >= 0.0f) || (point > aa_bell_get_point_count(self->model) - 1))
+		goto bail;
+
+	for(int i = 0; i < self->voice_count; i++) {
+		double level;
+
+		if(!self->voices[i].active) {
+			ret = i;
+			break;
+		}
+
+		level = self->voices[i].struck ? HUGE_VAL
+		    : aa_voices_level(self->voices[i].bell);
+		if((ret < 0) || (level < quietest)) {
+			ret = i;
+			quietest = level;
+		}
+	}
+
+	if(ret < 0)
+		goto bail;
+
+	voice = &self->voices[ret];
+
+	if(voice->active) {
+		aa_bell_clear_history(voice->bell);
+		aa_bell_clear_force(voice->bell);
+	} else {
+		voice->active = true;
+		self->active_count++;
+	}
+
+	// Voices of single point models share the model's gains.
+	if(point != aa_bell_get_strike_point(voice->bell))
+		aa_bell_set_strike_point(voice->bell, point);
+
+	voice->struck = true;
+	aa_bell_add_energy_at(voice->bell, energy, dur, offset);
+
+bail:
+	return ret;
+}
+
+void
+aa_voices_clear_history(aa_voices_t self) {
+	for(int i = 0; i < self->voice_count; i++) {
+		struct aa_voice_s *voice = &self->voices[i];
+
+		if(voice->active) {
+			aa_bell_clear_history(voice->bell);
+			aa_bell_clear_force(voice->bell);
+			voice->active = false;
+		}
+	}
+	self->active_count = 0;
+}
+
+int
+aa_voices_get_voice_count(aa_voices_t self) {
+	return self->voice_count;
+}
+
+int
+aa_voices_get_active_count(aa_voices_t self) {
+	return self->active_count;
+}
+
+bool
+aa_voices_is_voice_active(
+	aa_voices_t self, int index
+) {
+	return self->voices[index].active;
+}
+
+aa_bell_t
+aa_voices_get_model(aa_voices_t self) {
+	return self->model;
+}
+
+/** Renders at most modes modes per block across every voice, ranked by
+    how much they would be heard, so that a crowded pool degrades
+    gracefully instead of overrunning the buffer; 0 renders every mode.
+    Voices struck in a block render in full, so the budget may be
+    exceeded while many voices are struck at once. Allocates; call it
+    outside the audio thread. Returns nonzero if it could not be
+    changed.
+ */
+int
+aa_voices_set_mode_budget(
+	aa_voices_t self, int modes
+) {
+	if(modes < 0)
+		return -1;
+
+	if(!modes) {
+		if(self->budget) {
+			for(int i = 0; i < self->voice_count; i++)
+				aa_bell_budget_detach(self->budget, self->voices[i].bell);
+			aa_bell_budget_release(self->budget);
+			free(self->ranked);
+			self->budget = NULL;
+			self->ranked = NULL;
+		}
+		return 0;
+	}
+
+	if(!self->budget) {
+		self->budget = aa_bell_budget_create(self->model, self->voice_count,
+			modes);
+		self->ranked = calloc(sizeof(aa_bell_t), self->voice_count);
+
+		if(!self->budget || !self->ranked)
+			goto fail;
+
+		for(int i = 0; i < self->voice_count; i++) {
+			if(aa_bell_budget_attach(self->budget, self->voices[i].bell))
+				goto fail;
+		}
+	}
+
+	aa_bell_budget_set_modes(self->budget, modes);
+
+	return 0;
+
+fail:
+	if(self->budget) {
+		for(int i = 0; i < self->voice_count; i++)
+			aa_bell_budget_detach(self->budget, self->voices[i].bell);
+		aa_bell_budget_release(self->budget);
+	}
+	free(self->ranked);
+	self->budget = NULL;
+	self->ranked = NULL;
+	return -1;
+}
+
+int
+aa_voices_get_mode_budget(aa_voices_t self) {
+	return self->budget ? aa_bell_budget_get_modes(self->budget) : 0;
+}
+
+/** Number of modes of sounding voices the budget left out of the last
+    block.
+ */
+int
+aa_voices_get_dropped_mode_count(aa_voices_t self) {
+	return self->budget ? aa_bell_budget_get_dropped_count(self->budget) : 0;
+}
+
+/** Prepares the pool for the next block: applies pending parameter
+    changes to the model, then lets the mode budget choose what the
+    sounding voices render. Called by aa_voices_mix_sound_buffer();
+    anything rendering voices one at a time must call it first.
+ */
+void
+aa_voices_start_block(aa_voices_t self) {
+	int count = 0;
+
+	aa_bell_apply_params(self->model);
+
+	if(!self->budget)
+		return;
+
+	for(int i = 0; i < self->voice_count; i++) {
+		if(self->voices[i].active)
+			self->ranked[count++] = self->voices[i].bell;
+	}
+
+	aa_bell_budget_select(self->budget, self->ranked, count);
+}
+
+/** Adds voice index into output, or stores it there if store is set,
+    if it is sounding and returns its energy. A silent voice leaves
+    output untouched. Distinct voices may be rendered concurrently; the
+    pool itself is only updated by aa_voices_retire_silent().
+ */
+double
+aa_voices_render_voice(
+	aa_voices_t self, int index, float *output, bool store
+) {
+	struct aa_voice_s *voice = &self->voices[index];
+
+	if(!voice->active)
+		return 0.0;
+
+	voice->struck = false;
+
+	return aa_bell_render_sound_buffer(voice->bell, output, store);
+}
+
+/** Returns voices that have gone silent, and have no strike still to
+    come, to the pool. A voice that culls modes is silent once it has
+    culled all of them; otherwise the level of all its modes decides.
+ */
+void
+aa_voices_retire_silent(aa_voices_t self) {
+	for(int i = 0; i < self->voice_count; i++) {
+		struct aa_voice_s *voice = &self->voices[i];
+		bool silent = voice->active
+		    && (aa_bell_get_cull_threshold(voice->bell) > 0.0f
+		        ? aa_bell_is_quiet(voice->bell)
+		        : aa_voices_level(voice->bell) < AA_VOICES_SILENCE_LEVEL);
+
+		if(silent && !aa_bell_has_pending_force(voice->bell)) {
+			aa_bell_clear_history(voice->bell);
+			voice->active = false;
+			self->active_count--;
+		}
+	}
+}
+
+/** Renders every active voice into output, the first storing into it
+    if store is set, which clears it when no voice is sounding.
+ */
+static double
+aa_voices_render(
+	aa_voices_t self, float *output, bool store
+) {
+	double total = 0.0;
+
+	aa_voices_start_block(self);
+
+	for(int i = 0; i < self->voice_count; i++) {
+		if(!self->voices[i].active)
+			continue;
+
+		total += aa_voices_render_voice(self, i, output, store);
+		store = false;
+	}
+
+	if(store)
+		memset((void*)output, 0, sizeof(float) * self->bufferSize);
+
+	aa_voices_retire_silent(self);
+
+	return total;
+}
+
+/** Starts the block with aa_voices_start_block(), then adds every
+    active voice into output. Voices that have gone silent are returned
+    to the pool. Returns the sum of the voices' energies.
+ */
+double
+aa_voices_mix_sound_buffer(
+	aa_voices_t self, float *output
+) {
+	return aa_voices_render(self, output, false);
+}
+
+double
+aa_voices_compute_sound_buffer(
+	aa_voices_t self, float *output
+) {
+	double total = 0.0;
+
+	total = aa_voices_render(self, output, true);
+
+	aa_bell_clamp_buffer(output, self->bufferSize);
+
+	return total;
+}
@@ -0,0 +1,67 @@
+//
+//  voices.h
+//
+
+#ifndef __AA_VOICES_H__
+#define __AA_VOICES_H__ 1
+
+#if !defined(__BEGIN_DECLS) || !defined(__END_DECLS)
+#if defined(__cplusplus)
+#define __BEGIN_DECLS   extern "C" {
+#define __END_DECLS \
+	}
+#else
+#define __BEGIN_DECLS
+#define __END_DECLS
+#endif
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bell.h"
+
+__BEGIN_DECLS
+
+/** A voice whose modes together ring at less than this, judged from
+    their state after a buffer, is considered silent and returned to the
+    pool, unless it culls modes. */
+#define AA_VOICES_SILENCE_LEVEL     (1e-7)
+
+struct aa_voices_s;
+typedef struct aa_voices_s *aa_voices_t;
+
+aa_voices_t aa_voices_create(
+	aa_bell_t model, int voice_count);
+void aa_voices_release(aa_voices_t self);
+
+int aa_voices_strike(
+	aa_voices_t self, float energy, float dur);
+int aa_voices_strike_at(
+	aa_voices_t self, float energy, float dur, float point, int offset);
+void aa_voices_clear_history(aa_voices_t self);
+
+int aa_voices_get_voice_count(aa_voices_t self);
+int aa_voices_get_active_count(aa_voices_t self);
+bool aa_voices_is_voice_active(
+	aa_voices_t self, int index);
+aa_bell_t aa_voices_get_model(aa_voices_t self);
+
+int aa_voices_set_mode_budget(
+	aa_voices_t self, int modes);
+int aa_voices_get_mode_budget(aa_voices_t self);
+int aa_voices_get_dropped_mode_count(aa_voices_t self);
+
+void aa_voices_start_block(aa_voices_t self);
+double aa_voices_render_voice(
+	aa_voices_t self, int index, float *output, bool store);
+void aa_voices_retire_silent(aa_voices_t self);
+
+double aa_voices_mix_sound_buffer(
+	aa_voices_t self, float *output);
+double aa_voices_compute_sound_buffer(
+	aa_voices_t self, float *output);
+
+__END_DECLS
+#endif                          // #ifndef __AA_VOICES_H__